@@ -0,0 +1,118 @@
+///////////////////////////////////////////////////////////////////////////////
+// antialiasing.h
+// ========
+// anti-aliasing of the scene: multisampling resolved from an offscreen
+// target, or FXAA or TAA applied to a single sampled one
+//
+// Begin redirects the scene into a target of this class and End writes the
+// anti-aliased result to the framebuffer that was bound before, the window
+// or the DynamicResolution target, over the same renderWidth x renderHeight
+// corner. Targets are allocated at the window size, only for the modes used,
+// in colorFormat: RGBA16F when the destination is the ToneMapping target, so
+// the resolve and filters keep the highlights it tonemaps.
+//
+//	MSAA  SAMPLES samples per pixel, resolved with glBlitFramebuffer. The
+//	      deferred path lights a single sampled G-buffer, so it gains no
+//	      anti-aliasing.
+//	FXAA  one fullscreen pass that blurs along the luma edges it detects
+//	TAA   the projection is offset by a sub-pixel Halton (2, 3) sample every
+//	      frame and the result accumulated in a history texture. Each pixel
+//	      finds its history by reprojecting its depth with the previous
+//	      camera, then clamps it to the range of its 3x3 neighbourhood so
+//	      disoccluded and moving surfaces (there are no motion vectors) do
+//	      not ghost. The deferred path copies its G-buffer depth in.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+class AntiAliasing
+{
+
+public:
+	enum Mode
+	{
+		OFF,
+		MSAA,
+		FXAA,
+		TAA,
+		MODE_COUNT
+	};
+
+	static const char* const MODE_NAMES[MODE_COUNT];
+
+	static const GLsizei SAMPLES = 4;           // of MSAA, lowered to GL_MAX_SAMPLES
+	static const GLuint COLOR_UNIT = 12;        // scene color of the post passes
+	static const GLuint DEPTH_UNIT = 13;
+	static const GLuint HISTORY_UNIT = 14;
+
+	static constexpr float HISTORY_WEIGHT = 0.9f;  // of the clamped history in every TAA frame
+	static const int JITTER_SAMPLES = 8;
+
+	Mode mode = OFF;
+	GLsizei samples = 0;                        // MSAA samples in use
+	GLenum colorFormat = GL_RGBA8;              // of the color targets and the history
+
+public:
+	bool Create();
+	void Destroy();
+
+	// Switch modes, starting the TAA history over
+	void SetMode(Mode mode);
+
+	// Store color in format from the next Begin, reallocating the targets
+	void SetColorFormat(GLenum format);
+
+	// With TAA, projection offset by this frame's sub-pixel sample
+	glm::mat4 Jitter(const glm::mat4& projection, GLsizei renderWidth, GLsizei renderHeight) const;
+
+	// Bind and clear the target of the mode; width and height size the targets, the scene covers the render size
+	void Begin(GLsizei renderWidth, GLsizei renderHeight, GLsizei width, GLsizei height);
+
+	// Resolve or filter into the framebuffer bound before Begin; viewProjection is this frame's, unjittered
+	void End(const glm::mat4& viewProjection);
+
+	bool Active() const { return active; }
+
+	// TAA reprojects the depth of its target, which the frame has to fill
+	bool ReadsDepth() const { return active && mode == TAA; }
+
+private:
+	bool AllocateMultisample();
+	bool AllocateSingle();
+	bool AllocateHistory();
+	void Release();
+
+	GLsizei width = 0;                          // size of the targets
+	GLsizei height = 0;
+	GLsizei renderWidth = 0;                    // part of them the frame covers
+	GLsizei renderHeight = 0;
+	bool active = false;                        // the frame in flight renders to a target of this class
+	GLint destination = 0;                      // framebuffer bound before Begin
+
+	// MSAA: multisampled color and depth renderbuffers
+	GLuint multisampleFramebuffer = 0;
+	GLuint multisampleColor = 0;
+	GLuint multisampleDepth = 0;
+
+	// FXAA and TAA: color sampled with linear filtering, depth for the reprojection
+	GLuint sceneFramebuffer = 0;
+	GLuint sceneColor = 0;
+	GLuint sceneDepth = 0;
+
+	// TAA: accumulated frames, written and read alternately
+	GLuint historyFramebuffers[2] = {};
+	GLuint historyTextures[2] = {};
+	int historyIndex = 0;                       // written this frame
+	bool historyValid = false;
+	glm::vec2 historySize = glm::vec2(0.0f);    // render size the history was written at
+	glm::mat4 previousViewProjection = glm::mat4(1.0f);
+	unsigned int frameIndex = 0;
+
+	GLuint fxaaProgram = 0;
+	GLuint taaProgram = 0;
+	GLuint emptyVao = 0;                        // the fullscreen triangle is generated from gl_VertexID
+};
@@ -0,0 +1,54 @@
+///////////////////////////////////////////////////////////////////////////////
+// benchmark.h
+// ========
+// frame samples of a benchmark run, summarized as percentiles and written
+// as JSON
+//
+// Every measured frame adds one sample: the CPU time of the frame and the
+// counters of its submit. GPU times arrive REGION_COUNT frames late, like
+// every GpuTimer result, so they are added on their own once read. The JSON
+// holds the settings of the run beside the summaries, so two files from
+// different builds can be diffed directly.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+class FrameBenchmark
+{
+
+public:
+	// Distribution of one measure over the run
+	struct Summary
+	{
+		double mean = 0.0;
+		double p50 = 0.0;
+		double p95 = 0.0;
+		double p99 = 0.0;
+		double max = 0.0;
+	};
+
+	// Name and value of a setting of the run, both written as JSON strings
+	typedef std::vector<std::pair<std::string, std::string>> Settings;
+
+	std::vector<double> cpuMs;
+	std::vector<double> gpuMs;
+	std::vector<double> draws;
+	std::vector<double> triangles;
+	std::vector<double> drawCalls;          // GL draw calls of the submit
+	std::vector<double> programChanges;     // glUseProgram calls of the submit
+	std::vector<double> stateChanges;       // program, texture, vertex array and buffer binds of the submit
+
+public:
+	// Nearest-rank percentiles of values
+	static Summary Summarize(std::vector<double> values);
+
+	void AddFrame(double cpuMs, int draws, int triangles, int drawCalls, int programChanges, int stateChanges);
+	void AddGpuFrame(double gpuMs) { this->gpuMs.push_back(gpuMs); }
+
+	void Report() const;
+	bool WriteJson(const std::string& path, const Settings& settings) const;
+};
@@ -0,0 +1,88 @@
+///////////////////////////////////////////////////////////////////////////////
+// bvh.h
+// ========
+// world bounds of every scene draw and a bounding volume hierarchy over them,
+// used to cull the draw list against the view frustum
+//
+// The hierarchy is built once at load by splitting the draws at the median
+// of their centers along the longest axis. Nodes are stored depth first, the
+// left child of an inner node follows it directly. When draws move, Refit
+// updates their bounds and the node bounds without changing the topology.
+// Split hands out subtrees so that several threads can cull at once.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "scene.h"
+
+// Axis aligned bounding box
+struct Aabb
+{
+	glm::vec3 min;
+	glm::vec3 max;
+
+	static Aabb Empty();
+	void Grow(const glm::vec3& point);
+	void Grow(const Aabb& box);
+	glm::vec3 Center() const { return (min + max) * 0.5f; }
+	Aabb Transformed(const glm::mat4& matrix) const;
+};
+
+// Planes of a view frustum, normals point inwards
+struct Frustum
+{
+	glm::vec4 planes[6];
+
+	void Extract(const glm::mat4& viewProjection);
+};
+
+class SceneBvh
+{
+
+public:
+	// World bounds of every draw, indexed by draw ID
+	std::vector<Aabb> drawBounds;
+
+public:
+	bool Build(const Scene& scene);
+	void Clear();
+
+	// Recompute the bounds of moved draws from their model matrix and refit the nodes
+	void Refit(const Scene& scene, const std::vector<GLuint>& movedIds);
+
+	// Append the IDs of the draws that may be inside the frustum
+	void Cull(const Frustum& frustum, std::vector<GLuint>& visibleIds) const;
+
+	// Roots of disjoint subtrees covering every draw, at least count unless the tree is smaller
+	void Split(size_t count, std::vector<GLuint>& subtrees) const;
+
+	// Cull the draws below one node returned by Split
+	void CullSubtree(GLuint node, const Frustum& frustum, std::vector<GLuint>& visibleIds) const;
+
+	size_t NodeCount() const { return nodes.size(); }
+
+private:
+	static const GLuint LEAF_SIZE = 4;
+	static const int ALL_PLANES = 0x3f;
+
+	struct Node
+	{
+		Aabb bounds;
+		GLuint first;               // leaf: first index into ids, inner: index of the right child
+		GLuint count;               // draws in a leaf, 0 for inner nodes
+	};
+
+	std::vector<Node> nodes;
+	std::vector<GLuint> ids;        // draw IDs, leaves reference ranges of it
+	std::vector<Aabb> objectBounds; // object space bounds of every draw, indexed by draw ID
+
+	void BuildNode(GLuint first, GLuint count, const std::vector<glm::vec3>& centers);
+	void CullNode(GLuint index, const Frustum& frustum, int planeMask, std::vector<GLuint>& visibleIds) const;
+	void AppendAll(GLuint index, std::vector<GLuint>& visibleIds) const;
+};
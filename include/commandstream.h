@@ -0,0 +1,63 @@
+///////////////////////////////////////////////////////////////////////////////
+// commandstream.h
+// ========
+// retained list of GL state changes and draw calls, recorded once and
+// replayed every frame
+//
+// Commands are fixed size records in one contiguous array; Replay walks it
+// with a single switch, so the per-frame cost is the GL calls themselves and
+// none of the culling, sorting and redundant state tests that produced them.
+// Everything a command references (programs, buffers, offsets, textures)
+// must stay valid until the stream is cleared, so only static data can be
+// recorded.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <vector>
+
+class CommandStream
+{
+
+public:
+	enum Op : GLuint
+	{
+		USE_PROGRAM,
+		BIND_VERTEX_ARRAY,
+		BIND_TEXTURE,
+		BIND_UNIFORM_RANGE,
+		DRAW_ARRAYS,
+		DRAW_ELEMENTS
+	};
+
+	struct Command
+	{
+		Op op;
+		GLuint a;                   // program, vao, texture unit, binding or draw mode
+		GLuint b;                   // texture or buffer
+		GLint count;                // vertex / index count or range size
+		GLintptr offset;            // first vertex, index byte offset or range offset
+	};
+
+	GLsizei drawCalls = 0;
+
+public:
+	void Clear();
+	bool Empty() const { return commands.empty(); }
+	size_t Size() const { return commands.size(); }
+
+	void UseProgram(GLuint program);
+	void BindVertexArray(GLuint vao);
+	void BindTexture(GLuint unit, GLuint texture);
+	void BindUniformRange(GLuint binding, GLuint buffer, GLintptr offset, GLsizeiptr size);
+	void DrawArrays(GLenum mode, GLint first, GLsizei count);
+	void DrawElements(GLenum mode, GLsizei count, GLintptr indexOffset);
+
+	void Replay() const;
+
+private:
+	std::vector<Command> commands;
+};
@@ -0,0 +1,62 @@
+///////////////////////////////////////////////////////////////////////////////
+// deferredshading.h
+// ========
+// G-buffer of the deferred path and its fullscreen lighting pass
+//
+// The geometry pass writes, per pixel, only what the lighting needs:
+//
+//	ALBEDO_UNIT   GL_RGBA8    surface color (textures blended, or object color)
+//	NORMAL_UNIT   GL_RG16     world normal, octahedral encoded
+//	DRAW_ID_UNIT  GL_RG16UI   draw ID, low and high 16 bits
+//	DEPTH_UNIT    depth       world position is rebuilt from it
+//
+// 12 bytes of color per pixel. Material lights and specular parameters are
+// looked up from the draw data SSBO by draw ID, so the lighting pass runs the
+// same Phong math as the forward shaders once per pixel instead of once per
+// shaded fragment, however many surfaces were drawn over each other.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+class DeferredShading
+{
+
+public:
+	static const GLuint ALBEDO_UNIT = 4;
+	static const GLuint NORMAL_UNIT = 5;
+	static const GLuint DRAW_ID_UNIT = 6;
+	static const GLuint DEPTH_UNIT = 7;
+
+	GLsizei width = 0;
+	GLsizei height = 0;
+
+public:
+	bool Create(GLsizei width, GLsizei height);
+	void Destroy();
+
+	// Bind and clear the G-buffer, reallocating it when the framebuffer size changed
+	bool BeginGeometry(GLsizei width, GLsizei height);
+	void EndGeometry();
+
+	// Copy the G-buffer depth of the viewport into the framebuffer restored by EndGeometry
+	void CopyDepth();
+
+	// Shade every covered pixel of the viewport into the bound framebuffer with program, a deferred lighting shader
+	void Light(GLuint program, const glm::mat4& inverseViewProjection);
+
+private:
+	bool Allocate();
+	void Release();
+
+	GLuint framebuffer = 0;
+	GLint savedFramebuffer = 0;     // bound before BeginGeometry, restored by EndGeometry
+	GLuint albedoTexture = 0;
+	GLuint normalTexture = 0;
+	GLuint drawIdTexture = 0;
+	GLuint depthTexture = 0;
+	GLuint emptyVao = 0;        // the fullscreen triangle is generated from gl_VertexID
+};
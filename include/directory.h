@@ -0,0 +1,15 @@
+///////////////////////////////////////////////////////////////////////////////
+// directory.h
+// ========
+// creation of the directories the program writes its files to
+//
+// POSIX mkdir takes a mode and reports directories with S_ISDIR, while MSVC
+// only offers _mkdir and _S_IFDIR, so the difference is kept here.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <string>
+
+// Create path if it is missing; returns whether it now is a directory
+bool MakeDirectory(const std::string& path);
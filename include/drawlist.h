@@ -0,0 +1,56 @@
+///////////////////////////////////////////////////////////////////////////////
+// drawlist.h
+// ========
+// builds the sorted list of visible draws on the job system
+//
+// The frame's draw list is split into jobs: with frustum culling each job
+// culls one subtree of the scene hierarchy, without it each job takes a
+// range of draw IDs. A job turns its draws into packets of (submit key, draw
+// ID) in its own buffer and sorts them, so jobs never share memory. The
+// sorted runs are then merged pairwise, again as jobs, into one list in the
+// order the submit paths expect. Keys are unique, so the result does not
+// depend on how the jobs were scheduled. Only the GL submission that
+// consumes the list stays on the context thread.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <vector>
+
+#include "bvh.h"
+#include "jobsystem.h"
+#include "scenebatch.h"
+
+class DrawListBuilder
+{
+
+public:
+	// Jobs per thread of the pool, so subtrees of uneven size still balance
+	static const size_t JOBS_PER_THREAD = 4;
+
+	// Jobs the last Build was split into
+	size_t lastJobCount = 0;
+
+public:
+	// Fill visibleIds with the draws inside frustum, all draws without one, sorted by SubmitKey
+	void Build(JobSystem& jobs, bool threaded, const SceneBvh& bvh, const Frustum* frustum,
+		const SceneBatch& batch, bool indirect, std::vector<GLuint>& visibleIds);
+
+private:
+	struct DrawPacket
+	{
+		GLuint key;                             // SceneBatch::SubmitKey of the draw
+		GLuint drawId;
+
+		bool operator<(const DrawPacket& other) const { return key < other.key; }
+	};
+
+	std::vector<GLuint> subtrees;               // hierarchy node culled by every job
+	std::vector<std::vector<GLuint>> jobIds;    // draws kept by every job
+	std::vector<std::vector<DrawPacket>> jobPackets;
+	std::vector<DrawPacket> packets;            // the sorted runs of all jobs, back to back
+	std::vector<size_t> runStarts;              // first packet of every run, then packets.size()
+};
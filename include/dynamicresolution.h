@@ -0,0 +1,84 @@
+///////////////////////////////////////////////////////////////////////////////
+// dynamicresolution.h
+// ========
+// offscreen scene target rendered at a scale that holds a GPU frame time,
+// upscaled to the window with a sharpening filter
+//
+// The target is allocated at the window size and the scene renders into its
+// lower left renderWidth x renderHeight corner, so a new scale is only a new
+// viewport, never a reallocation. Update feeds the controller the GPU time
+// of a frame, read REGION_COUNT frames late like every GpuTimer result. Pixel
+// cost follows the area, so the scale of that frame times
+// sqrt(target / time) is the scale that would have hit the target; the
+// current scale moves a fraction of the way there per frame, so the lag
+// cannot make it oscillate, and holds still while the smoothed time stays
+// within HEADROOM below the target. Upscale samples the corner bilinearly
+// and sharpens it with a cross shaped unsharp mask clamped to the
+// neighbourhood, which gives back edge contrast without halos.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include "framering.h"
+
+class DynamicResolution
+{
+
+public:
+	static const GLuint SOURCE_UNIT = 11;       // scene color during the upscale
+
+	static constexpr float MIN_SCALE = 0.5f;
+	static constexpr float SHARPNESS = 0.5f;    // unsharp mask strength below full scale
+
+	bool supported = false;
+	bool enabled = false;
+	double targetMs = 16.0;                     // GPU frame time to hold
+	GLuint outputFramebuffer = 0;               // where frames end, the window unless headless
+
+	// Scale along each axis for the next frame and the size of the frame in flight
+	float scale = 1.0f;
+	GLsizei renderWidth = 0;
+	GLsizei renderHeight = 0;
+
+	// Controller input of the last Update
+	double lastGpuMs = 0.0;
+	double smoothedGpuMs = 0.0;
+
+public:
+	bool Create(GLsizei width, GLsizei height);
+	void Destroy();
+
+	// GPU time of the frame rendered in region, now complete
+	void Update(int region, double gpuMs);
+
+	// Bind and clear the frame's target: the scaled corner of the scene target when enabled, else the output
+	bool Begin(int region, GLsizei width, GLsizei height);
+
+	// Upscale the scene target to the output, nothing when the frame rendered there directly
+	void End();
+
+	bool Offscreen() const { return offscreen; }
+
+private:
+	static constexpr double SMOOTHING = 0.2;    // weight of a new time in smoothedGpuMs
+	static constexpr double HEADROOM = 0.1;     // fraction below the target the scale holds at
+	static constexpr float GAIN = 0.25f;        // fraction of the way to the desired scale per frame
+
+	bool Allocate();
+	void Release();
+
+	GLsizei width = 0;                          // target size, the window framebuffer
+	GLsizei height = 0;
+	bool offscreen = false;                     // the frame in flight renders to the target
+	float frameScales[FrameRing::REGION_COUNT] = {};    // 0 for frames rendered to the window
+
+	GLuint framebuffer = 0;
+	GLuint colorTexture = 0;
+	GLuint depthTexture = 0;
+	GLuint program = 0;
+	GLuint emptyVao = 0;                        // the fullscreen triangle is generated from gl_VertexID
+	GLint sourceScaleLocation = -1;
+	GLint sharpnessLocation = -1;
+};
@@ -0,0 +1,39 @@
+///////////////////////////////////////////////////////////////////////////////
+// framecapture.h
+// ========
+// offscreen framebuffer the headless mode renders every frame into, written
+// out as PNG or PPM images
+//
+// A headless context has no window framebuffer worth reading (an EGL
+// pbuffer or an OSMesa buffer), so the frame ends in this framebuffer
+// instead: DynamicResolution binds it where it would bind the window. Write
+// reads it back with glReadPixels, flips the rows to top down and encodes
+// them. PNG is written with stored deflate blocks, so it needs no zlib and
+// is about the size of the PPM.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <string>
+
+class FrameCapture
+{
+
+public:
+	GLuint framebuffer = 0;
+	GLsizei width = 0;
+	GLsizei height = 0;
+
+public:
+	bool Create(GLsizei width, GLsizei height);
+	void Destroy();
+
+	// Write the last frame to path, a PNG unless path ends in .ppm
+	bool Write(const std::string& path) const;
+
+private:
+	GLuint colorRenderbuffer = 0;
+	GLuint depthRenderbuffer = 0;
+};
@@ -0,0 +1,53 @@
+///////////////////////////////////////////////////////////////////////////////
+// framering.h
+// ========
+// ring allocator for data written by the CPU every frame
+//
+// One buffer, created with glBufferStorage and mapped persistently and
+// coherently, is split into REGION_COUNT frame regions. Each frame writes
+// into its own region and fences it when its commands are submitted; a
+// region is only reused once the GPU has passed its fence, so writes never
+// race the GPU and GL never has to synchronize the buffer implicitly.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+class FrameRing
+{
+
+public:
+	static const int REGION_COUNT = 3;
+
+	// Part of the current frame region handed out by Allocate
+	struct Allocation
+	{
+		void* data;                 // write only, nullptr when the region is full
+		GLintptr offset;            // byte offset in buffer, for glBindBufferRange
+		GLsizeiptr size;
+	};
+
+	GLuint buffer = 0;
+	GLsizeiptr regionSize = 0;
+
+	// Time BeginFrame spent waiting for the GPU to release the region
+	double lastWaitMs = 0.0;
+
+public:
+	bool Create(GLsizeiptr size);
+	void Destroy();
+
+	void BeginFrame();
+	Allocation Allocate(GLsizeiptr size, GLsizeiptr alignment);
+	void EndFrame();
+
+	// Region of the current frame, 0 to REGION_COUNT - 1
+	int Region() const { return region; }
+
+private:
+	char* mapped = nullptr;
+	GLsync fences[REGION_COUNT] = {};
+	int region = 0;
+	GLsizeiptr used = 0;            // bytes allocated from the current region
+};
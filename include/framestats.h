@@ -0,0 +1,67 @@
+///////////////////////////////////////////////////////////////////////////////
+// framestats.h
+// ========
+// per-frame counters and timings, averaged over a report interval
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+struct FrameStats
+{
+	// Counters of the last frame
+	int draws = 0;
+	int culled = 0;
+	int occluded = 0;               // hidden by occluders, REGION_COUNT frames late
+	int submitCalls = 0;
+	int programChanges = 0;         // glUseProgram calls of the submit
+	int stateChanges = 0;           // program, texture, vertex array and buffer binds of the submit
+	int triangles = 0;
+	int nodesUpdated = 0;           // scene graph nodes whose world transform was recomputed
+	int drawListJobs = 0;           // jobs the draw list was split into
+	int lights = 0;                 // scene lights inside the view frustum
+	int litClusters = 0;            // light cells with at least one light
+	int lightIndices = 0;           // light entries over every cell
+	int maxClusterLights = 0;
+	int staticShadowDraws = 0;      // draws in the cached static shadow map
+	int dynamicShadowDraws = 0;     // draws in the per-frame shadow overlay
+	int renderWidth = 0;            // scene resolution, below the window with dynamic resolution
+	int renderHeight = 0;
+
+	// Totals over the current report interval
+	int frames = 0;
+	double updateMs = 0.0;          // scene graph and transform propagation
+	double drawListMs = 0.0;        // culling, sorting and merging the visible draws
+	double lightBinMs = 0.0;        // culling and binning the scene lights
+	double submitMs = 0.0;
+	double fenceWaitMs = 0.0;       // CPU time blocked on the frame ring fences
+	double gpuSurfaceMs = 0.0;      // forward shading or the G-buffer pass, REGION_COUNT frames late
+	double gpuLightingMs = 0.0;     // deferred lighting pass
+	double gpuStaticShadowMs = 0.0; // static shadow map renders, 0 in frames that reuse it
+	double gpuDynamicShadowMs = 0.0;
+	int staticShadowRenders = 0;
+	double gpuFrameMs = 0.0;        // every timed pass, the input of the resolution controller
+	double gpuUpscaleMs = 0.0;
+	double gpuAntiAliasingMs = 0.0; // MSAA resolve, FXAA or TAA pass
+	double gpuToneMappingMs = 0.0;  // luminance histogram, exposure and tonemap
+	double frameMs = 0.0;           // time between frames
+
+	void ResetInterval()
+	{
+		frames = 0;
+		updateMs = 0.0;
+		drawListMs = 0.0;
+		lightBinMs = 0.0;
+		submitMs = 0.0;
+		fenceWaitMs = 0.0;
+		gpuSurfaceMs = 0.0;
+		gpuLightingMs = 0.0;
+		gpuStaticShadowMs = 0.0;
+		gpuDynamicShadowMs = 0.0;
+		staticShadowRenders = 0;
+		gpuFrameMs = 0.0;
+		gpuUpscaleMs = 0.0;
+		gpuAntiAliasingMs = 0.0;
+		gpuToneMappingMs = 0.0;
+		frameMs = 0.0;
+	}
+};
@@ -0,0 +1,44 @@
+///////////////////////////////////////////////////////////////////////////////
+// gputimer.h
+// ========
+// GPU time of render passes, measured with GL_TIME_ELAPSED queries
+//
+// Every pass has one query per frame ring region. The queries of a region are
+// read when the frame ring takes that region again, after waiting on its
+// fence, so the results are ready and reading them never stalls; the times
+// lag REGION_COUNT frames behind. Only one pass can be timed at a time.
+//
+// The pass count is free, so one timer can time the render passes and
+// another every scene section.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <vector>
+
+#include "framering.h"
+
+class GpuTimer
+{
+
+public:
+	// Milliseconds of every pass in the frame whose queries were read last, 0 if it did not run
+	std::vector<double> lastMs;
+
+public:
+	void Create(int passCount);
+	void Destroy();
+
+	void Begin(int pass, int region);
+	void End();
+
+	// Collect the queries issued in region
+	void Read(int region);
+
+private:
+	int passCount = 0;
+	std::vector<GLuint> queries[FrameRing::REGION_COUNT];
+	std::vector<char> issued[FrameRing::REGION_COUNT];
+};
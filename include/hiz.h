@@ -0,0 +1,73 @@
+///////////////////////////////////////////////////////////////////////////////
+// hiz.h
+// ========
+// hierarchical-Z occlusion culling of the indirect draw commands
+//
+// Each frame the large occluders of the scene (board, card stacks, hotels)
+// are rendered depth only into a small depth buffer. A compute shader
+// reduces it to a pyramid whose texels hold the farthest depth of the texels
+// below them. A second compute shader then tests the world bounds of every
+// prepared draw command against the pyramid level where the projected box
+// covers at most 2x2 texels, and zeroes the instance count of the commands
+// that are hidden, so the GPU skips them without a round trip to the CPU.
+//
+// Hidden draws are counted into a persistently mapped buffer, one slot per
+// frame ring region; a slot is read back once the frame ring has waited on
+// the fence of its region, so the count lags REGION_COUNT frames behind.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "bvh.h"
+#include "framering.h"
+#include "scenebatch.h"
+
+class HiZCuller
+{
+
+public:
+	// Width and height of the occlusion depth buffer, a power of two
+	static const GLsizei SIZE = 512;
+
+	// Texture unit the depth buffer and the pyramid are sampled from
+	static const GLuint TEXTURE_UNIT = 3;
+
+	bool supported = false;
+
+	// Draws hidden by the occluders in the frame whose result was read last
+	GLuint lastOccluded = 0;
+
+public:
+	bool Create(const std::vector<Aabb>& drawBounds);
+	void Destroy();
+
+	// Upload the bounds of draws that moved
+	void UpdateBounds(const std::vector<Aabb>& drawBounds, const std::vector<GLuint>& movedIds);
+
+	// Bracket the depth only occluder pass
+	void BeginOcclusion();
+	void EndOcclusion();
+
+	void Cull(const SceneBatch::IndirectCommands& commands, const glm::mat4& viewProjection, int region);
+	void ReadResults(int region);
+
+private:
+	static const GLsizei LEVEL_COUNT = 10;      // log2(SIZE) + 1
+
+	GLuint depthTexture = 0;
+	GLuint framebuffer = 0;
+	GLuint pyramid = 0;
+	GLuint boundsBuffer = 0;
+	GLuint resultBuffer = 0;
+	GLuint* results = nullptr;                  // mapped resultBuffer, one count per frame ring region
+	GLuint reduceProgram = 0;
+	GLuint testProgram = 0;
+	GLint savedViewport[4] = {};
+	GLint savedFramebuffer = 0;
+};
@@ -0,0 +1,56 @@
+///////////////////////////////////////////////////////////////////////////////
+// jobsystem.h
+// ========
+// fixed pool of worker threads running parallel-for jobs
+//
+// Run hands a batch of numbered jobs to the workers and blocks until all of
+// them finished; the calling thread takes jobs too, so a pool without
+// workers simply runs the batch inline. Jobs are claimed one at a time from
+// an atomic counter, which balances uneven jobs without any queue. Jobs must
+// not touch GL, the context stays current on the calling thread only.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem
+{
+
+public:
+	typedef std::function<void(size_t job)> Job;
+
+	// Upper bound on the workers Start creates
+	static const size_t MAX_WORKERS = 15;
+
+public:
+	// Start one worker per hardware thread beside the calling one
+	void Start();
+	void Stop();
+
+	// Run job(0) .. job(jobCount - 1) and return when all of them finished
+	void Run(size_t jobCount, const Job& job);
+
+	size_t WorkerCount() const { return workers.size(); }
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;           // a batch was posted or the pool stops
+	std::condition_variable done;           // the last worker left the batch
+	const Job* batch = nullptr;
+	size_t batchSize = 0;
+	std::atomic<size_t> nextJob{ 0 };
+	size_t busyWorkers = 0;
+	unsigned generation = 0;                // incremented for every batch
+	bool stopping = false;
+
+	void WorkerLoop(unsigned seen);
+	void RunJobs();
+};
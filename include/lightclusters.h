@@ -0,0 +1,98 @@
+///////////////////////////////////////////////////////////////////////////////
+// lightclusters.h
+// ========
+// clustered forward lighting: the point lights of the scene binned into a
+// grid of view frustum cells (froxels)
+//
+// The view frustum is split into TILES_X x TILES_Y screen tiles and SLICES
+// depth slices, spaced exponentially between the near and far planes so the
+// cells stay roughly cubic. Every frame the CPU projects the bounding sphere
+// of each light to the range of cells it touches and writes, per cell, the
+// offset and count of its entries in a light index list. A fragment finds its
+// cell from gl_FragCoord and its view depth and only iterates the lights of
+// that cell, so its cost follows the lights nearby, not the lights in the
+// scene.
+//
+// Lights, cells and indices are written to the frame ring and bound as two
+// shader storage buffers:
+//
+//	LIGHT_BINDING: vec4 clusterScale, uvec4 clusterInfo, PointLight lights[]
+//	CLUSTER_BINDING: uint clusterData[], 2 per cell (first index, count),
+//	followed by the light indices
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "framering.h"
+#include "scene.h"
+#include "scenegraph.h"
+
+class LightClusters
+{
+
+public:
+	static const GLuint TILES_X = 16;
+	static const GLuint TILES_Y = 9;
+	static const GLuint SLICES = 24;
+	static const GLuint CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+
+	// Lights past MAX_LIGHTS and entries past MAX_INDICES are dropped, see lastDropped
+	static const GLuint MAX_LIGHTS = 1024;
+	static const GLuint MAX_INDICES = 64 * 1024;
+
+	static const GLuint LIGHT_BINDING = 5;
+	static const GLuint CLUSTER_BINDING = 6;
+
+	// Frame ring bytes Build may use per frame
+	GLsizeiptr ringBytes = 0;
+
+	// Results of the last Build
+	GLuint lastLights = 0;                  // lights touching at least one cell
+	GLuint lastIndices = 0;                 // light entries over every cell
+	GLuint lastLitClusters = 0;             // cells with at least one light
+	GLuint lastMaxPerCluster = 0;
+	GLuint lastDropped = 0;                 // lights or entries that did not fit
+
+public:
+	void Create();
+
+	// Bin the lights for this view and bind the buffers; with enabled false no light is bound
+	void Build(FrameRing& ring, const std::vector<Scene::Light>& lights, const SceneGraph& graph,
+		const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane,
+		GLsizei width, GLsizei height, bool enabled);
+
+private:
+	// std430 layout of the light buffer
+	struct PointLight
+	{
+		glm::vec4 positionRadius;           // world position, radius
+		glm::vec4 color;
+	};
+
+	struct LightHeader
+	{
+		glm::vec4 clusterScale;             // xy = tiles per pixel, z = slice scale, w = slice bias
+		GLuint clusterInfo[4];              // TILES_X, TILES_Y, SLICES, light count
+	};
+
+	// Cells touched by a light, inclusive
+	struct CellRange
+	{
+		GLuint light;
+		GLuint x0, x1, y0, y1, z0, z1;
+	};
+
+	GLint storageAlignment = 1;             // GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT
+
+	// Scratch reused every frame
+	std::vector<PointLight> binned;
+	std::vector<CellRange> ranges;
+	std::vector<GLuint> clusterData;
+	std::vector<GLuint> cursors;
+};
@@ -0,0 +1,98 @@
+///////////////////////////////////////////////////////////////////////////////
+// lightmapbaker.h
+// ========
+// CPU baked diffuse lighting of the static, lightmapped surfaces
+//
+// Every draw recorded as lightmapped gets a SIZE x SIZE layer of one texture
+// array. The baker rasterizes the draw in texture coordinate space and, for
+// every texel it covers, evaluates the diffuse terms of the surface shader:
+// ambient, both material lights, the key light and the scene point lights.
+// Each light is tested for visibility with a ray cast against the static
+// draws, through a two level hierarchy: one bounding volume hierarchy over
+// the triangles of every mesh range, shared by all draws of that range, and
+// one over the world bounds of the draws. Rows of texels are baked on the
+// JobSystem; texels no triangle covers are then filled from their
+// neighbours so bilinear filtering does not bleed black in at the edges.
+//
+// The texture coordinates double as the lightmap coordinates, so a
+// lightmapped draw must map them once over [0, 1] without overlap, like the
+// plane mesh does; other draws are refused. Lightmapped draws must not move,
+// dynamic draws cast no baked shadows.
+//
+// Results are cached in a file keyed by a hash of everything the bake reads,
+// so a changed scene or light rebakes and an unchanged one loads in place.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "jobsystem.h"
+#include "scene.h"
+
+class LightmapBaker
+{
+
+public:
+	static const GLsizei SIZE = 128;            // texels along each side of a layer
+	static const GLuint TEXTURE_UNIT = 10;
+
+	// Point light of the scene at its world position
+	struct PointLight
+	{
+		glm::vec3 position;
+		glm::vec3 color;
+		float radius;
+	};
+
+	// Lights the baker adds to the material lights of each draw
+	struct Lighting
+	{
+		glm::vec3 ambient;                      // ambient color times strength
+		glm::vec3 keyDirection;                 // unit vector towards the key light
+		glm::vec3 keyColor;
+		std::vector<PointLight> points;         // static lights only
+	};
+
+	GLsizei layerCount = 0;
+
+	// Results of the last Bake
+	bool lastFromCache = false;
+	size_t lastRays = 0;
+	size_t lastTriangles = 0;                   // static triangles the rays were cast against
+	int lastRefused = 0;                        // lightmapped draws without usable coordinates
+
+public:
+	// Bake or load the lightmapped draws and store their layer in the material
+	bool Bake(JobSystem& jobs, Scene& scene, const std::vector<char>& dynamicDraws, const Lighting& lighting,
+		const std::string& cachePath);
+	void Destroy();
+
+	void Bind() const;
+
+private:
+	// Start of the cache file, followed by SIZE x SIZE RGB floats per layer
+	struct CacheHeader
+	{
+		uint32_t magic;
+		uint32_t size;
+		uint64_t key;
+		uint32_t layerCount;
+		uint32_t reserved;
+	};
+
+	static const uint32_t CACHE_MAGIC = 0x4d4c534d;   // "MSLM"
+
+	GLuint texture = 0;                         // GL_TEXTURE_2D_ARRAY, RGB16F
+
+	bool LoadCache(const std::string& path, uint64_t key, std::vector<float>& texels) const;
+	void StoreCache(const std::string& path, uint64_t key, const std::vector<float>& texels) const;
+	void Upload(const std::vector<float>& texels);
+};
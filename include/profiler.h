@@ -0,0 +1,90 @@
+///////////////////////////////////////////////////////////////////////////////
+// profiler.h
+// ========
+// scoped CPU zones recorded per thread and written as a Chrome trace
+//
+// PROFILE_ZONE("name") times the rest of the enclosing scope and
+// PROFILE_FUNCTION() the enclosing function; names must outlive the run,
+// string literals or __func__. A zone costs two timestamps and one append
+// to a buffer owned by the calling thread: the thread fills chunks of
+// CHUNK_EVENTS events and publishes each count with a release store, so
+// recording takes no lock and a dump can read every thread while they keep
+// recording. Timestamps are rdtsc on x86 and steady_clock elsewhere, both
+// converted to microseconds by comparing them with steady_clock between the
+// first zone and the dump. A thread drops its zones past MAX_CHUNKS chunks.
+//
+// PROFILE_DUMP(path) writes every zone so far as Chrome trace event JSON,
+// for chrome://tracing or Perfetto. Without ENABLE_PROFILER defined every
+// macro expands to nothing and this file declares nothing else.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifdef ENABLE_PROFILER
+
+#include <chrono>
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+class Profiler
+{
+
+public:
+	static const int CHUNK_EVENTS = 16384;
+	static const int MAX_CHUNKS = 64;           // per thread, about 25 MB
+
+public:
+	static uint64_t Now()
+	{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+	}
+
+	// Append a finished zone to the calling thread's buffer
+	static void Record(const char* name, uint64_t start, uint64_t end);
+
+	// Name the calling thread in the trace
+	static void SetThreadName(const char* name);
+
+	// Write every zone recorded so far; returns whether the file was written
+	static bool WriteChromeTrace(const char* path);
+};
+
+class ProfileZone
+{
+
+public:
+	explicit ProfileZone(const char* name) : name(name), start(Profiler::Now()) {}
+	~ProfileZone() { Profiler::Record(name, start, Profiler::Now()); }
+
+	ProfileZone(const ProfileZone&) = delete;
+	ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+	const char* name;
+	uint64_t start;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__func__)
+#define PROFILE_THREAD(name) Profiler::SetThreadName(name)
+#define PROFILE_DUMP(path) Profiler::WriteChromeTrace(path)
+
+#else
+
+#define PROFILE_ZONE(name)
+#define PROFILE_FUNCTION()
+#define PROFILE_THREAD(name)
+#define PROFILE_DUMP(path) ((void)0)
+
+#endif
@@ -0,0 +1,61 @@
+///////////////////////////////////////////////////////////////////////////////
+// programcache.h
+// ========
+// on-disk cache of linked shader program binaries
+//
+// A linked program is saved with glGetProgramBinary under a key hashed from
+// its vertex and fragment sources and the GL vendor, renderer and version
+// strings, so a new driver or an edited shader never picks up a stale binary.
+// On the next launch the binary is handed to glProgramBinary instead of
+// compiling the sources. Drivers may still reject a binary (after an update
+// that kept the version string, for instance); the entry is then deleted and
+// the caller compiles from source as if nothing was cached.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <string>
+
+class ProgramCache
+{
+
+public:
+	bool enabled = false;
+
+	// Lookups of the current run
+	int hits = 0;
+	int misses = 0;
+	int rejected = 0;               // binaries found but refused by the driver
+
+public:
+	// Use directory for the cache, false without program binary support
+	bool Open(const std::string& directory);
+
+	// Create programId from a cached binary, false if the sources must be compiled
+	bool Load(const char* vertexSource, const char* fragmentSource, GLuint& programId);
+
+	// Save a program linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+	void Store(const char* vertexSource, const char* fragmentSource, GLuint programId);
+
+private:
+	// Start of every cache file
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t format;            // binaryFormat of glGetProgramBinary
+		uint64_t key;
+		uint32_t length;            // binary bytes following the header
+		uint32_t reserved;
+	};
+
+	static const uint32_t MAGIC = 0x42505347;  // "GSPB"
+
+	std::string directory;
+	std::string driver;             // vendor, renderer and version strings
+
+	uint64_t Key(const char* vertexSource, const char* fragmentSource) const;
+	std::string PathOf(uint64_t key) const;
+};
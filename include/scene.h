@@ -0,0 +1,91 @@
+///////////////////////////////////////////////////////////////////////////////
+// scene.h
+// ========
+// flat list of every draw that makes up the static scene
+//
+// The scene is recorded once at load, see SceneFile. Set the recording state
+// (mesh, material, model, section, occluder, lightmapped) and call DrawArrays / DrawElements to
+// append a draw. Point lights are listed separately and are not drawn.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+#include "meshes.h"
+
+class Scene
+{
+
+public:
+
+	// Shading state of a draw, mirrors the uniforms of the surface shader
+	struct Material
+	{
+		GLuint textures[2];         // uTexture (unit 0) and uSecondTexture (unit 1)
+		glm::vec2 uvScale;
+		glm::vec2 uvScale2;
+		float blendFactor;
+		bool hasTexture;
+		glm::vec4 objectColor;
+		glm::vec3 light1Color;
+		glm::vec3 light1Position;
+		glm::vec3 light2Color;
+		glm::vec3 light2Position;
+		float specularIntensity1;
+		float highlightSize1;
+		float specularIntensity2;
+		float highlightSize2;
+		GLint lightmapLayer;        // layer of the baked lighting, -1 when lit per fragment, see LightmapBaker
+	};
+
+	// A range of a mesh drawn with a single GL draw call
+	struct DrawRange
+	{
+		const Meshes::GLMesh* mesh;
+		GLenum mode;                // GL_TRIANGLES, GL_TRIANGLE_STRIP or GL_TRIANGLE_FAN
+		GLint first;                // first vertex (arrays) or first index (elements)
+		GLsizei count;
+		bool indexed;               // drawn with glDrawElements
+	};
+
+	struct Draw
+	{
+		DrawRange range;
+		Material material;
+		glm::mat4 model;
+		GLuint section;             // index into sections
+		bool occluder;              // rendered into the occlusion depth buffer
+		bool lightmapped;           // static surface whose diffuse lighting is baked
+	};
+
+	// Point light at the origin of a scene graph node, see LightClusters
+	struct Light
+	{
+		GLuint node;                // SceneGraph node
+		glm::vec3 color;
+		float radius;               // no contribution past this distance
+	};
+
+	std::vector<Draw> draws;
+	std::vector<std::string> sections;
+	std::vector<Light> lights;
+
+	// Recording state
+	const Meshes::GLMesh* mesh = nullptr;
+	Material material;
+	glm::mat4 model;
+	GLuint section = 0;
+	bool occluder = false;
+	bool lightmapped = false;
+
+public:
+	void Clear();
+	void DrawArrays(GLenum mode, GLint first, GLsizei count);
+	void DrawElements(GLenum mode, GLsizei count);
+};
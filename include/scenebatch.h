@@ -0,0 +1,182 @@
+///////////////////////////////////////////////////////////////////////////////
+// scenebatch.h
+// ========
+// compiles the scene draw list into GPU buffers and submits it
+//
+// Indirect path: every mesh range used by the scene is merged into one
+// vertex/index buffer, each draw becomes a DrawElementsIndirectCommand and
+// its material goes into a per-draw SSBO. Draws sharing the same shader
+// variant and texture bindings are submitted with one
+// glMultiDrawElementsIndirect.
+//
+// Every draw selects the ShaderPermutations variant of its material
+// features, and both paths are sorted by variant first so programs change
+// as rarely as possible. Texture units a variant does not sample are left
+// alone.
+//
+// Both paths address per-draw data by draw ID, the index of the draw in the
+// scene draw list. Model and normal matrices come from the TransformBuffer.
+// Each submit takes the IDs of the draws that survived culling, sorted by
+// SubmitKey so that draws sharing state are adjacent; when some are culled,
+// the indirect path writes the visible commands to the frame ring.
+// The indirect path is split in PrepareIndirect and SubmitIndirect so that
+// the prepared commands can be culled further on the GPU in between. When
+// the scene sections are timed apart, PrepareIndirect also splits the
+// buckets at every section of the draws it is given, so each section can be
+// submitted on its own over its range of buckets. Depth
+// passes draw from a position only copy of the merged vertex buffer.
+//
+// Loop path: fallback for drivers without multi-draw-indirect. Draws are
+// sorted by variant, mesh and textures and submitted one by one with the
+// variants of the classic surface shader. Their constants are written to the frame ring each frame
+// and bound with glBindBufferRange instead of being sent as uniforms.
+// RecordLoop records the same calls into a CommandStream for replay, reading
+// the constants from a static buffer instead.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "scene.h"
+#include "framering.h"
+#include "commandstream.h"
+#include "shaderpermutations.h"
+
+class SceneBatch
+{
+
+public:
+
+	// Layout of a record in GL_DRAW_INDIRECT_BUFFER
+	struct DrawElementsIndirectCommand
+	{
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;        // draw ID
+	};
+
+	// std430 layout of a record in the per-draw SSBO, indexed by draw ID
+	struct DrawData
+	{
+		glm::vec4 objectColor;
+		glm::vec4 light1Color;
+		glm::vec4 light1Position;
+		glm::vec4 light2Color;
+		glm::vec4 light2Position;
+		glm::vec4 uvScales;         // xy = uvScale, zw = UvScale2
+		glm::vec4 specular;         // specularIntensity1, highlightSize1, specularIntensity2, highlightSize2
+		glm::vec4 params;           // x = blendFactor, y = ubHasTexture, z = lightmap layer or -1
+	};
+
+	// std140 layout of the DrawConstants uniform block of the loop path
+	struct LoopConstants
+	{
+		DrawData data;
+		GLint drawId;
+		GLint padding[3];
+	};
+
+	// Run of commands that share a shader variant and texture bindings
+	struct Bucket
+	{
+		GLuint features;            // ShaderPermutations mask
+		GLuint textures[2];
+		GLuint firstCommand;
+		GLsizei commandCount;
+	};
+
+	// Run of prepared buckets that draw one scene section
+	struct SectionBuckets
+	{
+		GLuint section;
+		GLuint firstBucket;
+		GLsizei bucketCount;
+	};
+
+	// Commands selected by PrepareIndirect
+	struct IndirectCommands
+	{
+		GLuint buffer;              // static indirect buffer or the frame ring buffer
+		GLuint firstCommand;        // index of the first command in buffer
+		GLsizei count;
+	};
+
+	bool indirectSupported = false;
+
+	GLsizei drawCount = 0;
+	GLsizei triangleCount = 0;
+
+	// GL draw calls, program changes, state changes, draws and triangles of the last submit. State changes are
+	// the program, texture, vertex array and buffer binds of every pass; they add up until the caller resets
+	// them, once per frame, so the depth passes ahead of the submit are included
+	GLsizei lastSubmitCalls = 0;
+	GLsizei lastSubmitPrograms = 0;
+	GLsizei lastSubmitStateChanges = 0;
+	GLsizei lastSubmitDraws = 0;
+	GLsizei lastSubmitTriangles = 0;
+
+	// Frame ring bytes a submit writes per frame at most
+	GLsizeiptr ringBytes = 0;
+
+	IndirectCommands prepared = {};
+
+	// Sections of the prepared buckets in submission order, filled when PrepareIndirect splits them by section
+	std::vector<SectionBuckets> preparedSections;
+
+	// Uniform block binding of DrawConstants
+	static const GLuint LOOP_CONSTANTS_BINDING = 1;
+
+public:
+	bool Build(const Scene& scene);
+	void Destroy();
+
+	// Position of a draw in the submission order of either path
+	GLuint SubmitKey(GLuint id, bool indirect) const { return indirect ? commandOfDraw[id] : loopPositionOfDraw[id]; }
+
+	// Distinct shader feature masks of the draws, each needs its variant prepared
+	const std::vector<GLuint>& FeatureMasks() const { return featureMasks; }
+
+	void PrepareIndirect(FrameRing& ring, const std::vector<GLuint>& visibleIds, bool writable, bool bySection);
+	void SubmitIndirect(const ShaderPermutations& programs);
+	void SubmitIndirect(const ShaderPermutations& programs, GLuint firstBucket, GLsizei bucketCount);
+	void SubmitIndirectDepth();
+	void SubmitDepthOnly(FrameRing& ring, const std::vector<GLuint>& ids);
+	void SubmitLoop(FrameRing& ring, const std::vector<GLuint>& visibleIds, const ShaderPermutations& programs);
+	void RecordLoop(CommandStream& stream, const std::vector<GLuint>& visibleIds, const ShaderPermutations& programs);
+
+private:
+	std::vector<Scene::Draw> draws;         // scene draws, indexed by draw ID
+	std::vector<GLsizei> drawTriangles;     // indexed by draw ID
+	std::vector<GLuint> drawFeatures;       // ShaderPermutations mask, by draw ID
+	std::vector<GLuint> featureMasks;
+	std::vector<GLuint> loopOrder;          // draw IDs sorted by state for the loop path
+	std::vector<GLuint> loopPositionOfDraw; // index into loopOrder, by draw ID
+	std::vector<LoopConstants> loopConstants;   // in loopOrder
+	GLsizeiptr loopAlignment = 1;           // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+	GLsizeiptr loopStride = 0;              // LoopConstants rounded up to loopAlignment
+	std::vector<Bucket> buckets;
+	std::vector<DrawElementsIndirectCommand> commands;   // copy of the indirect buffer
+	std::vector<GLuint> commandOfDraw;      // index into commands, by draw ID
+	std::vector<GLuint> bucketOfCommand;    // index into buckets, by command
+	std::vector<Bucket> preparedBuckets;
+
+	GLuint vao = 0;
+	GLuint depthVao = 0;                    // positions and draw IDs only
+	GLuint vertexBuffer = 0;
+	GLuint positionBuffer = 0;
+	GLuint indexBuffer = 0;
+	GLuint drawIdBuffer = 0;
+	GLuint indirectBuffer = 0;
+	GLuint drawDataBuffer = 0;
+	GLuint loopConstantBuffer = 0;          // loopConstants at loopStride, for recorded streams
+
+	void UploadIndirect(const std::vector<GLuint>& order);
+	void CountVisible(const std::vector<GLuint>& visibleIds);
+};
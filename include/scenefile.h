@@ -0,0 +1,206 @@
+///////////////////////////////////////////////////////////////////////////////
+// scenefile.h
+// ========
+// scene description: a text form for authoring, compiled to a binary form
+// that is memory mapped and read in place at load
+//
+// Text form, one statement per line, '#' starts a comment:
+//
+//	texture <name> <path> [clamp]
+//	material <name>
+//		textures <name|none> <name|none>
+//		textured                        (sample the textures, else use color)
+//		color <r> <g> <b> <a>
+//		uv_scale <u> <v>
+//		uv_scale2 <u> <v>
+//		blend <factor>
+//		light1 <r> <g> <b> at <x> <y> <z>
+//		light2 <r> <g> <b> at <x> <y> <z>
+//		specular1 <intensity> <highlight size>
+//		specular2 <intensity> <highlight size>
+//	end
+//	section <name>                      (groups the nodes that follow it)
+//	group <name>                        (parent node without draws)
+//		parent <name>
+//		<transform>...
+//	end
+//	node <name>
+//		parent <name>                   (earlier node or group of the same file)
+//		mesh <box|cone|cylinder|tapered_cylinder|plane|prism|sphere|pyramid3|pyramid4|torus|dice>
+//		material <name>
+//		occluder                        (large enough to hide other nodes)
+//		lightmapped                     (static, diffuse lighting baked, see LightmapBaker)
+//		<transform>...
+//		arrays <triangles|strip|fan> <first> <count|all>
+//		elements <triangles|strip|fan> <count|all>
+//	end
+//	light <name>                        (point light, see LightClusters)
+//		parent <name>
+//		color <r> <g> <b>
+//		radius <distance>               (no light past this distance)
+//		<transform>...
+//	end
+//	instance <file>                     (path relative to this file)
+//		<transform>...
+//	end
+//
+// Transforms are multiplied in the order they are listed and are relative to
+// the parent node, if any:
+//
+//	translate <x> <y> <z>
+//	rotate <degrees> <axis x> <axis y> <axis z>
+//	rotate_radians <radians> <axis x> <axis y> <axis z>
+//	scale <x> <y> <z>
+//
+// Each instance becomes a group named after its file, parent of the top level
+// nodes of that file; textures, materials and sections are shared by name.
+// Nodes keep their local transform, see SceneGraph. A light sits at the
+// origin of its node, so it follows its parent and every instance has its
+// own. The binary form is a header followed by arrays of fixed size
+// records, names and paths are offsets into a trailing string table.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class SceneFile
+{
+
+public:
+
+	static const uint32_t VERSION = 4;
+
+	// NodeRecord flags
+	static const uint32_t NODE_OCCLUDER = 1;
+	static const uint32_t NODE_LIGHTMAPPED = 2;
+
+	// Meshes a node can reference, see Meshes
+	enum MeshId : uint32_t
+	{
+		MESH_BOX,
+		MESH_CONE,
+		MESH_CYLINDER,
+		MESH_TAPERED_CYLINDER,
+		MESH_PLANE,
+		MESH_PRISM,
+		MESH_SPHERE,
+		MESH_PYRAMID3,
+		MESH_PYRAMID4,
+		MESH_TORUS,
+		MESH_DICE,
+		MESH_COUNT
+	};
+
+	static const char* const MESH_NAMES[MESH_COUNT];
+
+	struct Header
+	{
+		char magic[4];              // "MSCN"
+		uint32_t version;
+		uint32_t textureCount;
+		uint32_t materialCount;
+		uint32_t sectionCount;
+		uint32_t nodeCount;
+		uint32_t drawCount;
+		uint32_t lightCount;
+		uint32_t stringBytes;
+
+		// Byte offsets of each array from the start of the file
+		uint32_t textureOffset;
+		uint32_t materialOffset;
+		uint32_t sectionOffset;
+		uint32_t nodeOffset;
+		uint32_t drawOffset;
+		uint32_t lightOffset;
+		uint32_t stringOffset;
+	};
+
+	struct TextureRecord
+	{
+		uint32_t name;
+		uint32_t path;
+		uint32_t clamp;             // GL_CLAMP_TO_EDGE instead of GL_REPEAT
+	};
+
+	// Mirrors Scene::Material, textures are indices into the texture array or -1
+	struct MaterialRecord
+	{
+		int32_t textures[2];
+		float uvScale[2];
+		float uvScale2[2];
+		float objectColor[4];
+		float light1Color[3];
+		float light1Position[3];
+		float light2Color[3];
+		float light2Position[3];
+		float specular[4];          // specularIntensity1, highlightSize1, specularIntensity2, highlightSize2
+		float blendFactor;
+		uint32_t hasTexture;
+	};
+
+	struct SectionRecord
+	{
+		uint32_t name;
+	};
+
+	// Nodes follow their parent; groups are nodes without draws
+	struct NodeRecord
+	{
+		uint32_t name;
+		uint32_t section;
+		int32_t parent;             // index of an earlier node or -1
+		uint32_t flags;             // NODE_OCCLUDER, NODE_LIGHTMAPPED
+		float model[16];            // local transform, column major
+	};
+
+	// One GL draw call, draws of a node are consecutive
+	struct DrawRecord
+	{
+		uint32_t node;
+		uint32_t material;
+		uint32_t mesh;              // MeshId
+		uint32_t mode;              // GL_TRIANGLES, GL_TRIANGLE_STRIP or GL_TRIANGLE_FAN
+		int32_t first;
+		int32_t count;              // -1 draws every vertex / index of the mesh
+		uint32_t indexed;
+	};
+
+	// Point light at the origin of a node without draws
+	struct LightRecord
+	{
+		uint32_t node;
+		float color[3];
+		float radius;
+	};
+
+	// Views into the mapped file, valid until Close()
+	const Header* header = nullptr;
+	const TextureRecord* textures = nullptr;
+	const MaterialRecord* materials = nullptr;
+	const SectionRecord* sections = nullptr;
+	const NodeRecord* nodes = nullptr;
+	const DrawRecord* draws = nullptr;
+	const LightRecord* lights = nullptr;
+
+public:
+	~SceneFile();
+
+	static bool Compile(const char* textPath, const char* binaryPath);
+	static bool NeedsCompile(const char* textPath, const char* binaryPath);
+
+	bool Open(const char* binaryPath);
+	void Close();
+
+	const char* String(uint32_t offset) const { return strings + offset; }
+
+private:
+	const char* strings = nullptr;
+
+	// Whole file, either memory mapped or read into fileData
+	const void* mapping = nullptr;
+	size_t mappingSize = 0;
+	std::vector<char> fileData;
+};
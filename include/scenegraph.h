@@ -0,0 +1,66 @@
+///////////////////////////////////////////////////////////////////////////////
+// scenegraph.h
+// ========
+// hierarchy of scene nodes with local and world transforms
+//
+// Nodes are stored as parallel arrays in depth-first order, so the subtree of
+// a node is the range [node, subtreeEnds[node]) and every parent comes before
+// its children. Changing a local transform only flags the node; Update then
+// recomputes the world transforms of the flagged subtrees in one forward pass
+// over each range and leaves the rest of the scene untouched.
+//
+// Each node owns a range of the scene draw list, whose model matrices are the
+// world transform of the node.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+class SceneGraph
+{
+
+public:
+	// A node as read from the scene file, parents before children
+	struct NodeDesc
+	{
+		std::string name;
+		GLint parent;               // index into the descriptions or -1
+		glm::mat4 local;
+		GLuint firstDraw;
+		GLuint drawCount;
+	};
+
+	// Per node, in depth-first order
+	std::vector<std::string> names;
+	std::vector<GLint> parents;             // -1 for roots
+	std::vector<GLuint> subtreeEnds;        // one past the last descendant
+	std::vector<glm::mat4> locals;
+	std::vector<glm::mat4> worlds;
+	std::vector<GLuint> firstDraws;
+	std::vector<GLuint> drawCounts;
+
+public:
+	// positions, if given, receives the depth-first position of every description
+	void Build(const std::vector<NodeDesc>& nodes, std::vector<GLuint>* positions = nullptr);
+	void Clear();
+
+	// First node with the given name, -1 if none
+	GLint Find(const std::string& name) const;
+
+	void SetLocal(GLuint node, const glm::mat4& local);
+
+	// Recompute the flagged subtrees, appending every node whose world transform changed
+	void Update(std::vector<GLuint>& updatedNodes);
+
+	size_t NodeCount() const { return parents.size(); }
+
+private:
+	std::vector<char> dirty;
+	bool anyDirty = false;
+};
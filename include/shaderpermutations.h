@@ -0,0 +1,80 @@
+///////////////////////////////////////////////////////////////////////////////
+// shaderpermutations.h
+// ========
+// specialized variants of one shader program, selected by a feature mask
+//
+// Every feature of the mask becomes a #define inserted after the #version
+// line of both sources, so the shader tests it with a constant and the
+// compiler removes the code of disabled features: a variant without
+// TEXTURED never samples a texture, one without SPECULAR never calls pow.
+// Variants are compiled by Prepare and cached by their mask; draws then
+// select theirs with Program. With specialize off every mask maps to the
+// variant with all features, the behavior of the original single shader.
+// Swap replaces the sources and every compiled variant at once, for shaders
+// rebuilt by the ShaderReloader.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class ShaderPermutations
+{
+
+public:
+	// Feature flags of the surface shaders
+	enum Feature : GLuint
+	{
+		TEXTURED = 1 << 0,          // samples uTexture instead of using the object color
+		BLEND = 1 << 1,             // mixes uSecondTexture in by the blend factor
+		SPECULAR = 1 << 2,          // adds specular highlights
+		SECOND_LIGHT = 1 << 3,      // LIGHT_COUNT 2 instead of 1
+		LIGHTMAPPED = 1 << 4,       // baked lighting times albedo, see LightmapBaker
+	};
+
+	static const GLuint FEATURE_COUNT = 5;
+	static const GLuint VARIANT_COUNT = 1 << FEATURE_COUNT;
+	static const GLuint ALL_FEATURES = VARIANT_COUNT - 1;
+
+	// Compiles and links a program, leaving it in use
+	typedef bool (*CompileFunction)(const char* vertexSource, const char* fragmentSource, GLuint& programId);
+
+	// Sets the uniforms of a freshly compiled program, which is in use
+	typedef std::function<void(GLuint programId)> SetupFunction;
+
+	bool specialize = true;
+
+public:
+	void Create(const std::string& vertexSource, const std::string& fragmentSource, CompileFunction compile, SetupFunction setup);
+	void Destroy();
+
+	// Compile the variant of a mask unless it is cached
+	bool Prepare(GLuint features);
+
+	GLuint Program(GLuint features) const { return programs[specialize ? features : ALL_FEATURES]; }
+
+	// Variants compiled so far, and their masks
+	GLuint Count() const;
+	std::vector<GLuint> Masks() const;
+
+	// Adopt new sources and programs built from them, one per mask; the old programs are deleted
+	void Swap(const std::string& vertexSource, const std::string& fragmentSource,
+		const std::vector<GLuint>& masks, const std::vector<GLuint>& replacements);
+
+	// #define lines of a mask
+	static std::string Defines(GLuint features);
+
+	// Source with the defines of a mask
+	static std::string Permute(const std::string& source, GLuint features);
+
+private:
+	std::string vertexSource;
+	std::string fragmentSource;
+	CompileFunction compile = nullptr;
+	SetupFunction setup;
+	GLuint programs[VARIANT_COUNT] = {};
+};
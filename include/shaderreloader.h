@@ -0,0 +1,100 @@
+///////////////////////////////////////////////////////////////////////////////
+// shaderreloader.h
+// ========
+// shader sources loaded from a directory, watched for edits and recompiled
+// in the background
+//
+// Source returns the text of a shader file, writing the embedded source out
+// first when the file is missing so there is something to edit. Changed
+// reports the files written since the last call: inotify on Linux, a poll of
+// their modification times elsewhere. The owner of a program then Submits
+// the new sources of all its programs as one batch; compiles and links are
+// issued at once and, with KHR_parallel_shader_compile (or the ARB version),
+// run on driver threads while frames keep rendering with the old programs.
+// Update polls GL_COMPLETION_STATUS_KHR and, once every program of a batch
+// is done, hands them all to the swap function between frames, so draws
+// never see half a batch. A batch with one failed program is deleted and
+// the old programs stay in use. Without the extension the driver compiles
+// when Update asks for the link status, and that frame takes the hitch.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <chrono>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+class ShaderReloader
+{
+
+public:
+	// Sources of one program of a batch
+	struct Request
+	{
+		std::string vertexSource;
+		std::string fragmentSource;
+	};
+
+	// Takes ownership of the linked programs of a batch, in request order
+	typedef std::function<void(const std::vector<GLuint>& programs)> SwapFunction;
+
+	bool enabled = false;
+	bool parallel = false;              // compiles run on driver threads
+
+	// Batches of the current run
+	int reloads = 0;                    // swapped in
+	int failures = 0;                   // dropped, the old programs stayed
+	double lastReloadMs = 0.0;          // from Submit to the swap
+
+public:
+	// Watch directory, created if missing
+	bool Open(const std::string& directory);
+	void Close();
+
+	// Current text of a watched file, fallback (and no file) while disabled
+	std::string Source(const std::string& name, const char* fallback);
+
+	// Names of the watched files whose text changed since the last call
+	std::vector<std::string> Changed();
+
+	// Compile and link a batch, replacing a pending one with the same label
+	void Submit(const std::string& label, const std::vector<Request>& requests, SwapFunction swap);
+
+	// Swap in or drop every finished batch, never waits on a pending one
+	void Update();
+
+private:
+	struct Batch
+	{
+		std::string label;
+		std::vector<GLuint> programs;
+		SwapFunction swap;
+		std::chrono::steady_clock::time_point start;
+	};
+
+	// A source file and the text programs were last built from
+	struct WatchedFile
+	{
+		std::string text;
+		time_t modified = 0;
+	};
+
+	std::string directory;
+	int notifyFd = -1;                  // inotify descriptor, -1 when polling
+	std::chrono::steady_clock::time_point lastPoll;
+	std::map<std::string, WatchedFile> files;
+	std::vector<Batch> pending;
+
+	std::string PathOf(const std::string& name) const;
+	bool Completed(GLuint program) const;
+	static bool Linked(GLuint program, const std::string& label, bool report);
+	static void DeleteBatch(Batch& batch);
+
+	// Embedded sources are a single line after GLSL(), break them up for editing
+	static std::string Format(const char* source);
+};
@@ -0,0 +1,97 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadowmaps.h
+// ========
+// shadow maps of the key light: a cached map of the static draws and a small
+// overlay map of the dynamic draws
+//
+// The key light is directional. Its static map covers the bounds of the
+// whole scene and is rendered once, then reused every frame until a draw it
+// holds moves. A moved static draw becomes dynamic for good and the static
+// map is rendered once more without it, so a scene where only a few objects
+// move settles after one re-render. The dynamic draws (the spinning token,
+// anything that moved) are rendered every frame into the overlay map, whose
+// frustum is fitted to their bounds only, so it stays sharp at a fraction of
+// the size. Fragments take the darker of both lookups, each filtered with a
+// 3x3 PCF kernel of hardware compared bilinear taps.
+//
+// Like HiZCuller, the passes are bracketed by Begin / End calls and the
+// caller submits the depth only draws with the light view bound.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "bvh.h"
+
+class ShadowMaps
+{
+
+public:
+	static const GLsizei STATIC_SIZE = 2048;
+	static const GLsizei DYNAMIC_SIZE = 512;
+
+	// Texture units the maps are sampled from
+	static const GLuint STATIC_UNIT = 8;
+	static const GLuint DYNAMIC_UNIT = 9;
+
+	bool supported = false;
+
+	// False until the static map holds the current static draws
+	bool staticValid = false;
+
+	// Draws rendered into each map
+	std::vector<GLuint> staticIds;
+	std::vector<GLuint> dynamicIds;
+
+	// Light view and the projections of both maps, set by Fit
+	glm::mat4 lightView;
+	glm::mat4 staticProjection;
+	glm::mat4 dynamicProjection;
+
+	// World to shadow map texture coordinates and depth, in [0, 1]
+	glm::mat4 staticShadowMatrix;
+	glm::mat4 dynamicShadowMatrix;
+
+	// World size of a texel of each map, for the normal offset of the lookups
+	float staticTexelSize = 0.0f;
+	float dynamicTexelSize = 0.0f;
+
+public:
+	// dynamicDraws: draws expected to move, never rendered into the static map
+	bool Create(size_t drawCount, const std::vector<GLuint>& dynamicDraws);
+	void Destroy();
+
+	// Turn moved static draws into dynamic ones, invalidating the static map
+	void Invalidate(const std::vector<GLuint>& movedIds);
+
+	// Fit the static map to the scene bounds when it is invalid and the overlay to the dynamic draws
+	void Fit(const glm::vec3& lightDirection, const std::vector<Aabb>& drawBounds);
+
+	void BeginStatic();
+	void EndStatic();
+	void BeginDynamic();
+	void EndDynamic();
+
+	// Bind both maps to their texture units
+	void Bind() const;
+
+private:
+	void Begin(GLuint framebuffer, GLsizei size);
+	void End();
+
+	std::vector<char> dynamic;              // per draw
+	glm::vec3 fittedDirection = glm::vec3(0.0f);
+	glm::vec2 depthRange = glm::vec2(0.0f); // near and far plane of both maps in light space
+
+	GLuint staticTexture = 0;
+	GLuint dynamicTexture = 0;
+	GLuint staticFramebuffer = 0;
+	GLuint dynamicFramebuffer = 0;
+	GLint savedViewport[4] = {};
+	GLint savedFramebuffer = 0;
+};
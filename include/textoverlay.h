@@ -0,0 +1,47 @@
+///////////////////////////////////////////////////////////////////////////////
+// textoverlay.h
+// ========
+// lines of text drawn over the finished frame with a built-in 5x7 font
+//
+// The glyphs are baked into a one channel texture at Create, one cell of
+// CELL_WIDTH x CELL_HEIGHT texels per character, plus a solid cell for the
+// translucent box behind the text. Draw streams two triangles per character
+// into one buffer and draws them in a single call, blended over whatever is
+// bound. The font has upper case letters, digits and a little punctuation;
+// lower case is drawn as upper case and anything else as a space.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <string>
+#include <vector>
+
+class TextOverlay
+{
+
+public:
+	// Sampled only during Draw; the post passes using this unit bind their textures every frame
+	static const GLuint FONT_UNIT = 11;
+
+	static const int CELL_WIDTH = 6;            // glyph plus one texel of spacing
+	static const int CELL_HEIGHT = 8;
+	static const int PIXEL_SCALE = 2;           // window pixels per font texel
+	static const int MARGIN = 8;                // window pixels from the top left corner
+
+public:
+	bool Create();
+	void Destroy();
+
+	// Draw lines from the top left corner of the bound width x height framebuffer
+	void Draw(const std::vector<std::string>& lines, GLsizei width, GLsizei height);
+
+private:
+	GLuint fontTexture = 0;
+	GLuint program = 0;
+	GLuint vao = 0;
+	GLuint vbo = 0;
+	GLint viewportSizeLocation = -1;
+	std::vector<GLfloat> vertices;              // reused between draws
+};
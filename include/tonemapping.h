@@ -0,0 +1,87 @@
+///////////////////////////////////////////////////////////////////////////////
+// tonemapping.h
+// ========
+// floating-point scene target, exposure adapted from a luminance histogram
+// and tonemapped to the framebuffer bound before it
+//
+// Begin redirects the scene into an RGBA16F target, so the highlights the
+// two Phong lights push past 1.0 survive until End. End runs three passes
+// over the renderWidth x renderHeight corner:
+//
+//	histogram  a compute shader bins the log2 luminance of every
+//	           HISTOGRAM_STRIDE-th pixel along each axis into BIN_COUNT bins,
+//	           in shared memory first so the global atomics are one per bin
+//	           and work group
+//	exposure   one work group reduces the bins to the mean log luminance,
+//	           ignoring the black bin, moves the adapted luminance towards it
+//	           at ADAPTATION_RATE and derives the exposure that puts it at
+//	           KEY_VALUE; it also clears the bins for the next frame
+//	tonemap    a fullscreen triangle scales the scene by the exposure and
+//	           applies the ACES filmic fit
+//
+// The adapted luminance and the exposure stay on the GPU in the histogram
+// buffer, so nothing is read back. Needs compute shaders; without them the
+// scene renders straight to the framebuffer as before.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+class ToneMapping
+{
+
+public:
+	static const GLuint COLOR_UNIT = 15;            // scene color of the histogram and tonemap passes
+	static const GLuint HISTOGRAM_BINDING = 7;      // shader storage binding of the bins and exposure
+
+	// Defined with the same names in the compute shaders
+	static const GLuint BIN_COUNT = 256;            // bin 0 holds the black pixels
+	static const GLuint GROUP_SIZE = 16;            // histogram work groups are GROUP_SIZE x GROUP_SIZE
+	static const GLuint HISTOGRAM_STRIDE = 2;       // pixels sampled along each axis
+
+	static constexpr float MIN_LOG_LUMINANCE = -8.0f;   // log2 range the bins cover
+	static constexpr float MAX_LOG_LUMINANCE = 4.0f;
+	static constexpr float KEY_VALUE = 0.18f;           // luminance the adapted average is exposed to
+	static constexpr float MIN_EXPOSURE = 0.25f;
+	static constexpr float MAX_EXPOSURE = 4.0f;
+	static constexpr float ADAPTATION_RATE = 1.5f;      // per second
+
+	bool supported = false;
+	bool enabled = true;
+
+public:
+	bool Create();
+	void Destroy();
+
+	// Bind and clear the float target; width and height size it, the scene covers the render size
+	void Begin(GLsizei renderWidth, GLsizei renderHeight, GLsizei width, GLsizei height);
+
+	// Adapt the exposure and tonemap into the framebuffer bound before Begin
+	void End(float deltaSeconds);
+
+	bool Active() const { return active; }
+
+private:
+	bool Allocate();
+	void Release();
+
+	GLsizei width = 0;                              // size of the target
+	GLsizei height = 0;
+	GLsizei renderWidth = 0;                        // part of it the frame covers
+	GLsizei renderHeight = 0;
+	bool active = false;                            // the frame in flight renders to the target
+	GLint destination = 0;                          // framebuffer bound before Begin
+
+	GLuint framebuffer = 0;
+	GLuint colorTexture = 0;
+	GLuint depthTexture = 0;
+	GLuint histogramBuffer = 0;                     // adapted luminance, exposure, then the bins
+
+	GLuint histogramProgram = 0;
+	GLuint exposureProgram = 0;
+	GLuint tonemapProgram = 0;
+	GLuint emptyVao = 0;                            // the fullscreen triangle is generated from gl_VertexID
+	GLint renderSizeLocation = -1;
+	GLint adaptationLocation = -1;
+};
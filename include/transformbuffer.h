@@ -0,0 +1,56 @@
+///////////////////////////////////////////////////////////////////////////////
+// transformbuffer.h
+// ========
+// model and normal matrices of every scene draw, baked once at load into a
+// texture buffer and fetched in the vertex shader by draw ID
+//
+// Each draw takes TEXELS_PER_DRAW RGBA32F texels: the four columns of the
+// model matrix followed by the three columns of the normal matrix. The
+// normal matrices are computed on the CPU, several draws at a time, so the
+// vertex shader never inverts a matrix; draws scaled uniformly are flagged
+// and the shader takes mat3(model) instead of fetching theirs. Draws
+// that move are rewritten through the frame ring and copied into place on
+// the GPU, so the buffer is never updated while a frame still reads it.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "scene.h"
+#include "framering.h"
+
+class TransformBuffer
+{
+
+public:
+	static const GLint TEXELS_PER_DRAW = 7;
+
+	// w of the first normal matrix texel of a draw scaled uniformly
+	static constexpr float UNIFORM_SCALE = 1.0f;
+
+	// Draws Update streams through the frame ring per frame, more fall back to glBufferSubData
+	static const GLsizei STREAMED_DRAWS = 256;
+
+	GLsizei count = 0;
+
+	// Draws whose normal matrix is mat3(model) up to a scale
+	GLsizei uniformScaleCount = 0;
+
+	// Frame ring bytes Update writes per frame at most
+	GLsizeiptr ringBytes = 0;
+
+public:
+	bool Build(const Scene& scene);
+	void Update(FrameRing& ring, const Scene& scene, const std::vector<GLuint>& movedIds);
+	void Bind(GLuint unit) const;
+	void Destroy();
+
+private:
+	GLuint buffer = 0;
+	GLuint texture = 0;
+};
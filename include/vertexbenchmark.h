@@ -0,0 +1,48 @@
+///////////////////////////////////////////////////////////////////////////////
+// vertexbenchmark.h
+// ========
+// measures vertex throughput of the surface transform paths on a dense mesh
+//
+// A finely tessellated grid is drawn instanced into a small viewport, so the
+// GPU time is dominated by the vertex shader, once per normal matrix path:
+// the inverse computed per vertex, the matrix precomputed by TransformBuffer
+// and fetched, and mat3(model) for draws flagged as uniformly scaled. Each
+// path is timed with GL_TIME_ELAPSED queries and reported in vertices per
+// second. Run from the command line with --vertex-benchmark.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include "transformbuffer.h"
+
+class VertexBenchmark
+{
+
+public:
+	static const GLuint GRID_SIZE = 256;        // quads along each side of the mesh
+	static const GLsizei INSTANCE_COUNT = 64;
+	static const int DRAWS_PER_SAMPLE = 8;
+	static const int SAMPLE_COUNT = 5;          // after one warm up sample
+
+public:
+	// Time every path and print the results, false if GL objects could not be created
+	bool Run();
+
+private:
+	GLuint vao = 0;
+	GLuint vertexBuffer = 0;
+	GLuint indexBuffer = 0;
+	GLsizei indexCount = 0;
+	GLsizei vertexCount = 0;
+	GLuint inverseProgram = 0;
+	GLuint precomputedProgram = 0;
+	GLuint query = 0;
+	TransformBuffer scaled;                     // non-uniform scales, normal matrices fetched
+	TransformBuffer uniform;                    // uniform scales, normal matrices skipped
+
+	void CreateGrid();
+	double Measure(GLuint program, const TransformBuffer& transforms);
+	void Destroy();
+};
@@ -2,6 +2,12 @@
 
 #include <iostream>         // cout, cerr
 #include <cstdlib>          // EXIT_FAILURE
+#include <cstdio>           // sscanf, snprintf
+#include <chrono>           // steady_clock
+#include <string>           // string
+#include <vector>           // vector
+#include <algorithm>        // find
+#include <fstream>          // ofstream
 #include <GL/glew.h>        // GLEW library
 #include <GLFW/glfw3.h>     // GLFW library
 
@@ -13,6 +19,34 @@
 
 // include the provided basic shape meshes code
 #include "meshes.h"
+#include "scene.h"
+#include "scenefile.h"
+#include "scenegraph.h"
+#include "scenebatch.h"
+#include "framering.h"
+#include "commandstream.h"
+#include "transformbuffer.h"
+#include "bvh.h"
+#include "hiz.h"
+#include "lightclusters.h"
+#include "deferredshading.h"
+#include "gputimer.h"
+#include "shadowmaps.h"
+#include "lightmapbaker.h"
+#include "dynamicresolution.h"
+#include "framecapture.h"
+#include "antialiasing.h"
+#include "benchmark.h"
+#include "tonemapping.h"
+#include "jobsystem.h"
+#include "drawlist.h"
+#include "vertexbenchmark.h"
+#include "shaderpermutations.h"
+#include "programcache.h"
+#include "shaderreloader.h"
+#include "textoverlay.h"
+#include "profiler.h"
+#include "framestats.h"
 
 #include <camera.h>
 
@@ -26,6 +60,24 @@ using namespace std; // Standard namespace
 #define GLSL(Version, Source) "#version " #Version " core \n" #Source
 #endif
 
+// FrameData uniform block, member for member struct FrameData. GLSL requires a block to be declared identically in
+// every stage of a program, so all shaders reading it get this one declaration after their #version line.
+#define FRAME_DATA_BLOCK \
+	"layout(std140, binding = 0) uniform FrameData\n" \
+	"{\n" \
+	"	mat4 view;\n" \
+	"	mat4 projection;\n" \
+	"	vec4 viewPosition;\n" \
+	"	vec4 ambientLight;\n" \
+	"	mat4 staticShadowMatrix;\n" \
+	"	mat4 dynamicShadowMatrix;\n" \
+	"	vec4 keyLightDirection;\n" \
+	"	vec4 keyLightColor;\n" \
+	"	vec4 shadowParams;\n" \
+	"	vec4 lightmapParams;\n" \
+	"};\n"
+#define GLSL_FRAME_DATA(Version, Source) "#version " #Version " core \n" FRAME_DATA_BLOCK #Source
+
 // Unnamed namespace
 namespace
 {
@@ -46,30 +98,35 @@ namespace
 	// Main GLFW window
 	GLFWwindow* gWindow = nullptr;
 	
-	//textures
-	GLuint gRedWoodGrain;
-	GLuint gGreenWoodGrain;
-	GLuint gBoard;
-	GLuint gTable;
-	GLuint gWoodGrain;
-	GLuint gNoise;
-	GLuint gStitch;
-	GLuint gDots;
-	GLuint gCardStack;
-	GLuint gChanceCard;
-	GLuint gCommunityChestCard;
-	GLuint gBoardwalk;
-	GLuint gParkPlace;
-	GLuint gSmudge;
-	GLuint gDottedMetal;
-	GLuint gPaper;
-	GLuint g500;
-	GLuint g100;
-	GLuint g50;
-	GLuint g20;
-	GLuint g10;
-	GLuint g5;
-	GLuint g1;
+	//textures of the loaded scene, indexed like its texture records
+	std::vector<GLuint> gTextures;
+
+	// Scene file, compiled to the binary form next to it when missing or stale
+	std::string gScenePath = "scenes/monopoly.scene";
+
+	//flag for timing the vertex transform paths instead of rendering the scene, set by --vertex-benchmark
+	bool gVertexBenchmark = false;
+
+	// Linked program binaries saved between runs, disabled by --no-program-cache
+	const char* const PROGRAM_CACHE_DIRECTORY = "shadercache";
+	ProgramCache gProgramCache;
+	bool gUseProgramCache = true;
+
+	// Time spent creating shader programs, from source or from the cache
+	double gShaderMs = 0.0;
+
+	// Shader files edited while running, in the directory given by --shader-dir
+	ShaderReloader gShaderReloader;
+	std::string gShaderDirectory;
+	const char* const SURFACE_VERTEX_FILE = "surface.vert";
+	const char* const SURFACE_FRAGMENT_FILE = "surface.frag";
+	const char* const INDIRECT_VERTEX_FILE = "indirect.vert";
+	const char* const INDIRECT_FRAGMENT_FILE = "indirect.frag";
+	const char* const GBUFFER_FRAGMENT_FILE = "gbuffer.frag";
+	const char* const DEFERRED_LIGHTING_VERTEX_FILE = "deferred_lighting.vert";
+	const char* const DEFERRED_LIGHTING_FRAGMENT_FILE = "deferred_lighting.frag";
+	const char* const DEPTH_VERTEX_FILE = "depth.vert";
+	const char* const DEPTH_FRAGMENT_FILE = "depth.frag";
 
 	//assign these to x,y,z vals of any object for testing
 	//uses up, down, left right, 7, 8 for .1 increments
@@ -77,11 +134,18 @@ namespace
 	float yTest = 0.f;
 	float zTest = 0.f;
 
-	//tiling
-	static glm::vec2 gUVScale(1.0f, 1.0f);
+	// Shader program variants, one per material feature mask, specialization toggled with V
+	ShaderPermutations gSurfacePrograms;
+
+	// Shader program variants for the indirect submission path
+	ShaderPermutations gIndirectPrograms;
 
-	// Shader program
-	GLuint gProgramId;
+	// G-buffer variants of the indirect surface shader and the lighting pass of the deferred path
+	ShaderPermutations gGBufferPrograms;
+	GLuint gDeferredLightingProgramId = 0;
+
+	// Depth only shader program for the occluder pass and the depth pre-pass
+	GLuint gDepthProgramId;
 
 	// camera
 	Camera gCamera(glm::vec3(-3.5f, 5.0f, 15.0f));
@@ -92,9 +156,217 @@ namespace
 	//Shape Meshes from Professor Brian
 	Meshes meshes;
 
+	// Draw list recorded once at load and its GPU batch
+	Scene gScene;
+	SceneBatch gSceneBatch;
+
+	// Node hierarchy of the scene, draws take the world transform of their node
+	SceneGraph gSceneGraph;
+	std::vector<GLuint> gUpdatedNodes;
+	std::vector<GLuint> gMovedIds;
+
+	// Token spun in place to exercise the transform updates, toggled with F
+	const char* const ANIMATED_NODE = "top_hat";
+	GLint gAnimatedNode = -1;
+	glm::mat4 gAnimatedNodeLocal;
+	bool gAnimateToken = false;
+
+	// Model and normal matrices of every draw, fetched by draw ID
+	TransformBuffer gTransforms;
+	const GLuint TRANSFORM_TEXTURE_UNIT = 2;
+
+	// Per-frame data (camera, loop path constants) is written to a persistently mapped ring
+	FrameRing gFrameRing;
+	const GLuint FRAME_DATA_BINDING = 0;
+	GLint gUniformAlignment = 1; // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+
+	// std140 layout of the FrameData uniform block, declared to the shaders by FRAME_DATA_BLOCK
+	struct FrameData
+	{
+		glm::mat4 view;
+		glm::mat4 projection;
+		glm::vec4 viewPosition;
+		glm::vec4 ambientLight;     // rgb = ambientColor, a = ambientStrength
+		glm::mat4 staticShadowMatrix;
+		glm::mat4 dynamicShadowMatrix;
+		// The key light is part of the scene lighting, lit with shadows off too: shadowParams.x only decides
+		// whether the shadow maps darken it, and the lightmaps bake it either way
+		glm::vec4 keyLightDirection; // xyz = unit vector towards the key light
+		glm::vec4 keyLightColor;
+		glm::vec4 shadowParams;     // x = shadows on, y = static normal offset, z = dynamic normal offset
+		glm::vec4 lightmapParams;   // x = baked lighting on
+	};
+
+	//flag for submission path, toggled with M
+	bool gUseIndirect = false;
+
+	// Bounds hierarchy of the static scene and the draws that passed culling this frame
+	SceneBvh gSceneBvh;
+	std::vector<GLuint> gVisibleIds;
+
+	//flag for frustum culling, toggled with C
+	bool gFrustumCulling = true;
+
+	// Worker threads building the sorted draw list, GL calls stay on the main thread
+	JobSystem gJobs;
+	DrawListBuilder gDrawList;
+
+	//flag for building the draw list on the worker threads, toggled with J
+	bool gThreadedDrawList = true;
+
+	// CPU draw list time with the workers off and on over the whole run
+	double gDrawListMsTotal[2] = { 0.0, 0.0 };
+	int gDrawListFrames[2] = { 0, 0 };
+
+	// Hierarchical-Z occlusion culling of the indirect path and this frame's visible occluders
+	HiZCuller gHiZ;
+	std::vector<GLuint> gOccluderIds;
+
+	//flag for occlusion culling, toggled with H
+	bool gOcclusionCulling = true;
+
+	//flag for the depth pre-pass of the indirect path, toggled with Z
+	bool gDepthPrepass = false;
+
+	// Scene point lights binned into view frustum cells every frame
+	LightClusters gLightClusters;
+
+	//flag for the clustered scene lights, toggled with L
+	bool gClusteredLights = true;
+
+	// G-buffer and fullscreen lighting pass, an alternative to forward shading on the indirect path
+	DeferredShading gDeferred;
+	bool gDeferredSupported = false;
+
+	//flag for the deferred path, toggled with G
+	bool gDeferredShading = false;
+
+	// Ambient light of the scene, rgb = color, a = strength
+	const glm::vec4 AMBIENT_LIGHT = glm::vec4(.5f, .5f, .5f, .8f);
+
+	// Directional key light of the scene, the only light casting shadows. It lights the scene in every shadow mode,
+	// so turning shadows off removes its shadows, not the light
+	const glm::vec3 KEY_LIGHT_DIRECTION = glm::normalize(glm::vec3(0.3f, 1.0f, 0.5f));
+	const glm::vec3 KEY_LIGHT_COLOR = glm::vec3(0.35f, 0.33f, 0.3f);
+
+	// Cached static shadow map and the per-frame overlay of the dynamic draws
+	ShadowMaps gShadows;
+
+	// Shadows of the key light: off, static map cached, or both maps rendered every frame
+	enum ShadowMode { SHADOWS_OFF, SHADOWS_CACHED, SHADOWS_UNCACHED, SHADOW_MODE_COUNT };
+	const char* const SHADOW_MODE_NAMES[SHADOW_MODE_COUNT] = { "off", "cached", "uncached" };
+
+	//flag for the shadow mode, cycled with K
+	int gShadowMode = SHADOWS_CACHED;
+
+	// Static map renders over the whole run and the GPU time of the last one
+	int gStaticShadowRenders = 0;
+	double gLastStaticShadowMs = 0.0;
+
+	// Baked diffuse lighting of the static table and board
+	LightmapBaker gLightmaps;
+
+	//flag for the lightmaps, toggled with B
+	bool gUseLightmaps = true;
+
+	// Offscreen scene target scaled to hold a GPU frame time, toggled with U
+	DynamicResolution gDynamicResolution;
+	double gRenderScaleTotal = 0.0;
+	int gRenderScaleFrames = 0;
+
+	// Anti-aliasing of the scene, cycled with N or chosen with --aa
+	AntiAliasing gAntiAliasing;
+	AntiAliasing::Mode gStartAntiAliasing = AntiAliasing::OFF;
+
+	// Scene and anti-aliasing pass GPU time per anti-aliasing mode over the whole run
+	int gRegionAntiAliasing[FrameRing::REGION_COUNT] = {};
+	double gAntiAliasingSceneMs[AntiAliasing::MODE_COUNT] = {};
+	double gAntiAliasingPassMs[AntiAliasing::MODE_COUNT] = {};
+	int gAntiAliasingFrames[AntiAliasing::MODE_COUNT] = {};
+
+	// Floating-point scene target tonemapped with an exposure adapted from its luminance, toggled with X
+	ToneMapping gToneMapping;
+	double gToneMappingMsTotal = 0.0;
+	int gToneMappingFrames = 0;
+
+	// GPU time of the surface pass (forward shading or the G-buffer), the deferred lighting pass, both shadow passes,
+	// the upscale of the dynamic resolution target, the anti-aliasing resolve or filter and the tonemapping passes
+	enum GpuPass { GPU_PASS_SURFACE, GPU_PASS_LIGHTING, GPU_PASS_STATIC_SHADOW, GPU_PASS_DYNAMIC_SHADOW, GPU_PASS_UPSCALE,
+		GPU_PASS_ANTIALIASING, GPU_PASS_TONEMAPPING, GPU_PASS_COUNT };
+	GpuTimer gGpuTimer;
+	bool gRegionDeferred[FrameRing::REGION_COUNT] = {};
+
+	// GPU time of every scene section while T shows them over the frame or --section-csv writes them
+	const double SECTION_SMOOTHING = 0.1;           // weight of a new time in the overlay
+	GpuTimer gSectionTimer;
+	bool gSectionOverlay = false;
+	bool gRegionSectionTiming[FrameRing::REGION_COUNT] = {};
+	std::vector<std::vector<GLuint>> gSectionIds;   // visible draws of every section
+	std::vector<GLuint> gSectionOrderIds;           // the same, section after section
+	std::vector<double> gSectionSmoothedMs;
+	std::string gSectionCsvPath;
+	std::ofstream gSectionCsv;
+	int gSectionCsvRows = 0;
+	TextOverlay gTextOverlay;
+
+	// GPU pass times with forward and deferred shading over the whole run
+	double gGpuMsTotal[2][GPU_PASS_COUNT] = {};
+	int gGpuFrames[2] = { 0, 0 };
+
+	// Shadow pass GPU time per shadow mode over the whole run
+	int gRegionShadowMode[FrameRing::REGION_COUNT] = {};
+	double gShadowMsTotal[SHADOW_MODE_COUNT] = {};
+	int gShadowFrames[SHADOW_MODE_COUNT] = {};
+
+	// Depth range of both projections, also the depth range of the light cells
+	const float NEAR_PLANE = 0.1f;
+	const float FAR_PLANE = 100.0f;
+
+	// Frame statistics, printed every STATS_INTERVAL seconds
+	const double STATS_INTERVAL = 2.0;
+	FrameStats gFrameStats;
+	double gLastStatsTime = 0.0;
+
+	// Loop path commands recorded for replay and the draws they were recorded for
+	CommandStream gCommandStream;
+	std::vector<GLuint> gRecordedIds;
+	int gStreamRecordings = 0;
+
+	//flag for replaying the recorded loop path, toggled with R
+	bool gReplay = false;
+
+	// CPU submit time per submit mode over the whole run
+	const int SUBMIT_MODE_COUNT = 3;
+	const char* const SUBMIT_MODE_NAMES[SUBMIT_MODE_COUNT] = { "loop", "indirect", "loop replay" };
+	double gSubmitMsTotal[SUBMIT_MODE_COUNT] = { 0.0, 0.0, 0.0 };
+	int gSubmitFrames[SUBMIT_MODE_COUNT] = { 0, 0, 0 };
+
 	float gDeltaTime = 0.0f; // Time between current frame and last frame
 	float gLastFrame = 0.0f;
 
+	// Headless mode: no window, gHeadlessFrames frames at a fixed time step, each written to an image
+	const float HEADLESS_FRAME_SECONDS = 1.0f / 60.0f;
+	bool gHeadless = false;
+	int gHeadlessWidth = WINDOW_WIDTH;
+	int gHeadlessHeight = WINDOW_HEIGHT;
+	int gHeadlessFrames = 1;
+	std::string gOutputPrefix = "frame";
+	std::string gOutputFormat = "png";
+	FrameCapture gFrameCapture;
+
+	// CPU zones of builds with ENABLE_PROFILER, written on exit and on F12
+	const char* const PROFILE_TRACE_FILE = "profile_trace.json";
+
+	// Benchmark mode: gBenchmarkFrames frames along a fixed camera orbit at the headless time step, after
+	// BENCHMARK_WARMUP_FRAMES that are not measured
+	const int BENCHMARK_WARMUP_FRAMES = 30;
+	const glm::vec3 BENCHMARK_TARGET = glm::vec3(0.0f, 0.0f, 0.0f);
+	const float BENCHMARK_ORBIT_RADIUS = 15.0f;
+	const float BENCHMARK_ORBIT_DOLLY = 5.0f;      // the radius swings this far in and out twice per orbit
+	const float BENCHMARK_ORBIT_HEIGHT = 6.0f;
+	int gBenchmarkFrames = 0;
+	std::string gBenchmarkOutput = "benchmark.json";
+
 	//flag for projection type
 	bool isOrthographic = false;
 }
@@ -108,19 +380,41 @@ bool UInitialize(int, char* [], GLFWwindow** window);
 void UResizeWindow(GLFWwindow* window, int width, int height);
 void UProcessInput(GLFWwindow* window);
 void URender();
+bool URenderHeadless();
+bool URunBenchmark();
+void UBenchmarkCamera(float orbit);
+void URenderShadows();
+bool UParseArguments(int argc, char* argv[]);
+bool UParseAntiAliasing(const std::string& name, AntiAliasing::Mode& mode);
+bool UParseCamera(const char* argument, Camera& camera);
+bool ULoadScene(const std::string& scenePath, Scene& scene, SceneGraph& graph);
+void UApplyWorldTransforms(const SceneGraph& graph, const std::vector<GLuint>& nodes, Scene& scene, std::vector<GLuint>& movedIds);
+void UUpdateTransforms();
+void UReportFrameStats();
+int USubmitMode();
+bool USectionTiming();
+void USplitSections();
+void USubmitSectionsIndirect(const ShaderPermutations& programs);
+void USubmitSections();
+void URecordSectionTimes();
+std::vector<std::string> USectionOverlayLines();
 bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
 void UDestroyShaderProgram(GLuint programId);
+void USetSurfaceSamplers(GLuint programId);
+void USetDeferredLightingSamplers(GLuint programId);
+void USetDepthSamplers(GLuint programId);
+void UReloadShaders();
+void UReloadPermutations(const char* label, ShaderPermutations& permutations, const std::string& vertexSource, const std::string& fragmentSource);
 void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos);
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void UPKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
 bool UCreateTexture(const char* filename, GLuint& textureId);
 void flipImageVertically(unsigned char* image, int width, int height, int channels);
 void UDestroyTexture(GLuint& textureId);
-void renderMoneyDenomination(GLuint texture, glm::vec3 translation, float rotationAngle, GLint modelLoc);
 
 
 /* Surface Vertex Shader Source Code*/
-const GLchar* vertexShaderSource = GLSL(440,
+const GLchar* vertexShaderSource = GLSL_FRAME_DATA(440,
 
 	layout(location = 0) in vec3 vertexPosition; // VAP position 0 for vertex position data
 	layout(location = 1) in vec3 vertexNormal; // VAP position 1 for normals
@@ -131,23 +425,42 @@ const GLchar* vertexShaderSource = GLSL(440,
 	out vec2 vertexTextureCoordinate;
 
 	//Uniform / Global variables for the  transform matrices
-	uniform mat4 model;
-	uniform mat4 view;
-	uniform mat4 projection;
+	uniform samplerBuffer uTransforms; // Static transforms baked at load, see TransformBuffer
+
+	// Per-draw constants, see SceneBatch::LoopConstants
+	layout(std140, binding = 1) uniform DrawConstants
+	{
+		vec4 objectColor;
+		vec4 light1Color;
+		vec4 light1Position;
+		vec4 light2Color;
+		vec4 light2Position;
+		vec4 uvScales;
+		vec4 specular;
+		vec4 params;
+		int drawId; // Draw ID of the model and normal matrices in uTransforms
+	} d;
 
 	void main()
 	{
+		int base = d.drawId * 7;
+		mat4 model = mat4(texelFetch(uTransforms, base), texelFetch(uTransforms, base + 1), texelFetch(uTransforms, base + 2), texelFetch(uTransforms, base + 3));
+
+		// Normal matrix precomputed by TransformBuffer, w flags a uniform scale where mat3(model) is enough
+		vec4 normalColumn0 = texelFetch(uTransforms, base + 4);
+		mat3 normalMatrix = normalColumn0.w != 0.0 ? mat3(model) : mat3(normalColumn0.xyz, texelFetch(uTransforms, base + 5).xyz, texelFetch(uTransforms, base + 6).xyz);
+
 		gl_Position = projection * view * model * vec4(vertexPosition, 1.0f); // Transforms vertices into clip coordinates
 
 		vertexFragmentPos = vec3(model * vec4(vertexPosition, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
 
-		vertexFragmentNormal = mat3(transpose(inverse(model))) * vertexNormal; // get normal vectors in world space only and exclude normal translation properties
+		vertexFragmentNormal = normalMatrix * vertexNormal; // get normal vectors in world space only and exclude normal translation properties
 		vertexTextureCoordinate = textureCoordinate;
 	}
 );
 
 /* Surface Fragment Shader Source Code*/
-const GLchar* fragmentShaderSource = GLSL(440,
+const GLchar* fragmentShaderSource = GLSL_FRAME_DATA(440,
 
 	in vec3 vertexFragmentNormal; // For incoming normals
 	in vec3 vertexFragmentPos; // For incoming fragment position
@@ -155,92 +468,582 @@ const GLchar* fragmentShaderSource = GLSL(440,
 
 	out vec4 fragmentColor; // For outgoing cube color to the GPU
 
-	// Uniforms for the ambient light
-	uniform vec4 objectColor;
-	uniform vec3 ambientColor;
-	uniform float ambientStrength;
-
-	// Uniforms for light colors and positions
-	uniform vec3 light1Color;
-	uniform vec3 light1Position;
-	uniform vec3 light2Color;
-	uniform vec3 light2Position;
-
-	// Uniforms for lioghting details
-	uniform float specularIntensity1;
-	uniform float highlightSize1;
-	uniform float specularIntensity2; 
-	uniform float highlightSize2; 
-
-	// Camera position for specular calculation
-	uniform vec3 viewPosition;
+	// Per-draw material: colors, lights and lighting details, see SceneBatch::LoopConstants
+	layout(std140, binding = 1) uniform DrawConstants
+	{
+		vec4 objectColor;
+		vec4 light1Color;
+		vec4 light1Position;
+		vec4 light2Color;
+		vec4 light2Position;
+		vec4 uvScales; // xy = first texture scale, zw = second texture scale
+		vec4 specular; // specularIntensity1, highlightSize1, specularIntensity2, highlightSize2
+		vec4 params; // x = blendFactor, y = has texture
+		int drawId;
+	} d;
 
 	// Texture uniforms
 	uniform sampler2D uTexture;
-	uniform vec2 uvScale; 
 	uniform sampler2D uSecondTexture; 
-	uniform vec2 UvScale2; 
-	uniform float blendFactor;
 
-	// Texture boolean
-	uniform bool ubHasTexture;
+	// Point lights of the scene and their froxel cells, written to the frame ring every frame, see LightClusters
+	struct PointLight
+	{
+		vec4 positionRadius; // xyz = world position, w = radius
+		vec4 color;
+	};
+
+	layout(std430, binding = 5) readonly buffer LightBuffer
+	{
+		vec4 clusterScale; // xy = tiles per pixel, z = slice scale, w = slice bias
+		uvec4 clusterInfo; // x = tiles across, y = tiles down, z = slices, w = light count
+		PointLight lights[];
+	};
+
+	layout(std430, binding = 6) readonly buffer ClusterBuffer
+	{
+		uint clusterData[]; // first index and count of every cell, then the light indices
+	};
+
+	// Baked diffuse lighting of the static surfaces, one layer per draw, see LightmapBaker
+	uniform sampler2DArray uLightmaps;
 
+	// Shadow maps of the key light, depth compared in hardware
+	uniform sampler2DShadow uStaticShadow;
+	uniform sampler2DShadow uDynamicShadow;
+
+	// Lit fraction of a 3x3 PCF kernel around the position, pushed off the surface against acne
+	float ShadowVisibility(sampler2DShadow map, mat4 shadowMatrix, vec3 position, vec3 normal, float normalOffset)
+	{
+		vec3 coordinate = (shadowMatrix * vec4(position + normal * normalOffset, 1.0)).xyz;
+		if (coordinate.z >= 1.0)
+			return 1.0;
+
+		vec2 texel = 1.0 / vec2(textureSize(map, 0));
+		float lit = 0.0;
+		for (int y = -1; y <= 1; ++y)
+			for (int x = -1; x <= 1; ++x)
+				lit += texture(map, vec3(coordinate.xy + vec2(x, y) * texel, coordinate.z));
+		return lit / 9.0;
+	}
+
+	// TEXTURED, BLEND, SPECULAR, LIGHT_COUNT and LIGHTMAPPED are defined per variant by ShaderPermutations
 	void main() {
 
 		// Ambient component
-		vec3 ambient = ambientStrength * ambientColor;
+		vec3 ambient = ambientLight.a * ambientLight.rgb;
 
-		//**Calculate Diffuse lighting**
 		vec3 norm = normalize(vertexFragmentNormal); // Normalize vectors to 1 unit
-		vec3 light1Direction = normalize(light1Position - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
-		float impact1 = max(dot(norm, light1Direction), 0.0);// Calculate diffuse impact by generating dot product of normal and light
-		vec3 diffuse1 = impact1 * light1Color; // Generate diffuse light color
-		vec3 light2Direction = normalize(light2Position - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
-		float impact2 = max(dot(norm, light2Direction), 0.0);// Calculate diffuse impact by generating dot product of normal and light
-		vec3 diffuse2 = impact2 * light2Color; // Generate diffuse light color
+		vec3 viewDir = normalize(viewPosition.xyz - vertexFragmentPos); // Calculate the view direction vector from the fragment position to the camera
+
+		// Surface color: the first texture, blended with the second by the blend factor, or the object color
+		vec3 surfaceColor = d.objectColor.xyz;
+		if (TEXTURED)
+		{
+			vec4 textureColor = texture(uTexture, vertexTextureCoordinate * d.uvScales.xy);
+			if (BLEND)
+				textureColor = mix(textureColor, texture(uSecondTexture, vertexTextureCoordinate * d.uvScales.zw), d.params.x);
+			surfaceColor = textureColor.xyz;
+		}
+
+		// Static surfaces read their lighting from the lightmap instead of evaluating every light
+		if (LIGHTMAPPED && lightmapParams.x > 0.0 && d.params.z >= 0.0)
+		{
+			fragmentColor = vec4(texture(uLightmaps, vec3(vertexTextureCoordinate, d.params.z)).rgb * surfaceColor, 1.0);
+			return;
+		}
+
+		// Both light terms carry the ambient component, also when the second light is dark
+		vec3 lighting = 2.0 * ambient;
+
+		//**Calculate Diffuse lighting**
+		vec3 light1Direction = normalize(d.light1Position.xyz - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
+		lighting += max(dot(norm, light1Direction), 0.0) * d.light1Color.xyz; // Diffuse impact of the light times its color
 
 		//**Calculate Specular lighting**
-		vec3 viewDir = normalize(viewPosition - vertexFragmentPos); // // Calculate the view direction vector from the fragment position to the camera
-		vec3 reflectDir1 = reflect(-light1Direction, norm);// Calculate reflection vector	
+		// Dot product of the view direction and the reflection vector, raised to the power of the highlight size,
+		// then multiplied by the specular intensity and light color.
+		if (SPECULAR)
+			lighting += d.specular.x * pow(max(dot(viewDir, reflect(-light1Direction, norm)), 0.0), d.specular.y) * d.light1Color.xyz;
 
-		// Calculate the specular component by taking the dot product of the view direction and the reflection vector,
-		// raising it to the power of the highlight size, and then multiplying by the specular intensity and light color.
-		float specularComponent1 = pow(max(dot(viewDir, reflectDir1), 0.0), highlightSize1);
-		vec3 specular1 = specularIntensity1 * specularComponent1 * light1Color;
+		// Repeat for the second light source.
+		if (LIGHT_COUNT > 1)
+		{
+			vec3 light2Direction = normalize(d.light2Position.xyz - vertexFragmentPos);
+			lighting += max(dot(norm, light2Direction), 0.0) * d.light2Color.xyz;
+			if (SPECULAR)
+				lighting += d.specular.z * pow(max(dot(viewDir, reflect(-light2Direction, norm)), 0.0), d.specular.w) * d.light2Color.xyz;
+		}
 
-		// Repeat the specular calculation for the second light source.
-		vec3 reflectDir2 = reflect(-light2Direction, norm);
-		float specularComponent2 = pow(max(dot(viewDir, reflectDir2), 0.0), highlightSize2);
-		vec3 specular2 = specularIntensity2 * specularComponent2 * light2Color;
+		// Key light, always lit; shadowed by the cached static map and the dynamic overlay when shadows are on
+		float keyVisibility = 1.0;
+		if (shadowParams.x > 0.0)
+			keyVisibility = min(ShadowVisibility(uStaticShadow, staticShadowMatrix, vertexFragmentPos, norm, shadowParams.y),
+				ShadowVisibility(uDynamicShadow, dynamicShadowMatrix, vertexFragmentPos, norm, shadowParams.z));
+		vec3 keyRadiance = keyVisibility * keyLightColor.rgb;
+		lighting += max(dot(norm, keyLightDirection.xyz), 0.0) * keyRadiance;
+		if (SPECULAR)
+			lighting += d.specular.x * pow(max(dot(viewDir, reflect(-keyLightDirection.xyz, norm)), 0.0), d.specular.y) * keyRadiance;
+
+		// Scene point lights, only those binned into the cell of this fragment
+		if (clusterInfo.w > 0u)
+		{
+			float depth = -(view * vec4(vertexFragmentPos, 1.0)).z;
+			uvec2 tile = min(uvec2(gl_FragCoord.xy * clusterScale.xy), clusterInfo.xy - 1u);
+			uint slice = uint(clamp(log(depth) * clusterScale.z + clusterScale.w, 0.0, float(clusterInfo.z - 1u)));
+			uint cell = (slice * clusterInfo.y + tile.y) * clusterInfo.x + tile.x;
+			uint first = clusterData[2u * cell];
+			uint end = first + clusterData[2u * cell + 1u];
+			for (uint i = first; i < end; ++i)
+			{
+				PointLight light = lights[clusterData[i]];
+				vec3 toLight = light.positionRadius.xyz - vertexFragmentPos;
+				float lightDistance = length(toLight);
+				float falloff = clamp(1.0 - lightDistance / light.positionRadius.w, 0.0, 1.0);
+				vec3 radiance = falloff * falloff * light.color.rgb;
+				vec3 lightDirection = toLight / max(lightDistance, 0.0001);
+				lighting += max(dot(norm, lightDirection), 0.0) * radiance;
+				if (SPECULAR)
+					lighting += d.specular.x * pow(max(dot(viewDir, reflect(-lightDirection, norm)), 0.0), d.specular.y) * radiance;
+			}
+		}
 
-		// Texture Colors
-		
-		// Sample the texture color from the first texture using the UV coordinates, scaled by uvScale
-		vec4 textureColor = texture(uTexture, vertexTextureCoordinate * uvScale);
+		fragmentColor = vec4(lighting * surfaceColor, 1.0);
+});
+
+/* Indirect Surface Vertex Shader Source Code, per-draw data comes from the draw data SSBO*/
+const GLchar* indirectVertexShaderSource = GLSL_FRAME_DATA(440,
+
+	layout(location = 0) in vec3 vertexPosition; // VAP position 0 for vertex position data
+	layout(location = 1) in vec3 vertexNormal; // VAP position 1 for normals
+	layout(location = 2) in vec2 textureCoordinate;  // VAP position 2 for texture coordinates
+	layout(location = 3) in uint drawId; // Per-instance draw index, selected by the command's baseInstance
+
+	out vec3 vertexFragmentNormal; // For outgoing normals to fragment shader
+	out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
+	out vec2 vertexTextureCoordinate;
+	flat out uint vertexDrawId; // For the per-draw material lookup in the fragment shader
+
+	invariant gl_Position; // Must match the depth pre-pass bit for bit for the GL_EQUAL depth test
+
+	//Uniform / Global variables for the transform matrices
+	uniform samplerBuffer uTransforms; // Static transforms baked at load, see TransformBuffer
+
+	void main()
+	{
+		int base = int(drawId) * 7;
+		mat4 model = mat4(texelFetch(uTransforms, base), texelFetch(uTransforms, base + 1), texelFetch(uTransforms, base + 2), texelFetch(uTransforms, base + 3));
+
+		// Normal matrix precomputed by TransformBuffer, w flags a uniform scale where mat3(model) is enough
+		vec4 normalColumn0 = texelFetch(uTransforms, base + 4);
+		mat3 normalMatrix = normalColumn0.w != 0.0 ? mat3(model) : mat3(normalColumn0.xyz, texelFetch(uTransforms, base + 5).xyz, texelFetch(uTransforms, base + 6).xyz);
+
+		gl_Position = projection * view * model * vec4(vertexPosition, 1.0f); // Transforms vertices into clip coordinates
+
+		vertexFragmentPos = vec3(model * vec4(vertexPosition, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
+
+		vertexFragmentNormal = normalMatrix * vertexNormal; // get normal vectors in world space only and exclude normal translation properties
+		vertexTextureCoordinate = textureCoordinate;
+		vertexDrawId = drawId;
+	}
+);
+
+/* Indirect Surface Fragment Shader Source Code, same lighting as the surface fragment shader*/
+const GLchar* indirectFragmentShaderSource = GLSL_FRAME_DATA(440,
+
+	in vec3 vertexFragmentNormal; // For incoming normals
+	in vec3 vertexFragmentPos; // For incoming fragment position
+	in vec2 vertexTextureCoordinate;
+	flat in uint vertexDrawId;
+
+	out vec4 fragmentColor; // For outgoing cube color to the GPU
+
+	// Per-draw material, see SceneBatch::DrawData
+	struct DrawData
+	{
+		vec4 objectColor;
+		vec4 light1Color;
+		vec4 light1Position;
+		vec4 light2Color;
+		vec4 light2Position;
+		vec4 uvScales;
+		vec4 specular;
+		vec4 params;
+	};
+
+	layout(std430, binding = 0) readonly buffer DrawDataBuffer
+	{
+		DrawData draws[];
+	};
+
+	// Texture uniforms
+	uniform sampler2D uTexture;
+	uniform sampler2D uSecondTexture;
+
+	// Point lights of the scene and their froxel cells, written to the frame ring every frame, see LightClusters
+	struct PointLight
+	{
+		vec4 positionRadius; // xyz = world position, w = radius
+		vec4 color;
+	};
+
+	layout(std430, binding = 5) readonly buffer LightBuffer
+	{
+		vec4 clusterScale; // xy = tiles per pixel, z = slice scale, w = slice bias
+		uvec4 clusterInfo; // x = tiles across, y = tiles down, z = slices, w = light count
+		PointLight lights[];
+	};
+
+	layout(std430, binding = 6) readonly buffer ClusterBuffer
+	{
+		uint clusterData[]; // first index and count of every cell, then the light indices
+	};
+
+	// Baked diffuse lighting of the static surfaces, one layer per draw, see LightmapBaker
+	uniform sampler2DArray uLightmaps;
+
+	// Shadow maps of the key light, depth compared in hardware
+	uniform sampler2DShadow uStaticShadow;
+	uniform sampler2DShadow uDynamicShadow;
+
+	// Lit fraction of a 3x3 PCF kernel around the position, pushed off the surface against acne
+	float ShadowVisibility(sampler2DShadow map, mat4 shadowMatrix, vec3 position, vec3 normal, float normalOffset)
+	{
+		vec3 coordinate = (shadowMatrix * vec4(position + normal * normalOffset, 1.0)).xyz;
+		if (coordinate.z >= 1.0)
+			return 1.0;
+
+		vec2 texel = 1.0 / vec2(textureSize(map, 0));
+		float lit = 0.0;
+		for (int y = -1; y <= 1; ++y)
+			for (int x = -1; x <= 1; ++x)
+				lit += texture(map, vec3(coordinate.xy + vec2(x, y) * texel, coordinate.z));
+		return lit / 9.0;
+	}
+
+	// TEXTURED, BLEND, SPECULAR, LIGHT_COUNT and LIGHTMAPPED are defined per variant by ShaderPermutations
+	void main() {
+
+		DrawData d = draws[vertexDrawId];
 
-		// repeat for second texture
-		vec4 textureColor2 = texture(uSecondTexture, vertexTextureCoordinate * UvScale2);
+		// Ambient component
+		vec3 ambient = ambientLight.a * ambientLight.rgb;
 
-		// Blend the two textures based on the blend factor
-		vec4 combinedTextureColor = mix(textureColor, textureColor2, blendFactor);
-		vec3 phong1;
-		vec3 phong2;
+		vec3 norm = normalize(vertexFragmentNormal);
+		vec3 viewDir = normalize(viewPosition.xyz - vertexFragmentPos);
 
-		//Allows textures or colors 
-		if (ubHasTexture == true) 
+		// Texture Colors, blended by the draw's blend factor, or the object color
+		vec3 surfaceColor = d.objectColor.xyz;
+		if (TEXTURED)
 		{
-			phong1 = (ambient + diffuse1 + specular1) * combinedTextureColor.xyz;
-			phong2 = (ambient + diffuse2 + specular2) * combinedTextureColor.xyz;
+			vec4 textureColor = texture(uTexture, vertexTextureCoordinate * d.uvScales.xy);
+			if (BLEND)
+				textureColor = mix(textureColor, texture(uSecondTexture, vertexTextureCoordinate * d.uvScales.zw), d.params.x);
+			surfaceColor = textureColor.xyz;
 		}
-		else
+
+		// Static surfaces read their lighting from the lightmap instead of evaluating every light
+		if (LIGHTMAPPED && lightmapParams.x > 0.0 && d.params.z >= 0.0)
+		{
+			fragmentColor = vec4(texture(uLightmaps, vec3(vertexTextureCoordinate, d.params.z)).rgb * surfaceColor, 1.0);
+			return;
+		}
+
+		// Both light terms carry the ambient component, also when the second light is dark
+		vec3 lighting = 2.0 * ambient;
+
+		//**Calculate Diffuse and Specular lighting**
+		vec3 light1Direction = normalize(d.light1Position.xyz - vertexFragmentPos);
+		lighting += max(dot(norm, light1Direction), 0.0) * d.light1Color.xyz;
+		if (SPECULAR)
+			lighting += d.specular.x * pow(max(dot(viewDir, reflect(-light1Direction, norm)), 0.0), d.specular.y) * d.light1Color.xyz;
+
+		if (LIGHT_COUNT > 1)
+		{
+			vec3 light2Direction = normalize(d.light2Position.xyz - vertexFragmentPos);
+			lighting += max(dot(norm, light2Direction), 0.0) * d.light2Color.xyz;
+			if (SPECULAR)
+				lighting += d.specular.z * pow(max(dot(viewDir, reflect(-light2Direction, norm)), 0.0), d.specular.w) * d.light2Color.xyz;
+		}
+
+		// Key light, always lit; shadowed by the cached static map and the dynamic overlay when shadows are on
+		float keyVisibility = 1.0;
+		if (shadowParams.x > 0.0)
+			keyVisibility = min(ShadowVisibility(uStaticShadow, staticShadowMatrix, vertexFragmentPos, norm, shadowParams.y),
+				ShadowVisibility(uDynamicShadow, dynamicShadowMatrix, vertexFragmentPos, norm, shadowParams.z));
+		vec3 keyRadiance = keyVisibility * keyLightColor.rgb;
+		lighting += max(dot(norm, keyLightDirection.xyz), 0.0) * keyRadiance;
+		if (SPECULAR)
+			lighting += d.specular.x * pow(max(dot(viewDir, reflect(-keyLightDirection.xyz, norm)), 0.0), d.specular.y) * keyRadiance;
+
+		// Scene point lights, only those binned into the cell of this fragment
+		if (clusterInfo.w > 0u)
+		{
+			float depth = -(view * vec4(vertexFragmentPos, 1.0)).z;
+			uvec2 tile = min(uvec2(gl_FragCoord.xy * clusterScale.xy), clusterInfo.xy - 1u);
+			uint slice = uint(clamp(log(depth) * clusterScale.z + clusterScale.w, 0.0, float(clusterInfo.z - 1u)));
+			uint cell = (slice * clusterInfo.y + tile.y) * clusterInfo.x + tile.x;
+			uint first = clusterData[2u * cell];
+			uint end = first + clusterData[2u * cell + 1u];
+			for (uint i = first; i < end; ++i)
+			{
+				PointLight light = lights[clusterData[i]];
+				vec3 toLight = light.positionRadius.xyz - vertexFragmentPos;
+				float lightDistance = length(toLight);
+				float falloff = clamp(1.0 - lightDistance / light.positionRadius.w, 0.0, 1.0);
+				vec3 radiance = falloff * falloff * light.color.rgb;
+				vec3 lightDirection = toLight / max(lightDistance, 0.0001);
+				lighting += max(dot(norm, lightDirection), 0.0) * radiance;
+				if (SPECULAR)
+					lighting += d.specular.x * pow(max(dot(viewDir, reflect(-lightDirection, norm)), 0.0), d.specular.y) * radiance;
+			}
+		}
+
+		fragmentColor = vec4(lighting * surfaceColor, 1.0);
+});
+
+/* G-buffer Fragment Shader Source Code, the geometry pass of the deferred path, see DeferredShading*/
+const GLchar* gBufferFragmentShaderSource = GLSL(440,
+
+	in vec3 vertexFragmentNormal;
+	in vec3 vertexFragmentPos;
+	in vec2 vertexTextureCoordinate;
+	flat in uint vertexDrawId;
+
+	layout(location = 0) out vec4 gAlbedo; // surface color
+	layout(location = 1) out vec2 gNormal; // octahedral encoded world normal
+	layout(location = 2) out uvec2 gDrawId; // low and high 16 bits of the draw ID
+
+	// Per-draw material, see SceneBatch::DrawData
+	struct DrawData
+	{
+		vec4 objectColor;
+		vec4 light1Color;
+		vec4 light1Position;
+		vec4 light2Color;
+		vec4 light2Position;
+		vec4 uvScales;
+		vec4 specular;
+		vec4 params;
+	};
+
+	layout(std430, binding = 0) readonly buffer DrawDataBuffer
+	{
+		DrawData draws[];
+	};
+
+	// Texture uniforms
+	uniform sampler2D uTexture;
+	uniform sampler2D uSecondTexture;
+
+	// Folds the unit sphere onto the unit square, the lower hemisphere into the corners
+	vec2 EncodeNormal(vec3 n)
+	{
+		n /= abs(n.x) + abs(n.y) + abs(n.z);
+		vec2 folded = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+		return folded * 0.5 + 0.5;
+	}
+
+	// TEXTURED and BLEND are defined per variant by ShaderPermutations, lighting happens in the lighting pass
+	void main() {
+
+		DrawData d = draws[vertexDrawId];
+
+		vec3 surfaceColor = d.objectColor.xyz;
+		if (TEXTURED)
 		{
-			phong1 = (ambient + diffuse1 + specular1) * objectColor.xyz;
-			phong2 = (ambient + diffuse2 + specular2) * objectColor.xyz;
+			vec4 textureColor = texture(uTexture, vertexTextureCoordinate * d.uvScales.xy);
+			if (BLEND)
+				textureColor = mix(textureColor, texture(uSecondTexture, vertexTextureCoordinate * d.uvScales.zw), d.params.x);
+			surfaceColor = textureColor.xyz;
 		}
 
-		fragmentColor = vec4(phong1 + phong2, 1.0);
+		gAlbedo = vec4(surfaceColor, 1.0);
+		gNormal = EncodeNormal(normalize(vertexFragmentNormal));
+		gDrawId = uvec2(vertexDrawId & 0xFFFFu, vertexDrawId >> 16u);
 });
 
+/* Deferred Lighting Vertex Shader Source Code, one triangle covering the screen*/
+const GLchar* deferredLightingVertexShaderSource = GLSL(440,
+
+	void main()
+	{
+		// (-1, -1), (3, -1), (-1, 3)
+		vec2 corner = vec2(float((gl_VertexID & 1) << 2) - 1.0, float((gl_VertexID & 2) << 1) - 1.0);
+		gl_Position = vec4(corner, 0.0, 1.0);
+	}
+);
+
+/* Deferred Lighting Fragment Shader Source Code, the forward Phong math once per pixel*/
+const GLchar* deferredLightingFragmentShaderSource = GLSL_FRAME_DATA(440,
+
+	out vec4 fragmentColor;
+
+	// Per-draw material, see SceneBatch::DrawData
+	struct DrawData
+	{
+		vec4 objectColor;
+		vec4 light1Color;
+		vec4 light1Position;
+		vec4 light2Color;
+		vec4 light2Position;
+		vec4 uvScales;
+		vec4 specular;
+		vec4 params;
+	};
+
+	layout(std430, binding = 0) readonly buffer DrawDataBuffer
+	{
+		DrawData draws[];
+	};
+
+	// Point lights of the scene and their froxel cells, see LightClusters
+	struct PointLight
+	{
+		vec4 positionRadius;
+		vec4 color;
+	};
+
+	layout(std430, binding = 5) readonly buffer LightBuffer
+	{
+		vec4 clusterScale;
+		uvec4 clusterInfo;
+		PointLight lights[];
+	};
+
+	layout(std430, binding = 6) readonly buffer ClusterBuffer
+	{
+		uint clusterData[];
+	};
+
+	// G-buffer, see DeferredShading
+	uniform sampler2D uAlbedo;
+	uniform sampler2D uNormal;
+	uniform usampler2D uDrawId;
+	uniform sampler2D uDepth;
+	uniform mat4 uInverseViewProjection;
+	uniform vec2 uViewportSize; // the scene may cover only part of the G-buffer, see DynamicResolution
+
+	vec3 DecodeNormal(vec2 encoded)
+	{
+		encoded = encoded * 2.0 - 1.0;
+		vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+		float fold = max(-n.z, 0.0);
+		n.xy += vec2(n.x >= 0.0 ? -fold : fold, n.y >= 0.0 ? -fold : fold);
+		return normalize(n);
+	}
+
+	// Shadow maps of the key light, depth compared in hardware
+	uniform sampler2DShadow uStaticShadow;
+	uniform sampler2DShadow uDynamicShadow;
+
+	// Lit fraction of a 3x3 PCF kernel around the position, pushed off the surface against acne
+	float ShadowVisibility(sampler2DShadow map, mat4 shadowMatrix, vec3 position, vec3 normal, float normalOffset)
+	{
+		vec3 coordinate = (shadowMatrix * vec4(position + normal * normalOffset, 1.0)).xyz;
+		if (coordinate.z >= 1.0)
+			return 1.0;
+
+		vec2 texel = 1.0 / vec2(textureSize(map, 0));
+		float lit = 0.0;
+		for (int y = -1; y <= 1; ++y)
+			for (int x = -1; x <= 1; ++x)
+				lit += texture(map, vec3(coordinate.xy + vec2(x, y) * texel, coordinate.z));
+		return lit / 9.0;
+	}
+
+	void main() {
+
+		ivec2 pixel = ivec2(gl_FragCoord.xy);
+		float depth = texelFetch(uDepth, pixel, 0).r;
+		if (depth == 1.0)
+			discard; // nothing was drawn here
+
+		// World position from the depth buffer
+		vec4 position = uInverseViewProjection * vec4(gl_FragCoord.xy / uViewportSize * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+		vec3 vertexFragmentPos = position.xyz / position.w;
+
+		uvec2 drawId = texelFetch(uDrawId, pixel, 0).xy;
+		DrawData d = draws[drawId.x | (drawId.y << 16u)];
+		vec3 surfaceColor = texelFetch(uAlbedo, pixel, 0).rgb;
+		vec3 norm = DecodeNormal(texelFetch(uNormal, pixel, 0).xy);
+
+		vec3 ambient = ambientLight.a * ambientLight.rgb;
+		vec3 viewDir = normalize(viewPosition.xyz - vertexFragmentPos);
+
+		// Both light terms carry the ambient component, also when the second light is dark
+		vec3 lighting = 2.0 * ambient;
+
+		// Material lights; a zero specular intensity or light color adds nothing, as in the variants that skip them
+		vec3 light1Direction = normalize(d.light1Position.xyz - vertexFragmentPos);
+		lighting += max(dot(norm, light1Direction), 0.0) * d.light1Color.xyz;
+		lighting += d.specular.x * pow(max(dot(viewDir, reflect(-light1Direction, norm)), 0.0), d.specular.y) * d.light1Color.xyz;
+
+		vec3 light2Direction = normalize(d.light2Position.xyz - vertexFragmentPos);
+		lighting += max(dot(norm, light2Direction), 0.0) * d.light2Color.xyz;
+		lighting += d.specular.z * pow(max(dot(viewDir, reflect(-light2Direction, norm)), 0.0), d.specular.w) * d.light2Color.xyz;
+
+		// Key light, always lit; shadowed by the cached static map and the dynamic overlay when shadows are on
+		float keyVisibility = 1.0;
+		if (shadowParams.x > 0.0)
+			keyVisibility = min(ShadowVisibility(uStaticShadow, staticShadowMatrix, vertexFragmentPos, norm, shadowParams.y),
+				ShadowVisibility(uDynamicShadow, dynamicShadowMatrix, vertexFragmentPos, norm, shadowParams.z));
+		vec3 keyRadiance = keyVisibility * keyLightColor.rgb;
+		lighting += max(dot(norm, keyLightDirection.xyz), 0.0) * keyRadiance;
+		lighting += d.specular.x * pow(max(dot(viewDir, reflect(-keyLightDirection.xyz, norm)), 0.0), d.specular.y) * keyRadiance;
+
+		// Scene point lights, only those binned into the cell of this pixel
+		if (clusterInfo.w > 0u)
+		{
+			float viewDepth = -(view * vec4(vertexFragmentPos, 1.0)).z;
+			uvec2 tile = min(uvec2(gl_FragCoord.xy * clusterScale.xy), clusterInfo.xy - 1u);
+			uint slice = uint(clamp(log(viewDepth) * clusterScale.z + clusterScale.w, 0.0, float(clusterInfo.z - 1u)));
+			uint cell = (slice * clusterInfo.y + tile.y) * clusterInfo.x + tile.x;
+			uint first = clusterData[2u * cell];
+			uint end = first + clusterData[2u * cell + 1u];
+			for (uint i = first; i < end; ++i)
+			{
+				PointLight light = lights[clusterData[i]];
+				vec3 toLight = light.positionRadius.xyz - vertexFragmentPos;
+				float lightDistance = length(toLight);
+				float falloff = clamp(1.0 - lightDistance / light.positionRadius.w, 0.0, 1.0);
+				vec3 radiance = falloff * falloff * light.color.rgb;
+				vec3 lightDirection = toLight / max(lightDistance, 0.0001);
+				lighting += max(dot(norm, lightDirection), 0.0) * radiance;
+				lighting += d.specular.x * pow(max(dot(viewDir, reflect(-lightDirection, norm)), 0.0), d.specular.y) * radiance;
+			}
+		}
+
+		fragmentColor = vec4(lighting * surfaceColor, 1.0);
+});
+
+/* Depth Only Vertex Shader Source Code, reads the position only stream for the occluder pass and the depth pre-pass*/
+const GLchar* depthVertexShaderSource = GLSL_FRAME_DATA(440,
+
+	layout(location = 0) in vec3 vertexPosition; // VAP position 0 for vertex position data
+	layout(location = 3) in uint drawId; // Per-instance draw index, selected by the command's baseInstance
+
+	invariant gl_Position; // Same clip position as the indirect surface vertex shader
+
+	uniform samplerBuffer uTransforms; // Static transforms baked at load, see TransformBuffer
+
+	void main()
+	{
+		int base = int(drawId) * 7;
+		mat4 model = mat4(texelFetch(uTransforms, base), texelFetch(uTransforms, base + 1), texelFetch(uTransforms, base + 2), texelFetch(uTransforms, base + 3));
+
+		gl_Position = projection * view * model * vec4(vertexPosition, 1.0f); // Transforms vertices into clip coordinates
+	}
+);
+
+/* Depth Only Fragment Shader Source Code, paired with the depth only vertex shader*/
+const GLchar* depthFragmentShaderSource = GLSL(440,
+
+	void main()
+	{
+	}
+);
+
 // Images are loaded with Y axis going down, but OpenGL's Y axis goes up, so let's flip it
 void flipImageVertically(unsigned char* image, int width, int height, int channels)
 {
@@ -264,155 +1067,291 @@ void flipImageVertically(unsigned char* image, int width, int height, int channe
 
 int main(int argc, char* argv[])
 {
-	if (!UInitialize(argc, argv, &gWindow))
+	PROFILE_THREAD("Main");
+	auto startupStart = std::chrono::steady_clock::now();
+
+	if (!UParseArguments(argc, argv))
 		return EXIT_FAILURE;
 
-	meshes.CreateMeshes();
-	// Create the shader program
-	if (!UCreateShaderProgram(vertexShaderSource, fragmentShaderSource, gProgramId))
+	if (!UInitialize(argc, argv, &gWindow))
 		return EXIT_FAILURE;
 
-	// Load textures
+	if (gUseProgramCache && gProgramCache.Open(PROGRAM_CACHE_DIRECTORY))
+		cout << "INFO: Program binary cache in " << PROGRAM_CACHE_DIRECTORY << "/" << endl;
+	else
+		cout << "INFO: Program binary cache " << (gUseProgramCache ? "unavailable, program binaries are not supported" : "disabled") << endl;
 
-	// Load the red wood texture
-	if (!UCreateTexture("resources/red-wood.jpg", gRedWoodGrain))
+	// Headless frames end in an offscreen framebuffer that is read back, there is no window to present
+	if (gHeadless)
 	{
-		cout << "Failed to load texture red wood texture" << endl;
-		return EXIT_FAILURE;
+		if (!gFrameCapture.Create(gHeadlessWidth, gHeadlessHeight))
+			return EXIT_FAILURE;
+		gDynamicResolution.outputFramebuffer = gFrameCapture.framebuffer;
 	}
 
-	// Load the green wood texture
-	if (!UCreateTexture("resources/green-wood.jpg", gGreenWoodGrain))
+	if (gVertexBenchmark)
 	{
-		cout << "Failed to load texture green wood texture" << endl;
-		return EXIT_FAILURE;
+		VertexBenchmark benchmark;
+		bool completed = benchmark.Run();
+		glfwTerminate();
+		return completed ? EXIT_SUCCESS : EXIT_FAILURE;
 	}
 
-	// Load the Monopoly board texture
-	if (!UCreateTexture("resources/monopoly_board.jpg", gBoard)) {
-		cout << "Failed to load Monopoly board texture" << endl;
-		return EXIT_FAILURE;
+	// Shader sources come from the embedded literals, or from files watched for edits
+	if (!gShaderDirectory.empty())
+	{
+		if (gShaderReloader.Open(gShaderDirectory))
+			cout << "INFO: Shader hot reload from " << gShaderDirectory << "/, compiling "
+				<< (gShaderReloader.parallel ? "on driver threads" : "in place, parallel shader compile is not supported") << endl;
+		else
+			cout << "INFO: Shader hot reload unavailable, " << gShaderDirectory << " is not a directory" << endl;
 	}
 
-	// Load the table texture
-	if (!UCreateTexture("resources/table.jpg", gTable)) {
-		cout << "Failed to load table texture" << endl;
+	meshes.CreateMeshes();
+	// Create the shader program
+	if (!UCreateShaderProgram(gShaderReloader.Source(DEPTH_VERTEX_FILE, depthVertexShaderSource).c_str(),
+		gShaderReloader.Source(DEPTH_FRAGMENT_FILE, depthFragmentShaderSource).c_str(), gDepthProgramId))
 		return EXIT_FAILURE;
-	}
+	USetDepthSamplers(gDepthProgramId);
 
-	// Load the wood grain texture
-	if (!UCreateTexture("resources/wood-grain.jpg", gWoodGrain)) {
-		cout << "Failed to load wood grain texture" << endl;
-		return EXIT_FAILURE;
-	}
+	gSurfacePrograms.Create(gShaderReloader.Source(SURFACE_VERTEX_FILE, vertexShaderSource),
+		gShaderReloader.Source(SURFACE_FRAGMENT_FILE, fragmentShaderSource), UCreateShaderProgram, USetSurfaceSamplers);
+	gIndirectPrograms.Create(gShaderReloader.Source(INDIRECT_VERTEX_FILE, indirectVertexShaderSource),
+		gShaderReloader.Source(INDIRECT_FRAGMENT_FILE, indirectFragmentShaderSource), UCreateShaderProgram, USetSurfaceSamplers);
+	gGBufferPrograms.Create(gShaderReloader.Source(INDIRECT_VERTEX_FILE, indirectVertexShaderSource),
+		gShaderReloader.Source(GBUFFER_FRAGMENT_FILE, gBufferFragmentShaderSource), UCreateShaderProgram, USetSurfaceSamplers);
 
-	// Load the noise texture
-	if (!UCreateTexture("resources/noise.jpg", gNoise)) {
-		cout << "Failed to load noise texture" << endl;
+	// Load the scene description with its textures and compile it for submission
+	if (!ULoadScene(gScenePath, gScene, gSceneGraph))
+	{
+		cout << "Failed to load scene " << gScenePath << endl;
 		return EXIT_FAILURE;
 	}
 
-	// Load the stitch texture
-	if (!UCreateTexture("resources/stitch.jpg", gStitch)) {
-		cout << "Failed to load stitch texture" << endl;
-		return EXIT_FAILURE;
+	gAnimatedNode = gSceneGraph.Find(ANIMATED_NODE);
+	if (gAnimatedNode >= 0)
+	{
+		gAnimatedNodeLocal = gSceneGraph.locals[gAnimatedNode];
+		cout << "INFO: Scene graph: " << gSceneGraph.NodeCount() << " nodes, F spins the " << ANIMATED_NODE << " subtree of "
+			<< gSceneGraph.subtreeEnds[gAnimatedNode] - gAnimatedNode << " nodes" << endl;
 	}
 
-	// Load the dots texture
-	if (!UCreateTexture("resources/dice_dots.png", gDots)) {
-		cout << "Failed to load dots texture" << endl;
-		return EXIT_FAILURE;
+	// The draws of the animated subtree move; they are neither baked nor cached in the static shadow map
+	std::vector<GLuint> dynamicDraws;
+	std::vector<char> isDynamic(gScene.draws.size(), 0);
+	if (gAnimatedNode >= 0)
+	{
+		for (GLuint node = gAnimatedNode; node < gSceneGraph.subtreeEnds[gAnimatedNode]; ++node)
+		{
+			for (GLuint id = gSceneGraph.firstDraws[node]; id < gSceneGraph.firstDraws[node] + gSceneGraph.drawCounts[node]; ++id)
+			{
+				dynamicDraws.push_back(id);
+				isDynamic[id] = 1;
+			}
+		}
 	}
 
-	// Load the card stack texture
-	if (!UCreateTexture("resources/card-stack.jpg", gCardStack)) {
-		cout << "Failed to load card stack texture" << endl;
-		return EXIT_FAILURE;
-	}
+	// The draw list and the lightmap baker run on the main thread and one worker per spare core
+	gJobs.Start();
+	cout << "INFO: Draw list: " << gJobs.WorkerCount() << " worker threads, J toggles them" << endl;
 
-	// Load the chance card texture
-	if (!UCreateTexture("resources/chance_card.jpg", gChanceCard)) {
-		cout << "Failed to load chance card texture" << endl;
-		return EXIT_FAILURE;
+	// Diffuse lighting of the static lightmapped surfaces, baked before the batch reads their shader features
+	LightmapBaker::Lighting bakedLighting;
+	bakedLighting.ambient = glm::vec3(AMBIENT_LIGHT) * AMBIENT_LIGHT.w;
+	bakedLighting.keyDirection = KEY_LIGHT_DIRECTION;
+	bakedLighting.keyColor = KEY_LIGHT_COLOR;
+	for (const Scene::Light& light : gScene.lights)
+	{
+		bool moves = gAnimatedNode >= 0 && light.node >= static_cast<GLuint>(gAnimatedNode) && light.node < gSceneGraph.subtreeEnds[gAnimatedNode];
+		if (moves)
+			continue;
+		LightmapBaker::PointLight point = { glm::vec3(gSceneGraph.worlds[light.node][3]), light.color, light.radius };
+		bakedLighting.points.push_back(point);
 	}
-
-	// Load the community chest card texture
-	if (!UCreateTexture("resources/community_chest_card.jpg", gCommunityChestCard)) {
-		cout << "Failed to load community chest card texture" << endl;
-		return EXIT_FAILURE;
+	auto lightmapStart = std::chrono::steady_clock::now();
+	gLightmaps.Bake(gJobs, gScene, isDynamic, bakedLighting, gScenePath + ".lightmaps");
+	double lightmapMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - lightmapStart).count();
+	if (gLightmaps.layerCount > 0)
+	{
+		cout << "INFO: Lightmaps: " << gLightmaps.layerCount << " surfaces at " << LightmapBaker::SIZE << "x" << LightmapBaker::SIZE;
+		if (gLightmaps.lastFromCache)
+			cout << " loaded from cache in " << lightmapMs << " ms";
+		else
+			cout << " baked in " << lightmapMs << " ms, " << gLightmaps.lastRays << " rays against " << gLightmaps.lastTriangles << " static triangles";
+		cout << ", B toggles them" << endl;
 	}
-
-	// Load the boardwalk texture
-	if (!UCreateTexture("resources/boardwalk.jpg", gBoardwalk)) {
-		cout << "Failed to load boardwalk texture" << endl;
+	if (!gSceneBatch.Build(gScene))
+	{
+		cout << "Failed to build the scene batch" << endl;
 		return EXIT_FAILURE;
 	}
+	gUseIndirect = gSceneBatch.indirectSupported;
 
-	// Load the park place texture
-	if (!UCreateTexture("resources/park_place.jpg", gParkPlace)) {
-		cout << "Failed to load park place texture" << endl;
-		return EXIT_FAILURE;
+	// Compile the shader variant of every material feature mask in the scene
+	auto variantStart = std::chrono::steady_clock::now();
+	for (GLuint features : gSceneBatch.FeatureMasks())
+	{
+		if (!gSurfacePrograms.Prepare(features)
+			|| (gSceneBatch.indirectSupported && (!gIndirectPrograms.Prepare(features) || !gGBufferPrograms.Prepare(features))))
+			return EXIT_FAILURE;
 	}
+	double variantMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - variantStart).count();
+	cout << "INFO: Shader variants: " << gSceneBatch.FeatureMasks().size() << " feature masks, "
+		<< gSurfacePrograms.Count() + gIndirectPrograms.Count() + gGBufferPrograms.Count() << " programs compiled in " << variantMs << " ms, V toggles specialization" << endl;
 
-	// Load the smudge texture
-	if (!UCreateTexture("resources/smudge.jpg", gSmudge)) {
-		cout << "Failed to smudge texture" << endl;
+	// World bounds of every draw and the hierarchy used for frustum culling
+	auto bvhStart = std::chrono::steady_clock::now();
+	if (!gSceneBvh.Build(gScene))
+	{
+		cout << "Failed to build the scene bounds hierarchy" << endl;
 		return EXIT_FAILURE;
 	}
-	// Load the dotted_metal texture
-	if (!UCreateTexture("resources/dotted_metal.jpg", gDottedMetal)) {
-		cout << "Failed to dotted_metal texture" << endl;
-		return EXIT_FAILURE;
+	double bvhMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - bvhStart).count();
+	cout << "INFO: Scene BVH: " << gSceneBvh.NodeCount() << " nodes over " << gSceneBvh.drawBounds.size()
+		<< " draws built in " << bvhMs << " ms, C toggles frustum culling" << endl;
+
+	// The deferred path draws the indirect commands into a G-buffer, then lights every pixel once
+	int framebufferWidth, framebufferHeight;
+	glfwGetFramebufferSize(gWindow, &framebufferWidth, &framebufferHeight);
+	if (gSceneBatch.indirectSupported && gDeferred.Create(framebufferWidth, framebufferHeight)
+		&& UCreateShaderProgram(gShaderReloader.Source(DEFERRED_LIGHTING_VERTEX_FILE, deferredLightingVertexShaderSource).c_str(),
+			gShaderReloader.Source(DEFERRED_LIGHTING_FRAGMENT_FILE, deferredLightingFragmentShaderSource).c_str(), gDeferredLightingProgramId))
+	{
+		USetDeferredLightingSamplers(gDeferredLightingProgramId);
+		gDeferredSupported = true;
+		cout << "INFO: Deferred shading available, G toggles it against forward shading" << endl;
 	}
-
-	// Load the paper texture
-	if (!UCreateTexture("resources/paper.jpg", gPaper)) {
-		cout << "Failed to paper texture" << endl;
-		return EXIT_FAILURE;
+	else
+		cout << "INFO: Deferred shading unavailable, it needs multi-draw-indirect and a complete G-buffer" << endl;
+	gGpuTimer.Create(GPU_PASS_COUNT);
+
+	// Every section of the scene gets its own timer queries, read like the pass times
+	gSectionTimer.Create(static_cast<int>(gScene.sections.size()));
+	gSectionIds.resize(gScene.sections.size());
+	gSectionSmoothedMs.assign(gScene.sections.size(), 0.0);
+	if (!gTextOverlay.Create())
+		cout << "INFO: Text overlay unavailable, its program did not compile" << endl;
+	if (!gSectionCsvPath.empty())
+	{
+		gSectionCsv.open(gSectionCsvPath, std::ios::trunc);
+		if (gSectionCsv)
+		{
+			gSectionCsv << "frame";
+			for (const std::string& section : gScene.sections)
+				gSectionCsv << "," << section;
+			gSectionCsv << ",total" << endl;
+			cout << "INFO: Section GPU times written to " << gSectionCsvPath << endl;
+		}
+		else
+			cout << "ERROR::SECTIONS::Cannot write " << gSectionCsvPath << endl;
 	}
+	cout << "INFO: T shows the GPU time of every scene section, timed through the active submit path" << endl;
 
-	// Load the 500 texture
-	if (!UCreateTexture("resources/500.jpg", g500)) {
-		cout << "Failed to 500 texture" << endl;
-		return EXIT_FAILURE;
-	}
-	// Load the 100 texture
-	if (!UCreateTexture("resources/100.jpg", g100)) {
-		cout << "Failed to 100 texture" << endl;
-		return EXIT_FAILURE;
-	}
-	// Load the 50 texture
-	if (!UCreateTexture("resources/50.jpg", g50)) {
-		cout << "Failed to 50 texture" << endl;
-		return EXIT_FAILURE;
+	// The scene can render below the window resolution and be upscaled when the GPU falls behind
+	if (gDynamicResolution.Create(framebufferWidth, framebufferHeight))
+		cout << "INFO: Dynamic resolution " << (gDynamicResolution.enabled ? "on" : "available") << ", holding " << gDynamicResolution.targetMs
+			<< " ms of GPU time down to " << DynamicResolution::MIN_SCALE * 100.0f << "% scale, U toggles it" << endl;
+	else
+		cout << "INFO: Dynamic resolution unavailable, the scene target is incomplete" << endl;
+
+	if (gAntiAliasing.Create())
+	{
+		gAntiAliasing.SetMode(gStartAntiAliasing);
+		cout << "INFO: Anti-aliasing: " << AntiAliasing::MODE_NAMES[gAntiAliasing.mode] << ", MSAA with "
+			<< gAntiAliasing.samples << " samples, N cycles the modes" << endl;
 	}
-	// Load the 10 texture
-	if (!UCreateTexture("resources/10.jpg", g10)) {
-		cout << "Failed to 10 texture" << endl;
+	else
+		cout << "INFO: Anti-aliasing unavailable, its programs did not compile" << endl;
+
+	if (gToneMapping.Create())
+		cout << "INFO: HDR scene target with histogram auto-exposure on, X toggles it" << endl;
+	else
+		cout << "INFO: HDR tonemapping unavailable, compute shaders are required" << endl;
+
+	// Occlusion culling tests the indirect commands against a depth pyramid of the occluders
+	if (gSceneBatch.indirectSupported && gHiZ.Create(gSceneBvh.drawBounds))
+		cout << "INFO: Hierarchical-Z occlusion culling enabled, H toggles it" << endl;
+	else
+		cout << "INFO: Hierarchical-Z occlusion culling unavailable, compute shaders and multi-draw-indirect are required" << endl;
+
+	// Bake every model and normal matrix once; only view and projection change per frame
+	auto bakeStart = std::chrono::steady_clock::now();
+	if (!gTransforms.Build(gScene))
+	{
+		cout << "Failed to build the static transform buffer" << endl;
 		return EXIT_FAILURE;
 	}
-	// Load the 5 texture
-	if (!UCreateTexture("resources/5.jpg", g5)) {
-		cout << "Failed to 5 texture" << endl;
-		return EXIT_FAILURE;
+	double bakeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - bakeStart).count();
+
+	// Measure what recomposing every world transform and copying it to the draws would cost each frame
+	const int REBUILD_SAMPLES = 100;
+	SceneGraph rebuiltGraph = gSceneGraph;
+	Scene rebuiltScene = gScene;
+	std::vector<GLuint> rebuiltNodes, rebuiltIds;
+	auto rebuildStart = std::chrono::steady_clock::now();
+	for (int i = 0; i < REBUILD_SAMPLES; ++i)
+	{
+		for (GLuint node = 0; node < rebuiltGraph.NodeCount(); ++node)
+		{
+			if (rebuiltGraph.parents[node] < 0)
+				rebuiltGraph.SetLocal(node, rebuiltGraph.locals[node]);
+		}
+		rebuiltNodes.clear();
+		rebuiltIds.clear();
+		rebuiltGraph.Update(rebuiltNodes);
+		UApplyWorldTransforms(rebuiltGraph, rebuiltNodes, rebuiltScene, rebuiltIds);
 	}
-	// Load the 1 texture
-	if (!UCreateTexture("resources/1.jpg", g1)) {
-		cout << "Failed to 1 texture" << endl;
+	double rebuildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - rebuildStart).count() / REBUILD_SAMPLES;
+
+	cout << "INFO: Static transforms: " << gTransforms.count << " draws baked in " << bakeMs
+		<< " ms, saves " << rebuildMs << " ms/frame of matrix rebuilding and " << gTransforms.count << " model uploads per frame, "
+		<< gTransforms.uniformScaleCount << " uniformly scaled draws skip the normal matrix fetch" << endl;
+
+	// Scene lights are culled and binned into the view frustum cells every frame
+	gLightClusters.Create();
+	cout << "INFO: Clustered lighting: " << gScene.lights.size() << " scene lights over "
+		<< LightClusters::TILES_X << "x" << LightClusters::TILES_Y << "x" << LightClusters::SLICES << " cells, L toggles them" << endl;
+
+	// Frame data is written every frame, sized for the camera and both light views, the loop path constants,
+	// moved transforms, light cells and the commands of both shadow passes
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &gUniformAlignment);
+	GLsizeiptr shadowRingBytes = 2 * (sizeof(FrameData) + gUniformAlignment)
+		+ (gScene.draws.size() + 2) * sizeof(SceneBatch::DrawElementsIndirectCommand);
+	if (!gFrameRing.Create(sizeof(FrameData) + gUniformAlignment + gSceneBatch.ringBytes + gTransforms.ringBytes + gLightClusters.ringBytes
+		+ shadowRingBytes))
+	{
+		cout << "Failed to create the frame ring, ARB_buffer_storage is required" << endl;
 		return EXIT_FAILURE;
 	}
 
-	// tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
-	glUseProgram(gProgramId);
+	// The static shadow map caches everything but the dynamic draws
+	if (gSceneBatch.indirectSupported && gShadows.Create(gScene.draws.size(), dynamicDraws))
+		cout << "INFO: Shadows: " << gShadows.staticIds.size() << " static draws cached in a " << ShadowMaps::STATIC_SIZE << " map, "
+			<< gShadows.dynamicIds.size() << " dynamic draws in a " << ShadowMaps::DYNAMIC_SIZE << " overlay, K cycles shadows" << endl;
+	else
+		cout << "INFO: Shadows unavailable, they need multi-draw-indirect and complete depth targets" << endl;
+
+	cout << "INFO: Scene: " << gSceneBatch.drawCount << " draws, multi-draw-indirect "
+		<< (gSceneBatch.indirectSupported ? "enabled (M toggles the per-draw loop, R its replay, Z the depth pre-pass)" : "unavailable, using the per-draw loop (R toggles its replay)") << endl;
+
 
+	double startupMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupStart).count();
+	cout << "INFO: Startup: " << startupMs << " ms, shader programs " << gShaderMs << " ms";
+	if (gProgramCache.enabled)
+		cout << " (program cache: " << gProgramCache.hits << " hits, " << gProgramCache.misses << " misses, "
+			<< gProgramCache.rejected << " rejected)" << endl;
+	else
+		cout << " (no program cache)" << endl;
 
 	// Sets the background color of the window to black (it will be implicitely used by glClear)
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
 	// render loop
 	// -----------
-	while (!glfwWindowShouldClose(gWindow))
+	bool completed = gBenchmarkFrames > 0 ? URunBenchmark() : gHeadless ? URenderHeadless() : true;
+	while (!gHeadless && gBenchmarkFrames == 0 && !glfwWindowShouldClose(gWindow))
 	{
+		PROFILE_ZONE("Frame");
 
 		float currentFrame = glfwGetTime();
 		gDeltaTime = currentFrame - gLastFrame;
@@ -424,49 +1363,215 @@ int main(int argc, char* argv[])
 
 		// Render this frame
 		URender();
+		UReportFrameStats();
 
+		PROFILE_ZONE("glfwPollEvents");
 		glfwPollEvents();
 	}
 
+	// Compare the CPU submit time of every submit mode
+	for (int mode = 0; mode < SUBMIT_MODE_COUNT; ++mode)
+	{
+		if (gSubmitFrames[mode] > 0)
+			cout << "INFO: " << SUBMIT_MODE_NAMES[mode] << " submit average: "
+				<< gSubmitMsTotal[mode] / gSubmitFrames[mode] << " ms/frame over " << gSubmitFrames[mode] << " frames" << endl;
+	}
+	if (gStreamRecordings > 0)
+		cout << "INFO: loop replay recorded " << gStreamRecordings << " times" << endl;
+	for (int threaded = 0; threaded < 2; ++threaded)
+	{
+		if (gDrawListFrames[threaded] > 0)
+			cout << "INFO: " << (threaded ? "threaded" : "single thread") << " draw list average: "
+				<< gDrawListMsTotal[threaded] / gDrawListFrames[threaded] << " ms/frame over " << gDrawListFrames[threaded] << " frames" << endl;
+	}
+
+	const char* const SHADING_NAMES[2] = { "forward", "deferred" };
+	for (int shading = 0; shading < 2; ++shading)
+	{
+		if (gGpuFrames[shading] > 0)
+			cout << "INFO: " << SHADING_NAMES[shading] << " shading GPU average: surface pass "
+				<< gGpuMsTotal[shading][GPU_PASS_SURFACE] / gGpuFrames[shading] << " ms, lighting pass "
+				<< gGpuMsTotal[shading][GPU_PASS_LIGHTING] / gGpuFrames[shading] << " ms over " << gGpuFrames[shading] << " frames" << endl;
+	}
+
+	for (int mode = SHADOWS_CACHED; mode < SHADOW_MODE_COUNT; ++mode)
+	{
+		if (gShadowFrames[mode] > 0)
+			cout << "INFO: " << SHADOW_MODE_NAMES[mode] << " shadows GPU average: "
+				<< gShadowMsTotal[mode] / gShadowFrames[mode] << " ms/frame over " << gShadowFrames[mode] << " frames" << endl;
+	}
+	if (gStaticShadowRenders > 0)
+		cout << "INFO: static shadow map rendered " << gStaticShadowRenders << " times, last in " << gLastStaticShadowMs << " ms" << endl;
+	for (int mode = 0; mode < AntiAliasing::MODE_COUNT; ++mode)
+	{
+		if (gAntiAliasingFrames[mode] > 0)
+			cout << "INFO: " << AntiAliasing::MODE_NAMES[mode] << " GPU average: scene passes "
+				<< gAntiAliasingSceneMs[mode] / gAntiAliasingFrames[mode] << " ms, anti-aliasing pass "
+				<< gAntiAliasingPassMs[mode] / gAntiAliasingFrames[mode] << " ms over " << gAntiAliasingFrames[mode] << " frames" << endl;
+	}
+	if (gToneMappingFrames > 0)
+		cout << "INFO: tonemapping GPU average " << gToneMappingMsTotal / gToneMappingFrames << " ms over " << gToneMappingFrames << " frames" << endl;
+	if (gRenderScaleFrames > 0)
+		cout << "INFO: dynamic resolution average scale " << gRenderScaleTotal / gRenderScaleFrames << " over " << gRenderScaleFrames << " frames" << endl;
+	if (gShaderReloader.reloads + gShaderReloader.failures > 0)
+		cout << "INFO: shaders reloaded " << gShaderReloader.reloads << " times, " << gShaderReloader.failures
+			<< " failed, last in " << gShaderReloader.lastReloadMs << " ms" << endl;
+
+	// Release the workers, the scene batch, its transforms and the frame ring
+	gJobs.Stop();
+	gHiZ.Destroy();
+	gSceneBvh.Clear();
+	gSceneBatch.Destroy();
+	gTransforms.Destroy();
+	gFrameRing.Destroy();
+	gDeferred.Destroy();
+	gGpuTimer.Destroy();
+	gShadows.Destroy();
+	gLightmaps.Destroy();
+	gDynamicResolution.Destroy();
+	gAntiAliasing.Destroy();
+	gToneMapping.Destroy();
+	gFrameCapture.Destroy();
+	gSectionTimer.Destroy();
+	gTextOverlay.Destroy();
+	gShaderReloader.Close();
+
 	// Release mesh data
 	meshes.DestroyMeshes();
 
 	// Release textures
-	UDestroyTexture(gRedWoodGrain);
-	UDestroyTexture(gGreenWoodGrain);
-	UDestroyTexture(gBoard);
-	UDestroyTexture(gTable);
-	UDestroyTexture(gWoodGrain);
-	UDestroyTexture(gNoise);
-	UDestroyTexture(gStitch);
-	UDestroyTexture(gDots);
-	UDestroyTexture(gCardStack);
-	UDestroyTexture(gChanceCard);
-	UDestroyTexture(gCommunityChestCard);
-	UDestroyTexture(gBoardwalk);
-	UDestroyTexture(gParkPlace);
-	UDestroyTexture(gSmudge);
-	UDestroyTexture(gDottedMetal);
-	UDestroyTexture(gPaper);
-	UDestroyTexture(g500);
-	UDestroyTexture(g100);
-	UDestroyTexture(g50);
-	UDestroyTexture(g10);
-	UDestroyTexture(g5);
-	UDestroyTexture(g1);
-
-	// Release shader program
-	UDestroyShaderProgram(gProgramId);
-
-	exit(EXIT_SUCCESS); // Terminates the program successfully
+	for (GLuint& texture : gTextures)
+		UDestroyTexture(texture);
+
+	// Release shader programs
+	gSurfacePrograms.Destroy();
+	gIndirectPrograms.Destroy();
+	gGBufferPrograms.Destroy();
+	UDestroyShaderProgram(gDeferredLightingProgramId);
+	UDestroyShaderProgram(gDepthProgramId);
+
+	// Every zone of the run, startup included
+	PROFILE_DUMP(PROFILE_TRACE_FILE);
+
+	exit(completed ? EXIT_SUCCESS : EXIT_FAILURE); // Terminates the program successfully
+}
+
+
+// Renders gHeadlessFrames frames into the capture framebuffer and writes each to an image. Time advances by a
+// fixed step from 0, so the same arguments render the same animation on every machine.
+bool URenderHeadless()
+{
+	auto start = std::chrono::steady_clock::now();
+	for (int frame = 0; frame < gHeadlessFrames; ++frame)
+	{
+		glfwSetTime(frame * HEADLESS_FRAME_SECONDS);
+		gDeltaTime = HEADLESS_FRAME_SECONDS;
+
+		URender();
+		UReportFrameStats();
+
+		char number[16];
+		snprintf(number, sizeof(number), "%04d", frame);
+		if (!gFrameCapture.Write(gOutputPrefix + number + "." + gOutputFormat))
+			return false;
+	}
+
+	double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	cout << "INFO: Headless: wrote " << gHeadlessFrames << " " << gOutputFormat << " frames to " << gOutputPrefix << "*, "
+		<< totalMs / gHeadlessFrames << " ms/frame with the read back" << endl;
+	return true;
+}
+
+
+// Renders the warm-up and the measured frames along the camera orbit at the fixed time step, then reports
+// their percentiles and writes them as JSON. A GPU time is read REGION_COUNT frames after its frame, so
+// REGION_COUNT more frames are rendered to collect the times of the last measured ones.
+bool URunBenchmark()
+{
+	// Without vsync the CPU time is the cost of the frame, not the wait for the display
+	if (!gHeadless)
+		glfwSwapInterval(0);
+
+	FrameBenchmark benchmark;
+	const int lastMeasured = BENCHMARK_WARMUP_FRAMES + gBenchmarkFrames;
+	for (int frame = 0; frame < lastMeasured + FrameRing::REGION_COUNT; ++frame)
+	{
+		glfwSetTime(frame * HEADLESS_FRAME_SECONDS);
+		gDeltaTime = HEADLESS_FRAME_SECONDS;
+		UBenchmarkCamera(static_cast<float>(frame - BENCHMARK_WARMUP_FRAMES) / gBenchmarkFrames);
+
+		auto frameStart = std::chrono::steady_clock::now();
+		URender();
+		double cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+		glfwPollEvents();
+
+		if (frame >= BENCHMARK_WARMUP_FRAMES && frame < lastMeasured)
+			benchmark.AddFrame(cpuMs, gFrameStats.draws, gFrameStats.triangles, gFrameStats.submitCalls, gFrameStats.programChanges,
+				gFrameStats.stateChanges);
+
+		// The times read this frame belong to the frame REGION_COUNT earlier
+		int gpuFrame = frame - FrameRing::REGION_COUNT;
+		if (gpuFrame >= BENCHMARK_WARMUP_FRAMES && gpuFrame < lastMeasured)
+		{
+			double gpuMs = 0.0;
+			for (int pass = 0; pass < GPU_PASS_COUNT; ++pass)
+				gpuMs += gGpuTimer.lastMs[pass];
+			for (double sectionMs : gSectionTimer.lastMs)
+				gpuMs += sectionMs;
+			benchmark.AddGpuFrame(gpuMs);
+		}
+	}
+
+	int framebufferWidth, framebufferHeight;
+	glfwGetFramebufferSize(gWindow, &framebufferWidth, &framebufferHeight);
+	FrameBenchmark::Settings settings =
+	{
+		{ "scene", gScenePath },
+		{ "renderer", reinterpret_cast<const char*>(glGetString(GL_RENDERER)) },
+		{ "resolution", std::to_string(framebufferWidth) + "x" + std::to_string(framebufferHeight) },
+		{ "warmup_frames", std::to_string(BENCHMARK_WARMUP_FRAMES) },
+		{ "submit", SUBMIT_MODE_NAMES[USubmitMode()] },
+		{ "shading", gDeferredShading && gUseIndirect ? "deferred" : "forward" },
+		{ "shadows", gShadows.supported ? SHADOW_MODE_NAMES[gShadowMode] : "unsupported" },
+		{ "anti_aliasing", AntiAliasing::MODE_NAMES[gAntiAliasing.mode] },
+		{ "tonemapping", gToneMapping.enabled && gToneMapping.supported ? "on" : "off" },
+		{ "dynamic_resolution", gDynamicResolution.enabled && gDynamicResolution.supported ? "on" : "off" }
+	};
+
+	benchmark.Report();
+	if (!benchmark.WriteJson(gBenchmarkOutput, settings))
+		return false;
+	cout << "INFO: Benchmark written to " << gBenchmarkOutput << endl;
+	return true;
+}
+
+
+// Puts the camera on the benchmark orbit around the board, looking at its center; orbit 0 to 1 is one turn
+void UBenchmarkCamera(float orbit)
+{
+	float angle = glm::radians(360.0f) * orbit;
+	float radius = BENCHMARK_ORBIT_RADIUS + BENCHMARK_ORBIT_DOLLY * std::sin(2.0f * angle);
+	glm::vec3 position = BENCHMARK_TARGET + glm::vec3(radius * std::cos(angle), BENCHMARK_ORBIT_HEIGHT, radius * std::sin(angle));
+
+	glm::vec3 direction = glm::normalize(BENCHMARK_TARGET - position);
+	float yaw = glm::degrees(std::atan2(direction.z, direction.x));
+	float pitch = glm::degrees(std::asin(direction.y));
+	gCamera = Camera(position, glm::vec3(0.0f, 1.0f, 0.0f), yaw, pitch);
 }
 
 
 // Initialize GLFW, GLEW, and create a window
 bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 {
+	PROFILE_FUNCTION();
+
 	// GLFW: initialize and configure
 	// ------------------------------
+#ifdef GLFW_PLATFORM_NULL
+	// GLFW 3.4 and later create headless contexts without a display server
+	if (gHeadless)
+		glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
@@ -479,30 +1584,56 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 
 	// GLFW: window creation
 	// ---------------------
-	* window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_TITLE, NULL, NULL);
-	if (*window == NULL)
+	if (gHeadless)
 	{
-		std::cout << "Failed to create GLFW window" << std::endl;
-		glfwTerminate();
-		return false;
+		// Never shown: an EGL pbuffer context on a GPU, else OSMesa, which renders on the CPU with llvmpipe
+		const int CONTEXT_APIS[2] = { GLFW_EGL_CONTEXT_API, GLFW_OSMESA_CONTEXT_API };
+		const char* const CONTEXT_API_NAMES[2] = { "EGL", "OSMesa" };
+
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		*window = NULL;
+		for (int i = 0; i < 2 && *window == NULL; ++i)
+		{
+			glfwWindowHint(GLFW_CONTEXT_CREATION_API, CONTEXT_APIS[i]);
+			*window = glfwCreateWindow(gHeadlessWidth, gHeadlessHeight, WINDOW_TITLE, NULL, NULL);
+			if (*window != NULL)
+				cout << "INFO: Headless " << gHeadlessWidth << "x" << gHeadlessHeight << " context through " << CONTEXT_API_NAMES[i] << endl;
+		}
+		if (*window == NULL)
+		{
+			std::cout << "Failed to create a headless context, neither EGL nor OSMesa is available" << std::endl;
+			glfwTerminate();
+			return false;
+		}
+		glfwMakeContextCurrent(*window);
 	}
-	glfwMakeContextCurrent(*window);
-	glfwSetFramebufferSizeCallback(*window, UResizeWindow);
+	else
+	{
+		*window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_TITLE, NULL, NULL);
+		if (*window == NULL)
+		{
+			std::cout << "Failed to create GLFW window" << std::endl;
+			glfwTerminate();
+			return false;
+		}
+		glfwMakeContextCurrent(*window);
+		glfwSetFramebufferSizeCallback(*window, UResizeWindow);
 
-	// Set up mouse event callbacks
-	glfwSetCursorPosCallback(*window, UMousePositionCallback);
-	glfwSetScrollCallback(*window, UMouseScrollCallback);
-	glfwSetKeyCallback(*window, UPKeyCallback);
+		// Set up mouse event callbacks
+		glfwSetCursorPosCallback(*window, UMousePositionCallback);
+		glfwSetScrollCallback(*window, UMouseScrollCallback);
+		glfwSetKeyCallback(*window, UPKeyCallback);
 
-	// Calculate the center coordinates
-	double centerX = static_cast<double>(WINDOW_WIDTH) / 2.0;
-	double centerY = static_cast<double>(WINDOW_HEIGHT) / 2.0;
+		// Calculate the center coordinates
+		double centerX = static_cast<double>(WINDOW_WIDTH) / 2.0;
+		double centerY = static_cast<double>(WINDOW_HEIGHT) / 2.0;
 
-	// Set the mouse cursor position to the center
-	glfwSetCursorPos(*window, centerX, centerY);
+		// Set the mouse cursor position to the center
+		glfwSetCursorPos(*window, centerX, centerY);
 
-	// Disables cursor capture
-	glfwSetInputMode(*window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+		// Disables cursor capture
+		glfwSetInputMode(*window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+	}
 
 	// GLEW: initialize
 	// ----------------
@@ -510,7 +1641,8 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 	glewExperimental = GL_TRUE;
 	GLenum GlewInitResult = glewInit();
 
-	if (GLEW_OK != GlewInitResult)
+	// GLEW built for GLX reports the missing GLX display under EGL and OSMesa, after it loaded the GL entry points
+	if (GLEW_OK != GlewInitResult && !(gHeadless && GlewInitResult == GLEW_ERROR_NO_GLX_DISPLAY))
 	{
 		std::cerr << glewGetErrorString(GlewInitResult) << std::endl;
 		return false;
@@ -526,6 +1658,7 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 void UProcessInput(GLFWwindow* window)
 {
+	PROFILE_FUNCTION();
 	bool pKeyWasPressed = false;
 
 	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
@@ -601,1299 +1734,989 @@ void UPKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mo
 	// Toggle perspective projection
 	if (key == GLFW_KEY_P && action == GLFW_RELEASE)
 	{
-		isOrthographic = false; // Set to false to use perspective projection
-	}
-
-	// Toggle orthographic projection
-	if (key == GLFW_KEY_O && action == GLFW_RELEASE)
-	{
-		isOrthographic = true; // Set to true to use orthographic projection
-	}
-}
-
-
-// glfw: Whenever the mouse scroll wheel scrolls, this callback is called.
-// ----------------------------------------------------------------------
-void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
-{
-	gCamera.ProcessMouseScroll(yoffset);
-}
-
-
-// glfw: whenever the window size changed (by OS or user resize) this callback function executes
-void UResizeWindow(GLFWwindow* window, int width, int height)
-{
-	glViewport(0, 0, width, height);
-}
-
-
-// Functioned called to render a frame
-void URender()
-{
-	GLint modelLoc;
-	GLint viewLoc;
-	GLint projLoc;
-	GLint viewPosLoc;
-	GLint ambStrLoc;
-	GLint ambColLoc;
-	GLint light1ColLoc;
-	GLint light1PosLoc;
-	GLint light1Direction;
-	GLint light2ColLoc;
-	GLint light2PosLoc;
-	GLint objColLoc;
-	GLint specInt1Loc;
-	GLint highlghtSz1Loc;
-	GLint specInt2Loc;
-	GLint highlghtSz2Loc;
-	GLint uHasTextureLoc;
-	bool ubHasTextureVal;
-	glm::mat4 scale;
-	glm::mat4 rotation;
-	glm::mat4 rotation1;
-	glm::mat4 rotation2;
-	glm::mat4 rotation3;
-	glm::mat4 translation;
-	glm::mat4 objectTranslation;
-	glm::mat4 model;
-	glm::mat4 view;
-	glm::mat4 projection;
-	glm::vec2 uvScale;
-	glm::vec2 uvScale2;
-
-	// Enable z-depth
-	glEnable(GL_DEPTH_TEST);
-
-	// Clear the frame and z buffers
-	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-	// Transforms the camera
-	// Calculate camera's position in polar coordinates
-	view = gCamera.GetViewMatrix();
-
-	// Creates a projection using isOrthographic value
-	if (isOrthographic)
-	{
-		projection = glm::ortho(-15.f, 15.f, -15.f, 15.f, 0.1f, 100.f);
-	}
-	else
-	{
-		projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
-	}
-
-	// Set the shader to be used
-	glUseProgram(gProgramId);
-
-	// Default blend factor 
-	float defaultBlendFactor = 0.0f;
-	//blend factor for the secondary texture
-	float noiseBlendFactor = 0.f; 
-
-	// Get the location of the blendFactor uniform
-	GLint blendFactorLocation = glGetUniformLocation(gProgramId, "blendFactor");
-
-	// Set default blend factor before rendering any object
-	glUniform1f(blendFactorLocation, defaultBlendFactor);
-
-	// Retrieves and passes transform matrices to the Shader program
-	modelLoc = glGetUniformLocation(gProgramId, "model");
-	viewLoc = glGetUniformLocation(gProgramId, "view");
-	projLoc = glGetUniformLocation(gProgramId, "projection");
-	viewPosLoc = glGetUniformLocation(gProgramId, "viewPosition");
-	ambStrLoc = glGetUniformLocation(gProgramId, "ambientStrength");
-	ambColLoc = glGetUniformLocation(gProgramId, "ambientColor");
-	light1ColLoc = glGetUniformLocation(gProgramId, "light1Color");
-	light1PosLoc = glGetUniformLocation(gProgramId, "light1Position");
-	light2ColLoc = glGetUniformLocation(gProgramId, "light2Color");
-	light2PosLoc = glGetUniformLocation(gProgramId, "light2Position");
-	objColLoc = glGetUniformLocation(gProgramId, "objectColor");
-	specInt1Loc = glGetUniformLocation(gProgramId, "specularIntensity1");
-	highlghtSz1Loc = glGetUniformLocation(gProgramId, "highlightSize1");
-	specInt2Loc = glGetUniformLocation(gProgramId, "specularIntensity2");
-	highlghtSz2Loc = glGetUniformLocation(gProgramId, "highlightSize2");
-	uHasTextureLoc = glGetUniformLocation(gProgramId, "ubHasTexture");
-
-	// Retrieves and passes transform matrices to the Shader program
-	modelLoc = glGetUniformLocation(gProgramId, "model");
-	viewLoc = glGetUniformLocation(gProgramId, "view");
-	projLoc = glGetUniformLocation(gProgramId, "projection");
-
-	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-	glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-	
-	//set the camera view location
-	glUniform3f(viewPosLoc, gCamera.Position.x, gCamera.Position.y, gCamera.Position.z);
-
-	GLint UVScaleLoc = glGetUniformLocation(gProgramId, "uvScale");
-	glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
-
-	///// set ambient lighting for entire scene---------------------
-	glUniform1f(ambStrLoc, .8f);                //ambient lighting strength
-	glUniform3f(ambColLoc, .5f, .5f, .5f);    //ambient lighting color
-	/////----------------------------------------------------------
-
-	/*******************************
-	*
-	*			GAME PIECES
-	* 
-	* ******************************/
-
-	/*******************************
-	*
-	*			Thimble
-	*
-	* ******************************/
-
-
-	/******THIMBLE COMMON PROPERTIES*******/
-
-	glUseProgram(gProgramId);
-	glUniform1i(glGetUniformLocation(gProgramId, "ubHasTexture"), GL_TRUE); // Enable texturing
-	
-	// Diffuse lighting
-	glUniform3f(light1ColLoc, 0.3f, 0.3f, 0.3f); // Soft white light from overhead
-	glUniform3f(light1PosLoc, 5.0f, 2.0f, 10.0f); // Overhead light position
-
-	// Specular lighting
-	glUniform3f(light2ColLoc, 0.6f, 0.6f, 0.6f); // Moderate white side light for depth
-	glUniform3f(light2PosLoc, 5.0f, 2.0f, 10.0f); // Side light position
-
-	// High specular intensity and concentrated highlight size make the object shiny
-	glUniform1f(specInt1Loc, 0.9f); 
-	glUniform1f(highlghtSz1Loc, 10.f); 
-	glUniform1f(specInt2Loc, 0.9f); 
-	glUniform1f(highlghtSz2Loc, 10.f); 
-
-	/******THIMBLE BASE*******/
-
-	glBindVertexArray(meshes.gTorusMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, gDottedMetal); // Bind dotted metal texture for thimble bottom
-
-	// Tiny scale samples color from the dotted metal texture
-	uvScale = glm::vec2(.00001f, .00001f);
-	glUniform2fv(glGetUniformLocation(gProgramId, "uvScale"), 1, glm::value_ptr(uvScale));
-
-	// Transformations for the base
-	scale = glm::scale(glm::vec3(.1f, .1f, .1f));
-	rotation = glm::rotate(glm::radians(90.f), glm::vec3(1.f, 0.f, 0.0f));
-	translation = glm::translate(glm::vec3(-1.7f, 0.f, 4.1f));
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	
-	// Draw the thimble bottom
-	glDrawArrays(GL_TRIANGLES, 0, meshes.gTorusMesh.nVertices);
-
-	/******THIMBLE MIDDLE*******/
-
-	glBindVertexArray(meshes.gTaperedCylinderMesh.vao);
-
-	// UV scale adjustments for the middle 
-	uvScale = glm::vec2(5.f, 3.f);
-	glUniform2fv(glGetUniformLocation(gProgramId, "uvScale"), 1, glm::value_ptr(uvScale));
-
-	// Transformations for the middle 
-	rotation = glm::rotate(glm::radians(0.f), glm::vec3(1.f, 0.f, 0.0f)); //Rotation is reset 
-	scale = glm::scale(glm::vec3(.105f, .2f, .105f));
-
-	
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	// Draw the middle part
-	glDrawArrays(GL_TRIANGLE_STRIP, 72, 146); // Only drawing the sides as top/bottom are likely covered
-
-	/******THIMBLE TOP*******/
-
-	glBindVertexArray(meshes.gSphereMesh.vao);
-
-	// Tiny scale samples color from the dotted metal texture
-	uvScale = glm::vec2(.00001f, .00001f);
-	glUniform2fv(glGetUniformLocation(gProgramId, "uvScale"), 1, glm::value_ptr(uvScale));
-
-	// Transformations for the top 
-	scale = glm::scale(glm::vec3(0.0555f, 0.032f, 0.0555f));
-	translation = glm::translate(glm::vec3(-1.7f, .19f, 4.1f));
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	
-	// Draw the thimble top
-	glDrawElements(GL_TRIANGLES, meshes.gSphereMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	// Cleanup after drawing the thimble
-	glBindVertexArray(0);
-
-
-	/*******************************
-	*
-	*			TOP HAT
-	*
-	* ******************************/
-
-	/******TOP HAT COMMON PROPERTIES*******/
-
-	// Activate the shader program
-	glUseProgram(gProgramId);
-
-	// Enable texturing
-	glUniform1i(glGetUniformLocation(gProgramId, "ubHasTexture"), GL_TRUE);
-
-	// Setup common lighting properties for the Top Hat
-	// Diffuse lighting
-	glUniform3f(light1ColLoc, 0.3f, 0.3f, 0.3f); // Soft white light from overhead
-	glUniform3f(light1PosLoc, 5.0f, 2.0f, 10.0f); // Overhead light position
-
-	// Specular lighting
-	glUniform3f(light2ColLoc, 0.6f, 0.6f, 0.6f); // Moderate white side light for depth
-	glUniform3f(light2PosLoc, 5.0f, 2.0f, 10.0f); // Side light position
-
-	// High specular intensity and concentrated highlight size make the object shiny
-	glUniform1f(specInt1Loc, 0.9f);
-	glUniform1f(highlghtSz1Loc, 10.f);
-	glUniform1f(specInt2Loc, 0.9f);
-	glUniform1f(highlghtSz2Loc, 10.f);
-
-	//Total object translation
-	objectTranslation = glm::translate(glm::vec3(-2.7f, 0.f, 2.39f));
-
-	/******TOP HAT BASE*******/
-
-	// Bind the cylinder mesh for the base
-	glBindVertexArray(meshes.gCylinderMesh.vao);
-
-	// Transformations for the base
-	scale = glm::scale(glm::vec3(.1f, .011f, .1f)); // Scale the base to appropriate dimensions
-	rotation = glm::rotate(glm::radians(0.f), glm::vec3(1.f, 0.f, 0.0f)); // No rotation needed
-
-	// Apply transformations
-	model = objectTranslation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draw the base cylinder
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 36); // Bottom face
-	glDrawArrays(GL_TRIANGLE_FAN, 36, 72); // Top face
-	glDrawArrays(GL_TRIANGLE_STRIP, 72, 146); // Side faces
-
-	/******TOP HAT BRIM (TORUS)*******/
-
-	// Bind the torus mesh for the brim
-	glBindVertexArray(meshes.gTorusMesh.vao);
-
-	// Transformations for the brim
-	scale = glm::scale(glm::vec3(.1f, .109f, .13f)); // Scale the brim larger than the base
-	rotation = glm::rotate(glm::radians(90.f), glm::vec3(1.f, 0.f, 0.0f)); // Rotate to lay flat
-	translation = glm::translate(glm::vec3(0.f, 0.003f, 0.f)); // Adjust height slightly above the base
-
-	// Apply transformations
-	model = objectTranslation * translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draw the brim
-	glDrawArrays(GL_TRIANGLES, 0, meshes.gTorusMesh.nVertices);
-
-	/******TOP HAT TOP*******/
-
-	// Bind the cylinder mesh for the top 
-	glBindVertexArray(meshes.gCylinderMesh.vao);
-
-	// Transformations for the top
-	scale = glm::scale(glm::vec3(.065f, .075f, .065f)); // Scale for top part dimensions
-	rotation = glm::rotate(glm::radians(0.f), glm::vec3(1.f, 0.f, 0.0f)); // No rotation needed
-	translation = glm::translate(glm::vec3(-0.f, .011f, 0.f)); // Position on top of the base
-
-	// Apply transformations
-	model = objectTranslation * translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draw the top part
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 36); // Bottom face
-	glDrawArrays(GL_TRIANGLE_FAN, 36, 72); // Top face
-	glDrawArrays(GL_TRIANGLE_STRIP, 72, 146); // Side faces
-
-	// Cleanup
-	glBindVertexArray(0);
-
-	/*******************************
-	*
-	*			IRON
-	*
-	* ******************************/
-
-	/******IRON COMMON PROPERTIES*******/
-
-	// Activate the shader program
-	glUseProgram(gProgramId);
-
-	// Enable texturing
-	glUniform1i(glGetUniformLocation(gProgramId, "ubHasTexture"), GL_TRUE);
-
-	// Setup common lighting properties for the Top Hat
-	// Diffuse lighting
-	glUniform3f(light1ColLoc, 0.3f, 0.3f, 0.3f); // Soft white light from overhead
-	glUniform3f(light1PosLoc, 5.0f, 2.0f, 10.0f); // Overhead light position
-
-	// Specular lighting
-	glUniform3f(light2ColLoc, 0.6f, 0.6f, 0.6f); // Moderate white side light for depth
-	glUniform3f(light2PosLoc, 5.0f, 2.0f, 10.0f); // Side light position
-
-	// High specular intensity and concentrated highlight size make the object shiny
-	glUniform1f(specInt1Loc, 0.9f);
-	glUniform1f(highlghtSz1Loc, 10.f);
-	glUniform1f(specInt2Loc, 0.9f);
-	glUniform1f(highlghtSz2Loc, 10.f);
+		isOrthographic = false; // Set to false to use perspective projection
+	}
 
-	//Total object translation
-	objectTranslation = glm::translate(glm::vec3(-.32, 0.01f, 4.4f)); 
+	// Toggle orthographic projection
+	if (key == GLFW_KEY_O && action == GLFW_RELEASE)
+	{
+		isOrthographic = true; // Set to true to use orthographic projection
+	}
 
-	/******IRON BASE SQUARE*******/
+	// Toggle between multi-draw-indirect and the per-draw loop
+	if (key == GLFW_KEY_M && action == GLFW_RELEASE && gSceneBatch.indirectSupported)
+	{
+		gUseIndirect = !gUseIndirect;
+		gCommandStream.Clear();
+		gFrameStats.ResetInterval();
+	}
 
-	// Bind the box mesh for the base square
-	glBindVertexArray(meshes.gBoxMesh.vao);
+	// Toggle between the specialized shader variants and the variant with every feature
+	if (key == GLFW_KEY_V && action == GLFW_RELEASE)
+	{
+		gSurfacePrograms.specialize = gIndirectPrograms.specialize = gGBufferPrograms.specialize = !gSurfacePrograms.specialize;
+		gCommandStream.Clear();
+		cout << "INFO: Shader specialization " << (gSurfacePrograms.specialize ? "on" : "off") << endl;
+		gFrameStats.ResetInterval();
+	}
 
-	// Transformations for the base square
-	scale = glm::scale(glm::vec3(.2f, .02f, .2f)); // Scale to appropriate size for the iron base
-	rotation = glm::rotate(glm::radians(0.f), glm::vec3(0.f, 0.f, 1.f)); // No rotation needed
-	translation = glm::translate(glm::vec3(-.32, 0.01f, 4.4f)); // Position the base
+	// Toggle between forward and deferred shading of the indirect path
+	if (key == GLFW_KEY_G && action == GLFW_RELEASE && gDeferredSupported)
+	{
+		gDeferredShading = !gDeferredShading;
+		cout << "INFO: " << (gDeferredShading ? "Deferred" : "Forward") << " shading" << (gUseIndirect ? "" : " (M switches to the indirect path)") << endl;
+		gFrameStats.ResetInterval();
+	}
 
-	// Apply transformations
-	model = objectTranslation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+	// Toggle the baked lighting of the static surfaces against lighting them per fragment
+	if (key == GLFW_KEY_B && action == GLFW_RELEASE && gLightmaps.layerCount > 0)
+	{
+		gUseLightmaps = !gUseLightmaps;
+		cout << "INFO: Lightmaps " << (gUseLightmaps ? "on" : "off") << (gDeferredShading && gUseIndirect ? " (deferred shading lights every surface per pixel)" : "") << endl;
+		gFrameStats.ResetInterval();
+	}
 
-	// Draw the base square
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+	// Cycle the anti-aliasing: off, MSAA, FXAA, TAA
+	if (key == GLFW_KEY_N && action == GLFW_RELEASE)
+	{
+		gAntiAliasing.SetMode(static_cast<AntiAliasing::Mode>((gAntiAliasing.mode + 1) % AntiAliasing::MODE_COUNT));
+		cout << "INFO: Anti-aliasing: " << AntiAliasing::MODE_NAMES[gAntiAliasing.mode]
+			<< (gAntiAliasing.mode == AntiAliasing::MSAA && gDeferredShading && gUseIndirect ? " (the deferred path lights single samples)" : "") << endl;
+		gFrameStats.ResetInterval();
+	}
 
-	/******IRON BASE TRIANGLE*******/
+	// Toggle the GPU time of every scene section over the frame
+	if (key == GLFW_KEY_T && action == GLFW_RELEASE)
+	{
+		gSectionOverlay = !gSectionOverlay;
+		cout << "INFO: Section timing overlay " << (gSectionOverlay ? "on, each section timed in its own query" : "off") << endl;
+		gFrameStats.ResetInterval();
+	}
 
-	// Bind the prism mesh for the base triangle
-	glBindVertexArray(meshes.gPrismMesh.vao);
+	// Toggle the floating-point scene target and its tonemapping against writing the window directly
+	if (key == GLFW_KEY_X && action == GLFW_RELEASE && gToneMapping.supported)
+	{
+		gToneMapping.enabled = !gToneMapping.enabled;
+		cout << "INFO: HDR tonemapping " << (gToneMapping.enabled ? "on" : "off") << endl;
+		gFrameStats.ResetInterval();
+	}
 
-	// Transformations for the base triangle
-	scale = glm::scale(glm::vec3(.2f, .02f, .10f)); // Adjust size for the iron's pointed front
-	rotation = glm::rotate(glm::radians(-90.f), glm::vec3(0.f, 1.f, 0.f)); // Rotate to align with the base square
-	translation = glm::translate(glm::vec3(-.15f, 0.0f, 0.f)); // Position relative to the base square
+#ifdef ENABLE_PROFILER
+	// Write the CPU zones recorded so far, replacing the last trace
+	if (key == GLFW_KEY_F12 && action == GLFW_RELEASE)
+		PROFILE_DUMP(PROFILE_TRACE_FILE);
+#endif
 
-	// Apply transformations
-	model = objectTranslation * translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+	// Toggle rendering the scene at the scale that holds the GPU frame time, upscaled to the window
+	if (key == GLFW_KEY_U && action == GLFW_RELEASE && gDynamicResolution.supported)
+	{
+		gDynamicResolution.enabled = !gDynamicResolution.enabled;
+		cout << "INFO: Dynamic resolution " << (gDynamicResolution.enabled ? "on" : "off") << endl;
+		gFrameStats.ResetInterval();
+	}
 
-	// Draw the base triangle
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, meshes.gPrismMesh.nVertices);
+	// Cycle the key light shadows: off, cached static map, both maps every frame
+	if (key == GLFW_KEY_K && action == GLFW_RELEASE && gShadows.supported)
+	{
+		gShadowMode = (gShadowMode + 1) % SHADOW_MODE_COUNT;
+		gShadows.staticValid = false;
+		cout << "INFO: Shadows " << SHADOW_MODE_NAMES[gShadowMode] << endl;
+		gFrameStats.ResetInterval();
+	}
 
-	/******IRON HANDLE*******/
+	// Toggle the clustered scene lights, the material lights stay on
+	if (key == GLFW_KEY_L && action == GLFW_RELEASE)
+	{
+		gClusteredLights = !gClusteredLights;
+		cout << "INFO: Clustered scene lights " << (gClusteredLights ? "on" : "off") << endl;
+		gFrameStats.ResetInterval();
+	}
 
-	// Bind the cylinder mesh for the handle
-	glBindVertexArray(meshes.gCylinderMesh.vao);
+	// Toggle building the draw list on the worker threads
+	if (key == GLFW_KEY_J && action == GLFW_RELEASE)
+	{
+		gThreadedDrawList = !gThreadedDrawList;
+		cout << "INFO: Threaded draw list " << (gThreadedDrawList ? "on" : "off") << endl;
+		gFrameStats.ResetInterval();
+	}
 
-	// Transformations for the handle
-	scale = glm::scale(glm::vec3(.01f, .075f, .01f)); // Scale to handle dimensions
-	rotation = glm::rotate(glm::radians(30.f), glm::vec3(0.f, 0.f, 1.0f)); // Rotate for ergonomic angle
-	translation = glm::translate(glm::vec3(-.07f, 0.f, 0.f)); // Position on top of the base
+	// Toggle frustum culling
+	if (key == GLFW_KEY_C && action == GLFW_RELEASE)
+	{
+		gFrustumCulling = !gFrustumCulling;
+		cout << "INFO: Frustum culling " << (gFrustumCulling ? "on" : "off") << endl;
+		gFrameStats.ResetInterval();
+	}
 
-	// Apply transformations for one side of the handle
-	model = objectTranslation * translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+	// Toggle between replaying the recorded loop path and submitting it immediately
+	if (key == GLFW_KEY_R && action == GLFW_RELEASE)
+	{
+		gReplay = !gReplay;
+		gCommandStream.Clear();
+		cout << "INFO: Loop path replay " << (gReplay ? "on" : "off") << (gUseIndirect ? " (M switches to the loop path)" : "") << endl;
+		gFrameStats.ResetInterval();
+	}
 
-	// Draw one side of the handle
-	glDrawArrays(GL_TRIANGLE_STRIP, 72, 146); // Draw sides of the cylinder
+	// Toggle the token animation
+	if (key == GLFW_KEY_F && action == GLFW_RELEASE && gAnimatedNode >= 0)
+	{
+		gAnimateToken = !gAnimateToken;
+		cout << "INFO: Token animation " << (gAnimateToken ? "on" : "off") << endl;
+		gFrameStats.ResetInterval();
+	}
 
-	// Adjust rotation for the other side of the handle
-	rotation = glm::rotate(glm::radians(-30.f), glm::vec3(0.f, 0.f, 1.0f));
-	translation = glm::translate(glm::vec3(.03f, 0.f, 0.f));
+	// Toggle the depth pre-pass
+	if (key == GLFW_KEY_Z && action == GLFW_RELEASE && gSceneBatch.indirectSupported)
+	{
+		gDepthPrepass = !gDepthPrepass;
+		cout << "INFO: Depth pre-pass " << (gDepthPrepass ? "on" : "off") << endl;
+		gFrameStats.ResetInterval();
+	}
 
-	// Apply transformations for the other side
-	model = objectTranslation * translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+	// Toggle occlusion culling
+	if (key == GLFW_KEY_H && action == GLFW_RELEASE && gHiZ.supported)
+	{
+		gOcclusionCulling = !gOcclusionCulling;
+		cout << "INFO: Occlusion culling " << (gOcclusionCulling ? "on" : "off") << endl;
+		gFrameStats.ResetInterval();
+	}
+}
 
-	// Draw the other side of the handle
-	glDrawArrays(GL_TRIANGLE_STRIP, 72, 146); // Repeat drawing for symmetry
 
-	// Transformations for the top part of the handle
-	scale = glm::scale(glm::vec3(.01f, .1925f, .01f));
-	rotation = glm::rotate(glm::radians(90.f), glm::vec3(0.f, 0.f, 1.0f));
-	translation = glm::translate(glm::vec3(.0767f, .065f, 0.f));
+// glfw: Whenever the mouse scroll wheel scrolls, this callback is called.
+// ----------------------------------------------------------------------
+void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
+{
+	gCamera.ProcessMouseScroll(yoffset);
+}
 
-	// Apply transformations for the top handle
-	model = objectTranslation * translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
 
-	// Draw the top of the handle
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 36);		//bottom
-	glDrawArrays(GL_TRIANGLE_FAN, 36, 72);		//top
-	glDrawArrays(GL_TRIANGLE_STRIP, 72, 146);	//sides
+// glfw: whenever the window size changed (by OS or user resize) this callback function executes
+void UResizeWindow(GLFWwindow* window, int width, int height)
+{
+	glViewport(0, 0, width, height);
+}
 
-	// Cleanup
-	glBindVertexArray(0);
-	
-	/*******************************
-	*
-	*			DICE
-	*
-	* ******************************/
-
-	/******DICE COMMON PROPERTIES*******/
-
-	// Activate shader program and enable texturing
-	glUseProgram(gProgramId);
-	glUniform1i(glGetUniformLocation(gProgramId, "ubHasTexture"), GL_TRUE);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gDots); // Bind dots texture representing the dice faces
-
-	// Setup lighting properties for the dice
-	// Diffuse Lighting
-	glUniform3f(light1ColLoc, 0.3f, 0.3f, 0.3f); // Soft white light 
-	glUniform3f(light1PosLoc, 0.0f, 0.0f, 10.0f); // Overhead light source
-
-	// Specular Lighting
-	glUniform3f(light2ColLoc, 0.6f, 0.6f, 0.6f); // Moderate white light 
-	glUniform3f(light2PosLoc, 10.0f, 1.0f, 3.0f); // Side light source for added depth
-	glUniform1f(specInt1Loc, 0.5f); // Specular intensity for a moderate shine
-	glUniform1f(highlghtSz1Loc, 12.f); // Highlight size for a broad specular reflection
-	glUniform1f(specInt2Loc, 0.5f); // Specular intensity for a moderate shine
-	glUniform1f(highlghtSz2Loc, 12.f); // // Highlight size for a broad specular reflection
-
-	/******FIRST DIE*******/
-
-	// Bind the dice mesh VAO
-	glBindVertexArray(meshes.gDiceMesh.vao);
-
-	// UV scaling and transformations for the first dice
-	uvScale = glm::vec2(1.f, 1.f);
-	glUniform2fv(glGetUniformLocation(gProgramId, "uvScale"), 1, glm::value_ptr(uvScale));
-	scale = glm::scale(glm::vec3(.2f, .2f, .2f)); // Scale to size
-	rotation1 = glm::rotate(glm::radians(270.f), glm::vec3(0.f, 0.f, 1.f)); // Rotate vertically
-	rotation2 = glm::rotate(glm::radians(45.f), glm::vec3(1.f, 0.f, 0.f)); // Rotate horizontally
-	glm::mat4 combinedRotation = rotation1 * rotation2; // Combine rotations
-	translation = glm::translate(glm::vec3(-1.9, .1f, 1.6)); // Position on the object
-
-	// Apply transformations and draw the first die
-	model = translation * combinedRotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glDrawElements(GL_TRIANGLES, meshes.gDiceMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	/******SECOND DIE*******/
-
-	// Transformations for the second dice
-	rotation1 = glm::rotate(glm::radians(137.f), glm::vec3(0.f, 1.f, 0.f)); // Imperfect rotation for dynamic look
-	rotation2 = glm::rotate(glm::radians(0.f), glm::vec3(1.f, 0.f, 0.f)); // Reset rotation
-	combinedRotation = rotation1 * rotation2; // Combine rotations
-	translation = glm::translate(glm::vec3(-1.5, .1f, 1.8)); // Position the object
-
-	// Apply transformations and draw the second die
-	model = translation * combinedRotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glDrawElements(GL_TRIANGLES, meshes.gDiceMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	// Cleanup 
-	glBindVertexArray(0);
-
-
-	/*******************************
-	*
-	*			Cards
-	*
-	* ******************************/
-
-	/****** CARD COMMON PROPERTIES *******/
-
-	// Activate the shader program and enable texturing
-	glUseProgram(gProgramId);
-	glUniform1i(glGetUniformLocation(gProgramId, "ubHasTexture"), GL_TRUE);
-
-	// Setup lighting properties for the cards
-	// Diffuse Lighting
-	glUniform3f(light1ColLoc, 0.2f, 0.2f, 0.2f); // Dim white light for a soft appearance
-	glUniform3f(light1PosLoc, 0.0f, 0.0f, 10.0f); // Overhead position for uniform lighting
-
-	// Specular Lighting
-	glUniform3f(light2ColLoc, 0.2f, 0.2f, 0.2f); // Additional light source for minimal specular highlights
-	glUniform3f(light2PosLoc, 10.0f, 1.0f, 3.0f); // Side light position to add depth
-
-
-	glUniform1f(specInt1Loc, 0.0f); // No specular intensity for a matte finish
-	glUniform1f(highlghtSz1Loc, 1.0f); // Broad highlight size for a subtle effect
-	glUniform1f(specInt2Loc, 0.0f); // Repeat specular intensity 
-	glUniform1f(highlghtSz2Loc, 1.0f); // Repeat highlight 
-
-	/****** CHANCE CARDS *******/
-
-	// Bind the box mesh for Chance cards
-	glBindVertexArray(meshes.gBoxMesh.vao);
-
-	/******TOP ANGLED CARD*******/
-	// Transformations for top laying card
-	scale = glm::scale(glm::vec3(1.25f, .002f, .7f)); // Card dimensions
-	rotation = glm::rotate(glm::radians(-3.f), glm::vec3(0.f, 1.f, 0.f)); // Slight rotation 
-	translation = glm::translate(glm::vec3(-.6f, .135f, 2.5f)); // Position on the board
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Texture application for Chance card
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gChanceCard);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, gPaper);
-
-	// Texture blending for appearance
-	uvScale = glm::vec2(1.f, 1.f);
-	glUniform2fv(glGetUniformLocation(gProgramId, "uvScale"), 1, glm::value_ptr(uvScale));
-	float blendFactor = 0.15f; // Blend with paper texture for a worn look
-	glUniform1f(glGetUniformLocation(gProgramId, "blendFactor"), blendFactor);
-
-	// Draw top and bottom parts of the card
-	glDrawArrays(GL_TRIANGLE_FAN, 4, 4); // Top part of the card
-	glDrawArrays(GL_TRIANGLE_FAN, 16, 4); // Bottom part of the card
-
-	/******CARD STACK*******/
-	// Transformations for card stack
-	scale = glm::scale(glm::vec3(1.25f, .125f, .7f));
-	rotation = glm::rotate(glm::radians(-13.f), glm::vec3(0.f, 1.f, 0.f));
-	translation = glm::translate(glm::vec3(-.6f, .07f, 2.5));
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draw top and bottom 
-	glDrawArrays(GL_TRIANGLE_FAN, 4, 4);
-	glDrawArrays(GL_TRIANGLE_FAN, 16, 4);
-
-	// Texture application for stack
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gCardStack);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, gChanceCard);
-
-	// Texture blending 
-	uvScale = glm::vec2(1.f, .35f);
-	uvScale2 = glm::vec2(1.f, .1f);
-	glUniform2fv(glGetUniformLocation(gProgramId, "uvScale"), 1, glm::value_ptr(uvScale));
-	glUniform2fv(glGetUniformLocation(gProgramId, "UvScale2"), 1, glm::value_ptr(uvScale2));
-	blendFactor = .5f;
-	glUniform1f(glGetUniformLocation(gProgramId, "blendFactor"), blendFactor);
-
-	//Draw the sides of the card stack
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 4); // First side
-	glDrawArrays(GL_TRIANGLE_FAN, 8, 4); // Second side
-	glDrawArrays(GL_TRIANGLE_FAN, 12, 4); // Third side
-	glDrawArrays(GL_TRIANGLE_FAN, 20, 4); // Fourth side
-
-	//Transformations for the sides of single card
-	scale = glm::scale(glm::vec3(1.25f, .002f, .7f));
-	rotation = glm::rotate(glm::radians(-3.f), glm::vec3(0.f, 1.f, 0.f));
-	translation = glm::translate(glm::vec3(-.6f, .135f, 2.5));
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	uvScale = glm::vec2(1.f, .01f); //removes any horizontal lines from the card stack texture for the single card
-	glUniform2fv(glGetUniformLocation(gProgramId, "uvScale"), 1, glm::value_ptr(uvScale));
-
-	// Draw the sides of the single card
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-	glDrawArrays(GL_TRIANGLE_FAN, 8, 4);
-	glDrawArrays(GL_TRIANGLE_FAN, 12, 4);
-	glDrawArrays(GL_TRIANGLE_FAN, 20, 4);
-
-	//*****Community Chest*****//
-
-	/******CARD FACES*******/
-
-	// Texture application for community chest faces
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gCommunityChestCard);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, gPaper);
-
-	/******TOP ANGLED CARD*******/
-	
-	// Transformations for top laying card
-	scale = glm::scale(glm::vec3(1.25f, .002f, .7f)); // Card dimensions
-	rotation = glm::rotate(glm::radians(-183.f), glm::vec3(0.f, 1.f, 0.f)); // Slight rotation and opposite facing
-	translation = glm::translate(glm::vec3(.6f, .135f, -2.5f)); // Position on the board
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Texture blending
-	uvScale = glm::vec2(1.f, 1.f);
-	glUniform2fv(glGetUniformLocation(gProgramId, "uvScale"), 1, glm::value_ptr(uvScale));
-	blendFactor = 0.15f; // Blend with paper texture for a worn look
-	glUniform1f(glGetUniformLocation(gProgramId, "blendFactor"), blendFactor);
-
-	// Draw top and bottom parts of the card
-	glDrawArrays(GL_TRIANGLE_FAN, 4, 4); // Top part of the card
-	glDrawArrays(GL_TRIANGLE_FAN, 16, 4); // Bottom part of the card
-
-	/******CARD STACK*******/
-
-	// Transformations for stack below the angled card
-	scale = glm::scale(glm::vec3(1.25f, .125f, .7f));
-	rotation = glm::rotate(glm::radians(-13.f), glm::vec3(0.f, 1.f, 0.f));
-	translation = glm::translate(glm::vec3(.6f, .07f, -2.5));
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draw top and bottom 
-	glDrawArrays(GL_TRIANGLE_FAN, 4, 4);
-	glDrawArrays(GL_TRIANGLE_FAN, 16, 4);
-
-	/******SINGLE CARD ON TOP OF THE MONEY*******/
-
-	// Transformations for single card on top of the money
-	scale = glm::scale(glm::vec3(1.25f, .002f, .7f));
-	rotation = glm::rotate(glm::radians(-60.f), glm::vec3(0.f, 1.f, 0.f));
-	translation = glm::translate(glm::vec3(-.3f, -.990f, 6.8f));
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draw top and bottom 
-	glDrawArrays(GL_TRIANGLE_FAN, 4, 4);
-	glDrawArrays(GL_TRIANGLE_FAN, 16, 4);
-
-	/******SIDES*******/
-
-	// Texture application for community chest card sides
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gCardStack);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, gCommunityChestCard);
-
-	/******CARD STACK*******/
-
-	// Transformations for stack below the angled card
-	scale = glm::scale(glm::vec3(1.25f, .125f, .7f));
-	rotation = glm::rotate(glm::radians(-13.f), glm::vec3(0.f, 1.f, 0.f));
-	translation = glm::translate(glm::vec3(.6f, .07f, -2.5));
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Texture blending 
-	uvScale = glm::vec2(1.f, .35f);
-	uvScale2 = glm::vec2(1.f, .1f);
-	glUniform2fv(glGetUniformLocation(gProgramId, "uvScale"), 1, glm::value_ptr(uvScale));
-	glUniform2fv(glGetUniformLocation(gProgramId, "UvScale2"), 1, glm::value_ptr(uvScale2));
-	blendFactor = .5f;
-	glUniform1f(glGetUniformLocation(gProgramId, "blendFactor"), blendFactor);
-
-	// Sides drawing setup 
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 4); // First side
-	glDrawArrays(GL_TRIANGLE_FAN, 8, 4); // Second side
-	glDrawArrays(GL_TRIANGLE_FAN, 12, 4); // Third side
-	glDrawArrays(GL_TRIANGLE_FAN, 20, 4); // Fourth side
-
-	/******TOP LAYING CARD*******/
-
-	// Transformations for sides
-	scale = glm::scale(glm::vec3(1.25f, .002f, .7f));
-	rotation = glm::rotate(glm::radians(-3.f), glm::vec3(0.f, 1.f, 0.f));
-	translation = glm::translate(glm::vec3(.6f, .135f, -2.5));
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	uvScale = glm::vec2(1.f, .01f); //removes any horizontal lines from the card stack texture for the single card
-	glUniform2fv(glGetUniformLocation(gProgramId, "uvScale"), 1, glm::value_ptr(uvScale));
-
-	// Draw the sides 
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-	glDrawArrays(GL_TRIANGLE_FAN, 8, 4);
-	glDrawArrays(GL_TRIANGLE_FAN, 12, 4);
-	glDrawArrays(GL_TRIANGLE_FAN, 20, 4);
-
-	/******SINGLE CARD ON TOP OF THE MONEY*******/
-
-	// Transformations for single card on top of the money
-	rotation = glm::rotate(glm::radians(-60.f), glm::vec3(0.f, 1.f, 0.f));
-	translation = glm::translate(glm::vec3(-.3f, -.990f, 6.8f));
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draw the sides 
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-	glDrawArrays(GL_TRIANGLE_FAN, 8, 4);
-	glDrawArrays(GL_TRIANGLE_FAN, 12, 4);
-	glDrawArrays(GL_TRIANGLE_FAN, 20, 4);
-
-	// Cleanup 
-	uvScale = glm::vec2(1.f, 1.f);
-	uvScale2 = glm::vec2(1.f, 1.f);
-	glUniform2fv(glGetUniformLocation(gProgramId, "uvScale"), 1, glm::value_ptr(uvScale));
-	glUniform2fv(glGetUniformLocation(gProgramId, "UvScale2"), 1, glm::value_ptr(uvScale2));
-	glBindVertexArray(0);
-
-	/*******************************
-	*
-	*			PROPERTY CARDS
-	*
-	* ******************************/
-
-	/****** PROPERTY CARD COMMON PROPERTIES *******/
-
-	// Activate the shader program and enable texturing
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glUniform1i(glGetUniformLocation(gProgramId, "ubHasTexture"), GL_TRUE);
-
-	// Bind the box mesh for property cards
-	glBindVertexArray(meshes.gBoxMesh.vao);
-
-	// Setup lighting properties for the cards
-	// Diffuse Lighting
-	glUniform3f(light1ColLoc, 0.2f, 0.2f, 0.2f); // Dim white light for a soft appearance
-	glUniform3f(light1PosLoc, 0.0f, 0.0f, 10.0f); // Overhead position for uniform lighting
-
-	// Specular Lighting
-	glUniform3f(light2ColLoc, 0.2f, 0.2f, 0.2f); // Additional light source for minimal specular highlights
-	glUniform3f(light2PosLoc, 10.0f, 1.0f, 3.0f); // Side light position to add depth
-
-
-	glUniform1f(specInt1Loc, 0.0f); // No specular intensity for a matte finish
-	glUniform1f(highlghtSz1Loc, 1.0f); 
-	glUniform1f(specInt2Loc, 0.0f); //
-	glUniform1f(highlghtSz2Loc, 1.0f); 
-
-	/****** PARK PLACE *******/
-
-	// Transformations for Park Place
-	scale = glm::scale(glm::vec3(1.25f, .002f, 1.25f));
-	rotation = glm::rotate(glm::radians(45.f), glm::vec3(0.f, 1.f, 0.f));
-	translation = glm::translate(glm::vec3(-3.f, -1.f, 5.3f));
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Texture application for Park Place
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gParkPlace);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, gSmudge); 
-
-	// Texture blending for appearance
-	blendFactor = 0.08f; // Blend with smudge texture 
-	glUniform1f(glGetUniformLocation(gProgramId, "blendFactor"), blendFactor);
-
-	// Draw Park Place
-	glDrawArrays(GL_TRIANGLE_FAN, 16, 4); //Only need one face
-
-	/****** BOARDWALK *******/
-
-	// Transformations for Boardwalk
-
-	rotation = glm::rotate(glm::radians(33.f), glm::vec3(0.f, 1.f, 0.f));
-	translation = glm::translate(glm::vec3(-2.7f, -.999f, 5.6f));
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Texture application for Boardwalk
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gBoardwalk);
-	// No second texture or blend factor needed for Boardwalk as per previous example
-
-	// Draw Boardwalk
-	glDrawArrays(GL_TRIANGLE_FAN, 16, 4); // Bottom part of the card
-
-	// Cleanup
-	glBindVertexArray(0);
-
-	/*******************************
-	 *
-	 *          Money
-	 *
-	 ******************************/
-
-	 /****** MONEY COMMON PROPERTIES *******/
-
-	 // Activate the shader program and enable texturing
-	glUseProgram(gProgramId);
-	glUniform1i(glGetUniformLocation(gProgramId, "ubHasTexture"), GL_TRUE);
-
-	// Setup lighting properties for the money
-	// Diffuse Lighting
-	glUniform3f(light1ColLoc, 0.2f, 0.2f, 0.2f); // Soft white light for a gentle appearance
-	glUniform3f(light1PosLoc, 0.0f, 0.0f, 10.0f); // Overhead position for even lighting
-
-	// Specular Lighting
-	glUniform3f(light2ColLoc, 0.2f, 0.2f, 0.2f); // Secondary light source for soft highlights
-	glUniform3f(light2PosLoc, 10.0f, 1.0f, 3.0f); // Side light position
-
-	glUniform1f(specInt1Loc, 0.0f); // No specular intensity for a flat finish
-	glUniform1f(highlghtSz1Loc, 1.0f); // Wide highlight size for a soft effect
-	glUniform1f(specInt2Loc, 0.0f); // No specular intensity for the secondary light
-	glUniform1f(highlghtSz2Loc, 1.0f); // Wide highlight size for the secondary light
-
-	// Bind the box mesh for all money denominations
-	glBindVertexArray(meshes.gBoxMesh.vao);
-
-	/****** RENDER MONEY DENOMINATIONS *******/
-
-	// Render each denomination
-	renderMoneyDenomination(g500, glm::vec3(.23f, -.993f, 6.53f), -45.f, modelLoc);
-	renderMoneyDenomination(g100, glm::vec3(.42f, -.994f, 6.45f), -35.f, modelLoc);
-	renderMoneyDenomination(g50, glm::vec3(.6f, -.995f, 6.34f), -25.f, modelLoc);
-	renderMoneyDenomination(g10, glm::vec3(.75f, -.996f, 6.2f), -15.f, modelLoc);
-	renderMoneyDenomination(g5, glm::vec3(.9f, -.997f, 6.05f), -5.f, modelLoc);
-	renderMoneyDenomination(g1, glm::vec3(1.f, -.998f, 5.87f), 5.f, modelLoc);
-
-	// Cleanup 
-	glBindVertexArray(0);
-
-	/*******************************
-	 *
-	 *          Table
-	 *
-	 ******************************/
-
-	 /****** TABLE PLANE *******/
-
-	 // Activate the shader program and enable texturing for the table plane
-	glUseProgram(gProgramId);
-	glUniform1i(glGetUniformLocation(gProgramId, "ubHasTexture"), GL_TRUE);
-
-	// Lighting setup for the table plane
-	// Diffuse lighting
-	glUniform3f(light1ColLoc, 0.4f, 0.4f, 0.4f); // Soft white light
-	glUniform3f(light1PosLoc, 0.0f, 0.0f, 10.0f); // Overhead position
-
-	// Specular lighting
-	glUniform3f(light2ColLoc, 0.4f, 0.4f, 0.4f); // Secondary light source for soft highlights
-	glUniform3f(light2PosLoc, 10.0f, 1.0f, 3.0f); // Side light position
-
-	glUniform1f(specInt1Loc, 1.0f); // High specular intensity
-	glUniform1f(highlghtSz1Loc, 50.f); // Smaller highlight size for sharp reflections
-	glUniform1f(specInt2Loc, 1.0f); // High specular intensity for the secondary light
-	glUniform1f(highlghtSz2Loc, 50.f); // Smaller highlight size for secondary light
-
-	// Bind the table texture and set texture parameters
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gTable);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-	// Bind the VAO
-	glBindVertexArray(meshes.gPlaneMesh.vao);
-
-	// Apply transformations to the table plane
-	translation = glm::translate(glm::vec3(0.0f, -1.01f, 0.f));
-	rotation = glm::rotate(glm::radians(-14.f), glm::vec3(.0f, 1.0f, .0f));
-	scale = glm::scale(glm::vec3(10.0f, 5.0f, 8.0f));
-
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draw the table plane
-	glDrawElements(GL_TRIANGLES, meshes.gPlaneMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	/*******************************
-	 *
-	 *          BOARD SURFACE
-	 *
-	 ******************************/
-
-	// Activate the shader program and enable texturing for the playing surface
-	glUseProgram(gProgramId);
-	glUniform1i(glGetUniformLocation(gProgramId, "ubHasTexture"), GL_TRUE);
-
-	// Lighting setup for the playing surface
-
-	// Diffuse lighting
-	glUniform3f(light1ColLoc, 0.4f, 0.4f, 0.4f); // Soft white light
-	glUniform3f(light1PosLoc, 0.0f, 0.0f, 10.0f); // Overhead position
-	// Specular lighting
-	glUniform3f(light2ColLoc, 0.4f, 0.4f, 0.4f); // Secondary light source for soft highlights
-	glUniform3f(light2PosLoc, 10.0f, 1.0f, 3.0f); // Side light position
-
-	glUniform1f(specInt1Loc, 0.0f); // No specular intensity for a matte finish
-	glUniform1f(highlghtSz1Loc, 100.f); // Broad highlight size for a soft effect
-	glUniform1f(specInt2Loc, 0.0f); // No specular intensity for the secondary light
-	glUniform1f(highlghtSz2Loc, 100.f); // Broad highlight size for the secondary light
-
-	// Bind the board and stitching textures
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gBoard);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, gStitch);
-
-	// Apply transformations to the board plane
-	scale = glm::scale(glm::vec3(4.0f, 1.0f, 4.0f));
-	rotation = glm::rotate(-45.0f, glm::vec3(0.0f, 1.0f, 0.0f));
-	translation = glm::translate(glm::vec3(0.0f, 0.f, 0.f));
-
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	//Apply uv scaling and blending 
-	uvScale = glm::vec2(10.f, 10.f);
-	blendFactor = .15f;
-
-	// Apply custom scaling to stitching texture and set blend factor
-	glUniform2fv(glGetUniformLocation(gProgramId, "UvScale2"), 1, glm::value_ptr(uvScale));
-	glUniform1f(glGetUniformLocation(gProgramId, "blendFactor"), blendFactor);
-
-	// Draws the playing surface
-	glDrawElements(GL_TRIANGLES, meshes.gPlaneMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	// Cleanup after rendering
-	glBindVertexArray(0);
-
-	/*******************************
-	 *
-	 *          BOARD FRAME
-	 *
-	 ******************************/
-	
-	 // Activate the shader program and enable texturing 
-	glUseProgram(gProgramId);
-	glUniform1i(glGetUniformLocation(gProgramId, "ubHasTexture"), GL_TRUE);
-
-	// Lighting setup for the playing surface
-
-	// Diffuse lighting
-	glUniform3f(light1ColLoc, 0.4f, 0.4f, 0.4f); // Soft white light
-	glUniform3f(light1PosLoc, 0.0f, 0.0f, 10.0f); // Overhead position
-	// Specular lighting
-	glUniform3f(light2ColLoc, 0.4f, 0.4f, 0.4f); // Secondary light source for soft highlights
-	glUniform3f(light2PosLoc, 10.0f, 1.0f, 3.0f); // Side light position
-
-	glUniform1f(specInt1Loc, 0.9f); // high sheen
-	glUniform1f(highlghtSz1Loc, 10.f); // small highlight size 
-	glUniform1f(specInt2Loc, 0.9f); 
-	glUniform1f(highlghtSz2Loc, 10.f); 
-
-	// Base wood grain texture
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gWoodGrain);
-	glUniform1i(glGetUniformLocation(gProgramId, "uTexture"), 0);
-
-	// Noise texture 
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, gNoise);
-	glUniform1i(glGetUniformLocation(gProgramId, "uSecondTexture"), 1);
-
-	// Bind the VAO
-	glBindVertexArray(meshes.gBoxMesh.vao);
-
-	// Apply transformations to the board plane
-	scale = glm::scale(glm::vec3(8.5f, 1.0f, 8.5f));
-	rotation = glm::rotate(-45.f, glm::vec3(0.0, 1.0f, 0.0f));
-	translation = glm::translate(glm::vec3(0.0f, -.501, 0.0f));
-
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	//Apply uv scaling and blending 
-	//Wood texture uv scaling
-	glm::vec2 uvScaleSides(1.f, .3f);
-	glm::vec2 uvScaleTopBottom(1.0f, 1.0f);
-
-	//Noise texture uv scaling
-	glm::vec2 noiseUvScaleTopBottom = glm::vec2(1.0f, 1.0f);
-	glm::vec2 noiseUvScaleSides = glm::vec2(10.f, .5f);
-
-	//Apply side scaling
-	glUniform2fv(glGetUniformLocation(gProgramId, "uvScale"), 1, glm::value_ptr(uvScaleSides));
-	glUniform2fv(glGetUniformLocation(gProgramId, "UvScale2"), 1, glm::value_ptr(noiseUvScaleSides));
-	
-	//Apply blending
-	blendFactor = .15f;
-	glUniform1f(blendFactorLocation, blendFactor);
 
-	// Apply custom scaling to stitching texture and set blend factor
-	glUniform2fv(glGetUniformLocation(gProgramId, "UvScale2"), 1, glm::value_ptr(uvScale));
-	glUniform1f(glGetUniformLocation(gProgramId, "blendFactor"), blendFactor);
+// Functioned called to render a frame
+void URender()
+{
+	PROFILE_FUNCTION();
+	glm::mat4 view;
+	glm::mat4 projection;
 
-	// Draw the sides
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-	glDrawArrays(GL_TRIANGLE_FAN, 8, 4);
-	glDrawArrays(GL_TRIANGLE_FAN, 12, 4);
-	glDrawArrays(GL_TRIANGLE_FAN, 20, 4);
+	// Programs rebuilt from edited shader files swap in before anything is drawn
+	UReloadShaders();
 
-	//Set uv scaling for top and bottom
-	glUniform2fv(glGetUniformLocation(gProgramId, "uvScale"), 1, glm::value_ptr(uvScaleTopBottom));
-	glUniform2fv(glGetUniformLocation(gProgramId, "UvScale2"), 1, glm::value_ptr(noiseUvScaleTopBottom));
+	// Every pass of the frame adds its binds, the shadow and occluder depth passes included
+	gSceneBatch.lastSubmitStateChanges = 0;
 
-	//Draw top and bottom
-	glDrawArrays(GL_TRIANGLE_FAN, 4, 4);
-	glDrawArrays(GL_TRIANGLE_FAN, 16, 4);
+	// Enable z-depth
+	glEnable(GL_DEPTH_TEST);
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
-	// Cleanup 
-	glUniform1f(blendFactorLocation, defaultBlendFactor); //resets blending
-	glBindVertexArray(0);
+	// Transforms the camera
+	// Calculate camera's position in polar coordinates
+	view = gCamera.GetViewMatrix();
 
+	// Creates a projection using isOrthographic value
+	if (isOrthographic)
+	{
+		projection = glm::ortho(-15.f, 15.f, -15.f, 15.f, NEAR_PLANE, FAR_PLANE);
+	}
+	else
+	{
+		// Headless frames keep the shape of the requested resolution
+		GLfloat aspect = gHeadless ? (GLfloat)gHeadlessWidth / (GLfloat)gHeadlessHeight : (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT;
+		projection = glm::perspective(glm::radians(gCamera.Zoom), aspect, NEAR_PLANE, FAR_PLANE);
+	}
 
-	/*******************************
-	 *
-	 *          Hotels
-	 *
-	 ******************************/
+	// Static model and normal matrices, fetched by draw ID
+	gTransforms.Bind(TRANSFORM_TEXTURE_UNIT);
+	gLightmaps.Bind();
 
-	/****** HOTEL COMMON PROPERTIES *******/
+	// Take the next frame region, waiting if the GPU still reads it
+	gFrameRing.BeginFrame();
 
-	// Activate shader program and enable texturing
-	glUseProgram(gProgramId);
-	glUniform1i(glGetUniformLocation(gProgramId, "ubHasTexture"), GL_TRUE);
+	// The GPU is done with the last frame that used this region, collect its occlusion count
+	gHiZ.ReadResults(gFrameRing.Region());
 
-	// Diffuse lighting for soft illumination
-	glUniform3f(light1ColLoc, .3f, .6f, .6f); // moderate lighting with some red removed to prevent intense color
-	glUniform3f(light1PosLoc, 0.0f, 0.0f, 10.0f); // Overhead position
-	
-	// Specular lighting for a slight glossy appearance
-	glUniform3f(light2ColLoc, 0.3f, 0.6f, 0.6f); // moderate lighting with some red removed to prevent intense color
-	glUniform3f(light2PosLoc, 10.0f, 0.0f, 20.f); // Side light position
-	glUniform1f(specInt1Loc, 0.8f); // Specular intensity for light source 1
-	glUniform1f(highlghtSz1Loc, 10.f); // Highlight size for a focused effect
-	glUniform1f(specInt2Loc, .8f); // Specular intensity for light source 2
-	glUniform1f(highlghtSz2Loc, 10.f); // Highlight size for a focused effect
-	
-	// Set texture and bind VBO
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gRedWoodGrain);
-	glBindVertexArray(meshes.gBoxMesh.vao);
+	// Likewise for its GPU pass times, kept apart for forward and deferred shading
+	gGpuTimer.Read(gFrameRing.Region());
+	if (gGpuTimer.lastMs[GPU_PASS_SURFACE] > 0.0)
+	{
+		int shading = gRegionDeferred[gFrameRing.Region()];
+		for (int pass = GPU_PASS_SURFACE; pass <= GPU_PASS_LIGHTING; ++pass)
+			gGpuMsTotal[shading][pass] += gGpuTimer.lastMs[pass];
+		++gGpuFrames[shading];
+
+		int shadowMode = gRegionShadowMode[gFrameRing.Region()];
+		gShadowMsTotal[shadowMode] += gGpuTimer.lastMs[GPU_PASS_STATIC_SHADOW] + gGpuTimer.lastMs[GPU_PASS_DYNAMIC_SHADOW];
+		++gShadowFrames[shadowMode];
+
+		// MSAA costs mostly in the scene passes, FXAA and TAA in their own
+		int antiAliasing = gRegionAntiAliasing[gFrameRing.Region()];
+		gAntiAliasingSceneMs[antiAliasing] += gGpuTimer.lastMs[GPU_PASS_SURFACE] + gGpuTimer.lastMs[GPU_PASS_LIGHTING];
+		gAntiAliasingPassMs[antiAliasing] += gGpuTimer.lastMs[GPU_PASS_ANTIALIASING];
+		++gAntiAliasingFrames[antiAliasing];
+	}
+	if (gGpuTimer.lastMs[GPU_PASS_TONEMAPPING] > 0.0)
+	{
+		gToneMappingMsTotal += gGpuTimer.lastMs[GPU_PASS_TONEMAPPING];
+		++gToneMappingFrames;
+	}
+	// Section times of the same frame, its surface pass time only holds the setup and depth pre-pass
+	gSectionTimer.Read(gFrameRing.Region());
+	if (gRegionSectionTiming[gFrameRing.Region()])
+		URecordSectionTimes();
+	if (gGpuTimer.lastMs[GPU_PASS_STATIC_SHADOW] > 0.0)
+		gLastStaticShadowMs = gGpuTimer.lastMs[GPU_PASS_STATIC_SHADOW];
+
+	// The resolution controller holds the GPU time of the whole frame
+	double gpuFrameMs = 0.0;
+	for (int pass = 0; pass < GPU_PASS_COUNT; ++pass)
+		gpuFrameMs += gGpuTimer.lastMs[pass];
+	for (double sectionMs : gSectionTimer.lastMs)
+		gpuFrameMs += sectionMs;
+	gDynamicResolution.Update(gFrameRing.Region(), gpuFrameMs);
+
+	// Clear the frame and z buffers, of the scaled scene target or of the window
+	int framebufferWidth, framebufferHeight;
+	glfwGetFramebufferSize(gWindow, &framebufferWidth, &framebufferHeight);
+	gDynamicResolution.Begin(gFrameRing.Region(), framebufferWidth, framebufferHeight);
+	GLsizei renderWidth = gDynamicResolution.renderWidth;
+	GLsizei renderHeight = gDynamicResolution.renderHeight;
+
+	// The scene renders into the float target, tonemapped into the frame's target at the end
+	gToneMapping.Begin(renderWidth, renderHeight, framebufferWidth, framebufferHeight);
+
+	// Anti-aliasing renders the scene into its own target at the same size, in float when it resolves into the
+	// tonemapping target; TAA also jitters the projection
+	gAntiAliasing.SetColorFormat(gToneMapping.Active() ? GL_RGBA16F : GL_RGBA8);
+	gAntiAliasing.Begin(renderWidth, renderHeight, framebufferWidth, framebufferHeight);
+	glm::mat4 viewProjection = projection * view;
+	projection = gAntiAliasing.Jitter(projection, renderWidth, renderHeight);
+
+	// Propagate moved nodes to their draws before anything reads the transforms or bounds
+	auto updateStart = std::chrono::steady_clock::now();
+	UUpdateTransforms();
+	double updateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - updateStart).count();
+
+	// Shadow maps of the key light, the static one only when something in it moved
+	bool shadows = gShadowMode != SHADOWS_OFF && gShadows.supported;
+	if (shadows)
+		URenderShadows();
+
+	// Passes the camera transforms, the camera view location and the scene's ambient lighting
+	FrameRing::Allocation frame = gFrameRing.Allocate(sizeof(FrameData), gUniformAlignment);
+	FrameData* frameData = static_cast<FrameData*>(frame.data);
+	frameData->view = view;
+	frameData->projection = projection;
+	frameData->viewPosition = glm::vec4(gCamera.Position, 1.0f);
+	frameData->ambientLight = AMBIENT_LIGHT;
+	frameData->staticShadowMatrix = gShadows.staticShadowMatrix;
+	frameData->dynamicShadowMatrix = gShadows.dynamicShadowMatrix;
+	frameData->keyLightDirection = glm::vec4(KEY_LIGHT_DIRECTION, 0.0f);
+	frameData->keyLightColor = glm::vec4(KEY_LIGHT_COLOR, 1.0f);
+	frameData->shadowParams = glm::vec4(shadows ? 1.0f : 0.0f, 1.5f * gShadows.staticTexelSize, 1.5f * gShadows.dynamicTexelSize, 0.0f);
+	frameData->lightmapParams = glm::vec4(gUseLightmaps ? 1.0f : 0.0f, 0.0f, 0.0f, 0.0f);
+	glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, gFrameRing.buffer, frame.offset, frame.size);
+
+	// Bin the scene lights into the cells of this view, fragments only iterate the lights of their cell
+	auto lightStart = std::chrono::steady_clock::now();
+	gLightClusters.Build(gFrameRing, gScene.lights, gSceneGraph, view, projection, NEAR_PLANE, FAR_PLANE,
+		renderWidth, renderHeight, gClusteredLights);
+	double lightBinMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - lightStart).count();
+
+	// Keep only the draws whose bounds touch the view frustum, sorted in the order of the submit path
+	auto drawListStart = std::chrono::steady_clock::now();
+	Frustum frustum;
+	frustum.Extract(projection * view);
+	gDrawList.Build(gJobs, gThreadedDrawList, gSceneBvh, gFrustumCulling ? &frustum : nullptr,
+		gSceneBatch, gUseIndirect, gVisibleIds);
+	double drawListMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - drawListStart).count();
+
+	// Submit the static scene and time the CPU side of the submission
+	auto submitStart = std::chrono::steady_clock::now();
+	bool sectionTiming = USectionTiming();
+	bool occlusion = gUseIndirect && gOcclusionCulling && gHiZ.supported;
+	bool deferred = gUseIndirect && gDeferredShading && gDeferredSupported;
+	if (sectionTiming)
+		USplitSections();
+	if (gUseIndirect)
+	{
+		// Timed sections need their commands laid out section after section, before the GPU culls them
+		gSceneBatch.PrepareIndirect(gFrameRing, sectionTiming ? gSectionOrderIds : gVisibleIds, occlusion, sectionTiming);
+		if (occlusion)
+		{
+			// Render the visible occluders depth only, then drop the commands they hide
+			gOccluderIds.clear();
+			for (GLuint id : gVisibleIds)
+			{
+				if (gScene.draws[id].occluder)
+					gOccluderIds.push_back(id);
+			}
+
+			glUseProgram(gDepthProgramId);
+			gHiZ.BeginOcclusion();
+			gSceneBatch.SubmitDepthOnly(gFrameRing, gOccluderIds);
+			gHiZ.EndOcclusion();
+			gHiZ.Cull(gSceneBatch.prepared, projection * view, gFrameRing.Region());
+		}
 
-	std::vector<glm::mat4> modelMatrices; //list of hotel transformations
-	
-	/****** HOTEL BASE BOX *******/
+		// Forward shading draws to the window, the deferred path to the G-buffer
+		gGpuTimer.Begin(GPU_PASS_SURFACE, gFrameRing.Region());
+		if (deferred)
+			deferred = gDeferred.BeginGeometry(framebufferWidth, framebufferHeight);
 
-	// Transformations for the base
-	scale = glm::scale(glm::vec3(.3f, .25f, .25f));
-	rotation = glm::rotate(10.f, glm::vec3(0.0, 5.0f, 0.0f));
-	translation = glm::translate(glm::vec3(-.6f, 0.11f, 3.97f));
+		// Lay down depth first so the lighting only runs for the nearest fragment of each pixel
+		if (gDepthPrepass)
+		{
+			glUseProgram(gDepthProgramId);
+			glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+			gSceneBatch.SubmitIndirectDepth();
+			glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+			glDepthFunc(GL_EQUAL);
+			glDepthMask(GL_FALSE);
+		}
 
-	//middle hotel
-	model = translation * rotation * scale;
-	modelMatrices.push_back(model);
+		// Queries cannot nest, so when the sections are timed the surface pass only holds its setup and the depth pre-pass
+		const ShaderPermutations& programs = deferred ? gGBufferPrograms : gIndirectPrograms;
+		if (sectionTiming)
+		{
+			gGpuTimer.End();
+			USubmitSectionsIndirect(programs);
+		}
+		else
+			gSceneBatch.SubmitIndirect(programs);
 
-	//right hotel
-	translation = glm::translate(glm::vec3(.5f, 0.11f, 3.3f));
+		if (gDepthPrepass)
+		{
+			glDepthFunc(GL_LESS);
+			glDepthMask(GL_TRUE);
+		}
+		if (!sectionTiming)
+			gGpuTimer.End();
 
-	model = translation * rotation * scale;
-	modelMatrices.push_back(model);
+		// Light every covered pixel once from the G-buffer
+		if (deferred)
+		{
+			gDeferred.EndGeometry();
+			// TAA reprojects its history with the scene depth, which only the G-buffer holds
+			if (gAntiAliasing.ReadsDepth())
+				gDeferred.CopyDepth();
+			gGpuTimer.Begin(GPU_PASS_LIGHTING, gFrameRing.Region());
+			gDeferred.Light(gDeferredLightingProgramId, glm::inverse(projection * view));
+			gGpuTimer.End();
+		}
+	}
+	else if (sectionTiming)
+		USubmitSections();
+	else if (gReplay)
+	{
+		gGpuTimer.Begin(GPU_PASS_SURFACE, gFrameRing.Region());
+		// Re-record only when a different set of draws survives culling
+		if (gCommandStream.Empty() || gVisibleIds != gRecordedIds)
+		{
+			gSceneBatch.RecordLoop(gCommandStream, gVisibleIds, gSurfacePrograms);
+			gRecordedIds = gVisibleIds;
+			++gStreamRecordings;
+		}
+		else
+		{
+			// Every recorded command but the draws binds state
+			gSceneBatch.lastSubmitStateChanges += static_cast<GLsizei>(gCommandStream.Size()) - gCommandStream.drawCalls;
+		}
+		gCommandStream.Replay();
+		gGpuTimer.End();
+	}
+	else
+	{
+		gGpuTimer.Begin(GPU_PASS_SURFACE, gFrameRing.Region());
+		gSceneBatch.SubmitLoop(gFrameRing, gVisibleIds, gSurfacePrograms);
+		gGpuTimer.End();
+	}
+	double submitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - submitStart).count();
 
-	//left hotel
-	scale = glm::scale(glm::vec3(.25f, .25f, .3f));
-	rotation = glm::rotate(glm::radians(33.f), glm::vec3(0.0, 1.f, 0.0f));
-	translation = glm::translate(glm::vec3(-2.96f, 0.11f, 1.05f));
+	// Resolve or filter the anti-aliasing target into the float target, the scene target or the window
+	if (gAntiAliasing.Active())
+	{
+		PROFILE_ZONE("AntiAliasing::End");
+		gGpuTimer.Begin(GPU_PASS_ANTIALIASING, gFrameRing.Region());
+		gAntiAliasing.End(viewProjection);
+		gGpuTimer.End();
+	}
 
-	model = translation * rotation * scale;
-	modelMatrices.push_back(model);
+	// Expose and tonemap the float target into the scene target or the window
+	if (gToneMapping.Active())
+	{
+		PROFILE_ZONE("ToneMapping::End");
+		gGpuTimer.Begin(GPU_PASS_TONEMAPPING, gFrameRing.Region());
+		gToneMapping.End(gDeltaTime);
+		gGpuTimer.End();
+	}
 
-	for (const auto& modelMatrix : modelMatrices) {
-		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(modelMatrix));
-		// Draw base
-		glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+	// Upscale and sharpen the scene target into the window, inside the region so its time is read with the others
+	if (gDynamicResolution.Offscreen())
+	{
+		PROFILE_ZONE("DynamicResolution::End");
+		gGpuTimer.Begin(GPU_PASS_UPSCALE, gFrameRing.Region());
+		gDynamicResolution.End();
+		gGpuTimer.End();
+		gRenderScaleTotal += static_cast<double>(renderWidth) / framebufferWidth;
+		++gRenderScaleFrames;
 	}
 
-	modelMatrices.clear(); //clear models list
+	// Section times over the finished frame, at the window resolution
+	if (gSectionOverlay)
+		gTextOverlay.Draw(USectionOverlayLines(), framebufferWidth, framebufferHeight);
+
+	// The region may be reused once the GPU has executed this frame
+	gRegionDeferred[gFrameRing.Region()] = deferred;
+	gRegionShadowMode[gFrameRing.Region()] = shadows ? gShadowMode : SHADOWS_OFF;
+	gRegionAntiAliasing[gFrameRing.Region()] = gAntiAliasing.mode;
+	gRegionSectionTiming[gFrameRing.Region()] = sectionTiming;
+	gFrameRing.EndFrame();
+
+	gFrameStats.draws = gSceneBatch.lastSubmitDraws;
+	gFrameStats.culled = gSceneBatch.drawCount - gSceneBatch.lastSubmitDraws;
+	gFrameStats.occluded = occlusion ? gHiZ.lastOccluded : 0;
+	gFrameStats.nodesUpdated = static_cast<int>(gUpdatedNodes.size());
+	gFrameStats.updateMs += updateMs;
+	gFrameStats.submitCalls = gSceneBatch.lastSubmitCalls;
+	gFrameStats.programChanges = gSceneBatch.lastSubmitPrograms;
+	gFrameStats.stateChanges = gSceneBatch.lastSubmitStateChanges;
+	gFrameStats.triangles = gSceneBatch.lastSubmitTriangles;
+	gFrameStats.drawListJobs = static_cast<int>(gDrawList.lastJobCount);
+	gFrameStats.drawListMs += drawListMs;
+	gFrameStats.lights = static_cast<int>(gLightClusters.lastLights);
+	gFrameStats.litClusters = static_cast<int>(gLightClusters.lastLitClusters);
+	gFrameStats.lightIndices = static_cast<int>(gLightClusters.lastIndices);
+	gFrameStats.maxClusterLights = static_cast<int>(gLightClusters.lastMaxPerCluster);
+	gFrameStats.lightBinMs += lightBinMs;
+	gFrameStats.gpuSurfaceMs += gGpuTimer.lastMs[GPU_PASS_SURFACE];
+	gFrameStats.gpuLightingMs += gGpuTimer.lastMs[GPU_PASS_LIGHTING];
+	gFrameStats.gpuStaticShadowMs += gGpuTimer.lastMs[GPU_PASS_STATIC_SHADOW];
+	gFrameStats.gpuDynamicShadowMs += gGpuTimer.lastMs[GPU_PASS_DYNAMIC_SHADOW];
+	gFrameStats.staticShadowDraws = shadows ? static_cast<int>(gShadows.staticIds.size()) : 0;
+	gFrameStats.dynamicShadowDraws = shadows ? static_cast<int>(gShadows.dynamicIds.size()) : 0;
+	gFrameStats.renderWidth = renderWidth;
+	gFrameStats.renderHeight = renderHeight;
+	gFrameStats.gpuFrameMs += gpuFrameMs;
+	gFrameStats.gpuUpscaleMs += gGpuTimer.lastMs[GPU_PASS_UPSCALE];
+	gFrameStats.gpuAntiAliasingMs += gGpuTimer.lastMs[GPU_PASS_ANTIALIASING];
+	gFrameStats.gpuToneMappingMs += gGpuTimer.lastMs[GPU_PASS_TONEMAPPING];
+	gFrameStats.submitMs += submitMs;
+	gFrameStats.fenceWaitMs += gFrameRing.lastWaitMs;
+	gFrameStats.frameMs += gDeltaTime * 1000.0;
+	++gFrameStats.frames;
+
+	gSubmitMsTotal[USubmitMode()] += submitMs;
+	++gSubmitFrames[USubmitMode()];
+	gDrawListMsTotal[gThreadedDrawList] += drawListMs;
+	++gDrawListFrames[gThreadedDrawList];
+
+	// Headless frames are read back from the capture framebuffer instead
+	if (!gHeadless)
+	{
+		PROFILE_ZONE("glfwSwapBuffers");
+		glfwSwapBuffers(gWindow);
+	}
+}
 
-	/****** HOTEL OVERHANG BOX *******/
 
-	//middle hotel
-	scale = glm::scale(glm::vec3(.3f, .05f, .3f));
-	rotation = glm::rotate(10.f, glm::vec3(0.0, 5.0f, 0.0f));
-	translation = glm::translate(glm::vec3(.5f, .23f, 3.3f));
+///////////////////////////////////////////////////
+//	URenderShadows()
+//
+//	Render the shadow maps of the key light with
+//	the depth only program. The static map is kept
+//	until one of its draws moves (every frame when
+//	uncached), the dynamic overlay is redrawn every
+//	frame. Leaves the maps bound for the lighting
+///////////////////////////////////////////////////
+void URenderShadows()
+{
+	PROFILE_FUNCTION();
+	gShadows.Invalidate(gMovedIds);
+	if (gShadowMode == SHADOWS_UNCACHED)
+		gShadows.staticValid = false;
+	gShadows.Fit(KEY_LIGHT_DIRECTION, gSceneBvh.drawBounds);
+
+	glUseProgram(gDepthProgramId);
+	if (!gShadows.staticValid)
+	{
+		FrameRing::Allocation light = gFrameRing.Allocate(sizeof(FrameData), gUniformAlignment);
+		FrameData* lightData = static_cast<FrameData*>(light.data);
+		lightData->view = gShadows.lightView;
+		lightData->projection = gShadows.staticProjection;
+		glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, gFrameRing.buffer, light.offset, light.size);
+
+		gGpuTimer.Begin(GPU_PASS_STATIC_SHADOW, gFrameRing.Region());
+		gShadows.BeginStatic();
+		gSceneBatch.SubmitDepthOnly(gFrameRing, gShadows.staticIds);
+		gShadows.EndStatic();
+		gGpuTimer.End();
+		++gStaticShadowRenders;
+		++gFrameStats.staticShadowRenders;
+	}
 
-	model = translation * rotation * scale;
-	modelMatrices.push_back(model);
+	FrameRing::Allocation light = gFrameRing.Allocate(sizeof(FrameData), gUniformAlignment);
+	FrameData* lightData = static_cast<FrameData*>(light.data);
+	lightData->view = gShadows.lightView;
+	lightData->projection = gShadows.dynamicProjection;
+	glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, gFrameRing.buffer, light.offset, light.size);
 
-	//right hotel
-	translation = glm::translate(glm::vec3(-.6f, .23f, 3.97f));
+	gGpuTimer.Begin(GPU_PASS_DYNAMIC_SHADOW, gFrameRing.Region());
+	gShadows.BeginDynamic();
+	gSceneBatch.SubmitDepthOnly(gFrameRing, gShadows.dynamicIds);
+	gShadows.EndDynamic();
+	gGpuTimer.End();
 
-	model = translation * rotation * scale;
-	modelMatrices.push_back(model);
+	gShadows.Bind();
+}
 
-	//left hotel
-	rotation = glm::rotate(glm::radians(33.f), glm::vec3(0.0, 1.f, 0.0f));
-	translation = glm::translate(glm::vec3(-2.96f, .23f, 1.05f));
 
-	model = translation * rotation * scale;
-	modelMatrices.push_back(model);
+// Index of the active submit mode into SUBMIT_MODE_NAMES
+int USubmitMode()
+{
+	if (gUseIndirect)
+		return 1;
+	return gReplay && !USectionTiming() ? 2 : 0;
+}
 
-	for (const auto& modelMatrix : modelMatrices) {
-		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(modelMatrix));
-		// Draw overhangs
-		glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-	}
-	
-	modelMatrices.clear();//clear models list
-	glBindVertexArray(0);
 
-	/****** HOTEL ROOF PRISM *******/
-	// Activate the VBO
-	glBindVertexArray(meshes.gPrismMesh.vao);
 
-	//middle hotel
-	scale = glm::scale(glm::vec3(.3f, .3f, .1f));
-	rotation1 = glm::rotate(glm::radians(-90.f), glm::vec3(1.f, 0.f, 0.0f));
-	rotation2 = glm::rotate(glm::radians((303.f)), glm::vec3(0.f, 0.f, 1.0f));
-	combinedRotation = rotation1 * rotation2;
-	translation = glm::translate(glm::vec3(.5f, .305f, 3.3f));
+// Whether this frame times the scene sections, for the overlay or the CSV
+bool USectionTiming()
+{
+	return gSectionOverlay || gSectionCsv.is_open();
+}
 
-	model = translation * combinedRotation * scale;
 
-	modelMatrices.push_back(model);
+// Splits the visible draws by section, each keeping the submit order, and lays them out section after section
+void USplitSections()
+{
+	for (std::vector<GLuint>& ids : gSectionIds)
+		ids.clear();
+	for (GLuint id : gVisibleIds)
+		gSectionIds[gScene.draws[id].section].push_back(id);
+
+	gSectionOrderIds.clear();
+	for (const std::vector<GLuint>& ids : gSectionIds)
+		gSectionOrderIds.insert(gSectionOrderIds.end(), ids.begin(), ids.end());
+}
 
-	//right hotel
-	translation = glm::translate(glm::vec3(-.6f, .305f, 3.97f));
-	model = translation * combinedRotation * scale;
 
-	modelMatrices.push_back(model);
+// Draws the prepared indirect commands section by section, each inside its own GL_TIME_ELAPSED query with one
+// multi-draw per bucket of the section. Forward and deferred shading split alike, into the window or the G-buffer.
+void USubmitSectionsIndirect(const ShaderPermutations& programs)
+{
+	PROFILE_FUNCTION();
+	for (const SceneBatch::SectionBuckets& range : gSceneBatch.preparedSections)
+	{
+		gSectionTimer.Begin(static_cast<int>(range.section), gFrameRing.Region());
+		gSceneBatch.SubmitIndirect(programs, range.firstBucket, range.bucketCount);
+		gSectionTimer.End();
+	}
+}
 
-	//left hotel
 
-	rotation1 = glm::rotate(glm::radians(-90.f), glm::vec3(1.f, 0.f, 0.0f));
-	rotation2 = glm::rotate(glm::radians(-147.f), glm::vec3(0.f, 0.f, 1.0f));
-	translation = glm::translate(glm::vec3(-2.96, .305f, 1.05f));
-	combinedRotation = rotation1 * rotation2;
+// Submits the visible draws section by section through the draw loop, each inside its own GL_TIME_ELAPSED query.
+// Queries cannot nest, so the surface pass is not timed as a whole in these frames.
+void USubmitSections()
+{
+	PROFILE_FUNCTION();
+	GLsizei calls = 0, programs = 0, draws = 0, triangles = 0;
+	for (size_t section = 0; section < gSectionIds.size(); ++section)
+	{
+		if (gSectionIds[section].empty())
+			continue;
 
-	model = translation * combinedRotation * scale;
-	modelMatrices.push_back(model);
+		gSectionTimer.Begin(static_cast<int>(section), gFrameRing.Region());
+		gSceneBatch.SubmitLoop(gFrameRing, gSectionIds[section], gSurfacePrograms);
+		gSectionTimer.End();
 
-	for (const auto& modelMatrix : modelMatrices) {
-		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(modelMatrix));
-		// Draw roofs
-		glDrawArrays(GL_TRIANGLE_STRIP, 0, meshes.gPrismMesh.nVertices);
+		calls += gSceneBatch.lastSubmitCalls;
+		programs += gSceneBatch.lastSubmitPrograms;
+		draws += gSceneBatch.lastSubmitDraws;
+		triangles += gSceneBatch.lastSubmitTriangles;
 	}
 
-	modelMatrices.clear();//clear models list
+	// Counters of the whole submit, as the other paths report them; the state changes add up by themselves
+	gSceneBatch.lastSubmitCalls = calls;
+	gSceneBatch.lastSubmitPrograms = programs;
+	gSceneBatch.lastSubmitDraws = draws;
+	gSceneBatch.lastSubmitTriangles = triangles;
+}
 
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
-	
-	/*******************************
-	 *
-	 *          Houses
-	 *
-	 ******************************/
 
-	 /****** HOUSE COMMON PROPERTIES *******/
+// Feeds the section times just read to the overlay averages and appends them to the CSV
+void URecordSectionTimes()
+{
+	double totalMs = 0.0;
+	for (size_t section = 0; section < gSectionSmoothedMs.size(); ++section)
+	{
+		double ms = gSectionTimer.lastMs[section];
+		gSectionSmoothedMs[section] += SECTION_SMOOTHING * (ms - gSectionSmoothedMs[section]);
+		totalMs += ms;
+	}
 
-	// Activate shader program and enable texturing
-	glUseProgram(gProgramId);
-	glUniform1i(glGetUniformLocation(gProgramId, "ubHasTexture"), GL_TRUE);
+	if (gSectionCsv.is_open())
+	{
+		gSectionCsv << gSectionCsvRows++;
+		for (double ms : gSectionTimer.lastMs)
+			gSectionCsv << "," << ms;
+		gSectionCsv << "," << totalMs << "\n";
+	}
+}
 
-	// Set texture for the houses
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gGreenWoodGrain);
 
-	// Diffuse and specular lighting setup for houses
-	glUniform3f(light1ColLoc, .3f, .3f, .3f); // soft white lighting
-	glUniform3f(light1PosLoc, 0.0f, 0.0f, 10.0f); // Overhead position
+// Overlay text: the smoothed time of every section, costliest first
+std::vector<std::string> USectionOverlayLines()
+{
+	std::vector<size_t> order(gSectionSmoothedMs.size());
+	double totalMs = 0.0;
+	for (size_t section = 0; section < order.size(); ++section)
+	{
+		order[section] = section;
+		totalMs += gSectionSmoothedMs[section];
+	}
+	std::sort(order.begin(), order.end(), [](size_t a, size_t b) { return gSectionSmoothedMs[a] > gSectionSmoothedMs[b]; });
 
-	// Specular lighting for a slight glossy appearance
-	glUniform3f(light2ColLoc, 0.6f, 0.6f, 0.6f); // moderate lighting 
-	glUniform3f(light2PosLoc, 10.0f, 0.0f, 20.f); // Side light position
-	glUniform1f(specInt1Loc, 0.8f); // Specular intensity for light source 1
-	glUniform1f(highlghtSz1Loc, 10.f); // Highlight size for a focused effect
-	glUniform1f(specInt2Loc, .8f); // Specular intensity for light source 2
-	glUniform1f(highlghtSz2Loc, 10.f); // Highlight size for a focused effect
+	std::vector<std::string> lines;
+	lines.push_back("GPU SECTIONS      MS      %");
+	char line[64];
+	for (size_t section : order)
+	{
+		snprintf(line, sizeof(line), "%-14.14s %6.3f %5.1f%%", gScene.sections[section].c_str(), gSectionSmoothedMs[section],
+			totalMs > 0.0 ? 100.0 * gSectionSmoothedMs[section] / totalMs : 0.0);
+		lines.push_back(line);
+	}
+	snprintf(line, sizeof(line), "%-14s %6.3f", "TOTAL", totalMs);
+	lines.push_back(line);
+	return lines;
+}
 
-	glBindVertexArray(meshes.gBoxMesh.vao);
 
-	/****** HOUSE BASE BOX *******/
+// Prints the averaged frame statistics once every STATS_INTERVAL seconds
+void UReportFrameStats()
+{
+	double now = glfwGetTime();
+	if (now - gLastStatsTime < STATS_INTERVAL || gFrameStats.frames == 0)
+		return;
+
+	cout << "INFO: " << SUBMIT_MODE_NAMES[USubmitMode()] << " submit: "
+		<< gFrameStats.draws << " draws, "
+		<< gFrameStats.culled << " culled, "
+		<< gFrameStats.occluded << " occluded, "
+		<< gFrameStats.submitCalls << " GL draw calls, "
+		<< gFrameStats.programChanges << " program changes, "
+		<< gFrameStats.stateChanges << " state changes, "
+		<< gFrameStats.triangles << " triangles, "
+		<< gFrameStats.nodesUpdated << " nodes updated, CPU transform update "
+		<< gFrameStats.updateMs / gFrameStats.frames << " ms/frame, draw list ("
+		<< gFrameStats.drawListJobs << " jobs) "
+		<< gFrameStats.drawListMs / gFrameStats.frames << " ms/frame, "
+		<< gFrameStats.lights << " lights in " << gFrameStats.litClusters << " cells (avg "
+		<< (gFrameStats.litClusters > 0 ? static_cast<double>(gFrameStats.lightIndices) / gFrameStats.litClusters : 0.0) << ", max "
+		<< gFrameStats.maxClusterLights << " per cell) binned in "
+		<< gFrameStats.lightBinMs / gFrameStats.frames << " ms/frame, submit "
+		<< gFrameStats.submitMs / gFrameStats.frames << " ms/frame, fence wait "
+		<< gFrameStats.fenceWaitMs / gFrameStats.frames << " ms/frame, GPU surface "
+		<< gFrameStats.gpuSurfaceMs / gFrameStats.frames << " ms, deferred lighting "
+		<< gFrameStats.gpuLightingMs / gFrameStats.frames << " ms, frame "
+		<< gFrameStats.frameMs / gFrameStats.frames << " ms" << endl;
+
+	// The static map is only paid for in the frames that render it; re-rendering it every frame would cost its last time
+	if (gShadowMode != SHADOWS_OFF && gShadows.supported)
+	{
+		double staticMs = gFrameStats.gpuStaticShadowMs / gFrameStats.frames;
+		cout << "INFO: " << SHADOW_MODE_NAMES[gShadowMode] << " shadows: "
+			<< gFrameStats.staticShadowDraws << " static draws, map rendered " << gFrameStats.staticShadowRenders << " times ("
+			<< staticMs << " ms/frame), " << gFrameStats.dynamicShadowDraws << " dynamic draws "
+			<< gFrameStats.gpuDynamicShadowMs / gFrameStats.frames << " ms/frame";
+		if (gShadowMode == SHADOWS_CACHED)
+			cout << ", saves " << gLastStaticShadowMs - staticMs << " ms/frame against a full re-render";
+		cout << endl;
+	}
 
-	//right house
-	scale = glm::scale(glm::vec3(.25f, .05f, .2f));
-	rotation = glm::rotate(glm::radians(33.f), glm::vec3(0.0, 1.f, 0.0f));
-	translation = glm::translate(glm::vec3(-1.2f, 0.13f, 3.9f));
+	// The surface and lighting times above include the extra samples of MSAA
+	if (gAntiAliasing.mode != AntiAliasing::OFF)
+		cout << "INFO: " << AntiAliasing::MODE_NAMES[gAntiAliasing.mode] << ": GPU "
+			<< (gAntiAliasing.mode == AntiAliasing::MSAA ? "resolve " : "filter ") << gFrameStats.gpuAntiAliasingMs / gFrameStats.frames << " ms/frame" << endl;
 
-	model = translation * rotation * scale;
-	modelMatrices.push_back(model);
+	if (gToneMapping.enabled && gToneMapping.supported)
+		cout << "INFO: HDR tonemapping: GPU histogram, exposure and tonemap " << gFrameStats.gpuToneMappingMs / gFrameStats.frames << " ms/frame" << endl;
 
-	//left house
-	translation = glm::translate(glm::vec3(-1.91f, 0.13f, 2.75f));
+	// Scale of the last frame against the GPU time the controller holds
+	if (gDynamicResolution.enabled && gDynamicResolution.supported)
+		cout << "INFO: Dynamic resolution: " << gFrameStats.renderWidth << "x" << gFrameStats.renderHeight << " (scale "
+			<< gDynamicResolution.scale << "), GPU frame " << gFrameStats.gpuFrameMs / gFrameStats.frames << " ms/frame against "
+			<< gDynamicResolution.targetMs << " ms, upscale " << gFrameStats.gpuUpscaleMs / gFrameStats.frames << " ms/frame" << endl;
 
-	model = translation * rotation * scale;
-	modelMatrices.push_back(model);
+	gFrameStats.ResetInterval();
+	gLastStatsTime = now;
+}
 
 
-	for (const auto& modelMatrix : modelMatrices) {
-		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(modelMatrix));
-		// Draw base
-		glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+// Reads the command line options
+//   --scene <file.scene>                     scene to render
+//   --compile-scene <file.scene> <file.sceneb>   compile a scene and exit
+//   --vertex-benchmark                       time the vertex transform paths and exit
+//   --no-program-cache                       always compile shaders from source
+//   --shader-dir <dir>                       load shaders from dir and reload them when edited
+//   --target-frame-ms <ms>                   start with dynamic resolution holding ms of GPU time per frame
+//   --aa <off|msaa|fxaa|taa>                 start with an anti-aliasing mode
+//   --headless <width>x<height>              render offscreen without a window through EGL or OSMesa
+//   --frames <n>                             frames the headless mode renders, 1 by default
+//   --camera <x,y,z,yaw,pitch>               start the camera there
+//   --output <prefix>                        headless frames go to <prefix>0000.png, <prefix>0001.png, ...
+//   --output-format <png|ppm>                image format of the headless frames
+//   --section-csv <file.csv>                 write the GPU time of every scene section per frame
+//   --benchmark <frames>                     render frames along a fixed camera orbit, report percentiles and exit
+//   --benchmark-output <file.json>           where the benchmark results go, benchmark.json by default
+bool UParseArguments(int argc, char* argv[])
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		string option = argv[i];
+		if (option == "--scene" && i + 1 < argc)
+			gScenePath = argv[++i];
+		else if (option == "--vertex-benchmark")
+			gVertexBenchmark = true;
+		else if (option == "--no-program-cache")
+			gUseProgramCache = false;
+		else if (option == "--shader-dir" && i + 1 < argc)
+			gShaderDirectory = argv[++i];
+		else if (option == "--aa" && i + 1 < argc && UParseAntiAliasing(argv[i + 1], gStartAntiAliasing))
+			++i;
+		else if (option == "--headless" && i + 1 < argc && sscanf(argv[i + 1], "%dx%d", &gHeadlessWidth, &gHeadlessHeight) == 2
+			&& gHeadlessWidth > 0 && gHeadlessHeight > 0)
+		{
+			gHeadless = true;
+			++i;
+		}
+		else if (option == "--frames" && i + 1 < argc && atoi(argv[i + 1]) > 0)
+			gHeadlessFrames = atoi(argv[++i]);
+		else if (option == "--camera" && i + 1 < argc && UParseCamera(argv[i + 1], gCamera))
+			++i;
+		else if (option == "--section-csv" && i + 1 < argc)
+			gSectionCsvPath = argv[++i];
+		else if (option == "--benchmark" && i + 1 < argc && atoi(argv[i + 1]) > 0)
+			gBenchmarkFrames = atoi(argv[++i]);
+		else if (option == "--benchmark-output" && i + 1 < argc)
+			gBenchmarkOutput = argv[++i];
+		else if (option == "--output" && i + 1 < argc)
+			gOutputPrefix = argv[++i];
+		else if (option == "--output-format" && i + 1 < argc && (string(argv[i + 1]) == "png" || string(argv[i + 1]) == "ppm"))
+			gOutputFormat = argv[++i];
+		else if (option == "--target-frame-ms" && i + 1 < argc && atof(argv[i + 1]) > 0.0)
+		{
+			gDynamicResolution.targetMs = atof(argv[++i]);
+			gDynamicResolution.enabled = true;
+		}
+		else if (option == "--compile-scene" && i + 2 < argc)
+		{
+			bool compiled = SceneFile::Compile(argv[i + 1], argv[i + 2]);
+			exit(compiled ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+		else
+		{
+			cout << "Usage: " << argv[0] << " [--scene <file.scene>] [--vertex-benchmark] [--no-program-cache] [--shader-dir <dir>] [--target-frame-ms <ms>] [--aa <off|msaa|fxaa|taa>] [--headless <width>x<height>] [--frames <n>] [--camera <x,y,z,yaw,pitch>] [--output <prefix>] [--output-format <png|ppm>] [--section-csv <file.csv>] [--benchmark <frames>] [--benchmark-output <file.json>] [--compile-scene <file.scene> <file.sceneb>]" << endl;
+			return false;
+		}
 	}
+	return true;
+}
 
-	modelMatrices.clear(); //clear models list
-
-	/****** HOUSE OVERHANGS *******/
-
-	//right house
-	scale = glm::scale(glm::vec3(.2f, .15f, .2f));
-	rotation = glm::rotate(glm::radians(33.f), glm::vec3(0.0, 1.f, 0.0f));
-	translation = glm::translate(glm::vec3(-1.2f, 0.08f, 3.9f));
 
-	model = translation * rotation * scale;
-	modelMatrices.push_back(model);
+// Loads a scene file into the draw list, compiling its binary form first when it is stale.
+// The binary form is mapped and its records are copied as is, nothing is parsed.
+bool ULoadScene(const std::string& scenePath, Scene& scene, SceneGraph& graph)
+{
+	PROFILE_FUNCTION();
+	auto loadStart = std::chrono::steady_clock::now();
 
-	//left house
-	translation = glm::translate(glm::vec3(-1.91f, 0.08f, 2.75f));
+	std::string binaryPath = scenePath + "b";
+	if (SceneFile::NeedsCompile(scenePath.c_str(), binaryPath.c_str()) && !SceneFile::Compile(scenePath.c_str(), binaryPath.c_str()))
+		return false;
 
-	model = translation * rotation * scale;
-	modelMatrices.push_back(model);
+	SceneFile file;
+	if (!file.Open(binaryPath.c_str()))
+		return false;
+	const SceneFile::Header& header = *file.header;
 
+	// Textures
+	auto textureStart = std::chrono::steady_clock::now();
+	gTextures.assign(header.textureCount, 0);
+	for (uint32_t i = 0; i < header.textureCount; ++i)
+	{
+		const SceneFile::TextureRecord& record = file.textures[i];
+		if (!UCreateTexture(file.String(record.path), gTextures[i]))
+		{
+			cout << "Failed to load " << file.String(record.name) << " texture" << endl;
+			return false;
+		}
 
-	for (const auto& modelMatrix : modelMatrices) {
-		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(modelMatrix));
-		// Draw base
-		glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+		// e.g. the board texture is stretched over the whole playing surface
+		if (record.clamp)
+		{
+			glBindTexture(GL_TEXTURE_2D, gTextures[i]);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
 	}
+	double textureMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - textureStart).count();
 
-	modelMatrices.clear(); //clear models list
-
-	glBindVertexArray(0);
+	// Mesh of every SceneFile::MeshId
+	const Meshes::GLMesh* sceneMeshes[SceneFile::MESH_COUNT] =
+	{
+		&meshes.gBoxMesh, &meshes.gConeMesh, &meshes.gCylinderMesh, &meshes.gTaperedCylinderMesh,
+		&meshes.gPlaneMesh, &meshes.gPrismMesh, &meshes.gSphereMesh, &meshes.gPyramid3Mesh,
+		&meshes.gPyramid4Mesh, &meshes.gTorusMesh, &meshes.gDiceMesh
+	};
 
-	/****** HOTEL ROOF PRISM *******/
-	
-	// Activate the VBO
-	glBindVertexArray(meshes.gPrismMesh.vao);
+	scene.Clear();
+	for (uint32_t i = 0; i < header.sectionCount; ++i)
+		scene.sections.push_back(file.String(file.sections[i].name));
 
-	//right house
-	scale = glm::scale(glm::vec3(.25f, .2f, -.1f));
-	rotation1 = glm::rotate(glm::radians(90.f), glm::vec3(1.f, 0.f, 0.0f));
-	rotation2 = glm::rotate(glm::radians(-33.f), glm::vec3(0.f, 0.f, 1.0f));
-	combinedRotation = rotation1 * rotation2;
-	translation = glm::translate(glm::vec3(-1.2f, .2045f, 3.9f));
+	// Node hierarchy, the draws of a node are consecutive
+	std::vector<SceneGraph::NodeDesc> nodes(header.nodeCount);
+	for (uint32_t i = 0; i < header.nodeCount; ++i)
+	{
+		const SceneFile::NodeRecord& record = file.nodes[i];
+		nodes[i].name = file.String(record.name);
+		nodes[i].parent = record.parent;
+		nodes[i].local = glm::make_mat4(record.model);
+		nodes[i].firstDraw = 0;
+		nodes[i].drawCount = 0;
+	}
+	for (uint32_t i = 0; i < header.drawCount; ++i)
+	{
+		SceneGraph::NodeDesc& node = nodes[file.draws[i].node];
+		if (node.drawCount++ == 0)
+			node.firstDraw = i;
+	}
+	std::vector<GLuint> nodePositions;
+	graph.Build(nodes, &nodePositions);
 
-	model = translation * combinedRotation * scale;
-	modelMatrices.push_back(model);
+	// Lights sit at the origin of their node and follow it
+	for (uint32_t i = 0; i < header.lightCount; ++i)
+	{
+		const SceneFile::LightRecord& record = file.lights[i];
+		Scene::Light light = { nodePositions[record.node], glm::make_vec3(record.color), record.radius };
+		scene.lights.push_back(light);
+	}
 
-	//left house
-	translation = glm::translate(glm::vec3(-1.91f, .2045f, 2.75f));
-	model = translation * combinedRotation * scale;
+	// Model matrices are filled in from the world transforms once every draw is recorded
+	scene.model = glm::mat4(1.0f);
+	scene.draws.reserve(header.drawCount);
+	for (uint32_t i = 0; i < header.drawCount; ++i)
+	{
+		const SceneFile::DrawRecord& draw = file.draws[i];
+		const SceneFile::NodeRecord& node = file.nodes[draw.node];
+		const SceneFile::MaterialRecord& material = file.materials[draw.material];
+
+		scene.mesh = sceneMeshes[draw.mesh];
+		scene.section = node.section;
+		scene.occluder = (node.flags & SceneFile::NODE_OCCLUDER) != 0;
+		scene.lightmapped = (node.flags & SceneFile::NODE_LIGHTMAPPED) != 0;
+
+		for (int unit = 0; unit < 2; ++unit)
+			scene.material.textures[unit] = material.textures[unit] < 0 ? 0 : gTextures[material.textures[unit]];
+		scene.material.uvScale = glm::make_vec2(material.uvScale);
+		scene.material.uvScale2 = glm::make_vec2(material.uvScale2);
+		scene.material.blendFactor = material.blendFactor;
+		scene.material.hasTexture = material.hasTexture != 0;
+		scene.material.objectColor = glm::make_vec4(material.objectColor);
+		scene.material.light1Color = glm::make_vec3(material.light1Color);
+		scene.material.light1Position = glm::make_vec3(material.light1Position);
+		scene.material.light2Color = glm::make_vec3(material.light2Color);
+		scene.material.light2Position = glm::make_vec3(material.light2Position);
+		scene.material.specularIntensity1 = material.specular[0];
+		scene.material.highlightSize1 = material.specular[1];
+		scene.material.specularIntensity2 = material.specular[2];
+		scene.material.highlightSize2 = material.specular[3];
+
+		// SceneFile checks the indices of its records, the vertex ranges depend on the meshes built here;
+		// a count of -1 draws the rest of the mesh
+		int64_t meshCount = draw.indexed ? scene.mesh->nIndices : scene.mesh->nVertices;
+		int64_t drawCount = draw.count < 0 ? meshCount - draw.first : draw.count;
+		if (draw.first < 0 || draw.count < -1 || drawCount < 0 || draw.first + drawCount > meshCount)
+		{
+			cout << "ERROR::SCENE::" << binaryPath << " draw " << i << " is outside its mesh" << endl;
+			return false;
+		}
 
-	modelMatrices.push_back(model);
+		if (draw.indexed)
+			scene.DrawElements(draw.mode, static_cast<GLsizei>(drawCount));
+		else
+			scene.DrawArrays(draw.mode, draw.first, static_cast<GLsizei>(drawCount));
+	}
 
+	std::vector<GLuint> updatedNodes, movedIds;
+	graph.Update(updatedNodes);
+	UApplyWorldTransforms(graph, updatedNodes, scene, movedIds);
 
-	for (const auto& modelMatrix : modelMatrices) {
-		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(modelMatrix));
-		// Draw roofs
-		glDrawArrays(GL_TRIANGLE_STRIP, 0, meshes.gPrismMesh.nVertices);
-	}
+	double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+	cout << "INFO: Scene " << scenePath << ": " << header.nodeCount << " nodes, " << header.drawCount << " draws, "
+		<< header.lightCount << " lights, " << header.textureCount << " textures loaded in " << loadMs << " ms (" << loadMs - textureMs
+		<< " ms without texture decoding)" << endl;
 
-	modelMatrices.clear();//clear models list
+	return true;
+}
 
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
 
-	glfwSwapBuffers(gWindow);
+// Copies the world transform of each node to the model matrix of its draws
+void UApplyWorldTransforms(const SceneGraph& graph, const std::vector<GLuint>& nodes, Scene& scene, std::vector<GLuint>& movedIds)
+{
+	for (GLuint node : nodes)
+	{
+		for (GLuint id = graph.firstDraws[node]; id < graph.firstDraws[node] + graph.drawCounts[node]; ++id)
+		{
+			scene.draws[id].model = graph.worlds[node];
+			movedIds.push_back(id);
+		}
+	}
 }
 
-// Function to render a single money denomination
-void renderMoneyDenomination(GLuint texture, glm::vec3 translation, float rotationAngle, GLint modelLoc) {
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texture);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, gPaper); // Use paper texture for blending
 
-	// Set blend factor for texture blending
-	float blendFactor = 0.15f; // Blend with paper texture for a used look
-	glUniform1f(glGetUniformLocation(gProgramId, "blendFactor"), blendFactor);
+// Animates the scene and propagates the moved subtrees to the transform buffer and the culling bounds
+void UUpdateTransforms()
+{
+	PROFILE_FUNCTION();
+	gUpdatedNodes.clear();
+	gMovedIds.clear();
+
+	if (gAnimateToken && gAnimatedNode >= 0)
+		gSceneGraph.SetLocal(gAnimatedNode, gAnimatedNodeLocal * glm::rotate(static_cast<float>(glfwGetTime()), glm::vec3(0.0f, 1.0f, 0.0f)));
 
-	// Apply transformations
-	glm::mat4 model = glm::translate(translation) * glm::rotate(glm::radians(rotationAngle), glm::vec3(0.f, 1.f, 0.f)) * glm::scale(glm::vec3(2.1f, .002f, 1.0f));
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+	gSceneGraph.Update(gUpdatedNodes);
+	if (gUpdatedNodes.empty())
+		return;
 
-	// Draw the denomination
-	glDrawArrays(GL_TRIANGLE_FAN, 4, 4); // Top part of the money
-	glDrawArrays(GL_TRIANGLE_FAN, 16, 4); // Bottom part of the money
+	UApplyWorldTransforms(gSceneGraph, gUpdatedNodes, gScene, gMovedIds);
+	gTransforms.Update(gFrameRing, gScene, gMovedIds);
+	gSceneBvh.Refit(gScene, gMovedIds);
+	gHiZ.UpdateBounds(gSceneBvh.drawBounds, gMovedIds);
 }
 
+
 // Implements the UCreateShaders function
 bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId)
 {
+	PROFILE_FUNCTION();
+	auto start = std::chrono::steady_clock::now();
+
+	// Reuse the binary linked by an earlier run when the driver accepts it
+	if (gProgramCache.Load(vtxShaderSource, fragShaderSource, programId))
+	{
+		glUseProgram(programId);
+		gShaderMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		return true;
+	}
+
 	// Compilation and linkage error reporting
 	int success = 0;
 	char infoLog[512];
@@ -1937,6 +2760,10 @@ bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSou
 	glAttachShader(programId, vertexShaderId);
 	glAttachShader(programId, fragmentShaderId);
 
+	// Keep the linked binary retrievable for the program cache
+	if (gProgramCache.enabled)
+		glProgramParameteri(programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
 	glLinkProgram(programId);   // links the shader program
 	// check for linking errors
 	glGetProgramiv(programId, GL_LINK_STATUS, &success);
@@ -1948,12 +2775,16 @@ bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSou
 		return false;
 	}
 
+	gProgramCache.Store(vtxShaderSource, fragShaderSource, programId);
+
 	glUseProgram(programId);    // Uses the shader program
+	gShaderMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
 
 	return true;
 }
 
 bool UCreateTexture(const char* filename, GLuint& textureId) {
+	PROFILE_FUNCTION();
 	int width, height, channels;
 	unsigned char* image = stbi_load(filename, &width, &height, &channels, 0);
 	if (image) {
@@ -1997,4 +2828,135 @@ void UDestroyTexture(GLuint& textureId) {
 void UDestroyShaderProgram(GLuint programId)
 {
 	glDeleteProgram(programId);
+}
+
+// Tell opengl for each sampler of a surface program to which texture unit it belongs, the program is in use
+void USetSurfaceSamplers(GLuint programId)
+{
+	glUniform1i(glGetUniformLocation(programId, "uTexture"), 0);
+	glUniform1i(glGetUniformLocation(programId, "uSecondTexture"), 1);
+	glUniform1i(glGetUniformLocation(programId, "uTransforms"), TRANSFORM_TEXTURE_UNIT);
+	glUniform1i(glGetUniformLocation(programId, "uStaticShadow"), ShadowMaps::STATIC_UNIT);
+	glUniform1i(glGetUniformLocation(programId, "uDynamicShadow"), ShadowMaps::DYNAMIC_UNIT);
+	glUniform1i(glGetUniformLocation(programId, "uLightmaps"), LightmapBaker::TEXTURE_UNIT);
+}
+
+// Samplers of the deferred lighting program, which is in use
+void USetDeferredLightingSamplers(GLuint programId)
+{
+	glUniform1i(glGetUniformLocation(programId, "uAlbedo"), DeferredShading::ALBEDO_UNIT);
+	glUniform1i(glGetUniformLocation(programId, "uNormal"), DeferredShading::NORMAL_UNIT);
+	glUniform1i(glGetUniformLocation(programId, "uDrawId"), DeferredShading::DRAW_ID_UNIT);
+	glUniform1i(glGetUniformLocation(programId, "uDepth"), DeferredShading::DEPTH_UNIT);
+	glUniform1i(glGetUniformLocation(programId, "uStaticShadow"), ShadowMaps::STATIC_UNIT);
+	glUniform1i(glGetUniformLocation(programId, "uDynamicShadow"), ShadowMaps::DYNAMIC_UNIT);
+}
+
+// Samplers of the depth only program, which is in use
+void USetDepthSamplers(GLuint programId)
+{
+	glUniform1i(glGetUniformLocation(programId, "uTransforms"), TRANSFORM_TEXTURE_UNIT);
+}
+
+
+// Rebuilds the programs whose shader files changed and swaps in the ones that finished compiling
+void UReloadShaders()
+{
+	if (!gShaderReloader.enabled)
+		return;
+
+	vector<string> changed = gShaderReloader.Changed();
+	auto edited = [&changed](const char* vertexFile, const char* fragmentFile)
+	{
+		return find(changed.begin(), changed.end(), vertexFile) != changed.end()
+			|| find(changed.begin(), changed.end(), fragmentFile) != changed.end();
+	};
+
+	if (edited(SURFACE_VERTEX_FILE, SURFACE_FRAGMENT_FILE))
+		UReloadPermutations("surface", gSurfacePrograms, gShaderReloader.Source(SURFACE_VERTEX_FILE, vertexShaderSource),
+			gShaderReloader.Source(SURFACE_FRAGMENT_FILE, fragmentShaderSource));
+	if (edited(INDIRECT_VERTEX_FILE, INDIRECT_FRAGMENT_FILE))
+		UReloadPermutations("indirect", gIndirectPrograms, gShaderReloader.Source(INDIRECT_VERTEX_FILE, indirectVertexShaderSource),
+			gShaderReloader.Source(INDIRECT_FRAGMENT_FILE, indirectFragmentShaderSource));
+	if (edited(INDIRECT_VERTEX_FILE, GBUFFER_FRAGMENT_FILE))
+		UReloadPermutations("gbuffer", gGBufferPrograms, gShaderReloader.Source(INDIRECT_VERTEX_FILE, indirectVertexShaderSource),
+			gShaderReloader.Source(GBUFFER_FRAGMENT_FILE, gBufferFragmentShaderSource));
+
+	if (edited(DEPTH_VERTEX_FILE, DEPTH_FRAGMENT_FILE))
+	{
+		ShaderReloader::Request request = { gShaderReloader.Source(DEPTH_VERTEX_FILE, depthVertexShaderSource),
+			gShaderReloader.Source(DEPTH_FRAGMENT_FILE, depthFragmentShaderSource) };
+		gShaderReloader.Submit("depth", { request }, [](const vector<GLuint>& programs)
+		{
+			UDestroyShaderProgram(gDepthProgramId);
+			gDepthProgramId = programs[0];
+			glUseProgram(gDepthProgramId);
+			USetDepthSamplers(gDepthProgramId);
+		});
+	}
+
+	if (gDeferredSupported && edited(DEFERRED_LIGHTING_VERTEX_FILE, DEFERRED_LIGHTING_FRAGMENT_FILE))
+	{
+		ShaderReloader::Request request = { gShaderReloader.Source(DEFERRED_LIGHTING_VERTEX_FILE, deferredLightingVertexShaderSource),
+			gShaderReloader.Source(DEFERRED_LIGHTING_FRAGMENT_FILE, deferredLightingFragmentShaderSource) };
+		gShaderReloader.Submit("deferred lighting", { request }, [](const vector<GLuint>& programs)
+		{
+			UDestroyShaderProgram(gDeferredLightingProgramId);
+			gDeferredLightingProgramId = programs[0];
+			glUseProgram(gDeferredLightingProgramId);
+			USetDeferredLightingSamplers(gDeferredLightingProgramId);
+		});
+	}
+
+	gShaderReloader.Update();
+}
+
+
+// Recompiles every variant a set has compiled from new sources, swapped in as a whole once all of them linked
+void UReloadPermutations(const char* label, ShaderPermutations& permutations, const std::string& vertexSource, const std::string& fragmentSource)
+{
+	vector<GLuint> masks = permutations.Masks();
+	vector<ShaderReloader::Request> requests;
+	for (GLuint mask : masks)
+	{
+		ShaderReloader::Request request = { ShaderPermutations::Permute(vertexSource, mask), ShaderPermutations::Permute(fragmentSource, mask) };
+		requests.push_back(request);
+	}
+
+	gShaderReloader.Submit(label, requests, [&permutations, vertexSource, fragmentSource, masks](const vector<GLuint>& programs)
+	{
+		permutations.Swap(vertexSource, fragmentSource, masks, programs);
+
+		// The recorded loop replay names the old programs
+		gCommandStream.Clear();
+	});
+}
+
+
+// Anti-aliasing mode of an --aa argument
+bool UParseAntiAliasing(const std::string& name, AntiAliasing::Mode& mode)
+{
+	const char* const NAMES[AntiAliasing::MODE_COUNT] = { "off", "msaa", "fxaa", "taa" };
+	for (int i = 0; i < AntiAliasing::MODE_COUNT; ++i)
+	{
+		if (name == NAMES[i])
+		{
+			mode = static_cast<AntiAliasing::Mode>(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+
+// Camera of a --camera x,y,z,yaw,pitch argument, the angles in degrees
+bool UParseCamera(const char* argument, Camera& camera)
+{
+	glm::vec3 position;
+	float yaw, pitch;
+	if (sscanf(argument, "%f,%f,%f,%f,%f", &position.x, &position.y, &position.z, &yaw, &pitch) != 5)
+		return false;
+
+	camera = Camera(position, glm::vec3(0.0f, 1.0f, 0.0f), yaw, pitch);
+	return true;
 }
\ No newline at end of file
@@ -0,0 +1,467 @@
+///////////////////////////////////////////////////////////////////////////////
+// antialiasing.cpp
+// ========
+// anti-aliasing of the scene: multisampling resolved from an offscreen
+// target, or FXAA or TAA applied to a single sampled one
+///////////////////////////////////////////////////////////////////////////////
+
+#include "antialiasing.h"
+
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include <iostream>
+
+#ifndef GLSL
+#define GLSL(Version, Source) "#version " #Version " core \n" #Source
+#endif
+
+const char* const AntiAliasing::MODE_NAMES[AntiAliasing::MODE_COUNT] = { "no AA", "MSAA", "FXAA", "TAA" };
+
+namespace
+{
+	/* Fullscreen Triangle Vertex Shader Source Code*/
+	const GLchar* fullscreenVertexShaderSource = GLSL(440,
+
+		void main()
+		{
+			// (-1, -1), (3, -1), (-1, 3)
+			vec2 corner = vec2(float((gl_VertexID & 1) << 2) - 1.0, float((gl_VertexID & 2) << 1) - 1.0);
+			gl_Position = vec4(corner, 0.0, 1.0);
+		}
+	);
+
+	/* FXAA Fragment Shader Source Code*/
+	const GLchar* fxaaFragmentShaderSource = GLSL(440,
+
+		out vec4 fragmentColor;
+
+		uniform sampler2D uScene;
+		uniform vec2 uRenderSize; // pixels of uScene the frame covers
+
+		const float REDUCE_MIN = 1.0 / 128.0;
+		const float REDUCE_MUL = 1.0 / 8.0;
+		const float SPAN_MAX = 8.0;
+		const vec3 LUMA = vec3(0.299, 0.587, 0.114);
+
+		vec3 Fetch(vec2 uv, vec2 high)
+		{
+			return texture(uScene, min(uv, high)).rgb;
+		}
+
+		void main()
+		{
+			vec2 texel = 1.0 / vec2(textureSize(uScene, 0));
+			vec2 uv = gl_FragCoord.xy * texel;
+			vec2 high = (uRenderSize - 0.5) * texel;
+
+			// Luma of the pixel and its diagonal corners
+			vec3 rgbM = Fetch(uv, high);
+			float lumaNW = dot(Fetch(uv + vec2(-1.0, 1.0) * texel, high), LUMA);
+			float lumaNE = dot(Fetch(uv + vec2(1.0, 1.0) * texel, high), LUMA);
+			float lumaSW = dot(Fetch(uv + vec2(-1.0, -1.0) * texel, high), LUMA);
+			float lumaSE = dot(Fetch(uv + vec2(1.0, -1.0) * texel, high), LUMA);
+			float lumaM = dot(rgbM, LUMA);
+			float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));
+			float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));
+
+			// Blur direction along the edge, across the luma gradient
+			vec2 direction = vec2(-((lumaNW + lumaNE) - (lumaSW + lumaSE)), (lumaNW + lumaSW) - (lumaNE + lumaSE));
+			float directionReduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * 0.25 * REDUCE_MUL, REDUCE_MIN);
+			float inverseDirectionMin = 1.0 / (min(abs(direction.x), abs(direction.y)) + directionReduce);
+			direction = clamp(direction * inverseDirectionMin, vec2(-SPAN_MAX), vec2(SPAN_MAX)) * texel;
+
+			// Two taps along the edge, four when that stays inside the local luma range
+			vec3 rgbA = 0.5 * (Fetch(uv + direction * (1.0 / 3.0 - 0.5), high) + Fetch(uv + direction * (2.0 / 3.0 - 0.5), high));
+			vec3 rgbB = rgbA * 0.5 + 0.25 * (Fetch(uv - direction * 0.5, high) + Fetch(uv + direction * 0.5, high));
+			float lumaB = dot(rgbB, LUMA);
+			fragmentColor = vec4(lumaB < lumaMin || lumaB > lumaMax ? rgbA : rgbB, 1.0);
+		}
+	);
+
+	/* TAA Resolve Fragment Shader Source Code*/
+	const GLchar* taaFragmentShaderSource = GLSL(440,
+
+		out vec4 fragmentColor;
+
+		uniform sampler2D uScene;
+		uniform sampler2D uDepth;
+		uniform sampler2D uHistory;
+		uniform mat4 uInverseViewProjection; // this frame, unjittered
+		uniform mat4 uPreviousViewProjection;
+		uniform vec2 uRenderSize;
+		uniform vec2 uHistoryScale; // part of uHistory the previous frame covered
+		uniform float uHistoryWeight; // 0 starts the history over
+
+		void main()
+		{
+			ivec2 pixel = ivec2(gl_FragCoord.xy);
+			ivec2 last = ivec2(uRenderSize) - 1;
+			vec3 current = texelFetch(uScene, pixel, 0).rgb;
+
+			// Color range of the 3x3 neighbourhood, history outside it belongs to another surface
+			vec3 minimum = current;
+			vec3 maximum = current;
+			for (int y = -1; y <= 1; ++y)
+			{
+				for (int x = -1; x <= 1; ++x)
+				{
+					vec3 neighbour = texelFetch(uScene, clamp(pixel + ivec2(x, y), ivec2(0), last), 0).rgb;
+					minimum = min(minimum, neighbour);
+					maximum = max(maximum, neighbour);
+				}
+			}
+
+			// Where the surface of this pixel was in the previous frame, from the camera motion alone
+			float depth = texelFetch(uDepth, pixel, 0).r;
+			vec4 world = uInverseViewProjection * vec4(gl_FragCoord.xy / uRenderSize * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+			vec4 previous = uPreviousViewProjection * vec4(world.xyz / world.w, 1.0);
+			vec2 previousUv = previous.xy / previous.w * 0.5 + 0.5;
+
+			float weight = uHistoryWeight;
+			if (any(lessThan(previousUv, vec2(0.0))) || any(greaterThan(previousUv, vec2(1.0))))
+				weight = 0.0;
+
+			vec3 history = texture(uHistory, previousUv * uHistoryScale).rgb;
+			fragmentColor = vec4(mix(current, clamp(history, minimum, maximum), weight), 1.0);
+		}
+	);
+
+	bool CompileShader(GLenum type, const char* source, GLuint& shaderId)
+	{
+		int success = 0;
+		char infoLog[512];
+
+		shaderId = glCreateShader(type);
+		glShaderSource(shaderId, 1, &source, NULL);
+		glCompileShader(shaderId);
+		glGetShaderiv(shaderId, GL_COMPILE_STATUS, &success);
+		if (!success)
+		{
+			glGetShaderInfoLog(shaderId, sizeof(infoLog), NULL, infoLog);
+			std::cout << "ERROR::SHADER::" << (type == GL_VERTEX_SHADER ? "VERTEX" : "FRAGMENT") << "::COMPILATION_FAILED\n" << infoLog << std::endl;
+			glDeleteShader(shaderId);
+			return false;
+		}
+		return true;
+	}
+
+	bool CreateProgram(const char* vertexSource, const char* fragmentSource, GLuint& programId)
+	{
+		int success = 0;
+		char infoLog[512];
+
+		GLuint vertexShaderId = 0;
+		GLuint fragmentShaderId = 0;
+		if (!CompileShader(GL_VERTEX_SHADER, vertexSource, vertexShaderId))
+			return false;
+		if (!CompileShader(GL_FRAGMENT_SHADER, fragmentSource, fragmentShaderId))
+		{
+			glDeleteShader(vertexShaderId);
+			return false;
+		}
+
+		programId = glCreateProgram();
+		glAttachShader(programId, vertexShaderId);
+		glAttachShader(programId, fragmentShaderId);
+		glLinkProgram(programId);
+		glDeleteShader(vertexShaderId);
+		glDeleteShader(fragmentShaderId);
+		glGetProgramiv(programId, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
+			std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	GLuint CreateTarget(GLenum internalFormat, GLsizei width, GLsizei height, GLint filter)
+	{
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		return texture;
+	}
+
+	bool Complete(const char* name)
+	{
+		GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		if (status != GL_FRAMEBUFFER_COMPLETE)
+		{
+			std::cout << "ERROR::ANTIALIASING::" << name << " target incomplete, status 0x" << std::hex << status << std::dec << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	// Radical inverse of index in base, the Halton sequence
+	float Halton(unsigned int index, unsigned int base)
+	{
+		float result = 0.0f;
+		float fraction = 1.0f / base;
+		for (; index > 0; index /= base, fraction /= base)
+			result += fraction * (index % base);
+		return result;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Create()
+//
+//	Compile the FXAA and TAA programs; targets are
+//	allocated by Begin, once a mode needs them
+///////////////////////////////////////////////////
+bool AntiAliasing::Create()
+{
+	if (!CreateProgram(fullscreenVertexShaderSource, fxaaFragmentShaderSource, fxaaProgram)
+		|| !CreateProgram(fullscreenVertexShaderSource, taaFragmentShaderSource, taaProgram))
+	{
+		Destroy();
+		return false;
+	}
+
+	glUseProgram(fxaaProgram);
+	glUniform1i(glGetUniformLocation(fxaaProgram, "uScene"), COLOR_UNIT);
+	glUseProgram(taaProgram);
+	glUniform1i(glGetUniformLocation(taaProgram, "uScene"), COLOR_UNIT);
+	glUniform1i(glGetUniformLocation(taaProgram, "uDepth"), DEPTH_UNIT);
+	glUniform1i(glGetUniformLocation(taaProgram, "uHistory"), HISTORY_UNIT);
+	glGenVertexArrays(1, &emptyVao);
+
+	GLint maxSamples = 0;
+	glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+	samples = maxSamples < SAMPLES ? maxSamples : SAMPLES;
+	return true;
+}
+
+void AntiAliasing::Destroy()
+{
+	Release();
+	glDeleteProgram(fxaaProgram);
+	glDeleteProgram(taaProgram);
+	glDeleteVertexArrays(1, &emptyVao);
+	fxaaProgram = taaProgram = emptyVao = 0;
+	mode = OFF;
+}
+
+void AntiAliasing::SetMode(Mode mode)
+{
+	this->mode = mode;
+	historyValid = false;
+}
+
+void AntiAliasing::SetColorFormat(GLenum format)
+{
+	if (format == colorFormat)
+		return;
+	Release();
+	colorFormat = format;
+}
+
+bool AntiAliasing::AllocateMultisample()
+{
+	glGenRenderbuffers(1, &multisampleColor);
+	glBindRenderbuffer(GL_RENDERBUFFER, multisampleColor);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, colorFormat, width, height);
+	glGenRenderbuffers(1, &multisampleDepth);
+	glBindRenderbuffer(GL_RENDERBUFFER, multisampleDepth);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT32F, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &multisampleFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, multisampleFramebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, multisampleColor);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, multisampleDepth);
+	return Complete("MSAA");
+}
+
+bool AntiAliasing::AllocateSingle()
+{
+	sceneColor = CreateTarget(colorFormat, width, height, GL_LINEAR);
+	sceneDepth = CreateTarget(GL_DEPTH_COMPONENT32F, width, height, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &sceneFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, sceneColor, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, sceneDepth, 0);
+	return Complete("Scene");
+}
+
+bool AntiAliasing::AllocateHistory()
+{
+	glGenFramebuffers(2, historyFramebuffers);
+	for (int i = 0; i < 2; ++i)
+	{
+		historyTextures[i] = CreateTarget(colorFormat, width, height, GL_LINEAR);
+		glBindFramebuffer(GL_FRAMEBUFFER, historyFramebuffers[i]);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, historyTextures[i], 0);
+		if (!Complete("History"))
+			return false;
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	historyValid = false;
+	return true;
+}
+
+void AntiAliasing::Release()
+{
+	glDeleteFramebuffers(1, &multisampleFramebuffer);
+	GLuint renderbuffers[2] = { multisampleColor, multisampleDepth };
+	glDeleteRenderbuffers(2, renderbuffers);
+	multisampleFramebuffer = multisampleColor = multisampleDepth = 0;
+
+	glDeleteFramebuffers(1, &sceneFramebuffer);
+	GLuint textures[2] = { sceneColor, sceneDepth };
+	glDeleteTextures(2, textures);
+	sceneFramebuffer = sceneColor = sceneDepth = 0;
+
+	glDeleteFramebuffers(2, historyFramebuffers);
+	glDeleteTextures(2, historyTextures);
+	historyFramebuffers[0] = historyFramebuffers[1] = historyTextures[0] = historyTextures[1] = 0;
+	historyValid = false;
+}
+
+///////////////////////////////////////////////////
+//	Jitter(const glm::mat4&, GLsizei, GLsizei)
+//
+//	Offset clip space by a Halton sample inside the
+//	pixel, so consecutive TAA frames rasterize at
+//	JITTER_SAMPLES different positions
+///////////////////////////////////////////////////
+glm::mat4 AntiAliasing::Jitter(const glm::mat4& projection, GLsizei renderWidth, GLsizei renderHeight) const
+{
+	if (mode != TAA)
+		return projection;
+
+	unsigned int sample = frameIndex % JITTER_SAMPLES + 1;
+	glm::vec2 offset(Halton(sample, 2) - 0.5f, Halton(sample, 3) - 0.5f);
+	return glm::translate(glm::vec3(offset.x * 2.0f / renderWidth, offset.y * 2.0f / renderHeight, 0.0f)) * projection;
+}
+
+///////////////////////////////////////////////////
+//	Begin(GLsizei, GLsizei, GLsizei, GLsizei)
+//
+//	renderWidth, renderHeight: viewport of the scene
+//	width, height: window size, the size of every
+//	target; a new size reallocates them
+//
+//	Remember the bound framebuffer as the
+//	destination and render the scene into the target
+//	of the mode. A target that cannot be allocated
+//	turns anti-aliasing off
+///////////////////////////////////////////////////
+void AntiAliasing::Begin(GLsizei renderWidth, GLsizei renderHeight, GLsizei width, GLsizei height)
+{
+	active = false;
+	this->renderWidth = renderWidth;
+	this->renderHeight = renderHeight;
+	if (mode == OFF || width <= 0 || height <= 0)
+		return;
+
+	// Allocation leaves framebuffer 0 bound
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &destination);
+	if (width != this->width || height != this->height)
+	{
+		Release();
+		this->width = width;
+		this->height = height;
+	}
+
+	bool allocated = true;
+	if (mode == MSAA && !multisampleFramebuffer)
+		allocated = samples > 1 && AllocateMultisample();
+	else if (mode != MSAA && !sceneFramebuffer)
+		allocated = AllocateSingle();
+	if (allocated && mode == TAA && !historyFramebuffers[0])
+		allocated = AllocateHistory();
+	if (!allocated)
+	{
+		std::cout << "INFO: " << MODE_NAMES[mode] << " unavailable, anti-aliasing off" << std::endl;
+		Release();
+		mode = OFF;
+		glBindFramebuffer(GL_FRAMEBUFFER, destination);
+		return;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, mode == MSAA ? multisampleFramebuffer : sceneFramebuffer);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	active = true;
+}
+
+///////////////////////////////////////////////////
+//	End(const glm::mat4&)
+//
+//	viewProjection: camera of this frame without the
+//	jitter, kept to reproject the next frame
+//
+//	MSAA resolves with a blit. FXAA draws straight
+//	into the destination; TAA into the history, which
+//	is then copied to the destination
+///////////////////////////////////////////////////
+void AntiAliasing::End(const glm::mat4& viewProjection)
+{
+	if (!active)
+		return;
+	active = false;
+
+	if (mode == MSAA)
+	{
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, multisampleFramebuffer);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, destination);
+		glBlitFramebuffer(0, 0, renderWidth, renderHeight, 0, 0, renderWidth, renderHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, destination);
+		return;
+	}
+
+	glActiveTexture(GL_TEXTURE0 + COLOR_UNIT);
+	glBindTexture(GL_TEXTURE_2D, sceneColor);
+	glDisable(GL_DEPTH_TEST);
+	glBindVertexArray(emptyVao);
+
+	if (mode == FXAA)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, destination);
+		glUseProgram(fxaaProgram);
+		glUniform2f(glGetUniformLocation(fxaaProgram, "uRenderSize"), static_cast<GLfloat>(renderWidth), static_cast<GLfloat>(renderHeight));
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+	}
+	else
+	{
+		glActiveTexture(GL_TEXTURE0 + DEPTH_UNIT);
+		glBindTexture(GL_TEXTURE_2D, sceneDepth);
+		glActiveTexture(GL_TEXTURE0 + HISTORY_UNIT);
+		glBindTexture(GL_TEXTURE_2D, historyTextures[1 - historyIndex]);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, historyFramebuffers[historyIndex]);
+		glUseProgram(taaProgram);
+		glUniformMatrix4fv(glGetUniformLocation(taaProgram, "uInverseViewProjection"), 1, GL_FALSE, glm::value_ptr(glm::inverse(viewProjection)));
+		glUniformMatrix4fv(glGetUniformLocation(taaProgram, "uPreviousViewProjection"), 1, GL_FALSE, glm::value_ptr(previousViewProjection));
+		glUniform2f(glGetUniformLocation(taaProgram, "uRenderSize"), static_cast<GLfloat>(renderWidth), static_cast<GLfloat>(renderHeight));
+		glUniform2f(glGetUniformLocation(taaProgram, "uHistoryScale"), historySize.x / width, historySize.y / height);
+		glUniform1f(glGetUniformLocation(taaProgram, "uHistoryWeight"), historyValid ? HISTORY_WEIGHT : 0.0f);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, historyFramebuffers[historyIndex]);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, destination);
+		glBlitFramebuffer(0, 0, renderWidth, renderHeight, 0, 0, renderWidth, renderHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, destination);
+
+		historyIndex = 1 - historyIndex;
+		historyValid = true;
+		historySize = glm::vec2(static_cast<float>(renderWidth), static_cast<float>(renderHeight));
+		previousViewProjection = viewProjection;
+	}
+
+	glBindVertexArray(0);
+	glEnable(GL_DEPTH_TEST);
+	++frameIndex;
+}
@@ -0,0 +1,123 @@
+///////////////////////////////////////////////////////////////////////////////
+// benchmark.cpp
+// ========
+// frame samples of a benchmark run, summarized as percentiles and written
+// as JSON
+///////////////////////////////////////////////////////////////////////////////
+
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+	std::string Escape(const std::string& text)
+	{
+		std::string escaped;
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+				escaped += '\\';
+			escaped += c;
+		}
+		return escaped;
+	}
+
+	void WriteSummary(std::ofstream& file, const char* name, const FrameBenchmark::Summary& summary, bool last = false)
+	{
+		file << "\t\t\"" << name << "\": { \"mean\": " << summary.mean << ", \"p50\": " << summary.p50 << ", \"p95\": " << summary.p95
+			<< ", \"p99\": " << summary.p99 << ", \"max\": " << summary.max << " }" << (last ? "\n" : ",\n");
+	}
+}
+
+///////////////////////////////////////////////////
+//	Summarize(std::vector<double>)
+//
+//	values: one per frame, sorted in place
+//
+//	The p-th percentile is the smallest value at
+//	least p percent of the frames do not exceed
+///////////////////////////////////////////////////
+FrameBenchmark::Summary FrameBenchmark::Summarize(std::vector<double> values)
+{
+	Summary summary;
+	if (values.empty())
+		return summary;
+
+	std::sort(values.begin(), values.end());
+	auto percentile = [&values](double p)
+	{
+		size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * values.size()));
+		return values[rank > 0 ? rank - 1 : 0];
+	};
+
+	double sum = 0.0;
+	for (double value : values)
+		sum += value;
+	summary.mean = sum / values.size();
+	summary.p50 = percentile(50.0);
+	summary.p95 = percentile(95.0);
+	summary.p99 = percentile(99.0);
+	summary.max = values.back();
+	return summary;
+}
+
+void FrameBenchmark::AddFrame(double cpuMs, int draws, int triangles, int drawCalls, int programChanges, int stateChanges)
+{
+	this->cpuMs.push_back(cpuMs);
+	this->draws.push_back(draws);
+	this->triangles.push_back(triangles);
+	this->drawCalls.push_back(drawCalls);
+	this->programChanges.push_back(programChanges);
+	this->stateChanges.push_back(stateChanges);
+}
+
+void FrameBenchmark::Report() const
+{
+	Summary cpu = Summarize(cpuMs);
+	Summary gpu = Summarize(gpuMs);
+	std::cout << "INFO: Benchmark of " << cpuMs.size() << " frames: CPU p50 " << cpu.p50 << " ms, p95 " << cpu.p95 << " ms, p99 "
+		<< cpu.p99 << " ms; GPU p50 " << gpu.p50 << " ms, p95 " << gpu.p95 << " ms, p99 " << gpu.p99 << " ms; "
+		<< Summarize(draws).mean << " draws, " << Summarize(triangles).mean << " triangles, "
+		<< Summarize(drawCalls).mean << " GL draw calls, " << Summarize(programChanges).mean << " program changes, "
+		<< Summarize(stateChanges).mean << " state changes per frame" << std::endl;
+}
+
+///////////////////////////////////////////////////
+//	WriteJson(const std::string&, const Settings&)
+//
+//	path: JSON file, replaced
+//	settings: how the run was configured
+//
+//	Write the settings, the sample counts and the
+//	summary of every measure
+///////////////////////////////////////////////////
+bool FrameBenchmark::WriteJson(const std::string& path, const Settings& settings) const
+{
+	std::ofstream file(path, std::ios::trunc);
+	if (!file)
+	{
+		std::cout << "ERROR::BENCHMARK::Cannot write " << path << std::endl;
+		return false;
+	}
+
+	file << "{\n\t\"settings\": {\n";
+	for (size_t i = 0; i < settings.size(); ++i)
+		file << "\t\t\"" << Escape(settings[i].first) << "\": \"" << Escape(settings[i].second) << "\"" << (i + 1 < settings.size() ? ",\n" : "\n");
+	file << "\t},\n";
+	file << "\t\"frames\": " << cpuMs.size() << ",\n";
+	file << "\t\"gpu_frames\": " << gpuMs.size() << ",\n";
+	file << "\t\"measures\": {\n";
+	WriteSummary(file, "cpu_ms", Summarize(cpuMs));
+	WriteSummary(file, "gpu_ms", Summarize(gpuMs));
+	WriteSummary(file, "draws", Summarize(draws));
+	WriteSummary(file, "triangles", Summarize(triangles));
+	WriteSummary(file, "gl_draw_calls", Summarize(drawCalls));
+	WriteSummary(file, "program_changes", Summarize(programChanges));
+	WriteSummary(file, "state_changes", Summarize(stateChanges), true);
+	file << "\t}\n}\n";
+	return static_cast<bool>(file);
+}
@@ -0,0 +1,414 @@
+///////////////////////////////////////////////////////////////////////////////
+// bvh.cpp
+// ========
+// world bounds of every scene draw and a bounding volume hierarchy over them,
+// used to cull the draw list against the view frustum
+///////////////////////////////////////////////////////////////////////////////
+
+#include "bvh.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <map>
+
+namespace
+{
+	// Floats per interleaved vertex: position, normal, texture coordinates
+	const GLuint floatsPerVertex = 8;
+
+	// Vertex positions and indices of a mesh, read back from its VBOs
+	struct MeshPositions
+	{
+		std::vector<glm::vec3> positions;
+		std::vector<GLuint> indices;
+	};
+
+	MeshPositions ReadMesh(const Meshes::GLMesh& mesh)
+	{
+		MeshPositions data;
+		GLint size = 0;
+
+		glBindBuffer(GL_COPY_READ_BUFFER, mesh.vbos[0]);
+		glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
+		std::vector<GLfloat> vertices(size / sizeof(GLfloat));
+		glGetBufferSubData(GL_COPY_READ_BUFFER, 0, vertices.size() * sizeof(GLfloat), vertices.data());
+		for (size_t i = 0; i + 2 < vertices.size(); i += floatsPerVertex)
+			data.positions.push_back(glm::vec3(vertices[i], vertices[i + 1], vertices[i + 2]));
+
+		if (mesh.nIndices > 0)
+		{
+			data.indices.resize(mesh.nIndices);
+			glBindBuffer(GL_COPY_READ_BUFFER, mesh.vbos[1]);
+			glGetBufferSubData(GL_COPY_READ_BUFFER, 0, mesh.nIndices * sizeof(GLuint), data.indices.data());
+		}
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+		return data;
+	}
+
+	// Object space bounds of the vertices a draw range touches
+	Aabb RangeBounds(const Scene::DrawRange& range, const MeshPositions& data)
+	{
+		Aabb bounds = Aabb::Empty();
+		GLuint last = static_cast<GLuint>(range.first + range.count);
+
+		if (range.indexed)
+		{
+			last = std::min<GLuint>(last, static_cast<GLuint>(data.indices.size()));
+			for (GLuint i = range.first; i < last; ++i)
+			{
+				if (data.indices[i] < data.positions.size())
+					bounds.Grow(data.positions[data.indices[i]]);
+			}
+		}
+		else
+		{
+			last = std::min<GLuint>(last, static_cast<GLuint>(data.positions.size()));
+			for (GLuint v = range.first; v < last; ++v)
+				bounds.Grow(data.positions[v]);
+		}
+
+		return bounds;
+	}
+
+	// Signed distance of the box to a plane: < 0 outside, > 0 inside, 0 straddling
+	int Classify(const Aabb& box, const glm::vec4& plane)
+	{
+		glm::vec3 normal(plane);
+		glm::vec3 center = box.Center();
+		glm::vec3 extent = box.max - center;
+		float distance = glm::dot(normal, center) + plane.w;
+		float radius = extent.x * std::fabs(normal.x) + extent.y * std::fabs(normal.y) + extent.z * std::fabs(normal.z);
+
+		if (distance < -radius)
+			return -1;
+		return distance > radius ? 1 : 0;
+	}
+}
+
+Aabb Aabb::Empty()
+{
+	Aabb box = { glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) };
+	return box;
+}
+
+void Aabb::Grow(const glm::vec3& point)
+{
+	min = glm::min(min, point);
+	max = glm::max(max, point);
+}
+
+void Aabb::Grow(const Aabb& box)
+{
+	min = glm::min(min, box.min);
+	max = glm::max(max, box.max);
+}
+
+///////////////////////////////////////////////////
+//	Aabb::Transformed(const glm::mat4&)
+//
+//	Box enclosing this box after an affine transform
+///////////////////////////////////////////////////
+Aabb Aabb::Transformed(const glm::mat4& matrix) const
+{
+	if (min.x > max.x)
+		return *this;
+
+	glm::vec3 center = glm::vec3(matrix * glm::vec4(Center(), 1.0f));
+	glm::vec3 extent = max - Center();
+	glm::vec3 worldExtent(0.0f);
+	for (int column = 0; column < 3; ++column)
+	{
+		glm::vec3 axis(matrix[column]);
+		worldExtent += glm::vec3(std::fabs(axis.x), std::fabs(axis.y), std::fabs(axis.z)) * extent[column];
+	}
+
+	Aabb box = { center - worldExtent, center + worldExtent };
+	return box;
+}
+
+///////////////////////////////////////////////////
+//	Frustum::Extract(const glm::mat4&)
+//
+//	viewProjection: projection * view
+//
+//	Planes of the clip volume in world space
+///////////////////////////////////////////////////
+void Frustum::Extract(const glm::mat4& viewProjection)
+{
+	glm::vec4 rows[4];
+	for (int row = 0; row < 4; ++row)
+		rows[row] = glm::vec4(viewProjection[0][row], viewProjection[1][row], viewProjection[2][row], viewProjection[3][row]);
+
+	planes[0] = rows[3] + rows[0];      // left
+	planes[1] = rows[3] - rows[0];      // right
+	planes[2] = rows[3] + rows[1];      // bottom
+	planes[3] = rows[3] - rows[1];      // top
+	planes[4] = rows[3] + rows[2];      // near
+	planes[5] = rows[3] - rows[2];      // far
+
+	for (glm::vec4& plane : planes)
+		plane /= glm::length(glm::vec3(plane));
+}
+
+///////////////////////////////////////////////////
+//	Build(const Scene&)
+//
+//	scene: recorded draw list
+//
+//	Compute the world bounds of every draw and build
+//	the hierarchy over them
+///////////////////////////////////////////////////
+bool SceneBvh::Build(const Scene& scene)
+{
+	Clear();
+	if (scene.draws.empty())
+		return false;
+
+	std::map<const Meshes::GLMesh*, MeshPositions> meshData;
+	std::vector<glm::vec3> centers;
+	drawBounds.reserve(scene.draws.size());
+	objectBounds.reserve(scene.draws.size());
+	centers.reserve(scene.draws.size());
+
+	for (const Scene::Draw& draw : scene.draws)
+	{
+		auto found = meshData.find(draw.range.mesh);
+		if (found == meshData.end())
+			found = meshData.emplace(draw.range.mesh, ReadMesh(*draw.range.mesh)).first;
+
+		objectBounds.push_back(RangeBounds(draw.range, found->second));
+		Aabb bounds = objectBounds.back().Transformed(draw.model);
+		drawBounds.push_back(bounds);
+		centers.push_back(bounds.Center());
+	}
+
+	ids.resize(scene.draws.size());
+	for (size_t i = 0; i < ids.size(); ++i)
+		ids[i] = static_cast<GLuint>(i);
+
+	nodes.reserve(2 * ids.size() / LEAF_SIZE + 1);
+	BuildNode(0, static_cast<GLuint>(ids.size()), centers);
+
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	Clear()
+//
+//	Drop the bounds and the hierarchy
+///////////////////////////////////////////////////
+void SceneBvh::Clear()
+{
+	drawBounds.clear();
+	objectBounds.clear();
+	nodes.clear();
+	ids.clear();
+}
+
+///////////////////////////////////////////////////
+//	Refit(const Scene&, const std::vector<GLuint>&)
+//
+//	scene: draw list with the new model matrices
+//	movedIds: draws whose model matrix changed
+//
+//	Children are stored after their parent, so one
+//	backward pass over the nodes refits bottom up.
+//	The split is kept; it only degrades with large
+//	moves
+///////////////////////////////////////////////////
+void SceneBvh::Refit(const Scene& scene, const std::vector<GLuint>& movedIds)
+{
+	if (movedIds.empty())
+		return;
+
+	for (GLuint id : movedIds)
+		drawBounds[id] = objectBounds[id].Transformed(scene.draws[id].model);
+
+	for (size_t index = nodes.size(); index-- > 0;)
+	{
+		Node& node = nodes[index];
+		node.bounds = Aabb::Empty();
+		if (node.count > 0)
+		{
+			for (GLuint i = node.first; i < node.first + node.count; ++i)
+				node.bounds.Grow(drawBounds[ids[i]]);
+		}
+		else
+		{
+			node.bounds.Grow(nodes[index + 1].bounds);
+			node.bounds.Grow(nodes[node.first].bounds);
+		}
+	}
+}
+
+///////////////////////////////////////////////////
+//	BuildNode(GLuint, GLuint, const std::vector<glm::vec3>&)
+//
+//	first, count: range of ids covered by the node
+//	centers: center of every draw, indexed by draw ID
+///////////////////////////////////////////////////
+void SceneBvh::BuildNode(GLuint first, GLuint count, const std::vector<glm::vec3>& centers)
+{
+	GLuint index = static_cast<GLuint>(nodes.size());
+	nodes.push_back(Node());
+
+	Aabb bounds = Aabb::Empty();
+	Aabb centerBounds = Aabb::Empty();
+	for (GLuint i = first; i < first + count; ++i)
+	{
+		bounds.Grow(drawBounds[ids[i]]);
+		centerBounds.Grow(centers[ids[i]]);
+	}
+	nodes[index].bounds = bounds;
+
+	if (count <= LEAF_SIZE)
+	{
+		nodes[index].first = first;
+		nodes[index].count = count;
+		return;
+	}
+
+	// Split at the median center along the longest axis
+	glm::vec3 size = centerBounds.max - centerBounds.min;
+	int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+	GLuint half = count / 2;
+	std::nth_element(ids.begin() + first, ids.begin() + first + half, ids.begin() + first + count, [&](GLuint a, GLuint b)
+	{
+		return centers[a][axis] < centers[b][axis];
+	});
+
+	BuildNode(first, half, centers);
+	nodes[index].first = static_cast<GLuint>(nodes.size());
+	nodes[index].count = 0;
+	BuildNode(first + half, count - half, centers);
+}
+
+///////////////////////////////////////////////////
+//	Cull(const Frustum&, std::vector<GLuint>&)
+//
+//	frustum: view frustum in world space
+//	visibleIds: receives the IDs of visible draws
+///////////////////////////////////////////////////
+void SceneBvh::Cull(const Frustum& frustum, std::vector<GLuint>& visibleIds) const
+{
+	if (!nodes.empty())
+		CullNode(0, frustum, ALL_PLANES, visibleIds);
+}
+
+///////////////////////////////////////////////////
+//	Split(size_t, std::vector<GLuint>&)
+//
+//	count: number of subtrees wanted
+//	subtrees: receives the subtree roots, in the
+//	order Cull visits them
+//
+//	Replace every inner node by its children, one
+//	level at a time, until there are enough subtrees
+//	or only leaves are left
+///////////////////////////////////////////////////
+void SceneBvh::Split(size_t count, std::vector<GLuint>& subtrees) const
+{
+	subtrees.clear();
+	if (nodes.empty())
+		return;
+
+	subtrees.push_back(0);
+	bool split = true;
+	while (subtrees.size() < count && split)
+	{
+		split = false;
+		std::vector<GLuint> next;
+		for (GLuint index : subtrees)
+		{
+			if (nodes[index].count > 0)
+			{
+				next.push_back(index);
+				continue;
+			}
+			next.push_back(index + 1);
+			next.push_back(nodes[index].first);
+			split = true;
+		}
+		subtrees.swap(next);
+	}
+}
+
+///////////////////////////////////////////////////
+//	CullSubtree(GLuint, const Frustum&, std::vector<GLuint>&)
+//
+//	node: subtree root returned by Split
+//	visibleIds: receives the IDs of visible draws
+///////////////////////////////////////////////////
+void SceneBvh::CullSubtree(GLuint node, const Frustum& frustum, std::vector<GLuint>& visibleIds) const
+{
+	CullNode(node, frustum, ALL_PLANES, visibleIds);
+}
+
+///////////////////////////////////////////////////
+//	CullNode(GLuint, const Frustum&, int, std::vector<GLuint>&)
+//
+//	planeMask: planes the parent straddles, children
+//	fully inside a plane skip it
+///////////////////////////////////////////////////
+void SceneBvh::CullNode(GLuint index, const Frustum& frustum, int planeMask, std::vector<GLuint>& visibleIds) const
+{
+	const Node& node = nodes[index];
+
+	for (int plane = 0; plane < 6; ++plane)
+	{
+		if (!(planeMask & (1 << plane)))
+			continue;
+
+		int side = Classify(node.bounds, frustum.planes[plane]);
+		if (side < 0)
+			return;
+		if (side > 0)
+			planeMask &= ~(1 << plane);
+	}
+
+	// Completely inside, no need to test the children
+	if (planeMask == 0)
+	{
+		AppendAll(index, visibleIds);
+		return;
+	}
+
+	if (node.count > 0)
+	{
+		for (GLuint i = node.first; i < node.first + node.count; ++i)
+		{
+			bool inside = true;
+			for (int plane = 0; plane < 6 && inside; ++plane)
+			{
+				if (planeMask & (1 << plane))
+					inside = Classify(drawBounds[ids[i]], frustum.planes[plane]) >= 0;
+			}
+			if (inside)
+				visibleIds.push_back(ids[i]);
+		}
+		return;
+	}
+
+	CullNode(index + 1, frustum, planeMask, visibleIds);
+	CullNode(node.first, frustum, planeMask, visibleIds);
+}
+
+///////////////////////////////////////////////////
+//	AppendAll(GLuint, std::vector<GLuint>&)
+//
+//	Append every draw below a node
+///////////////////////////////////////////////////
+void SceneBvh::AppendAll(GLuint index, std::vector<GLuint>& visibleIds) const
+{
+	const Node& node = nodes[index];
+	if (node.count > 0)
+	{
+		visibleIds.insert(visibleIds.end(), ids.begin() + node.first, ids.begin() + node.first + node.count);
+		return;
+	}
+
+	AppendAll(index + 1, visibleIds);
+	AppendAll(node.first, visibleIds);
+}
@@ -0,0 +1,93 @@
+///////////////////////////////////////////////////////////////////////////////
+// commandstream.cpp
+// ========
+// retained list of GL state changes and draw calls
+///////////////////////////////////////////////////////////////////////////////
+
+#include "commandstream.h"
+
+///////////////////////////////////////////////////
+//	Clear()
+//
+//	Drop every recorded command
+///////////////////////////////////////////////////
+void CommandStream::Clear()
+{
+	commands.clear();
+	drawCalls = 0;
+}
+
+void CommandStream::UseProgram(GLuint program)
+{
+	Command command = { USE_PROGRAM, program, 0, 0, 0 };
+	commands.push_back(command);
+}
+
+void CommandStream::BindVertexArray(GLuint vao)
+{
+	Command command = { BIND_VERTEX_ARRAY, vao, 0, 0, 0 };
+	commands.push_back(command);
+}
+
+void CommandStream::BindTexture(GLuint unit, GLuint texture)
+{
+	Command command = { BIND_TEXTURE, unit, texture, 0, 0 };
+	commands.push_back(command);
+}
+
+void CommandStream::BindUniformRange(GLuint binding, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	Command command = { BIND_UNIFORM_RANGE, binding, buffer, static_cast<GLint>(size), offset };
+	commands.push_back(command);
+}
+
+void CommandStream::DrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+	Command command = { DRAW_ARRAYS, mode, 0, count, first };
+	commands.push_back(command);
+	++drawCalls;
+}
+
+void CommandStream::DrawElements(GLenum mode, GLsizei count, GLintptr indexOffset)
+{
+	Command command = { DRAW_ELEMENTS, mode, 0, count, indexOffset };
+	commands.push_back(command);
+	++drawCalls;
+}
+
+///////////////////////////////////////////////////
+//	Replay()
+//
+//	Issue the recorded commands in order. Elements
+//	are always GL_UNSIGNED_INT, like every mesh
+///////////////////////////////////////////////////
+void CommandStream::Replay() const
+{
+	for (const Command& command : commands)
+	{
+		switch (command.op)
+		{
+		case USE_PROGRAM:
+			glUseProgram(command.a);
+			break;
+		case BIND_VERTEX_ARRAY:
+			glBindVertexArray(command.a);
+			break;
+		case BIND_TEXTURE:
+			glActiveTexture(GL_TEXTURE0 + command.a);
+			glBindTexture(GL_TEXTURE_2D, command.b);
+			break;
+		case BIND_UNIFORM_RANGE:
+			glBindBufferRange(GL_UNIFORM_BUFFER, command.a, command.b, command.offset, command.count);
+			break;
+		case DRAW_ARRAYS:
+			glDrawArrays(command.a, static_cast<GLint>(command.offset), command.count);
+			break;
+		case DRAW_ELEMENTS:
+			glDrawElements(command.a, command.count, GL_UNSIGNED_INT, (void*)command.offset);
+			break;
+		}
+	}
+
+	glBindVertexArray(0);
+}
@@ -0,0 +1,179 @@
+///////////////////////////////////////////////////////////////////////////////
+// deferredshading.cpp
+// ========
+// G-buffer of the deferred path and its fullscreen lighting pass
+///////////////////////////////////////////////////////////////////////////////
+
+#include "deferredshading.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <iostream>
+
+namespace
+{
+	GLuint CreateTarget(GLenum internalFormat, GLsizei width, GLsizei height)
+	{
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		return texture;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Create(GLsizei, GLsizei)
+//
+//	width, height: framebuffer size in pixels
+//
+//	Allocate the G-buffer targets and check that
+//	they can be rendered to together
+///////////////////////////////////////////////////
+bool DeferredShading::Create(GLsizei width, GLsizei height)
+{
+	this->width = width;
+	this->height = height;
+	glGenVertexArrays(1, &emptyVao);
+
+	if (!Allocate())
+	{
+		Destroy();
+		return false;
+	}
+	return true;
+}
+
+void DeferredShading::Destroy()
+{
+	Release();
+	glDeleteVertexArrays(1, &emptyVao);
+	emptyVao = 0;
+}
+
+bool DeferredShading::Allocate()
+{
+	albedoTexture = CreateTarget(GL_RGBA8, width, height);
+	normalTexture = CreateTarget(GL_RG16, width, height);
+	drawIdTexture = CreateTarget(GL_RG16UI, width, height);
+	depthTexture = CreateTarget(GL_DEPTH_COMPONENT32F, width, height);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, drawIdTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+	const GLenum attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+	glDrawBuffers(3, attachments);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "ERROR::DEFERRED::G-buffer incomplete, status 0x" << std::hex << status << std::dec << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void DeferredShading::Release()
+{
+	glDeleteFramebuffers(1, &framebuffer);
+	GLuint textures[4] = { albedoTexture, normalTexture, drawIdTexture, depthTexture };
+	glDeleteTextures(4, textures);
+	framebuffer = albedoTexture = normalTexture = drawIdTexture = depthTexture = 0;
+}
+
+///////////////////////////////////////////////////
+//	BeginGeometry(GLsizei, GLsizei)
+//
+//	width, height: size of the frame's target, the
+//	viewport may render to a part of it
+//
+//	Render into the G-buffer from here on. Only depth
+//	is cleared, the lighting pass skips pixels left
+//	at the far plane
+///////////////////////////////////////////////////
+bool DeferredShading::BeginGeometry(GLsizei width, GLsizei height)
+{
+	if (width != this->width || height != this->height)
+	{
+		Release();
+		this->width = width;
+		this->height = height;
+		if (!Allocate())
+			return false;
+	}
+
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &savedFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	return true;
+}
+
+void DeferredShading::EndGeometry()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, savedFramebuffer);
+}
+
+///////////////////////////////////////////////////
+//	CopyDepth()
+//
+//	Blit the depth of the viewport into the
+//	framebuffer bound before BeginGeometry, for
+//	passes that read the scene depth. Its depth must
+//	be single sampled GL_DEPTH_COMPONENT32F
+///////////////////////////////////////////////////
+void DeferredShading::CopyDepth()
+{
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	GLint right = viewport[0] + viewport[2];
+	GLint top = viewport[1] + viewport[3];
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, savedFramebuffer);
+	glBlitFramebuffer(viewport[0], viewport[1], right, top, viewport[0], viewport[1], right, top, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, savedFramebuffer);
+}
+
+///////////////////////////////////////////////////
+//	Light(GLuint, const glm::mat4&)
+//
+//	program: deferred lighting shader
+//	inverseViewProjection: rebuilds world positions
+//	from depth
+//
+//	Draw one fullscreen triangle without depth test,
+//	reading the G-buffer through the texture units
+///////////////////////////////////////////////////
+void DeferredShading::Light(GLuint program, const glm::mat4& inverseViewProjection)
+{
+	const GLuint units[4] = { ALBEDO_UNIT, NORMAL_UNIT, DRAW_ID_UNIT, DEPTH_UNIT };
+	const GLuint textures[4] = { albedoTexture, normalTexture, drawIdTexture, depthTexture };
+	for (int i = 0; i < 4; ++i)
+	{
+		glActiveTexture(GL_TEXTURE0 + units[i]);
+		glBindTexture(GL_TEXTURE_2D, textures[i]);
+	}
+
+	// Pixels map to normalized device coordinates through the viewport, which may not cover the G-buffer
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	glUseProgram(program);
+	glUniformMatrix4fv(glGetUniformLocation(program, "uInverseViewProjection"), 1, GL_FALSE, glm::value_ptr(inverseViewProjection));
+	glUniform2f(glGetUniformLocation(program, "uViewportSize"), static_cast<GLfloat>(viewport[2]), static_cast<GLfloat>(viewport[3]));
+
+	glDisable(GL_DEPTH_TEST);
+	glBindVertexArray(emptyVao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	glEnable(GL_DEPTH_TEST);
+}
@@ -0,0 +1,32 @@
+///////////////////////////////////////////////////////////////////////////////
+// directory.cpp
+// ========
+// creation of the directories the program writes its files to
+///////////////////////////////////////////////////////////////////////////////
+
+#include "directory.h"
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+///////////////////////////////////////////////////
+//	MakeDirectory(const std::string&)
+//
+//	path: directory to create, its parent must exist
+//
+//	Create the directory, then check that it exists
+//	as one, whether it was just created or not
+///////////////////////////////////////////////////
+bool MakeDirectory(const std::string& path)
+{
+	struct stat info;
+#ifdef _WIN32
+	_mkdir(path.c_str());
+	return stat(path.c_str(), &info) == 0 && (info.st_mode & _S_IFDIR);
+#else
+	mkdir(path.c_str(), 0755);
+	return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+#endif
+}
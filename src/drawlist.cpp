@@ -0,0 +1,112 @@
+///////////////////////////////////////////////////////////////////////////////
+// drawlist.cpp
+// ========
+// builds the sorted list of visible draws on the job system
+///////////////////////////////////////////////////////////////////////////////
+
+#include "drawlist.h"
+
+#include <algorithm>
+
+#include "profiler.h"
+
+namespace
+{
+	// Run a batch on the pool, or inline on the calling thread
+	void Dispatch(JobSystem& jobs, bool threaded, size_t jobCount, const JobSystem::Job& job)
+	{
+		if (threaded)
+		{
+			jobs.Run(jobCount, job);
+			return;
+		}
+		for (size_t i = 0; i < jobCount; ++i)
+			job(i);
+	}
+}
+
+///////////////////////////////////////////////////
+//	Build(JobSystem&, bool, const SceneBvh&, const Frustum*, const SceneBatch&, bool, std::vector<GLuint>&)
+//
+//	threaded: spread the jobs over the pool, run them
+//	on the calling thread otherwise
+//	frustum: view frustum in world space, nullptr to
+//	keep every draw
+//	indirect: sort for the indirect path rather than
+//	the loop path
+//	visibleIds: receives the sorted draw IDs
+///////////////////////////////////////////////////
+void DrawListBuilder::Build(JobSystem& jobs, bool threaded, const SceneBvh& bvh, const Frustum* frustum,
+	const SceneBatch& batch, bool indirect, std::vector<GLuint>& visibleIds)
+{
+	PROFILE_ZONE("DrawListBuilder::Build");
+	const size_t threads = threaded ? jobs.WorkerCount() + 1 : 1;
+	const size_t drawCount = bvh.drawBounds.size();
+
+	size_t jobCount = 0;
+	if (frustum)
+	{
+		bvh.Split(threads * JOBS_PER_THREAD, subtrees);
+		jobCount = subtrees.size();
+	}
+	else
+		jobCount = std::min(threads * JOBS_PER_THREAD, drawCount);
+
+	lastJobCount = jobCount;
+	if (jobIds.size() < jobCount)
+	{
+		jobIds.resize(jobCount);
+		jobPackets.resize(jobCount);
+	}
+
+	// Cull, key and sort, every job into its own buffers
+	Dispatch(jobs, threaded, jobCount, [&](size_t job)
+	{
+		std::vector<GLuint>& ids = jobIds[job];
+		ids.clear();
+		if (frustum)
+			bvh.CullSubtree(subtrees[job], *frustum, ids);
+		else
+		{
+			for (size_t id = drawCount * job / jobCount; id < drawCount * (job + 1) / jobCount; ++id)
+				ids.push_back(static_cast<GLuint>(id));
+		}
+
+		std::vector<DrawPacket>& out = jobPackets[job];
+		out.clear();
+		for (GLuint id : ids)
+			out.push_back({ batch.SubmitKey(id, indirect), id });
+		std::sort(out.begin(), out.end());
+	});
+
+	packets.clear();
+	runStarts.clear();
+	for (size_t job = 0; job < jobCount; ++job)
+	{
+		runStarts.push_back(packets.size());
+		packets.insert(packets.end(), jobPackets[job].begin(), jobPackets[job].end());
+	}
+	runStarts.push_back(packets.size());
+
+	// Merge neighbouring runs, halving the run count every pass
+	while (runStarts.size() > 2)
+	{
+		const size_t runCount = runStarts.size() - 1;
+		Dispatch(jobs, threaded, runCount / 2, [&](size_t pair)
+		{
+			std::inplace_merge(packets.begin() + runStarts[2 * pair],
+				packets.begin() + runStarts[2 * pair + 1],
+				packets.begin() + runStarts[2 * pair + 2]);
+		});
+
+		size_t kept = 0;
+		for (size_t run = 0; run < runCount; run += 2)
+			runStarts[kept++] = runStarts[run];
+		runStarts[kept++] = runStarts[runCount];
+		runStarts.resize(kept);
+	}
+
+	visibleIds.resize(packets.size());
+	for (size_t i = 0; i < packets.size(); ++i)
+		visibleIds[i] = packets[i].drawId;
+}
@@ -0,0 +1,290 @@
+///////////////////////////////////////////////////////////////////////////////
+// dynamicresolution.cpp
+// ========
+// offscreen scene target rendered at a scale that holds a GPU frame time,
+// upscaled to the window with a sharpening filter
+///////////////////////////////////////////////////////////////////////////////
+
+#include "dynamicresolution.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#ifndef GLSL
+#define GLSL(Version, Source) "#version " #Version " core \n" #Source
+#endif
+
+namespace
+{
+	/* Upscale Vertex Shader Source Code*/
+	const GLchar* upscaleVertexShaderSource = GLSL(440,
+
+		void main()
+		{
+			// (-1, -1), (3, -1), (-1, 3)
+			vec2 corner = vec2(float((gl_VertexID & 1) << 2) - 1.0, float((gl_VertexID & 2) << 1) - 1.0);
+			gl_Position = vec4(corner, 0.0, 1.0);
+		}
+	);
+
+	/* Upscale Fragment Shader Source Code*/
+	const GLchar* upscaleFragmentShaderSource = GLSL(440,
+
+		out vec4 fragmentColor;
+
+		uniform sampler2D uScene;
+		uniform vec2 uSourceScale; // part of the target the scene was rendered to
+		uniform float uSharpness;
+
+		void main()
+		{
+			// The window and the target have the same size, the scene covers its lower left corner
+			vec2 texel = 1.0 / vec2(textureSize(uScene, 0));
+			vec2 uv = gl_FragCoord.xy * texel * uSourceScale;
+			vec2 low = 0.5 * texel;
+			vec2 high = uSourceScale - 0.5 * texel;
+
+			// One source texel apart, clamped so nothing outside the rendered corner is read
+			vec3 center = texture(uScene, clamp(uv, low, high)).rgb;
+			vec3 north = texture(uScene, clamp(uv + vec2(0.0, texel.y), low, high)).rgb;
+			vec3 south = texture(uScene, clamp(uv - vec2(0.0, texel.y), low, high)).rgb;
+			vec3 east = texture(uScene, clamp(uv + vec2(texel.x, 0.0), low, high)).rgb;
+			vec3 west = texture(uScene, clamp(uv - vec2(texel.x, 0.0), low, high)).rgb;
+
+			// Unsharp mask against the cross average, limited to the neighbourhood range so edges do not ring
+			vec3 blurred = 0.25 * (north + south + east + west);
+			vec3 sharpened = center + uSharpness * (center - blurred);
+			vec3 minimum = min(center, min(min(north, south), min(east, west)));
+			vec3 maximum = max(center, max(max(north, south), max(east, west)));
+			fragmentColor = vec4(clamp(sharpened, minimum, maximum), 1.0);
+		}
+	);
+
+	bool CompileShader(GLenum type, const char* source, GLuint& shaderId)
+	{
+		int success = 0;
+		char infoLog[512];
+
+		shaderId = glCreateShader(type);
+		glShaderSource(shaderId, 1, &source, NULL);
+		glCompileShader(shaderId);
+		glGetShaderiv(shaderId, GL_COMPILE_STATUS, &success);
+		if (!success)
+		{
+			glGetShaderInfoLog(shaderId, sizeof(infoLog), NULL, infoLog);
+			std::cout << "ERROR::SHADER::" << (type == GL_VERTEX_SHADER ? "VERTEX" : "FRAGMENT") << "::COMPILATION_FAILED\n" << infoLog << std::endl;
+			glDeleteShader(shaderId);
+			return false;
+		}
+		return true;
+	}
+
+	bool CreateProgram(const char* vertexSource, const char* fragmentSource, GLuint& programId)
+	{
+		int success = 0;
+		char infoLog[512];
+
+		GLuint vertexShaderId = 0;
+		GLuint fragmentShaderId = 0;
+		if (!CompileShader(GL_VERTEX_SHADER, vertexSource, vertexShaderId))
+			return false;
+		if (!CompileShader(GL_FRAGMENT_SHADER, fragmentSource, fragmentShaderId))
+		{
+			glDeleteShader(vertexShaderId);
+			return false;
+		}
+
+		programId = glCreateProgram();
+		glAttachShader(programId, vertexShaderId);
+		glAttachShader(programId, fragmentShaderId);
+		glLinkProgram(programId);
+		glDeleteShader(vertexShaderId);
+		glDeleteShader(fragmentShaderId);
+		glGetProgramiv(programId, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
+			std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	GLuint CreateTarget(GLenum internalFormat, GLsizei width, GLsizei height, GLint filter)
+	{
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		return texture;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Create(GLsizei, GLsizei)
+//
+//	width, height: window framebuffer size
+//
+//	Compile the upscale program and allocate the
+//	scene target
+///////////////////////////////////////////////////
+bool DynamicResolution::Create(GLsizei width, GLsizei height)
+{
+	supported = false;
+	if (!CreateProgram(upscaleVertexShaderSource, upscaleFragmentShaderSource, program))
+	{
+		Destroy();
+		return false;
+	}
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "uScene"), SOURCE_UNIT);
+	sourceScaleLocation = glGetUniformLocation(program, "uSourceScale");
+	sharpnessLocation = glGetUniformLocation(program, "uSharpness");
+	glGenVertexArrays(1, &emptyVao);
+
+	this->width = width;
+	this->height = height;
+	if (!Allocate())
+	{
+		Destroy();
+		return false;
+	}
+	supported = true;
+	return true;
+}
+
+void DynamicResolution::Destroy()
+{
+	Release();
+	glDeleteProgram(program);
+	glDeleteVertexArrays(1, &emptyVao);
+	program = 0;
+	emptyVao = 0;
+	supported = false;
+}
+
+bool DynamicResolution::Allocate()
+{
+	colorTexture = CreateTarget(GL_RGBA8, width, height, GL_LINEAR);
+	depthTexture = CreateTarget(GL_DEPTH_COMPONENT32F, width, height, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "ERROR::DYNAMIC_RESOLUTION::Scene target incomplete, status 0x" << std::hex << status << std::dec << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void DynamicResolution::Release()
+{
+	glDeleteFramebuffers(1, &framebuffer);
+	GLuint textures[2] = { colorTexture, depthTexture };
+	glDeleteTextures(2, textures);
+	framebuffer = colorTexture = depthTexture = 0;
+}
+
+///////////////////////////////////////////////////
+//	Update(int, double)
+//
+//	region: frame ring region the frame was issued in
+//	gpuMs: GPU time of every pass of that frame
+//
+//	Smooth the time and move the scale towards the
+//	one that would have held the target
+///////////////////////////////////////////////////
+void DynamicResolution::Update(int region, double gpuMs)
+{
+	float frameScale = frameScales[region];
+	frameScales[region] = 0.0f;
+	if (gpuMs <= 0.0)
+		return;
+
+	lastGpuMs = gpuMs;
+	smoothedGpuMs = smoothedGpuMs > 0.0 ? smoothedGpuMs + SMOOTHING * (gpuMs - smoothedGpuMs) : gpuMs;
+
+	// Frames rendered straight to the window, or already in the band, leave the scale alone
+	if (frameScale <= 0.0f || (smoothedGpuMs <= targetMs && smoothedGpuMs >= targetMs * (1.0 - HEADROOM)))
+		return;
+
+	float desired = frameScale * static_cast<float>(std::sqrt(targetMs / smoothedGpuMs));
+	scale += GAIN * (desired - scale);
+	scale = scale < MIN_SCALE ? MIN_SCALE : std::min(scale, 1.0f);
+}
+
+///////////////////////////////////////////////////
+//	Begin(int, GLsizei, GLsizei)
+//
+//	region: frame ring region of this frame
+//	width, height: window framebuffer size
+//
+//	Set the viewport to the render size and clear
+//	it; the scene target is reallocated when the
+//	window size changed. Returns whether the frame
+//	renders offscreen
+///////////////////////////////////////////////////
+bool DynamicResolution::Begin(int region, GLsizei width, GLsizei height)
+{
+	offscreen = supported && enabled && width > 0 && height > 0;    // minimized windows have no size
+	if (offscreen && (width != this->width || height != this->height))
+	{
+		Release();
+		this->width = width;
+		this->height = height;
+		offscreen = supported = Allocate();
+	}
+
+	renderWidth = width;
+	renderHeight = height;
+	if (offscreen)
+	{
+		renderWidth = std::max(static_cast<GLsizei>(std::lround(width * scale)), 1);
+		renderHeight = std::max(static_cast<GLsizei>(std::lround(height * scale)), 1);
+	}
+	frameScales[region] = offscreen ? scale : 0.0f;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, offscreen ? framebuffer : outputFramebuffer);
+	glViewport(0, 0, renderWidth, renderHeight);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	return offscreen;
+}
+
+///////////////////////////////////////////////////
+//	End()
+//
+//	Draw one fullscreen triangle over the output,
+//	sharpening only when the scene was scaled down
+///////////////////////////////////////////////////
+void DynamicResolution::End()
+{
+	if (!offscreen)
+		return;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
+	glViewport(0, 0, width, height);
+
+	glActiveTexture(GL_TEXTURE0 + SOURCE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, colorTexture);
+	glUseProgram(program);
+	glUniform2f(sourceScaleLocation, static_cast<GLfloat>(renderWidth) / width, static_cast<GLfloat>(renderHeight) / height);
+	glUniform1f(sharpnessLocation, renderWidth < width ? SHARPNESS : 0.0f);
+
+	glDisable(GL_DEPTH_TEST);
+	glBindVertexArray(emptyVao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	glEnable(GL_DEPTH_TEST);
+}
@@ -0,0 +1,193 @@
+///////////////////////////////////////////////////////////////////////////////
+// framecapture.cpp
+// ========
+// offscreen framebuffer the headless mode renders every frame into, written
+// out as PNG or PPM images
+///////////////////////////////////////////////////////////////////////////////
+
+#include "framecapture.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+	// Largest block deflate stores uncompressed
+	const size_t STORED_BLOCK_SIZE = 65535;
+
+	void AppendBigEndian(std::vector<unsigned char>& bytes, uint32_t value)
+	{
+		for (int shift = 24; shift >= 0; shift -= 8)
+			bytes.push_back(static_cast<unsigned char>(value >> shift));
+	}
+
+	uint32_t Crc32(const unsigned char* data, size_t size, uint32_t crc = 0)
+	{
+		static uint32_t table[256] = {};
+		if (table[1] == 0)
+		{
+			for (uint32_t i = 0; i < 256; ++i)
+			{
+				uint32_t value = i;
+				for (int bit = 0; bit < 8; ++bit)
+					value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+				table[i] = value;
+			}
+		}
+
+		crc = ~crc;
+		for (size_t i = 0; i < size; ++i)
+			crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	// Length, type, data and the CRC of type and data
+	void AppendChunk(std::vector<unsigned char>& png, const char* type, const std::vector<unsigned char>& data)
+	{
+		AppendBigEndian(png, static_cast<uint32_t>(data.size()));
+		size_t typeStart = png.size();
+		png.insert(png.end(), type, type + 4);
+		png.insert(png.end(), data.begin(), data.end());
+		AppendBigEndian(png, Crc32(&png[typeStart], png.size() - typeStart));
+	}
+
+	// 8-bit RGB rows, top down, each behind filter type 0, in a zlib stream of stored blocks
+	std::vector<unsigned char> EncodePng(const std::vector<unsigned char>& rgb, GLsizei width, GLsizei height)
+	{
+		const size_t rowSize = static_cast<size_t>(width) * 3;
+		std::vector<unsigned char> raw;
+		raw.reserve((rowSize + 1) * height);
+		for (GLsizei y = 0; y < height; ++y)
+		{
+			raw.push_back(0);
+			raw.insert(raw.end(), rgb.begin() + y * rowSize, rgb.begin() + (y + 1) * rowSize);
+		}
+
+		std::vector<unsigned char> zlib = { 0x78, 0x01 };
+		zlib.reserve(raw.size() + raw.size() / STORED_BLOCK_SIZE * 5 + 16);
+		for (size_t offset = 0; offset < raw.size() || offset == 0; offset += STORED_BLOCK_SIZE)
+		{
+			size_t size = std::min(STORED_BLOCK_SIZE, raw.size() - offset);
+			zlib.push_back(offset + size == raw.size() ? 1 : 0);
+			zlib.push_back(static_cast<unsigned char>(size));
+			zlib.push_back(static_cast<unsigned char>(size >> 8));
+			zlib.push_back(static_cast<unsigned char>(~size));
+			zlib.push_back(static_cast<unsigned char>(~size >> 8));
+			zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + size);
+		}
+
+		uint32_t a = 1, b = 0;
+		for (unsigned char byte : raw)
+		{
+			a = (a + byte) % 65521;
+			b = (b + a) % 65521;
+		}
+		AppendBigEndian(zlib, (b << 16) | a);
+
+		std::vector<unsigned char> header;
+		AppendBigEndian(header, static_cast<uint32_t>(width));
+		AppendBigEndian(header, static_cast<uint32_t>(height));
+		header.insert(header.end(), { 8, 2, 0, 0, 0 });     // 8 bits, RGB, deflate, no filter choice, not interlaced
+
+		std::vector<unsigned char> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		AppendChunk(png, "IHDR", header);
+		AppendChunk(png, "IDAT", zlib);
+		AppendChunk(png, "IEND", {});
+		return png;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Create(GLsizei, GLsizei)
+//
+//	width, height: size of the frames
+//
+//	Allocate 8-bit color and depth renderbuffers
+///////////////////////////////////////////////////
+bool FrameCapture::Create(GLsizei width, GLsizei height)
+{
+	this->width = width;
+	this->height = height;
+
+	glGenRenderbuffers(1, &colorRenderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, colorRenderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glGenRenderbuffers(1, &depthRenderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32F, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRenderbuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "ERROR::FRAME_CAPTURE::Framebuffer incomplete, status 0x" << std::hex << status << std::dec << std::endl;
+		Destroy();
+		return false;
+	}
+	return true;
+}
+
+void FrameCapture::Destroy()
+{
+	glDeleteFramebuffers(1, &framebuffer);
+	GLuint renderbuffers[2] = { colorRenderbuffer, depthRenderbuffer };
+	glDeleteRenderbuffers(2, renderbuffers);
+	framebuffer = colorRenderbuffer = depthRenderbuffer = 0;
+}
+
+///////////////////////////////////////////////////
+//	Write(const std::string&)
+//
+//	path: image file, replaced
+//
+//	Read the framebuffer back, waiting for the frame
+//	to finish, and encode it by the path extension
+///////////////////////////////////////////////////
+bool FrameCapture::Write(const std::string& path) const
+{
+	const size_t rowSize = static_cast<size_t>(width) * 3;
+	std::vector<unsigned char> pixels(rowSize * height);
+
+	GLint readFramebuffer = 0;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+
+	// GL rows run bottom up, both image formats top down
+	std::vector<unsigned char> rows(pixels.size());
+	for (GLsizei y = 0; y < height; ++y)
+		std::memcpy(&rows[y * rowSize], &pixels[(height - 1 - y) * rowSize], rowSize);
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		std::cout << "ERROR::FRAME_CAPTURE::Cannot write " << path << std::endl;
+		return false;
+	}
+
+	bool ppm = path.size() >= 4 && path.compare(path.size() - 4, 4, ".ppm") == 0;
+	if (ppm)
+	{
+		file << "P6\n" << width << " " << height << "\n255\n";
+		file.write(reinterpret_cast<const char*>(rows.data()), rows.size());
+	}
+	else
+	{
+		std::vector<unsigned char> png = EncodePng(rows, width, height);
+		file.write(reinterpret_cast<const char*>(png.data()), png.size());
+	}
+	return static_cast<bool>(file);
+}
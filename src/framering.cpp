@@ -0,0 +1,147 @@
+///////////////////////////////////////////////////////////////////////////////
+// framering.cpp
+// ========
+// ring allocator for data written by the CPU every frame
+///////////////////////////////////////////////////////////////////////////////
+
+#include "framering.h"
+
+#include <chrono>
+
+#include "profiler.h"
+
+namespace
+{
+	// How long a single glClientWaitSync blocks before checking again
+	const GLuint64 WAIT_TIMEOUT_NS = 1000000;
+
+	const GLbitfield STORAGE_FLAGS = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+}
+
+///////////////////////////////////////////////////
+//	Create(GLsizeiptr)
+//
+//	size: bytes available to each frame
+//
+//	Allocate and map the storage of every region.
+//	Fails without ARB_buffer_storage.
+///////////////////////////////////////////////////
+bool FrameRing::Create(GLsizeiptr size)
+{
+	if (!(GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage))
+		return false;
+
+	// Keep every region start aligned for any binding target
+	const GLsizeiptr regionAlignment = 256;
+	regionSize = (size + regionAlignment - 1) / regionAlignment * regionAlignment;
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferStorage(GL_COPY_WRITE_BUFFER, regionSize * REGION_COUNT, nullptr, STORAGE_FLAGS);
+	mapped = static_cast<char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, regionSize * REGION_COUNT, STORAGE_FLAGS));
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	if (!mapped)
+	{
+		Destroy();
+		return false;
+	}
+
+	region = 0;
+	used = 0;
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	Destroy()
+//
+//	Wait for the GPU and release the buffer
+///////////////////////////////////////////////////
+void FrameRing::Destroy()
+{
+	for (GLsync& fence : fences)
+	{
+		if (fence)
+		{
+			glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+			glDeleteSync(fence);
+			fence = 0;
+		}
+	}
+
+	if (mapped)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		mapped = nullptr;
+	}
+
+	glDeleteBuffers(1, &buffer);
+	buffer = 0;
+	regionSize = 0;
+}
+
+///////////////////////////////////////////////////
+//	BeginFrame()
+//
+//	Move to the next region, waiting until the GPU is
+//	done with the frame that last used it
+///////////////////////////////////////////////////
+void FrameRing::BeginFrame()
+{
+	PROFILE_ZONE("FrameRing::BeginFrame");
+	region = (region + 1) % REGION_COUNT;
+	used = 0;
+	lastWaitMs = 0.0;
+
+	GLsync& fence = fences[region];
+	if (!fence)
+		return;
+
+	auto waitStart = std::chrono::steady_clock::now();
+	GLenum result = glClientWaitSync(fence, 0, 0);
+	while (result == GL_TIMEOUT_EXPIRED)
+		result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, WAIT_TIMEOUT_NS);
+	lastWaitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - waitStart).count();
+
+	glDeleteSync(fence);
+	fence = 0;
+}
+
+///////////////////////////////////////////////////
+//	Allocate(GLsizeiptr, GLsizeiptr)
+//
+//	size: bytes to hand out
+//	alignment: required alignment of the buffer offset,
+//	e.g. GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+//
+//	Suballocate from the current region. The data must
+//	be written before EndFrame.
+///////////////////////////////////////////////////
+FrameRing::Allocation FrameRing::Allocate(GLsizeiptr size, GLsizeiptr alignment)
+{
+	GLintptr regionStart = region * regionSize;
+	GLintptr offset = (regionStart + used + alignment - 1) / alignment * alignment;
+
+	if (!mapped || offset + size > regionStart + regionSize)
+	{
+		Allocation none = { nullptr, 0, 0 };
+		return none;
+	}
+
+	used = offset + size - regionStart;
+	Allocation allocation = { mapped + offset, offset, size };
+	return allocation;
+}
+
+///////////////////////////////////////////////////
+//	EndFrame()
+//
+//	Fence the region once the commands reading it have
+//	been issued
+///////////////////////////////////////////////////
+void FrameRing::EndFrame()
+{
+	fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,70 @@
+///////////////////////////////////////////////////////////////////////////////
+// gputimer.cpp
+// ========
+// GPU time of render passes, measured with GL_TIME_ELAPSED queries
+///////////////////////////////////////////////////////////////////////////////
+
+#include "gputimer.h"
+
+///////////////////////////////////////////////////
+//	Create(int)
+//
+//	passCount: passes to time
+///////////////////////////////////////////////////
+void GpuTimer::Create(int passCount)
+{
+	this->passCount = passCount;
+	lastMs.assign(passCount, 0.0);
+	for (int region = 0; region < FrameRing::REGION_COUNT; ++region)
+	{
+		queries[region].assign(passCount, 0);
+		issued[region].assign(passCount, 0);
+		glGenQueries(passCount, queries[region].data());
+	}
+}
+
+void GpuTimer::Destroy()
+{
+	for (int region = 0; region < FrameRing::REGION_COUNT; ++region)
+	{
+		glDeleteQueries(passCount, queries[region].data());
+		queries[region].clear();
+		issued[region].clear();
+	}
+	lastMs.clear();
+	passCount = 0;
+}
+
+void GpuTimer::Begin(int pass, int region)
+{
+	glBeginQuery(GL_TIME_ELAPSED, queries[region][pass]);
+	issued[region][pass] = 1;
+}
+
+void GpuTimer::End()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+}
+
+///////////////////////////////////////////////////
+//	Read(int)
+//
+//	region: frame ring region whose fence has passed
+//
+//	Fetch the time of every pass issued in region
+//	and zero the passes that were not
+///////////////////////////////////////////////////
+void GpuTimer::Read(int region)
+{
+	for (int pass = 0; pass < passCount; ++pass)
+	{
+		lastMs[pass] = 0.0;
+		if (!issued[region][pass])
+			continue;
+
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(queries[region][pass], GL_QUERY_RESULT, &elapsed);
+		lastMs[pass] = elapsed / 1000000.0;
+		issued[region][pass] = 0;
+	}
+}
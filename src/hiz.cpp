@@ -0,0 +1,412 @@
+///////////////////////////////////////////////////////////////////////////////
+// hiz.cpp
+// ========
+// hierarchical-Z occlusion culling of the indirect draw commands
+///////////////////////////////////////////////////////////////////////////////
+
+#include "hiz.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <iostream>
+
+#ifndef GLSL
+#define GLSL(Version, Source) "#version " #Version " core \n" #Source
+#endif
+
+namespace
+{
+	const GLbitfield RESULT_FLAGS = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	// Image units of the reduce shader
+	const GLuint SOURCE_IMAGE_UNIT = 0;
+	const GLuint TARGET_IMAGE_UNIT = 1;
+
+	// Shader storage bindings of the test shader, 0 is the per-draw data of the surface shader
+	const GLuint COMMAND_BINDING = 2;
+	const GLuint BOUNDS_BINDING = 3;
+	const GLuint RESULT_BINDING = 4;
+
+	const GLuint REDUCE_GROUP_SIZE = 8;
+	const GLuint TEST_GROUP_SIZE = 64;
+
+	/* Reduce Compute Shader Source Code*/
+	const GLchar* reduceShaderSource = GLSL(430,
+		layout(local_size_x = 8, local_size_y = 8) in;
+
+		uniform sampler2D uDepth;           // level 0 source
+		layout(r32f, binding = 0) readonly uniform image2D uSource;
+		layout(r32f, binding = 1) writeonly uniform image2D uTarget;
+		uniform int uLevel;
+
+		void main()
+		{
+			ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+			if (any(greaterThanEqual(texel, imageSize(uTarget))))
+				return;
+
+			// Level 0 copies the depth buffer, every other level keeps the farthest of 2x2 texels
+			float depth;
+			if (uLevel == 0)
+				depth = texelFetch(uDepth, texel, 0).r;
+			else
+			{
+				ivec2 source = texel * 2;
+				depth = max(max(imageLoad(uSource, source).r, imageLoad(uSource, source + ivec2(1, 0)).r),
+					max(imageLoad(uSource, source + ivec2(0, 1)).r, imageLoad(uSource, source + ivec2(1, 1)).r));
+			}
+
+			imageStore(uTarget, texel, vec4(depth));
+		}
+	);
+
+	/* Test Compute Shader Source Code*/
+	const GLchar* testShaderSource = GLSL(430,
+		layout(local_size_x = 64) in;
+
+		// DrawElementsIndirectCommand, baseInstance is the draw ID
+		struct Command
+		{
+			uint count;
+			uint instanceCount;
+			uint firstIndex;
+			int baseVertex;
+			uint baseInstance;
+		};
+
+		layout(std430, binding = 2) buffer Commands
+		{
+			Command commands[];
+		};
+
+		// World bounds min and max of every draw ID
+		layout(std430, binding = 3) readonly buffer Bounds
+		{
+			vec4 bounds[];
+		};
+
+		layout(std430, binding = 4) buffer Results
+		{
+			uint occluded[];
+		};
+
+		uniform sampler2D uPyramid;
+		uniform mat4 uViewProjection;
+		uniform uint uFirstCommand;
+		uniform uint uCommandCount;
+		uniform uint uResultSlot;
+		uniform float uSize;
+
+		void main()
+		{
+			if (gl_GlobalInvocationID.x >= uCommandCount)
+				return;
+
+			uint command = uFirstCommand + gl_GlobalInvocationID.x;
+			uint drawId = commands[command].baseInstance;
+			vec3 boxMin = bounds[drawId * 2u].xyz;
+			vec3 boxMax = bounds[drawId * 2u + 1u].xyz;
+
+			// Screen rectangle and nearest depth of the box, boxes crossing the near plane stay visible
+			bool visible = boxMin.x > boxMax.x;
+			vec3 ndcMin = vec3(1.0);
+			vec3 ndcMax = vec3(-1.0);
+			for (int corner = 0; corner < 8 && !visible; ++corner)
+			{
+				vec3 position = mix(boxMin, boxMax, vec3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1));
+				vec4 clip = uViewProjection * vec4(position, 1.0);
+				if (clip.w <= 0.0)
+					visible = true;
+				else
+				{
+					vec3 ndc = clip.xyz / clip.w;
+					ndcMin = min(ndcMin, ndc);
+					ndcMax = max(ndcMax, ndc);
+				}
+			}
+
+			if (!visible)
+			{
+				vec2 uvMin = clamp(ndcMin.xy * 0.5 + 0.5, 0.0, 1.0);
+				vec2 uvMax = clamp(ndcMax.xy * 0.5 + 0.5, 0.0, 1.0);
+				vec2 extent = (uvMax - uvMin) * uSize;
+
+				// Level where the rectangle covers at most 2x2 texels
+				float level = ceil(log2(max(max(extent.x, extent.y), 1.0)));
+				float occluderDepth = max(
+					max(textureLod(uPyramid, uvMin, level).r, textureLod(uPyramid, vec2(uvMax.x, uvMin.y), level).r),
+					max(textureLod(uPyramid, vec2(uvMin.x, uvMax.y), level).r, textureLod(uPyramid, uvMax, level).r));
+
+				visible = ndcMin.z * 0.5 + 0.5 <= occluderDepth;
+			}
+
+			commands[command].instanceCount = visible ? 1u : 0u;
+			if (!visible)
+				atomicAdd(occluded[uResultSlot], 1u);
+		}
+	);
+
+	bool CreateComputeProgram(const char* source, GLuint& programId)
+	{
+		int success = 0;
+		char infoLog[512];
+
+		GLuint shaderId = glCreateShader(GL_COMPUTE_SHADER);
+		glShaderSource(shaderId, 1, &source, NULL);
+		glCompileShader(shaderId);
+		glGetShaderiv(shaderId, GL_COMPILE_STATUS, &success);
+		if (!success)
+		{
+			glGetShaderInfoLog(shaderId, sizeof(infoLog), NULL, infoLog);
+			std::cout << "ERROR::SHADER::COMPUTE::COMPILATION_FAILED\n" << infoLog << std::endl;
+			glDeleteShader(shaderId);
+			return false;
+		}
+
+		programId = glCreateProgram();
+		glAttachShader(programId, shaderId);
+		glLinkProgram(programId);
+		glDeleteShader(shaderId);
+		glGetProgramiv(programId, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
+			std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Create(const std::vector<Aabb>&)
+//
+//	drawBounds: world bounds of every draw ID
+//
+//	Create the occlusion depth buffer, the pyramid,
+//	the compute programs and their buffers. Fails
+//	without compute shaders.
+///////////////////////////////////////////////////
+bool HiZCuller::Create(const std::vector<Aabb>& drawBounds)
+{
+	supported = false;
+	if (!GLEW_VERSION_4_3 || drawBounds.empty())
+		return false;
+
+	if (!CreateComputeProgram(reduceShaderSource, reduceProgram) || !CreateComputeProgram(testShaderSource, testProgram))
+	{
+		Destroy();
+		return false;
+	}
+
+	glUseProgram(reduceProgram);
+	glUniform1i(glGetUniformLocation(reduceProgram, "uDepth"), TEXTURE_UNIT);
+	glUseProgram(testProgram);
+	glUniform1i(glGetUniformLocation(testProgram, "uPyramid"), TEXTURE_UNIT);
+	glUniform1f(glGetUniformLocation(testProgram, "uSize"), static_cast<float>(SIZE));
+	glUseProgram(0);
+
+	glGenTextures(1, &depthTexture);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, SIZE, SIZE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glGenTextures(1, &pyramid);
+	glBindTexture(GL_TEXTURE_2D, pyramid);
+	glTexStorage2D(GL_TEXTURE_2D, LEVEL_COUNT, GL_R32F, SIZE, SIZE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (!complete)
+	{
+		std::cout << "ERROR::HIZ::FRAMEBUFFER_INCOMPLETE" << std::endl;
+		Destroy();
+		return false;
+	}
+
+	std::vector<glm::vec4> bounds;
+	bounds.reserve(drawBounds.size() * 2);
+	for (const Aabb& box : drawBounds)
+	{
+		bounds.push_back(glm::vec4(box.min, 1.0f));
+		bounds.push_back(glm::vec4(box.max, 1.0f));
+	}
+
+	glGenBuffers(1, &boundsBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, boundsBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, bounds.size() * sizeof(glm::vec4), bounds.data(), GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &resultBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, resultBuffer);
+	glBufferStorage(GL_SHADER_STORAGE_BUFFER, FrameRing::REGION_COUNT * sizeof(GLuint), nullptr, RESULT_FLAGS);
+	results = static_cast<GLuint*>(glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, FrameRing::REGION_COUNT * sizeof(GLuint), RESULT_FLAGS));
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	if (!results)
+	{
+		Destroy();
+		return false;
+	}
+
+	for (int region = 0; region < FrameRing::REGION_COUNT; ++region)
+		results[region] = 0;
+
+	lastOccluded = 0;
+	supported = true;
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	Destroy()
+//
+//	Release the textures, buffers and programs
+///////////////////////////////////////////////////
+void HiZCuller::Destroy()
+{
+	if (results)
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, resultBuffer);
+		glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		results = nullptr;
+	}
+
+	glDeleteFramebuffers(1, &framebuffer);
+	glDeleteTextures(1, &depthTexture);
+	glDeleteTextures(1, &pyramid);
+	glDeleteBuffers(1, &boundsBuffer);
+	glDeleteBuffers(1, &resultBuffer);
+	glDeleteProgram(reduceProgram);
+	glDeleteProgram(testProgram);
+	framebuffer = depthTexture = pyramid = 0;
+	boundsBuffer = resultBuffer = 0;
+	reduceProgram = testProgram = 0;
+	supported = false;
+}
+
+///////////////////////////////////////////////////
+//	UpdateBounds(const std::vector<Aabb>&, const std::vector<GLuint>&)
+//
+//	drawBounds: world bounds of every draw ID
+//	movedIds: draws whose bounds changed
+///////////////////////////////////////////////////
+void HiZCuller::UpdateBounds(const std::vector<Aabb>& drawBounds, const std::vector<GLuint>& movedIds)
+{
+	if (!supported || movedIds.empty())
+		return;
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, boundsBuffer);
+	for (GLuint id : movedIds)
+	{
+		glm::vec4 bounds[2] = { glm::vec4(drawBounds[id].min, 1.0f), glm::vec4(drawBounds[id].max, 1.0f) };
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, id * sizeof(bounds), sizeof(bounds), bounds);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+///////////////////////////////////////////////////
+//	BeginOcclusion()
+//
+//	Bind and clear the occlusion depth buffer. The
+//	caller renders the occluders depth only, with the
+//	same view and projection as the frame.
+///////////////////////////////////////////////////
+void HiZCuller::BeginOcclusion()
+{
+	glGetIntegerv(GL_VIEWPORT, savedViewport);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &savedFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, SIZE, SIZE);
+	glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+///////////////////////////////////////////////////
+//	EndOcclusion()
+//
+//	Restore the frame's framebuffer and reduce the
+//	occlusion depth buffer to the pyramid
+///////////////////////////////////////////////////
+void HiZCuller::EndOcclusion()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, savedFramebuffer);
+	glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+
+	glUseProgram(reduceProgram);
+	glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	GLint levelLocation = glGetUniformLocation(reduceProgram, "uLevel");
+
+	for (GLint level = 0; level < LEVEL_COUNT; ++level)
+	{
+		GLuint size = SIZE >> level;
+		glUniform1i(levelLocation, level);
+		glBindImageTexture(SOURCE_IMAGE_UNIT, pyramid, level > 0 ? level - 1 : 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		glBindImageTexture(TARGET_IMAGE_UNIT, pyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		glDispatchCompute((size + REDUCE_GROUP_SIZE - 1) / REDUCE_GROUP_SIZE, (size + REDUCE_GROUP_SIZE - 1) / REDUCE_GROUP_SIZE, 1);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	}
+
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+///////////////////////////////////////////////////
+//	Cull(const SceneBatch::IndirectCommands&, const glm::mat4&, int)
+//
+//	commands: prepared commands, in the frame ring
+//	viewProjection: projection * view of the frame
+//	region: current frame ring region
+//
+//	Zero the instance count of the commands hidden by
+//	the occluders and count them into the region slot
+///////////////////////////////////////////////////
+void HiZCuller::Cull(const SceneBatch::IndirectCommands& commands, const glm::mat4& viewProjection, int region)
+{
+	if (commands.count == 0)
+		return;
+
+	glUseProgram(testProgram);
+	glUniformMatrix4fv(glGetUniformLocation(testProgram, "uViewProjection"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+	glUniform1ui(glGetUniformLocation(testProgram, "uFirstCommand"), commands.firstCommand);
+	glUniform1ui(glGetUniformLocation(testProgram, "uCommandCount"), static_cast<GLuint>(commands.count));
+	glUniform1ui(glGetUniformLocation(testProgram, "uResultSlot"), static_cast<GLuint>(region));
+
+	glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, pyramid);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMAND_BINDING, commands.buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BOUNDS_BINDING, boundsBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, RESULT_BINDING, resultBuffer);
+
+	glDispatchCompute((commands.count + TEST_GROUP_SIZE - 1) / TEST_GROUP_SIZE, 1, 1);
+
+	// The commands are read by the draws that follow, the count by the CPU
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+}
+
+///////////////////////////////////////////////////
+//	ReadResults(int)
+//
+//	region: frame ring region that BeginFrame just
+//	waited on
+//
+//	Read the occluded count of the last frame that
+//	used the region and reset it for this frame
+///////////////////////////////////////////////////
+void HiZCuller::ReadResults(int region)
+{
+	if (!results)
+		return;
+
+	lastOccluded = results[region];
+	results[region] = 0;
+}
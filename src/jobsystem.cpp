@@ -0,0 +1,119 @@
+///////////////////////////////////////////////////////////////////////////////
+// jobsystem.cpp
+// ========
+// fixed pool of worker threads running parallel-for jobs
+///////////////////////////////////////////////////////////////////////////////
+
+#include "jobsystem.h"
+
+#include <algorithm>
+
+#include "profiler.h"
+
+///////////////////////////////////////////////////
+//	Start()
+//
+//	Create the workers, none on a single core
+//	machine or when the core count is unknown
+///////////////////////////////////////////////////
+void JobSystem::Start()
+{
+	Stop();
+
+	unsigned cores = std::thread::hardware_concurrency();
+	size_t count = cores > 1 ? std::min<size_t>(cores - 1, size_t(MAX_WORKERS)) : 0;
+	stopping = false;
+	for (size_t i = 0; i < count; ++i)
+		workers.emplace_back(&JobSystem::WorkerLoop, this, generation);
+}
+
+///////////////////////////////////////////////////
+//	Stop()
+//
+//	Wake the workers and wait for them to exit
+///////////////////////////////////////////////////
+void JobSystem::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for (std::thread& worker : workers)
+		worker.join();
+	workers.clear();
+}
+
+///////////////////////////////////////////////////
+//	Run(size_t, const Job&)
+//
+//	jobCount: number of jobs in the batch
+//	job: called once with every job index, from any
+//	thread of the pool
+//
+//	Post the batch, take jobs on the calling thread
+//	as well and wait for the workers to finish theirs
+///////////////////////////////////////////////////
+void JobSystem::Run(size_t jobCount, const Job& job)
+{
+	if (workers.empty() || jobCount < 2)
+	{
+		for (size_t i = 0; i < jobCount; ++i)
+			job(i);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		batch = &job;
+		batchSize = jobCount;
+		nextJob = 0;
+		busyWorkers = workers.size();
+		++generation;
+	}
+	wake.notify_all();
+
+	RunJobs();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this] { return busyWorkers == 0; });
+	batch = nullptr;
+}
+
+///////////////////////////////////////////////////
+//	WorkerLoop(unsigned)
+//
+//	seen: generation of the last batch posted before
+//	the worker started
+//
+//	Sleep until a new batch is posted, help with it
+//	and report back, until the pool stops
+///////////////////////////////////////////////////
+void JobSystem::WorkerLoop(unsigned seen)
+{
+	PROFILE_THREAD("Job worker");
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return stopping || generation != seen; });
+			if (stopping)
+				return;
+			seen = generation;
+		}
+
+		RunJobs();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--busyWorkers == 0)
+			done.notify_one();
+	}
+}
+
+void JobSystem::RunJobs()
+{
+	PROFILE_ZONE("JobSystem::RunJobs");
+	for (size_t i = nextJob++; i < batchSize; i = nextJob++)
+		(*batch)(i);
+}
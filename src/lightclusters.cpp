@@ -0,0 +1,207 @@
+///////////////////////////////////////////////////////////////////////////////
+// lightclusters.cpp
+// ========
+// clustered forward lighting: the point lights of the scene binned into a
+// grid of view frustum cells (froxels)
+///////////////////////////////////////////////////////////////////////////////
+
+#include "lightclusters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "profiler.h"
+
+namespace
+{
+	// Tile of a normalized device coordinate, clamped to the grid
+	GLuint Tile(float ndc, GLuint count)
+	{
+		float tile = std::floor((ndc * 0.5f + 0.5f) * count);
+		return static_cast<GLuint>(std::min(std::max(tile, 0.0f), static_cast<float>(count - 1)));
+	}
+
+	// Depth slice of a view depth, the same mapping as the surface fragment shaders
+	GLuint Slice(float depth, float scale, float bias, GLuint count)
+	{
+		float slice = std::floor(std::log(depth) * scale + bias);
+		return static_cast<GLuint>(std::min(std::max(slice, 0.0f), static_cast<float>(count - 1)));
+	}
+}
+
+///////////////////////////////////////////////////
+//	Create()
+//
+//	Size the per-frame ring allocations for the
+//	worst case: every light and every index in use
+///////////////////////////////////////////////////
+void LightClusters::Create()
+{
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+
+	ringBytes = sizeof(LightHeader) + MAX_LIGHTS * sizeof(PointLight)
+		+ (2 * CLUSTER_COUNT + MAX_INDICES) * sizeof(GLuint) + 2 * storageAlignment;
+
+	binned.reserve(MAX_LIGHTS);
+	clusterData.reserve(2 * CLUSTER_COUNT + MAX_INDICES);
+	cursors.resize(CLUSTER_COUNT);
+}
+
+///////////////////////////////////////////////////
+//	Build(FrameRing&, const std::vector<Scene::Light>&,
+//		const SceneGraph&, const glm::mat4&,
+//		const glm::mat4&, float, float, GLsizei,
+//		GLsizei, bool)
+//
+//	ring: frame ring the buffers are written to
+//	lights: lights of the scene, positioned by graph
+//	view, projection: camera of this frame
+//	nearPlane, farPlane: depth range of projection
+//	width, height: framebuffer size in pixels
+//	enabled: false binds an empty light list
+//
+//	Cull every light against the frustum, bin the
+//	survivors into the cells their bounding box
+//	touches and bind the light and cell buffers
+///////////////////////////////////////////////////
+void LightClusters::Build(FrameRing& ring, const std::vector<Scene::Light>& lights, const SceneGraph& graph,
+	const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane,
+	GLsizei width, GLsizei height, bool enabled)
+{
+	PROFILE_ZONE("LightClusters::Build");
+	lastLights = 0;
+	lastIndices = 0;
+	lastLitClusters = 0;
+	lastMaxPerCluster = 0;
+	lastDropped = 0;
+	binned.clear();
+	ranges.clear();
+
+	// Exponential slices: slice = log(depth) * scale + bias, 0 at the near plane and SLICES at the far plane
+	float sliceScale = SLICES / std::log(farPlane / nearPlane);
+	float sliceBias = -std::log(nearPlane) * sliceScale;
+
+	for (size_t i = 0; enabled && i < lights.size(); ++i)
+	{
+		const Scene::Light& light = lights[i];
+		glm::vec3 position = glm::vec3(graph.worlds[light.node][3]);
+		glm::vec3 center = glm::vec3(view * glm::vec4(position, 1.0f));
+
+		// Depth range of the bounding sphere inside the frustum, the camera looks down -z
+		float nearDepth = std::max(-center.z - light.radius, nearPlane);
+		float farDepth = std::min(-center.z + light.radius, farPlane);
+		if (nearDepth > farDepth)
+			continue;
+
+		// Screen rectangle of the bounding box clipped to that depth range; its corners hold the extremes
+		glm::vec2 low(std::numeric_limits<float>::max());
+		glm::vec2 high(-std::numeric_limits<float>::max());
+		for (int corner = 0; corner < 8; ++corner)
+		{
+			glm::vec4 point(center.x + (corner & 1 ? light.radius : -light.radius),
+				center.y + (corner & 2 ? light.radius : -light.radius),
+				corner & 4 ? -farDepth : -nearDepth, 1.0f);
+			glm::vec4 clip = projection * point;
+			glm::vec2 ndc = glm::vec2(clip) / clip.w;
+			low = glm::min(low, ndc);
+			high = glm::max(high, ndc);
+		}
+		if (low.x > 1.0f || low.y > 1.0f || high.x < -1.0f || high.y < -1.0f)
+			continue;
+
+		if (binned.size() == MAX_LIGHTS)
+		{
+			++lastDropped;
+			continue;
+		}
+
+		CellRange range;
+		range.light = static_cast<GLuint>(binned.size());
+		range.x0 = Tile(low.x, TILES_X);
+		range.x1 = Tile(high.x, TILES_X);
+		range.y0 = Tile(low.y, TILES_Y);
+		range.y1 = Tile(high.y, TILES_Y);
+		range.z0 = Slice(nearDepth, sliceScale, sliceBias, SLICES);
+		range.z1 = Slice(farDepth, sliceScale, sliceBias, SLICES);
+		ranges.push_back(range);
+
+		PointLight binnedLight = { glm::vec4(position, light.radius), glm::vec4(light.color, 1.0f) };
+		binned.push_back(binnedLight);
+	}
+	lastLights = static_cast<GLuint>(binned.size());
+
+	FrameRing::Allocation lightAllocation = ring.Allocate(sizeof(LightHeader) + binned.size() * sizeof(PointLight), storageAlignment);
+	if (!lightAllocation.data)
+		return;
+
+	LightHeader header;
+	header.clusterScale = glm::vec4(static_cast<float>(TILES_X) / width, static_cast<float>(TILES_Y) / height, sliceScale, sliceBias);
+	header.clusterInfo[0] = TILES_X;
+	header.clusterInfo[1] = TILES_Y;
+	header.clusterInfo[2] = SLICES;
+	header.clusterInfo[3] = lastLights;
+	char* lightData = static_cast<char*>(lightAllocation.data);
+	std::memcpy(lightData, &header, sizeof(header));
+	if (!binned.empty())
+		std::memcpy(lightData + sizeof(header), binned.data(), binned.size() * sizeof(PointLight));
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, LIGHT_BINDING, ring.buffer, lightAllocation.offset, lightAllocation.size);
+
+	// Fragments skip the cells when no light is bound, any range satisfies the binding
+	if (binned.empty())
+	{
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, CLUSTER_BINDING, ring.buffer, lightAllocation.offset, lightAllocation.size);
+		return;
+	}
+
+	// Count the lights of every cell
+	clusterData.assign(2 * CLUSTER_COUNT, 0);
+	for (const CellRange& range : ranges)
+	{
+		for (GLuint z = range.z0; z <= range.z1; ++z)
+			for (GLuint y = range.y0; y <= range.y1; ++y)
+				for (GLuint x = range.x0; x <= range.x1; ++x)
+					++clusterData[2 * ((z * TILES_Y + y) * TILES_X + x) + 1];
+	}
+
+	// Turn the counts into ranges of the index list that follows the cells, truncated at MAX_INDICES
+	GLuint first = 2 * CLUSTER_COUNT;
+	const GLuint end = first + MAX_INDICES;
+	size_t requested = 0;
+	for (GLuint cell = 0; cell < CLUSTER_COUNT; ++cell)
+	{
+		GLuint count = clusterData[2 * cell + 1];
+		requested += count;
+		count = std::min(count, end - first);
+		clusterData[2 * cell] = first;
+		clusterData[2 * cell + 1] = count;
+		first += count;
+
+		lastLitClusters += count > 0;
+		lastMaxPerCluster = std::max(lastMaxPerCluster, count);
+	}
+	lastIndices = first - 2 * CLUSTER_COUNT;
+	lastDropped += static_cast<GLuint>(requested - lastIndices);
+
+	// Fill the index list in light order
+	clusterData.resize(first);
+	std::fill(cursors.begin(), cursors.end(), 0);
+	for (const CellRange& range : ranges)
+	{
+		for (GLuint z = range.z0; z <= range.z1; ++z)
+			for (GLuint y = range.y0; y <= range.y1; ++y)
+				for (GLuint x = range.x0; x <= range.x1; ++x)
+				{
+					GLuint cell = (z * TILES_Y + y) * TILES_X + x;
+					if (cursors[cell] < clusterData[2 * cell + 1])
+						clusterData[clusterData[2 * cell] + cursors[cell]++] = range.light;
+				}
+	}
+
+	FrameRing::Allocation clusterAllocation = ring.Allocate(clusterData.size() * sizeof(GLuint), storageAlignment);
+	if (!clusterAllocation.data)
+		return;
+	std::memcpy(clusterAllocation.data, clusterData.data(), clusterData.size() * sizeof(GLuint));
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, CLUSTER_BINDING, ring.buffer, clusterAllocation.offset, clusterAllocation.size);
+}
@@ -0,0 +1,712 @@
+///////////////////////////////////////////////////////////////////////////////
+// lightmapbaker.cpp
+// ========
+// CPU baked diffuse lighting of the static, lightmapped surfaces
+///////////////////////////////////////////////////////////////////////////////
+
+#include "lightmapbaker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <tuple>
+
+#include "bvh.h"
+#include "profiler.h"
+
+namespace
+{
+	// Floats per interleaved vertex: position, normal, texture coordinates
+	const GLuint floatsPerVertex = 8;
+
+	// Ray origins are pushed this far off their surface so it does not shadow itself
+	const float RAY_OFFSET = 0.002f;
+
+	// Bumped whenever the bake changes its results, so older cache files are rebaked
+	const uint32_t BAKE_VERSION = 1;
+
+	const GLuint LEAF_SIZE = 4;
+
+	// Vertices and indices of a mesh, read back from its VBOs
+	struct MeshData
+	{
+		std::vector<GLfloat> vertices;
+		std::vector<GLuint> indices;
+	};
+
+	MeshData ReadMesh(const Meshes::GLMesh& mesh)
+	{
+		MeshData data;
+		GLint size = 0;
+
+		glBindBuffer(GL_COPY_READ_BUFFER, mesh.vbos[0]);
+		glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
+		data.vertices.resize(size / sizeof(GLfloat));
+		glGetBufferSubData(GL_COPY_READ_BUFFER, 0, data.vertices.size() * sizeof(GLfloat), data.vertices.data());
+
+		if (mesh.nIndices > 0)
+		{
+			data.indices.resize(mesh.nIndices);
+			glBindBuffer(GL_COPY_READ_BUFFER, mesh.vbos[1]);
+			glGetBufferSubData(GL_COPY_READ_BUFFER, 0, mesh.nIndices * sizeof(GLuint), data.indices.data());
+		}
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+		return data;
+	}
+
+	struct Vertex
+	{
+		glm::vec3 position;
+		glm::vec3 normal;
+		glm::vec2 uv;
+	};
+
+	// Triangles GL rasterizes for a draw range, three object space vertices each
+	void RangeTriangles(const Scene::DrawRange& range, const MeshData& data, std::vector<Vertex>& triangles)
+	{
+		triangles.clear();
+		const size_t vertexCount = data.vertices.size() / floatsPerVertex;
+		auto fetch = [&](GLsizei corner, Vertex& vertex)
+		{
+			size_t index = static_cast<size_t>(range.first + corner);
+			if (range.indexed)
+			{
+				if (index >= data.indices.size())
+					return false;
+				index = data.indices[index];
+			}
+			if (index >= vertexCount)
+				return false;
+
+			const GLfloat* v = &data.vertices[index * floatsPerVertex];
+			vertex.position = glm::vec3(v[0], v[1], v[2]);
+			vertex.normal = glm::vec3(v[3], v[4], v[5]);
+			vertex.uv = glm::vec2(v[6], v[7]);
+			return true;
+		};
+
+		GLsizei count = range.mode == GL_TRIANGLES ? range.count / 3 : std::max(range.count - 2, 0);
+		for (GLsizei t = 0; t < count; ++t)
+		{
+			GLsizei corners[3] = { t, t + 1, t + 2 };       // GL_TRIANGLE_STRIP
+			if (range.mode == GL_TRIANGLES)
+			{
+				corners[0] = 3 * t;
+				corners[1] = 3 * t + 1;
+				corners[2] = 3 * t + 2;
+			}
+			else if (range.mode == GL_TRIANGLE_FAN)
+				corners[0] = 0;
+
+			Vertex triangle[3];
+			if (fetch(corners[0], triangle[0]) && fetch(corners[1], triangle[1]) && fetch(corners[2], triangle[2]))
+				triangles.insert(triangles.end(), triangle, triangle + 3);
+		}
+	}
+
+	// True when the texture coordinates stay in [0, 1] and cover no texel twice
+	bool UniqueCoordinates(const std::vector<Vertex>& triangles)
+	{
+		const float EPSILON = 0.001f;
+		float area = 0.0f;
+		for (size_t t = 0; t < triangles.size(); t += 3)
+		{
+			for (size_t corner = t; corner < t + 3; ++corner)
+			{
+				const glm::vec2& uv = triangles[corner].uv;
+				if (uv.x < -EPSILON || uv.y < -EPSILON || uv.x > 1.0f + EPSILON || uv.y > 1.0f + EPSILON)
+					return false;
+			}
+			glm::vec2 edge1 = triangles[t + 1].uv - triangles[t].uv;
+			glm::vec2 edge2 = triangles[t + 2].uv - triangles[t].uv;
+			area += 0.5f * std::fabs(edge1.x * edge2.y - edge2.x * edge1.y);
+		}
+		return !triangles.empty() && area <= 1.0f + EPSILON;
+	}
+
+	// Weights of the corners of a texture space triangle at a point, false outside it
+	bool Barycentric(const glm::vec2& point, const glm::vec2& a, const glm::vec2& b, const glm::vec2& c, glm::vec3& weights)
+	{
+		glm::vec2 edge1 = b - a;
+		glm::vec2 edge2 = c - a;
+		glm::vec2 offset = point - a;
+		float determinant = edge1.x * edge2.y - edge2.x * edge1.y;
+		if (std::fabs(determinant) < 1e-12f)
+			return false;
+
+		float wb = (offset.x * edge2.y - edge2.x * offset.y) / determinant;
+		float wc = (edge1.x * offset.y - offset.x * edge1.y) / determinant;
+		weights = glm::vec3(1.0f - wb - wc, wb, wc);
+
+		const float EDGE = -1e-5f;
+		return weights.x >= EDGE && weights.y >= EDGE && weights.z >= EDGE;
+	}
+
+	// Bounding volume hierarchy over boxes, stored depth first like SceneBvh
+	struct Hierarchy
+	{
+		struct Node
+		{
+			Aabb bounds;
+			GLuint first;               // leaf: first index into items, inner: index of the right child
+			GLuint count;               // items in a leaf, 0 for inner nodes
+		};
+
+		std::vector<Node> nodes;
+		std::vector<GLuint> items;      // box indices, in leaf order
+	};
+
+	// Split the items at the median of their centers along the longest axis
+	void BuildNodes(const std::vector<Aabb>& boxes, Hierarchy& tree, GLuint begin, GLuint end)
+	{
+		Aabb bounds = Aabb::Empty();
+		Aabb centers = Aabb::Empty();
+		for (GLuint i = begin; i < end; ++i)
+		{
+			bounds.Grow(boxes[tree.items[i]]);
+			centers.Grow(boxes[tree.items[i]].Center());
+		}
+
+		GLuint index = static_cast<GLuint>(tree.nodes.size());
+		Hierarchy::Node node = { bounds, begin, end - begin };
+		tree.nodes.push_back(node);
+		if (end - begin <= LEAF_SIZE)
+			return;
+
+		glm::vec3 extent = centers.max - centers.min;
+		int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+		GLuint middle = (begin + end) / 2;
+		std::nth_element(tree.items.begin() + begin, tree.items.begin() + middle, tree.items.begin() + end,
+			[&boxes, axis](GLuint a, GLuint b) { return boxes[a].Center()[axis] < boxes[b].Center()[axis]; });
+
+		tree.nodes[index].count = 0;
+		BuildNodes(boxes, tree, begin, middle);
+		tree.nodes[index].first = static_cast<GLuint>(tree.nodes.size());
+		BuildNodes(boxes, tree, middle, end);
+	}
+
+	Hierarchy BuildHierarchy(const std::vector<Aabb>& boxes)
+	{
+		Hierarchy tree;
+		tree.items.resize(boxes.size());
+		for (size_t i = 0; i < boxes.size(); ++i)
+			tree.items[i] = static_cast<GLuint>(i);
+		if (!boxes.empty())
+			BuildNodes(boxes, tree, 0, static_cast<GLuint>(boxes.size()));
+		return tree;
+	}
+
+	// Reciprocal of each component, infinite for 0 so the slab test needs no special case
+	glm::vec3 Reciprocal(const glm::vec3& direction)
+	{
+		return glm::vec3(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	}
+
+	// Slab test of a ray segment [0, tMax] against a box; fmin / fmax drop the NaN of 0 * infinity
+	bool HitsBox(const Aabb& box, const glm::vec3& origin, const glm::vec3& inverseDirection, float tMax)
+	{
+		float nearT = 0.0f;
+		float farT = tMax;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			float t0 = (box.min[axis] - origin[axis]) * inverseDirection[axis];
+			float t1 = (box.max[axis] - origin[axis]) * inverseDirection[axis];
+			nearT = std::fmax(nearT, std::fmin(t0, t1));
+			farT = std::fmin(farT, std::fmax(t0, t1));
+		}
+		return nearT <= farT;
+	}
+
+	// Moller-Trumbore intersection within (0, tMax)
+	bool HitsTriangle(const glm::vec3* corners, const glm::vec3& origin, const glm::vec3& direction, float tMax)
+	{
+		glm::vec3 edge1 = corners[1] - corners[0];
+		glm::vec3 edge2 = corners[2] - corners[0];
+		glm::vec3 p = glm::cross(direction, edge2);
+		float determinant = glm::dot(edge1, p);
+		if (std::fabs(determinant) < 1e-12f)
+			return false;
+
+		float inverse = 1.0f / determinant;
+		glm::vec3 s = origin - corners[0];
+		float u = glm::dot(s, p) * inverse;
+		if (u < 0.0f || u > 1.0f)
+			return false;
+
+		glm::vec3 q = glm::cross(s, edge1);
+		float v = glm::dot(direction, q) * inverse;
+		if (v < 0.0f || u + v > 1.0f)
+			return false;
+
+		float t = glm::dot(edge2, q) * inverse;
+		return t > 0.0f && t < tMax;
+	}
+
+	// Whether any leaf item accepted by hit lies on the ray segment
+	template<typename Hit>
+	bool AnyHit(const Hierarchy& tree, const glm::vec3& origin, const glm::vec3& inverseDirection, float tMax, const Hit& hit)
+	{
+		if (tree.nodes.empty())
+			return false;
+
+		GLuint stack[64];
+		int depth = 0;
+		stack[depth++] = 0;
+		while (depth > 0)
+		{
+			GLuint index = stack[--depth];
+			const Hierarchy::Node& node = tree.nodes[index];
+			if (!HitsBox(node.bounds, origin, inverseDirection, tMax))
+				continue;
+
+			if (node.count > 0)
+			{
+				for (GLuint i = node.first; i < node.first + node.count; ++i)
+				{
+					if (hit(tree.items[i]))
+						return true;
+				}
+			}
+			else
+			{
+				stack[depth++] = node.first;
+				stack[depth++] = index + 1;
+			}
+		}
+		return false;
+	}
+
+	// Static triangles of the scene in two levels: a hierarchy per mesh range, shared by
+	// every draw of that range, and one over the world bounds of the draws
+	class RayScene
+	{
+
+	public:
+		size_t triangleCount = 0;
+
+	public:
+		void Build(const Scene& scene, const std::vector<char>& dynamicDraws, std::map<const Meshes::GLMesh*, MeshData>& meshData)
+		{
+			typedef std::tuple<const Meshes::GLMesh*, GLenum, GLint, GLsizei, bool> RangeKey;
+			std::map<RangeKey, GLuint> meshOfRange;
+			std::vector<Aabb> instanceBounds;
+			std::vector<Vertex> triangles;
+
+			for (size_t id = 0; id < scene.draws.size(); ++id)
+			{
+				const Scene::Draw& draw = scene.draws[id];
+				if (dynamicDraws[id])
+					continue;
+
+				RangeKey key(draw.range.mesh, draw.range.mode, draw.range.first, draw.range.count, draw.range.indexed);
+				auto found = meshOfRange.find(key);
+				if (found == meshOfRange.end())
+				{
+					if (!meshData.count(draw.range.mesh))
+						meshData[draw.range.mesh] = ReadMesh(*draw.range.mesh);
+					RangeTriangles(draw.range, meshData[draw.range.mesh], triangles);
+
+					Mesh mesh;
+					std::vector<Aabb> boxes;
+					for (size_t t = 0; t < triangles.size(); t += 3)
+					{
+						Aabb box = Aabb::Empty();
+						for (size_t corner = t; corner < t + 3; ++corner)
+						{
+							mesh.corners.push_back(triangles[corner].position);
+							box.Grow(triangles[corner].position);
+						}
+						boxes.push_back(box);
+					}
+					mesh.tree = BuildHierarchy(boxes);
+					found = meshOfRange.insert(std::make_pair(key, static_cast<GLuint>(meshes.size()))).first;
+					meshes.push_back(mesh);
+				}
+
+				const Mesh& mesh = meshes[found->second];
+				if (mesh.tree.nodes.empty())
+					continue;
+
+				Instance instance = { glm::inverse(draw.model), found->second };
+				instances.push_back(instance);
+				instanceBounds.push_back(mesh.tree.nodes[0].bounds.Transformed(draw.model));
+				triangleCount += mesh.corners.size() / 3;
+			}
+			tree = BuildHierarchy(instanceBounds);
+		}
+
+		// Whether anything lies between origin and origin + direction * tMax
+		bool Occluded(const glm::vec3& origin, const glm::vec3& direction, float tMax) const
+		{
+			return AnyHit(tree, origin, Reciprocal(direction), tMax, [&](GLuint i)
+			{
+				// Object space keeps t, the direction is not normalized
+				const Instance& instance = instances[i];
+				const Mesh& mesh = meshes[instance.mesh];
+				glm::vec3 objectOrigin = glm::vec3(instance.worldToObject * glm::vec4(origin, 1.0f));
+				glm::vec3 objectDirection = glm::vec3(instance.worldToObject * glm::vec4(direction, 0.0f));
+				return AnyHit(mesh.tree, objectOrigin, Reciprocal(objectDirection), tMax, [&](GLuint t)
+				{
+					return HitsTriangle(&mesh.corners[3 * t], objectOrigin, objectDirection, tMax);
+				});
+			});
+		}
+
+	private:
+		struct Mesh
+		{
+			std::vector<glm::vec3> corners;     // three per triangle
+			Hierarchy tree;
+		};
+
+		struct Instance
+		{
+			glm::mat4 worldToObject;
+			GLuint mesh;
+		};
+
+		std::vector<Mesh> meshes;
+		std::vector<Instance> instances;
+		Hierarchy tree;
+	};
+
+	// Diffuse terms of the surface shaders at a point, each light only where a ray reaches it
+	glm::vec3 Irradiance(const RayScene& rays, const Scene::Material& material, const LightmapBaker::Lighting& lighting,
+		const glm::vec3& position, const glm::vec3& normal, size_t& rayCount)
+	{
+		glm::vec3 origin = position + normal * RAY_OFFSET;
+		auto visible = [&](const glm::vec3& direction, float tMax)
+		{
+			++rayCount;
+			return !rays.Occluded(origin, direction, tMax);
+		};
+
+		// Both light terms carry the ambient component, as in the surface shaders
+		glm::vec3 irradiance = 2.0f * lighting.ambient;
+
+		// Material lights have no falloff
+		const glm::vec3 materialColors[2] = { material.light1Color, material.light2Color };
+		const glm::vec3 materialPositions[2] = { material.light1Position, material.light2Position };
+		for (int light = 0; light < 2; ++light)
+		{
+			if (materialColors[light] == glm::vec3(0.0f))
+				continue;
+
+			glm::vec3 toLight = materialPositions[light] - position;
+			float diffuse = glm::dot(normal, glm::normalize(toLight));
+			if (diffuse > 0.0f && visible(toLight, 1.0f))
+				irradiance += diffuse * materialColors[light];
+		}
+
+		float key = glm::dot(normal, lighting.keyDirection);
+		if (key > 0.0f && visible(lighting.keyDirection, FLT_MAX))
+			irradiance += key * lighting.keyColor;
+
+		for (const LightmapBaker::PointLight& light : lighting.points)
+		{
+			glm::vec3 toLight = light.position - position;
+			float lightDistance = glm::length(toLight);
+			if (lightDistance >= light.radius)
+				continue;
+
+			float falloff = 1.0f - lightDistance / light.radius;
+			float diffuse = glm::dot(normal, toLight / std::max(lightDistance, 0.0001f));
+			if (diffuse > 0.0f && visible(toLight, 1.0f))
+				irradiance += diffuse * falloff * falloff * light.color;
+		}
+		return irradiance;
+	}
+
+	// Fill texels no triangle covers with the average of their covered neighbours, a few texels deep
+	void Dilate(std::vector<float>& texels, std::vector<char>& covered, GLsizei layerCount, GLsizei size)
+	{
+		const int PASSES = 2;
+		for (int pass = 0; pass < PASSES; ++pass)
+		{
+			std::vector<char> filled = covered;
+			for (GLsizei layer = 0; layer < layerCount; ++layer)
+				for (GLsizei y = 0; y < size; ++y)
+					for (GLsizei x = 0; x < size; ++x)
+					{
+						size_t texel = (static_cast<size_t>(layer) * size + y) * size + x;
+						if (covered[texel])
+							continue;
+
+						glm::vec3 sum(0.0f);
+						int count = 0;
+						for (GLsizei ny = std::max(y - 1, 0); ny <= std::min(y + 1, size - 1); ++ny)
+							for (GLsizei nx = std::max(x - 1, 0); nx <= std::min(x + 1, size - 1); ++nx)
+							{
+								size_t neighbour = (static_cast<size_t>(layer) * size + ny) * size + nx;
+								if (!covered[neighbour])
+									continue;
+								sum += glm::vec3(texels[3 * neighbour], texels[3 * neighbour + 1], texels[3 * neighbour + 2]);
+								++count;
+							}
+						if (count == 0)
+							continue;
+
+						sum = sum / static_cast<float>(count);
+						texels[3 * texel] = sum.x;
+						texels[3 * texel + 1] = sum.y;
+						texels[3 * texel + 2] = sum.z;
+						filled[texel] = 1;
+					}
+			covered.swap(filled);
+		}
+	}
+
+	// 64-bit FNV-1a over raw bytes, chained through hash
+	uint64_t HashBytes(const void* data, size_t size, uint64_t hash)
+	{
+		const uint64_t PRIME = 1099511628211ull;
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; ++i)
+			hash = (hash ^ bytes[i]) * PRIME;
+		return hash;
+	}
+
+	template<typename T>
+	uint64_t HashValue(const T& value, uint64_t hash)
+	{
+		return HashBytes(&value, sizeof(value), hash);
+	}
+
+	const uint64_t HASH_OFFSET = 14695981039346656037ull;
+
+	// Hash of everything the bake reads: lights, transforms and ranges of every draw
+	uint64_t BakeKey(const Scene& scene, const std::vector<char>& dynamicDraws, const LightmapBaker::Lighting& lighting)
+	{
+		const uint32_t layout[2] = { BAKE_VERSION, static_cast<uint32_t>(LightmapBaker::SIZE) };
+		uint64_t hash = HashValue(layout, HASH_OFFSET);
+		hash = HashValue(lighting.ambient, hash);
+		hash = HashValue(lighting.keyDirection, hash);
+		hash = HashValue(lighting.keyColor, hash);
+		for (const LightmapBaker::PointLight& light : lighting.points)
+		{
+			hash = HashValue(light.position, hash);
+			hash = HashValue(light.color, hash);
+			hash = HashValue(light.radius, hash);
+		}
+
+		for (size_t id = 0; id < scene.draws.size(); ++id)
+		{
+			const Scene::Draw& draw = scene.draws[id];
+			const GLint range[8] = { static_cast<GLint>(draw.range.mesh->nVertices), static_cast<GLint>(draw.range.mesh->nIndices),
+				static_cast<GLint>(draw.range.mode), draw.range.first, draw.range.count, draw.range.indexed,
+				dynamicDraws[id], draw.lightmapped };
+			hash = HashValue(range, hash);
+			hash = HashValue(draw.model, hash);
+			if (draw.lightmapped)
+			{
+				hash = HashValue(draw.material.light1Color, hash);
+				hash = HashValue(draw.material.light1Position, hash);
+				hash = HashValue(draw.material.light2Color, hash);
+				hash = HashValue(draw.material.light2Position, hash);
+			}
+		}
+		return hash;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Bake(JobSystem&, Scene&, const std::vector<char>&,
+//		const Lighting&, const std::string&)
+//
+//	jobs: runs the rows of texels in parallel
+//	scene: lightmapped draws receive their layer
+//	dynamicDraws: per draw, nonzero for draws that
+//	move; they cast no baked shadow
+//	lighting: lights beside the material lights
+//	cachePath: file the results are kept in
+//
+//	Load the layers from the cache when its key
+//	matches, else bake and store them, then upload
+//	the texture array
+///////////////////////////////////////////////////
+bool LightmapBaker::Bake(JobSystem& jobs, Scene& scene, const std::vector<char>& dynamicDraws, const Lighting& lighting,
+	const std::string& cachePath)
+{
+	PROFILE_ZONE("LightmapBaker::Bake");
+	Destroy();
+	lastFromCache = false;
+	lastRays = 0;
+	lastTriangles = 0;
+	lastRefused = 0;
+
+	// Every lightmapped static draw with usable coordinates gets a layer
+	std::map<const Meshes::GLMesh*, MeshData> meshData;
+	std::vector<GLuint> layerDraws;
+	std::vector<std::vector<Vertex>> layerTriangles;
+	for (size_t id = 0; id < scene.draws.size(); ++id)
+	{
+		Scene::Draw& draw = scene.draws[id];
+		draw.material.lightmapLayer = -1;
+		if (!draw.lightmapped)
+			continue;
+
+		if (!meshData.count(draw.range.mesh))
+			meshData[draw.range.mesh] = ReadMesh(*draw.range.mesh);
+		std::vector<Vertex> triangles;
+		RangeTriangles(draw.range, meshData[draw.range.mesh], triangles);
+		if (dynamicDraws[id] || !UniqueCoordinates(triangles))
+		{
+			std::cout << "ERROR::LIGHTMAP::DRAW_" << id << "::" << (dynamicDraws[id] ? "MOVES" : "TEXTURE_COORDINATES_OVERLAP") << std::endl;
+			++lastRefused;
+			continue;
+		}
+
+		draw.material.lightmapLayer = static_cast<GLint>(layerDraws.size());
+		layerDraws.push_back(static_cast<GLuint>(id));
+		layerTriangles.push_back(triangles);
+	}
+	layerCount = static_cast<GLsizei>(layerDraws.size());
+	if (layerCount == 0)
+		return true;
+
+	const uint64_t key = BakeKey(scene, dynamicDraws, lighting);
+	std::vector<float> texels;
+	if (LoadCache(cachePath, key, texels))
+	{
+		lastFromCache = true;
+		Upload(texels);
+		return true;
+	}
+
+	RayScene rays;
+	rays.Build(scene, dynamicDraws, meshData);
+	lastTriangles = rays.triangleCount;
+
+	const size_t texelCount = static_cast<size_t>(layerCount) * SIZE * SIZE;
+	texels.assign(3 * texelCount, 0.0f);
+	std::vector<char> covered(texelCount, 0);
+	std::atomic<size_t> rayCount{ 0 };
+
+	// One job per row of a layer; each texel takes the first triangle covering its center
+	jobs.Run(static_cast<size_t>(layerCount) * SIZE, [&](size_t job)
+	{
+		const GLsizei layer = static_cast<GLsizei>(job / SIZE);
+		const GLsizei row = static_cast<GLsizei>(job % SIZE);
+		const Scene::Draw& draw = scene.draws[layerDraws[layer]];
+		const std::vector<Vertex>& triangles = layerTriangles[layer];
+		const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(draw.model)));
+
+		size_t rowRays = 0;
+		for (GLsizei column = 0; column < SIZE; ++column)
+		{
+			glm::vec2 uv((column + 0.5f) / SIZE, (row + 0.5f) / SIZE);
+			for (size_t t = 0; t < triangles.size(); t += 3)
+			{
+				glm::vec3 weights;
+				if (!Barycentric(uv, triangles[t].uv, triangles[t + 1].uv, triangles[t + 2].uv, weights))
+					continue;
+
+				glm::vec3 position = triangles[t].position * weights.x + triangles[t + 1].position * weights.y + triangles[t + 2].position * weights.z;
+				glm::vec3 normal = triangles[t].normal * weights.x + triangles[t + 1].normal * weights.y + triangles[t + 2].normal * weights.z;
+				glm::vec3 worldPosition = glm::vec3(draw.model * glm::vec4(position, 1.0f));
+				glm::vec3 worldNormal = glm::normalize(normalMatrix * normal);
+				glm::vec3 irradiance = Irradiance(rays, draw.material, lighting, worldPosition, worldNormal, rowRays);
+
+				size_t texel = (static_cast<size_t>(layer) * SIZE + row) * SIZE + column;
+				texels[3 * texel] = irradiance.x;
+				texels[3 * texel + 1] = irradiance.y;
+				texels[3 * texel + 2] = irradiance.z;
+				covered[texel] = 1;
+				break;
+			}
+		}
+		rayCount += rowRays;
+	});
+	lastRays = rayCount;
+
+	Dilate(texels, covered, layerCount, SIZE);
+	StoreCache(cachePath, key, texels);
+	Upload(texels);
+	return true;
+}
+
+void LightmapBaker::Destroy()
+{
+	glDeleteTextures(1, &texture);
+	texture = 0;
+	layerCount = 0;
+}
+
+void LightmapBaker::Bind() const
+{
+	glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+}
+
+///////////////////////////////////////////////////
+//	LoadCache(const std::string&, uint64_t,
+//		std::vector<float>&)
+//
+//	Read the layers of a cache file written for the
+//	same key and layer count
+///////////////////////////////////////////////////
+bool LightmapBaker::LoadCache(const std::string& path, uint64_t key, std::vector<float>& texels) const
+{
+	std::ifstream file(path, std::ios::binary);
+	CacheHeader header = {};
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != CACHE_MAGIC
+		|| header.key != key || header.size != static_cast<uint32_t>(SIZE) || header.layerCount != static_cast<uint32_t>(layerCount))
+		return false;
+
+	texels.resize(3 * static_cast<size_t>(layerCount) * SIZE * SIZE);
+	return static_cast<bool>(file.read(reinterpret_cast<char*>(texels.data()), texels.size() * sizeof(float)));
+}
+
+///////////////////////////////////////////////////
+//	StoreCache(const std::string&, uint64_t,
+//		const std::vector<float>&)
+//
+//	Write to a temporary file and rename it into
+//	place, like ProgramCache
+///////////////////////////////////////////////////
+void LightmapBaker::StoreCache(const std::string& path, uint64_t key, const std::vector<float>& texels) const
+{
+	const std::string temporary = path + ".tmp";
+	CacheHeader header = { CACHE_MAGIC, static_cast<uint32_t>(SIZE), key, static_cast<uint32_t>(layerCount), 0 };
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(texels.data()), texels.size() * sizeof(float));
+		if (!file)
+		{
+			std::remove(temporary.c_str());
+			return;
+		}
+	}
+	std::rename(temporary.c_str(), path.c_str());
+}
+
+///////////////////////////////////////////////////
+//	Upload(const std::vector<float>&)
+//
+//	Create the texture array with a full mip chain,
+//	lighting values above 1 are kept in half floats
+///////////////////////////////////////////////////
+void LightmapBaker::Upload(const std::vector<float>& texels)
+{
+	GLsizei levels = 1;
+	for (GLsizei size = SIZE; size > 1; size /= 2)
+		++levels;
+
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, GL_RGB16F, SIZE, SIZE, layerCount);
+	glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, SIZE, SIZE, layerCount, GL_RGB, GL_FLOAT, texels.data());
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
@@ -11,6 +11,7 @@
 
 #include <vector>
 #include "../include/meshes.h"
+#include "profiler.h"
 
 namespace
 {
@@ -26,6 +27,7 @@ namespace
 ///////////////////////////////////////////////////
 void Meshes::CreateMeshes()
 {
+	PROFILE_ZONE("Meshes::CreateMeshes");
 	UCreatePlaneMesh(gPlaneMesh);
 	UCreatePrismMesh(gPrismMesh);
 	UCreateBoxMesh(gBoxMesh);
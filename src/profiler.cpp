@@ -0,0 +1,188 @@
+///////////////////////////////////////////////////////////////////////////////
+// profiler.cpp
+// ========
+// scoped CPU zones recorded per thread and written as a Chrome trace
+///////////////////////////////////////////////////////////////////////////////
+
+#include "profiler.h"
+
+#ifdef ENABLE_PROFILER
+
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+	struct Event
+	{
+		const char* name;
+		uint64_t start;
+		uint64_t end;
+	};
+
+	// Written only by the owning thread; count and next are published with release stores
+	struct Chunk
+	{
+		Event events[Profiler::CHUNK_EVENTS];
+		std::atomic<int> count{ 0 };
+		std::atomic<Chunk*> next{ nullptr };
+	};
+
+	struct ThreadBuffer
+	{
+		int id = 0;
+		std::atomic<const char*> name{ nullptr };
+		Chunk* head = nullptr;
+		Chunk* tail = nullptr;                  // owning thread only
+		int chunks = 0;                         // owning thread only
+		std::atomic<uint64_t> dropped{ 0 };
+	};
+
+	// Taken once per thread and by dumps, never while recording
+	std::mutex gThreadsMutex;
+	// Buffers are never freed, so a dump can still read the zones of threads that have ended
+	std::vector<ThreadBuffer*> gThreads;
+
+	// Pairs a timestamp with steady_clock so timestamps can be converted to microseconds
+	const uint64_t gEpochTicks = Profiler::Now();
+	const std::chrono::steady_clock::time_point gEpochTime = std::chrono::steady_clock::now();
+
+	thread_local ThreadBuffer* tBuffer = nullptr;
+
+	ThreadBuffer* LocalBuffer()
+	{
+		if (!tBuffer)
+		{
+			ThreadBuffer* buffer = new ThreadBuffer();
+			buffer->head = buffer->tail = new Chunk();
+			buffer->chunks = 1;
+
+			std::lock_guard<std::mutex> lock(gThreadsMutex);
+			buffer->id = static_cast<int>(gThreads.size()) + 1;
+			gThreads.push_back(buffer);
+			tBuffer = buffer;
+		}
+		return tBuffer;
+	}
+
+	void WriteName(std::ofstream& file, const char* name)
+	{
+		for (const char* c = name; *c; ++c)
+		{
+			if (*c == '"' || *c == '\\')
+				file << '\\';
+			file << *c;
+		}
+	}
+}
+
+///////////////////////////////////////////////////
+//	Record(const char*, uint64_t, uint64_t)
+//
+//	name: zone name, kept by pointer
+//	start, end: Now() at the start and end of the zone
+//
+//	Fill the last chunk of the calling thread and
+//	start a new one once it is full
+///////////////////////////////////////////////////
+void Profiler::Record(const char* name, uint64_t start, uint64_t end)
+{
+	ThreadBuffer* buffer = LocalBuffer();
+	Chunk* chunk = buffer->tail;
+	int count = chunk->count.load(std::memory_order_relaxed);
+	if (count == CHUNK_EVENTS)
+	{
+		if (buffer->chunks == MAX_CHUNKS)
+		{
+			buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		Chunk* next = new Chunk();
+		chunk->next.store(next, std::memory_order_release);
+		buffer->tail = chunk = next;
+		++buffer->chunks;
+		count = 0;
+	}
+
+	chunk->events[count] = { name, start, end };
+	chunk->count.store(count + 1, std::memory_order_release);
+}
+
+void Profiler::SetThreadName(const char* name)
+{
+	LocalBuffer()->name.store(name, std::memory_order_release);
+}
+
+///////////////////////////////////////////////////
+//	WriteChromeTrace(const char*)
+//
+//	path: JSON file, replaced
+//
+//	Write one complete event per zone and one name
+//	per named thread. Zones still open are not
+//	written; threads may keep recording meanwhile
+///////////////////////////////////////////////////
+bool Profiler::WriteChromeTrace(const char* path)
+{
+	std::vector<ThreadBuffer*> threads;
+	{
+		std::lock_guard<std::mutex> lock(gThreadsMutex);
+		threads = gThreads;
+	}
+
+	double elapsedUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - gEpochTime).count();
+	double ticksPerUs = elapsedUs > 0.0 ? static_cast<double>(Now() - gEpochTicks) / elapsedUs : 1.0;
+
+	std::ofstream file(path, std::ios::trunc);
+	if (!file)
+	{
+		std::cout << "ERROR::PROFILER::Cannot write " << path << std::endl;
+		return false;
+	}
+
+	file << std::fixed << std::setprecision(3);
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Monopoly Scene\"}}";
+
+	size_t events = 0;
+	uint64_t dropped = 0;
+	for (ThreadBuffer* buffer : threads)
+	{
+		if (const char* name = buffer->name.load(std::memory_order_acquire))
+		{
+			file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->id << ",\"args\":{\"name\":\"";
+			WriteName(file, name);
+			file << "\"}}";
+		}
+
+		for (Chunk* chunk = buffer->head; chunk; chunk = chunk->next.load(std::memory_order_acquire))
+		{
+			int count = chunk->count.load(std::memory_order_acquire);
+			for (int i = 0; i < count; ++i)
+			{
+				const Event& event = chunk->events[i];
+				file << ",\n{\"name\":\"";
+				WriteName(file, event.name);
+				file << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id
+					<< ",\"ts\":" << static_cast<double>(event.start - gEpochTicks) / ticksPerUs
+					<< ",\"dur\":" << static_cast<double>(event.end - event.start) / ticksPerUs << "}";
+			}
+			events += count;
+		}
+		dropped += buffer->dropped.load(std::memory_order_relaxed);
+	}
+	file << "\n]}\n";
+
+	std::cout << "INFO: Wrote " << events << " profiler zones from " << threads.size() << " threads to " << path;
+	if (dropped > 0)
+		std::cout << " (" << dropped << " dropped once a thread filled its buffer)";
+	std::cout << std::endl;
+	return static_cast<bool>(file);
+}
+
+#endif
@@ -0,0 +1,165 @@
+///////////////////////////////////////////////////////////////////////////////
+// programcache.cpp
+// ========
+// on-disk cache of linked shader program binaries
+///////////////////////////////////////////////////////////////////////////////
+
+#include "programcache.h"
+
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+#include "directory.h"
+
+namespace
+{
+	// 64-bit FNV-1a over a string and its terminator, chained through hash
+	uint64_t Hash(const char* text, uint64_t hash)
+	{
+		const uint64_t PRIME = 1099511628211ull;
+		for (const char* c = text; ; ++c)
+		{
+			hash = (hash ^ static_cast<unsigned char>(*c)) * PRIME;
+			if (!*c)
+				break;
+		}
+		return hash;
+	}
+
+	const uint64_t HASH_OFFSET = 14695981039346656037ull;
+
+	std::string GLString(GLenum name)
+	{
+		const GLubyte* value = glGetString(name);
+		return value ? reinterpret_cast<const char*>(value) : "";
+	}
+}
+
+///////////////////////////////////////////////////
+//	Open(const std::string&)
+//
+//	directory: where the binaries are kept, created
+//	if missing
+//
+//	Enable the cache when the driver can save at
+//	least one program binary format
+///////////////////////////////////////////////////
+bool ProgramCache::Open(const std::string& directory)
+{
+	enabled = false;
+	if (!(GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary))
+		return false;
+
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	if (formats <= 0)
+		return false;
+
+	if (!MakeDirectory(directory))
+		return false;
+
+	this->directory = directory;
+	driver = GLString(GL_VENDOR) + "\n" + GLString(GL_RENDERER) + "\n" + GLString(GL_VERSION);
+	enabled = true;
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	Load(const char*, const char*, GLuint&)
+//
+//	programId: receives the program when the cached
+//	binary links
+//
+//	Read the entry of the sources and create the
+//	program from it; entries the driver rejects are
+//	deleted
+///////////////////////////////////////////////////
+bool ProgramCache::Load(const char* vertexSource, const char* fragmentSource, GLuint& programId)
+{
+	if (!enabled)
+		return false;
+
+	const uint64_t key = Key(vertexSource, fragmentSource);
+	const std::string path = PathOf(key);
+	std::ifstream file(path, std::ios::binary);
+	Header header = {};
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != MAGIC || header.key != key)
+	{
+		++misses;
+		return false;
+	}
+
+	std::vector<char> binary(header.length);
+	if (!file.read(binary.data(), binary.size()))
+	{
+		++misses;
+		return false;
+	}
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+	GLint success = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		glDeleteProgram(program);
+		std::remove(path.c_str());
+		++rejected;
+		return false;
+	}
+
+	programId = program;
+	++hits;
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	Store(const char*, const char*, GLuint)
+//
+//	Write the binary of a linked program to a
+//	temporary file and rename it into place, so a
+//	reader never sees a partial entry
+///////////////////////////////////////////////////
+void ProgramCache::Store(const char* vertexSource, const char* fragmentSource, GLuint programId)
+{
+	if (!enabled)
+		return;
+
+	GLint length = 0;
+	glGetProgramiv(programId, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(programId, length, &length, &format, binary.data());
+
+	const uint64_t key = Key(vertexSource, fragmentSource);
+	const std::string path = PathOf(key);
+	const std::string temporary = path + ".tmp";
+	Header header = { MAGIC, format, key, static_cast<uint32_t>(length), 0 };
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(binary.data(), length);
+		if (!file)
+		{
+			std::remove(temporary.c_str());
+			return;
+		}
+	}
+	std::rename(temporary.c_str(), path.c_str());
+}
+
+uint64_t ProgramCache::Key(const char* vertexSource, const char* fragmentSource) const
+{
+	return Hash(driver.c_str(), Hash(fragmentSource, Hash(vertexSource, HASH_OFFSET)));
+}
+
+std::string ProgramCache::PathOf(uint64_t key) const
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+	return directory + "/" + name;
+}
@@ -0,0 +1,77 @@
+///////////////////////////////////////////////////////////////////////////////
+// scene.cpp
+// ========
+// flat list of every draw that makes up the static scene
+///////////////////////////////////////////////////////////////////////////////
+
+#include "scene.h"
+
+///////////////////////////////////////////////////
+//	Clear()
+//
+//	Drop every recorded draw and light and reset the recording
+//	state to the surface shader defaults
+///////////////////////////////////////////////////
+void Scene::Clear()
+{
+	draws.clear();
+	sections.clear();
+	lights.clear();
+
+	mesh = nullptr;
+	model = glm::mat4(1.0f);
+	section = 0;
+	occluder = false;
+	lightmapped = false;
+
+	material.textures[0] = 0;
+	material.textures[1] = 0;
+	material.uvScale = glm::vec2(1.0f, 1.0f);
+	material.uvScale2 = glm::vec2(1.0f, 1.0f);
+	material.blendFactor = 0.0f;
+	material.hasTexture = false;
+	material.objectColor = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+	material.light1Color = glm::vec3(0.0f);
+	material.light1Position = glm::vec3(0.0f);
+	material.light2Color = glm::vec3(0.0f);
+	material.light2Position = glm::vec3(0.0f);
+	material.specularIntensity1 = 0.0f;
+	material.highlightSize1 = 1.0f;
+	material.specularIntensity2 = 0.0f;
+	material.highlightSize2 = 1.0f;
+	material.lightmapLayer = -1;
+}
+
+///////////////////////////////////////////////////
+//	DrawArrays(GLenum, GLint, GLsizei)
+//
+//	Record a non-indexed draw of the bound mesh
+///////////////////////////////////////////////////
+void Scene::DrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+	Draw draw;
+	draw.range = { mesh, mode, first, count, false };
+	draw.material = material;
+	draw.model = model;
+	draw.section = section;
+	draw.occluder = occluder;
+	draw.lightmapped = lightmapped;
+	draws.push_back(draw);
+}
+
+///////////////////////////////////////////////////
+//	DrawElements(GLenum, GLsizei)
+//
+//	Record an indexed draw of the bound mesh
+///////////////////////////////////////////////////
+void Scene::DrawElements(GLenum mode, GLsizei count)
+{
+	Draw draw;
+	draw.range = { mesh, mode, 0, count, true };
+	draw.material = material;
+	draw.model = model;
+	draw.section = section;
+	draw.occluder = occluder;
+	draw.lightmapped = lightmapped;
+	draws.push_back(draw);
+}
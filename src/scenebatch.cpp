@@ -0,0 +1,755 @@
+///////////////////////////////////////////////////////////////////////////////
+// scenebatch.cpp
+// ========
+// compiles the scene draw list into GPU buffers and submits it
+///////////////////////////////////////////////////////////////////////////////
+
+#include "scenebatch.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <tuple>
+
+#include "profiler.h"
+
+namespace
+{
+	// Floats per interleaved vertex: position, normal, texture coordinates
+	const GLuint floatsPerVertex = 8;
+
+	// Placement of a mesh inside the merged vertex buffer
+	struct MeshData
+	{
+		GLint baseVertex;
+		GLuint vertexCount;
+		std::vector<GLuint> indices;    // element buffer of the mesh, if any
+	};
+
+	// Identifies a triangulated draw range so repeated ranges share indices
+	typedef std::tuple<const Meshes::GLMesh*, GLenum, GLint, GLsizei, bool> RangeKey;
+
+	// Converts a vertex sequence drawn with mode into a triangle list
+	void AppendTriangles(GLenum mode, const std::vector<GLuint>& sequence, std::vector<GLuint>& indices)
+	{
+		if (mode == GL_TRIANGLES)
+		{
+			for (size_t i = 0; i + 2 < sequence.size(); i += 3)
+			{
+				indices.push_back(sequence[i]);
+				indices.push_back(sequence[i + 1]);
+				indices.push_back(sequence[i + 2]);
+			}
+		}
+		else if (mode == GL_TRIANGLE_STRIP)
+		{
+			// Every other triangle of a strip is flipped to keep the winding
+			for (size_t i = 0; i + 2 < sequence.size(); ++i)
+			{
+				indices.push_back(sequence[i + (i % 2)]);
+				indices.push_back(sequence[i + 1 - (i % 2)]);
+				indices.push_back(sequence[i + 2]);
+			}
+		}
+		else if (mode == GL_TRIANGLE_FAN)
+		{
+			for (size_t i = 1; i + 1 < sequence.size(); ++i)
+			{
+				indices.push_back(sequence[0]);
+				indices.push_back(sequence[i]);
+				indices.push_back(sequence[i + 1]);
+			}
+		}
+	}
+
+	// Number of triangles GL rasterizes for a draw range
+	GLsizei TriangleCount(const Scene::DrawRange& range)
+	{
+		if (range.mode == GL_TRIANGLES)
+			return range.count / 3;
+		return range.count > 2 ? range.count - 2 : 0;
+	}
+
+	// Shader features a material needs, see ShaderPermutations
+	GLuint FeaturesOf(const Scene::Material& material)
+	{
+		GLuint features = 0;
+		if (material.hasTexture)
+		{
+			features |= ShaderPermutations::TEXTURED;
+			if (material.blendFactor != 0.0f)
+				features |= ShaderPermutations::BLEND;
+		}
+		if (material.specularIntensity1 != 0.0f || material.specularIntensity2 != 0.0f)
+			features |= ShaderPermutations::SPECULAR;
+		if (material.light2Color != glm::vec3(0.0f))
+			features |= ShaderPermutations::SECOND_LIGHT;
+		if (material.lightmapLayer >= 0)
+			features |= ShaderPermutations::LIGHTMAPPED;
+		return features;
+	}
+
+	// Orders draws by their texture bindings
+	bool TextureOrder(const Scene::Draw& a, const Scene::Draw& b)
+	{
+		if (a.material.textures[0] != b.material.textures[0])
+			return a.material.textures[0] < b.material.textures[0];
+		return a.material.textures[1] < b.material.textures[1];
+	}
+
+	// Shading constants of a draw as read by both surface shaders
+	SceneBatch::DrawData MakeDrawData(const Scene::Material& material)
+	{
+		SceneBatch::DrawData data;
+		data.objectColor = material.objectColor;
+		data.light1Color = glm::vec4(material.light1Color, 0.0f);
+		data.light1Position = glm::vec4(material.light1Position, 1.0f);
+		data.light2Color = glm::vec4(material.light2Color, 0.0f);
+		data.light2Position = glm::vec4(material.light2Position, 1.0f);
+		data.uvScales = glm::vec4(material.uvScale.x, material.uvScale.y, material.uvScale2.x, material.uvScale2.y);
+		data.specular = glm::vec4(material.specularIntensity1, material.highlightSize1, material.specularIntensity2, material.highlightSize2);
+		data.params = glm::vec4(material.blendFactor, material.hasTexture ? 1.0f : 0.0f, static_cast<float>(material.lightmapLayer), 0.0f);
+		return data;
+	}
+
+	// Draw IDs 0..count-1
+	std::vector<GLuint> Identity(size_t count)
+	{
+		std::vector<GLuint> ids(count);
+		for (size_t i = 0; i < count; ++i)
+			ids[i] = static_cast<GLuint>(i);
+		return ids;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Build(const Scene&)
+//
+//	scene: recorded draw list
+//
+//	Sort the draw list for both submission paths and,
+//	when multi-draw-indirect is available, upload the
+//	merged geometry, indirect commands and per-draw data
+///////////////////////////////////////////////////
+bool SceneBatch::Build(const Scene& scene)
+{
+	if (scene.draws.empty())
+		return false;
+
+	draws = scene.draws;
+	drawCount = static_cast<GLsizei>(draws.size());
+	triangleCount = 0;
+	drawTriangles.clear();
+	drawFeatures.clear();
+	featureMasks.clear();
+	for (Scene::Draw& draw : draws)
+	{
+		drawTriangles.push_back(TriangleCount(draw.range));
+		triangleCount += drawTriangles.back();
+
+		// Textures the variant does not sample need no binding and must not split batches
+		GLuint features = FeaturesOf(draw.material);
+		if (!(features & ShaderPermutations::TEXTURED))
+			draw.material.textures[0] = 0;
+		if (!(features & ShaderPermutations::BLEND))
+			draw.material.textures[1] = 0;
+		drawFeatures.push_back(features);
+		if (std::find(featureMasks.begin(), featureMasks.end(), features) == featureMasks.end())
+			featureMasks.push_back(features);
+	}
+
+	// Loop path: group by shader variant, then by mesh so VAO binds are rare, then by textures
+	loopOrder = Identity(draws.size());
+	std::stable_sort(loopOrder.begin(), loopOrder.end(), [this](GLuint a, GLuint b)
+	{
+		if (drawFeatures[a] != drawFeatures[b])
+			return drawFeatures[a] < drawFeatures[b];
+		if (draws[a].range.mesh->vao != draws[b].range.mesh->vao)
+			return draws[a].range.mesh->vao < draws[b].range.mesh->vao;
+		return TextureOrder(draws[a], draws[b]);
+	});
+	loopPositionOfDraw.resize(draws.size());
+	for (size_t i = 0; i < loopOrder.size(); ++i)
+		loopPositionOfDraw[loopOrder[i]] = static_cast<GLuint>(i);
+
+	// Loop path constants, copied to the frame ring in submission order
+	GLint alignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	loopAlignment = std::max(alignment, 1);
+	loopStride = (sizeof(LoopConstants) + loopAlignment - 1) / loopAlignment * loopAlignment;
+	ringBytes = loopStride * draws.size() + loopAlignment;
+
+	loopConstants.resize(loopOrder.size());
+	for (size_t i = 0; i < loopOrder.size(); ++i)
+	{
+		LoopConstants& constants = loopConstants[i];
+		constants.data = MakeDrawData(draws[loopOrder[i]].material);
+		constants.drawId = loopOrder[i];
+	}
+
+	// Static copy of the loop constants for recorded command streams
+	std::vector<char> packedConstants(loopStride * loopConstants.size());
+	for (size_t i = 0; i < loopConstants.size(); ++i)
+		std::memcpy(&packedConstants[i * loopStride], &loopConstants[i], sizeof(LoopConstants));
+	glGenBuffers(1, &loopConstantBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, loopConstantBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, packedConstants.size(), packedConstants.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	// Indirect path: group by shader variant and textures, one multi-draw per group
+	indirectSupported = GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect;
+	if (indirectSupported)
+	{
+		std::vector<GLuint> indirectOrder = Identity(draws.size());
+		std::stable_sort(indirectOrder.begin(), indirectOrder.end(), [this](GLuint a, GLuint b)
+		{
+			if (drawFeatures[a] != drawFeatures[b])
+				return drawFeatures[a] < drawFeatures[b];
+			return TextureOrder(draws[a], draws[b]);
+		});
+		UploadIndirect(indirectOrder);
+		// Visible commands plus the commands of a depth-only pass over the same draws
+		ringBytes = std::max<GLsizeiptr>(ringBytes, 2 * (commands.size() + 1) * sizeof(DrawElementsIndirectCommand));
+	}
+
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	UploadIndirect(const std::vector<GLuint>&)
+//
+//	order: draw IDs in submission order
+//
+//	Merge the vertex data of every mesh used by the
+//	scene, triangulate each draw range and upload the
+//	indirect commands and per-draw data
+///////////////////////////////////////////////////
+void SceneBatch::UploadIndirect(const std::vector<GLuint>& order)
+{
+	std::map<const Meshes::GLMesh*, MeshData> meshData;
+	std::map<RangeKey, std::pair<GLuint, GLuint>> ranges;   // first index, index count
+	std::vector<GLfloat> vertices;
+	std::vector<GLuint> indices;
+	std::vector<DrawData> drawData(draws.size());
+	std::vector<GLuint> drawIds = Identity(draws.size());
+
+	buckets.clear();
+	commands.clear();
+	commandOfDraw.assign(draws.size(), 0);
+	bucketOfCommand.clear();
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		const GLuint id = order[i];
+		const Scene::Draw& draw = draws[id];
+		const Scene::DrawRange& range = draw.range;
+		const Meshes::GLMesh* mesh = range.mesh;
+
+		// Read the mesh back from its VBOs the first time it is used
+		auto found = meshData.find(mesh);
+		if (found == meshData.end())
+		{
+			MeshData data;
+			GLint size = 0;
+
+			glBindBuffer(GL_COPY_READ_BUFFER, mesh->vbos[0]);
+			glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
+			data.baseVertex = static_cast<GLint>(vertices.size() / floatsPerVertex);
+			data.vertexCount = size / (sizeof(GLfloat) * floatsPerVertex);
+			vertices.resize(vertices.size() + data.vertexCount * floatsPerVertex);
+			glGetBufferSubData(GL_COPY_READ_BUFFER, 0, data.vertexCount * floatsPerVertex * sizeof(GLfloat), &vertices[data.baseVertex * floatsPerVertex]);
+
+			if (mesh->nIndices > 0)
+			{
+				data.indices.resize(mesh->nIndices);
+				glBindBuffer(GL_COPY_READ_BUFFER, mesh->vbos[1]);
+				glGetBufferSubData(GL_COPY_READ_BUFFER, 0, mesh->nIndices * sizeof(GLuint), data.indices.data());
+			}
+
+			found = meshData.emplace(mesh, data).first;
+		}
+
+		// Triangulate the range the first time it is used
+		RangeKey key(mesh, range.mode, range.first, range.count, range.indexed);
+		auto cached = ranges.find(key);
+		if (cached == ranges.end())
+		{
+			const MeshData& data = found->second;
+			std::vector<GLuint> sequence;
+			GLuint firstIndex = static_cast<GLuint>(indices.size());
+
+			if (range.indexed)
+			{
+				GLuint last = std::min<GLuint>(range.first + range.count, static_cast<GLuint>(data.indices.size()));
+				sequence.assign(data.indices.begin() + range.first, data.indices.begin() + last);
+			}
+			else
+			{
+				// Ranges past the end of the mesh are clipped like GL does
+				GLuint last = std::min<GLuint>(range.first + range.count, data.vertexCount);
+				for (GLuint v = range.first; v < last; ++v)
+					sequence.push_back(v);
+			}
+
+			AppendTriangles(range.mode, sequence, indices);
+			cached = ranges.emplace(key, std::make_pair(firstIndex, static_cast<GLuint>(indices.size()) - firstIndex)).first;
+		}
+
+		DrawElementsIndirectCommand command;
+		command.count = cached->second.second;
+		command.instanceCount = 1;
+		command.firstIndex = cached->second.first;
+		command.baseVertex = found->second.baseVertex;
+		command.baseInstance = id;
+		commandOfDraw[id] = static_cast<GLuint>(commands.size());
+		commands.push_back(command);
+
+		const Scene::Material& material = draw.material;
+		drawData[id] = MakeDrawData(material);
+
+		// Start a new bucket whenever the shader variant or the texture bindings change
+		if (buckets.empty() || buckets.back().features != drawFeatures[id]
+			|| buckets.back().textures[0] != material.textures[0] || buckets.back().textures[1] != material.textures[1])
+		{
+			Bucket bucket = { drawFeatures[id], { material.textures[0], material.textures[1] }, static_cast<GLuint>(i), 0 };
+			buckets.push_back(bucket);
+		}
+		++buckets.back().commandCount;
+		bucketOfCommand.push_back(static_cast<GLuint>(buckets.size() - 1));
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	// Merged geometry
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+
+	glGenBuffers(1, &vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+
+	glGenBuffers(1, &indexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+	GLint stride = sizeof(GLfloat) * floatsPerVertex;
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(GLfloat) * 3));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(GLfloat) * 6));
+	glEnableVertexAttribArray(2);
+
+	// Draw ID: one value per instance, selected by the command's baseInstance
+	glGenBuffers(1, &drawIdBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, drawIdBuffer);
+	glBufferData(GL_ARRAY_BUFFER, drawIds.size() * sizeof(GLuint), drawIds.data(), GL_STATIC_DRAW);
+	glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), 0);
+	glEnableVertexAttribArray(3);
+	glVertexAttribDivisor(3, 1);
+
+	// Position only stream for depth passes, sharing indices and draw IDs
+	std::vector<GLfloat> positions;
+	positions.reserve(vertices.size() / floatsPerVertex * 3);
+	for (size_t v = 0; v < vertices.size(); v += floatsPerVertex)
+		positions.insert(positions.end(), vertices.begin() + v, vertices.begin() + v + 3);
+
+	glGenVertexArrays(1, &depthVao);
+	glBindVertexArray(depthVao);
+
+	glGenBuffers(1, &positionBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
+	glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(GLfloat), positions.data(), GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 3, 0);
+	glEnableVertexAttribArray(0);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, drawIdBuffer);
+	glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), 0);
+	glEnableVertexAttribArray(3);
+	glVertexAttribDivisor(3, 1);
+
+	glBindVertexArray(0);
+
+	glGenBuffers(1, &indirectBuffer);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	glGenBuffers(1, &drawDataBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawDataBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, drawData.size() * sizeof(DrawData), drawData.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+///////////////////////////////////////////////////
+//	Destroy()
+//
+//	Release the GPU buffers of the batch
+///////////////////////////////////////////////////
+void SceneBatch::Destroy()
+{
+	glDeleteVertexArrays(1, &vao);
+	glDeleteVertexArrays(1, &depthVao);
+	glDeleteBuffers(1, &vertexBuffer);
+	glDeleteBuffers(1, &positionBuffer);
+	glDeleteBuffers(1, &indexBuffer);
+	glDeleteBuffers(1, &drawIdBuffer);
+	glDeleteBuffers(1, &indirectBuffer);
+	glDeleteBuffers(1, &drawDataBuffer);
+	glDeleteBuffers(1, &loopConstantBuffer);
+	loopConstantBuffer = 0;
+
+	vao = depthVao = vertexBuffer = positionBuffer = indexBuffer = drawIdBuffer = indirectBuffer = drawDataBuffer = 0;
+	buckets.clear();
+	preparedBuckets.clear();
+	commands.clear();
+	commandOfDraw.clear();
+	bucketOfCommand.clear();
+	draws.clear();
+	drawTriangles.clear();
+	drawFeatures.clear();
+	featureMasks.clear();
+	loopOrder.clear();
+	loopPositionOfDraw.clear();
+	loopConstants.clear();
+}
+
+///////////////////////////////////////////////////
+//	CountVisible(const std::vector<GLuint>&)
+//
+//	visibleIds: draws to submit
+//
+//	Count the draws and triangles the submit will
+//	issue
+///////////////////////////////////////////////////
+void SceneBatch::CountVisible(const std::vector<GLuint>& visibleIds)
+{
+	lastSubmitDraws = static_cast<GLsizei>(visibleIds.size());
+	lastSubmitTriangles = 0;
+	for (GLuint id : visibleIds)
+		lastSubmitTriangles += drawTriangles[id];
+}
+
+///////////////////////////////////////////////////
+//	PrepareIndirect(FrameRing&, const std::vector<GLuint>&, bool, bool)
+//
+//	ring: frame ring the visible commands are written to
+//	visibleIds: draws to submit, sorted by SubmitKey
+//	or by section and then SubmitKey
+//	writable: always copy the commands to the ring, so
+//	the GPU may edit them before SubmitIndirect
+//	bySection: also start a bucket at every section and
+//	list the buckets of each in preparedSections
+//
+//	Select the commands of the visible draws, keeping
+//	one bucket per variant and texture pair. When nothing is culled
+//	the static indirect buffer is used as is. Unsorted
+//	draws still render, split over more buckets.
+///////////////////////////////////////////////////
+void SceneBatch::PrepareIndirect(FrameRing& ring, const std::vector<GLuint>& visibleIds, bool writable, bool bySection)
+{
+	PROFILE_ZONE("SceneBatch::PrepareIndirect");
+	CountVisible(visibleIds);
+	lastSubmitCalls = 0;
+	lastSubmitPrograms = 0;
+
+	prepared.buffer = indirectBuffer;
+	prepared.firstCommand = 0;
+	prepared.count = drawCount;
+	preparedBuckets = buckets;
+	preparedSections.clear();
+	if (lastSubmitDraws == drawCount && !writable && !bySection)
+		return;
+
+	// Aligned to a whole command so buckets can address it by command index
+	FrameRing::Allocation allocation = ring.Allocate(lastSubmitDraws * sizeof(DrawElementsIndirectCommand), sizeof(DrawElementsIndirectCommand));
+	preparedBuckets.clear();
+	prepared.count = 0;
+	if (!allocation.data)
+		return;
+
+	// Copy the visible commands in order, starting a bucket whenever the source bucket or the section changes
+	DrawElementsIndirectCommand* out = static_cast<DrawElementsIndirectCommand*>(allocation.data);
+	prepared.buffer = ring.buffer;
+	prepared.firstCommand = static_cast<GLuint>(allocation.offset / sizeof(DrawElementsIndirectCommand));
+	GLuint currentBucket = 0;
+	for (GLuint id : visibleIds)
+	{
+		GLuint command = commandOfDraw[id];
+		bool newSection = bySection && (preparedSections.empty() || preparedSections.back().section != draws[id].section);
+		if (newSection)
+			preparedSections.push_back({ draws[id].section, static_cast<GLuint>(preparedBuckets.size()), 0 });
+		if (newSection || preparedBuckets.empty() || bucketOfCommand[command] != currentBucket)
+		{
+			currentBucket = bucketOfCommand[command];
+			Bucket compacted = buckets[currentBucket];
+			compacted.firstCommand = prepared.firstCommand + prepared.count;
+			compacted.commandCount = 0;
+			preparedBuckets.push_back(compacted);
+			if (bySection)
+				++preparedSections.back().bucketCount;
+		}
+		out[prepared.count++] = commands[command];
+		++preparedBuckets.back().commandCount;
+	}
+}
+
+///////////////////////////////////////////////////
+//	SubmitIndirect(const ShaderPermutations&)
+//
+//	programs: variants of the indirect surface shader
+//
+//	Draw every prepared bucket
+///////////////////////////////////////////////////
+void SceneBatch::SubmitIndirect(const ShaderPermutations& programs)
+{
+	SubmitIndirect(programs, 0, static_cast<GLsizei>(preparedBuckets.size()));
+}
+
+///////////////////////////////////////////////////
+//	SubmitIndirect(const ShaderPermutations&, GLuint, GLsizei)
+//
+//	programs: variants of the indirect surface shader
+//	firstBucket, bucketCount: prepared buckets to draw,
+//	such as the buckets of one section
+//
+//	Draw the prepared commands with one multi-draw per
+//	bucket, switching program and textures only when
+//	they change. The counters add up over the calls
+//	after PrepareIndirect
+///////////////////////////////////////////////////
+void SceneBatch::SubmitIndirect(const ShaderPermutations& programs, GLuint firstBucket, GLsizei bucketCount)
+{
+	PROFILE_ZONE("SceneBatch::SubmitIndirect");
+	glBindVertexArray(vao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, prepared.buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, drawDataBuffer);
+	lastSubmitStateChanges += 3;
+
+	const Bucket* previous = nullptr;
+	GLuint program = 0;
+	for (GLsizei i = 0; i < bucketCount; ++i)
+	{
+		const Bucket& bucket = preparedBuckets[firstBucket + i];
+		if (programs.Program(bucket.features) != program)
+		{
+			program = programs.Program(bucket.features);
+			glUseProgram(program);
+			++lastSubmitPrograms;
+			++lastSubmitStateChanges;
+		}
+		if (!previous || previous->textures[0] != bucket.textures[0])
+		{
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, bucket.textures[0]);
+			++lastSubmitStateChanges;
+		}
+		if (!previous || previous->textures[1] != bucket.textures[1])
+		{
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_2D, bucket.textures[1]);
+			++lastSubmitStateChanges;
+		}
+		previous = &bucket;
+
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+			(void*)(bucket.firstCommand * sizeof(DrawElementsIndirectCommand)), bucket.commandCount, 0);
+		++lastSubmitCalls;
+	}
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindVertexArray(0);
+}
+
+///////////////////////////////////////////////////
+//	SubmitIndirectDepth()
+//
+//	Draw the prepared commands from the position only
+//	stream with a single multi-draw, for a depth
+//	pre-pass ahead of SubmitIndirect
+///////////////////////////////////////////////////
+void SceneBatch::SubmitIndirectDepth()
+{
+	PROFILE_ZONE("SceneBatch::SubmitIndirectDepth");
+	if (prepared.count == 0)
+		return;
+
+	glBindVertexArray(depthVao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, prepared.buffer);
+	lastSubmitStateChanges += 2;
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+		(void*)(prepared.firstCommand * sizeof(DrawElementsIndirectCommand)), prepared.count, 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindVertexArray(0);
+}
+
+///////////////////////////////////////////////////
+//	SubmitDepthOnly(FrameRing&, const std::vector<GLuint>&)
+//
+//	ring: frame ring the commands are written to
+//	ids: draws to submit
+//
+//	Draw the given draws from the position only stream
+//	with a single multi-draw and no texture bindings,
+//	for passes that only write depth. Needs
+//	multi-draw-indirect.
+///////////////////////////////////////////////////
+void SceneBatch::SubmitDepthOnly(FrameRing& ring, const std::vector<GLuint>& ids)
+{
+	FrameRing::Allocation allocation = ring.Allocate(ids.size() * sizeof(DrawElementsIndirectCommand), sizeof(DrawElementsIndirectCommand));
+	if (!allocation.data || ids.empty())
+		return;
+
+	DrawElementsIndirectCommand* out = static_cast<DrawElementsIndirectCommand*>(allocation.data);
+	for (size_t i = 0; i < ids.size(); ++i)
+		out[i] = commands[commandOfDraw[ids[i]]];
+
+	glBindVertexArray(depthVao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, ring.buffer);
+	lastSubmitStateChanges += 2;
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)allocation.offset, static_cast<GLsizei>(ids.size()), 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindVertexArray(0);
+}
+
+///////////////////////////////////////////////////
+//	SubmitLoop(FrameRing&, const std::vector<GLuint>&, const ShaderPermutations&)
+//
+//	ring: frame ring the per-draw constants are
+//	written to
+//	visibleIds: draws to submit, sorted by SubmitKey
+//	programs: variants of the classic surface shader
+//
+//	Draw the visible draws one at a time in the given
+//	order, re-binding only the programs, meshes and
+//	textures that changed
+///////////////////////////////////////////////////
+void SceneBatch::SubmitLoop(FrameRing& ring, const std::vector<GLuint>& visibleIds, const ShaderPermutations& programs)
+{
+	PROFILE_ZONE("SceneBatch::SubmitLoop");
+	CountVisible(visibleIds);
+	lastSubmitCalls = 0;
+	lastSubmitPrograms = 0;
+
+	FrameRing::Allocation allocation = ring.Allocate(loopStride * lastSubmitDraws, loopAlignment);
+	if (!allocation.data)
+		return;
+
+	char* constants = static_cast<char*>(allocation.data);
+	const Scene::Draw* previous = nullptr;
+	GLuint program = 0;
+	GLsizeiptr offset = 0;
+	for (GLuint id : visibleIds)
+	{
+		const GLuint i = loopPositionOfDraw[id];
+		const Scene::Draw& draw = draws[id];
+		const Scene::Material& m = draw.material;
+		const Scene::Material* p = previous ? &previous->material : nullptr;
+
+		if (programs.Program(drawFeatures[id]) != program)
+		{
+			program = programs.Program(drawFeatures[id]);
+			glUseProgram(program);
+			++lastSubmitPrograms;
+			++lastSubmitStateChanges;
+		}
+		if (!previous || previous->range.mesh != draw.range.mesh)
+		{
+			glBindVertexArray(draw.range.mesh->vao);
+			++lastSubmitStateChanges;
+		}
+
+		if (!p || p->textures[0] != m.textures[0])
+		{
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, m.textures[0]);
+			++lastSubmitStateChanges;
+		}
+		if (!p || p->textures[1] != m.textures[1])
+		{
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_2D, m.textures[1]);
+			++lastSubmitStateChanges;
+		}
+
+		// Material and draw ID of this draw, the model matrix is fetched from the transform buffer
+		std::memcpy(constants + offset, &loopConstants[i], sizeof(LoopConstants));
+		glBindBufferRange(GL_UNIFORM_BUFFER, LOOP_CONSTANTS_BINDING, ring.buffer, allocation.offset + offset, sizeof(LoopConstants));
+		++lastSubmitStateChanges;
+		offset += loopStride;
+
+		if (draw.range.indexed)
+			glDrawElements(draw.range.mode, draw.range.count, GL_UNSIGNED_INT, (void*)(draw.range.first * sizeof(GLuint)));
+		else
+			glDrawArrays(draw.range.mode, draw.range.first, draw.range.count);
+		++lastSubmitCalls;
+
+		previous = &draw;
+	}
+
+	glBindVertexArray(0);
+}
+
+///////////////////////////////////////////////////
+//	RecordLoop(CommandStream&, const std::vector<GLuint>&, const ShaderPermutations&)
+//
+//	stream: stream to record into, cleared first
+//	visibleIds: draws to record, sorted by SubmitKey
+//	programs: variants of the classic surface shader
+//
+//	Record the same commands SubmitLoop issues, with
+//	the constants bound from the static constant
+//	buffer so the stream can be replayed as is until
+//	the visible draws change
+///////////////////////////////////////////////////
+void SceneBatch::RecordLoop(CommandStream& stream, const std::vector<GLuint>& visibleIds, const ShaderPermutations& programs)
+{
+	PROFILE_ZONE("SceneBatch::RecordLoop");
+	CountVisible(visibleIds);
+	stream.Clear();
+	lastSubmitPrograms = 0;
+
+	const Scene::Draw* previous = nullptr;
+	GLuint program = 0;
+	for (GLuint id : visibleIds)
+	{
+		const GLuint i = loopPositionOfDraw[id];
+		const Scene::Draw& draw = draws[id];
+		const Scene::Material& m = draw.material;
+		const Scene::Material* p = previous ? &previous->material : nullptr;
+
+		if (programs.Program(drawFeatures[id]) != program)
+		{
+			program = programs.Program(drawFeatures[id]);
+			stream.UseProgram(program);
+			++lastSubmitPrograms;
+			++lastSubmitStateChanges;
+		}
+		if (!previous || previous->range.mesh != draw.range.mesh)
+		{
+			stream.BindVertexArray(draw.range.mesh->vao);
+			++lastSubmitStateChanges;
+		}
+		if (!p || p->textures[0] != m.textures[0])
+		{
+			stream.BindTexture(0, m.textures[0]);
+			++lastSubmitStateChanges;
+		}
+		if (!p || p->textures[1] != m.textures[1])
+		{
+			stream.BindTexture(1, m.textures[1]);
+			++lastSubmitStateChanges;
+		}
+
+		stream.BindUniformRange(LOOP_CONSTANTS_BINDING, loopConstantBuffer, i * loopStride, sizeof(LoopConstants));
+		++lastSubmitStateChanges;
+
+		if (draw.range.indexed)
+			stream.DrawElements(draw.range.mode, draw.range.count, draw.range.first * sizeof(GLuint));
+		else
+			stream.DrawArrays(draw.range.mode, draw.range.first, draw.range.count);
+
+		previous = &draw;
+	}
+
+	lastSubmitCalls = stream.drawCalls;
+}
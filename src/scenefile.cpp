@@ -0,0 +1,700 @@
+///////////////////////////////////////////////////////////////////////////////
+// scenefile.cpp
+// ========
+// scene description: a text form for authoring, compiled to a binary form
+// that is memory mapped and read in place at load
+///////////////////////////////////////////////////////////////////////////////
+
+#include "scenefile.h"
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+const char* const SceneFile::MESH_NAMES[SceneFile::MESH_COUNT] =
+{
+	"box", "cone", "cylinder", "tapered_cylinder", "plane", "prism",
+	"sphere", "pyramid3", "pyramid4", "torus", "dice"
+};
+
+namespace
+{
+	const char MAGIC[4] = { 'M', 'S', 'C', 'N' };
+
+	// Instances nested deeper than this are assumed to include themselves
+	const int MAX_INSTANCE_DEPTH = 8;
+
+	// Records of every file reached from the top level scene
+	struct Compiler
+	{
+		std::vector<SceneFile::TextureRecord> textures;
+		std::vector<SceneFile::MaterialRecord> materials;
+		std::vector<SceneFile::SectionRecord> sections;
+		std::vector<SceneFile::NodeRecord> nodes;
+		std::vector<SceneFile::DrawRecord> draws;
+		std::vector<SceneFile::LightRecord> lights;
+		std::string strings;
+
+		std::map<std::string, uint32_t> textureIndex;
+		std::map<std::string, uint32_t> materialIndex;
+		std::map<std::string, uint32_t> sectionIndex;
+
+		uint32_t AddString(const std::string& text)
+		{
+			uint32_t offset = static_cast<uint32_t>(strings.size());
+			strings.append(text);
+			strings.push_back('\0');
+			return offset;
+		}
+
+		uint32_t AddSection(const std::string& name)
+		{
+			auto found = sectionIndex.find(name);
+			if (found != sectionIndex.end())
+				return found->second;
+
+			SceneFile::SectionRecord section = { AddString(name) };
+			sections.push_back(section);
+			return sectionIndex[name] = static_cast<uint32_t>(sections.size() - 1);
+		}
+
+		bool Parse(const std::string& path, int32_t parent, int depth);
+	};
+
+	bool Fail(const std::string& path, int line, const std::string& message)
+	{
+		std::cout << "ERROR::SCENE::" << path << ":" << line << ": " << message << std::endl;
+		return false;
+	}
+
+	// Directory part of a path including the trailing separator
+	std::string Directory(const std::string& path)
+	{
+		size_t slash = path.find_last_of("/\\");
+		return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+	}
+
+	bool ReadFloats(std::istringstream& tokens, float* values, int count)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			if (!(tokens >> values[i]))
+				return false;
+		}
+		return true;
+	}
+
+	bool ReadMode(const std::string& name, uint32_t& mode)
+	{
+		if (name == "triangles")
+			mode = GL_TRIANGLES;
+		else if (name == "strip")
+			mode = GL_TRIANGLE_STRIP;
+		else if (name == "fan")
+			mode = GL_TRIANGLE_FAN;
+		else
+			return false;
+		return true;
+	}
+
+	bool ReadCount(const std::string& text, int32_t& count)
+	{
+		if (text == "all")
+		{
+			count = -1;
+			return true;
+		}
+		char* end = nullptr;
+		long value = std::strtol(text.c_str(), &end, 10);
+		count = static_cast<int32_t>(value);
+		return *end == '\0' && value >= 0;
+	}
+
+	// Apply a transform statement to matrix, false if keyword is not one
+	bool ReadTransform(const std::string& keyword, std::istringstream& tokens, glm::mat4& matrix, bool& valid)
+	{
+		float v[4];
+		if (keyword == "translate")
+		{
+			valid = ReadFloats(tokens, v, 3);
+			matrix = matrix * glm::translate(glm::vec3(v[0], v[1], v[2]));
+		}
+		else if (keyword == "rotate" || keyword == "rotate_radians")
+		{
+			valid = ReadFloats(tokens, v, 4);
+			float angle = keyword == "rotate" ? glm::radians(v[0]) : v[0];
+			matrix = matrix * glm::rotate(angle, glm::vec3(v[1], v[2], v[3]));
+		}
+		else if (keyword == "scale")
+		{
+			valid = ReadFloats(tokens, v, 3);
+			matrix = matrix * glm::scale(glm::vec3(v[0], v[1], v[2]));
+		}
+		else
+			return false;
+		return true;
+	}
+
+	SceneFile::MaterialRecord DefaultMaterial()
+	{
+		SceneFile::MaterialRecord material;
+		std::memset(&material, 0, sizeof(material));
+		material.textures[0] = -1;
+		material.textures[1] = -1;
+		material.uvScale[0] = material.uvScale[1] = 1.0f;
+		material.uvScale2[0] = material.uvScale2[1] = 1.0f;
+		for (int i = 0; i < 4; ++i)
+			material.objectColor[i] = 1.0f;
+		material.specular[1] = 1.0f;
+		material.specular[3] = 1.0f;
+		return material;
+	}
+
+	///////////////////////////////////////////////////
+	//	Compiler::Parse(const std::string&, int32_t, int)
+	//
+	//	path: text scene to read
+	//	parent: node the top level nodes of the file are
+	//	attached to, -1 for none
+	//	depth: instance nesting level
+	//
+	//	Append the records of a text scene and of every
+	//	scene it instances
+	///////////////////////////////////////////////////
+	bool Compiler::Parse(const std::string& path, int32_t parent, int depth)
+	{
+		if (depth > MAX_INSTANCE_DEPTH)
+			return Fail(path, 0, "instances nested too deep");
+
+		std::ifstream file(path);
+		if (!file)
+			return Fail(path, 0, "cannot open file");
+
+		// Block being read: none, material, node, group, light or instance
+		enum Block { NONE, MATERIAL, NODE, GROUP, LIGHT, INSTANCE } block = NONE;
+		SceneFile::MaterialRecord material;
+		std::string materialName;
+		SceneFile::NodeRecord node;
+		uint32_t nodeIndex = 0;
+		uint32_t nodeMaterial = 0;
+		uint32_t nodeMesh = SceneFile::MESH_COUNT;
+		bool nodeHasMaterial = false;
+		std::vector<SceneFile::DrawRecord> nodeDraws;
+		SceneFile::LightRecord light;
+		std::string instancePath;
+		glm::mat4 local(1.0f);
+		std::string sectionName = "scene";
+
+		// Nodes and groups of this file by name, for parent statements
+		std::map<std::string, uint32_t> nodeNames;
+		std::string nodeName;
+
+		std::string text;
+		int line = 0;
+		while (std::getline(file, text))
+		{
+			++line;
+			size_t comment = text.find('#');
+			if (comment != std::string::npos)
+				text.erase(comment);
+
+			std::istringstream tokens(text);
+			std::string keyword;
+			if (!(tokens >> keyword))
+				continue;
+
+			bool valid = true;
+
+			if (block == NONE)
+			{
+				std::string name;
+				if (!(tokens >> name))
+					return Fail(path, line, keyword + " needs a name");
+
+				if (keyword == "texture")
+				{
+					std::string texturePath, wrap;
+					if (!(tokens >> texturePath))
+						return Fail(path, line, "texture needs a path");
+					tokens >> wrap;
+					if (textureIndex.count(name))
+						continue;
+
+					SceneFile::TextureRecord texture = { AddString(name), AddString(texturePath), wrap == "clamp" ? 1u : 0u };
+					textures.push_back(texture);
+					textureIndex[name] = static_cast<uint32_t>(textures.size() - 1);
+				}
+				else if (keyword == "material")
+				{
+					block = MATERIAL;
+					material = DefaultMaterial();
+					materialName = name;
+				}
+				else if (keyword == "section")
+					sectionName = name;
+				else if (keyword == "node" || keyword == "group" || keyword == "light")
+				{
+					block = keyword == "node" ? NODE : keyword == "group" ? GROUP : LIGHT;
+					local = glm::mat4(1.0f);
+					nodeName = name;
+					node.name = AddString(name);
+					node.section = AddSection(sectionName);
+					node.parent = parent;
+					node.flags = 0;
+					nodeMesh = SceneFile::MESH_COUNT;
+					nodeHasMaterial = false;
+					nodeDraws.clear();
+					light = SceneFile::LightRecord{ 0, { 1.0f, 1.0f, 1.0f }, 1.0f };
+				}
+				else if (keyword == "instance")
+				{
+					block = INSTANCE;
+					local = glm::mat4(1.0f);
+					instancePath = Directory(path) + name;
+				}
+				else
+					return Fail(path, line, "unknown statement " + keyword);
+			}
+			else if (keyword == "end")
+			{
+				if (block == MATERIAL)
+				{
+					// Instanced files share the materials of the first file that defines them
+					if (!materialIndex.count(materialName))
+					{
+						materials.push_back(material);
+						materialIndex[materialName] = static_cast<uint32_t>(materials.size() - 1);
+					}
+				}
+				else if (block == NODE || block == GROUP || block == LIGHT)
+				{
+					if (block == NODE && (nodeMesh == SceneFile::MESH_COUNT || !nodeHasMaterial))
+						return Fail(path, line, "node needs a mesh and a material");
+
+					std::memcpy(node.model, glm::value_ptr(local), sizeof(node.model));
+					nodeIndex = static_cast<uint32_t>(nodes.size());
+					nodeNames[nodeName] = nodeIndex;
+					nodes.push_back(node);
+
+					for (SceneFile::DrawRecord& draw : nodeDraws)
+					{
+						draw.node = nodeIndex;
+						draw.material = nodeMaterial;
+						draw.mesh = nodeMesh;
+						draws.push_back(draw);
+					}
+
+					if (block == LIGHT)
+					{
+						light.node = nodeIndex;
+						lights.push_back(light);
+					}
+				}
+				else
+				{
+					// The instance becomes a group holding the top level nodes of its file
+					SceneFile::NodeRecord group = {};
+					group.name = AddString(instancePath.substr(Directory(instancePath).size()));
+					group.section = AddSection(sectionName);
+					group.parent = parent;
+					std::memcpy(group.model, glm::value_ptr(local), sizeof(group.model));
+					nodes.push_back(group);
+
+					if (!Parse(instancePath, static_cast<int32_t>(nodes.size() - 1), depth + 1))
+						return Fail(path, line, "in instance " + instancePath);
+				}
+
+				block = NONE;
+			}
+			else if (block == MATERIAL)
+			{
+				if (keyword == "textures")
+				{
+					for (int i = 0; i < 2; ++i)
+					{
+						std::string name;
+						if (!(tokens >> name))
+							return Fail(path, line, "textures needs two names");
+						if (name == "none")
+							material.textures[i] = -1;
+						else if (textureIndex.count(name))
+							material.textures[i] = static_cast<int32_t>(textureIndex[name]);
+						else
+							return Fail(path, line, "unknown texture " + name);
+					}
+				}
+				else if (keyword == "textured")
+					material.hasTexture = 1;
+				else if (keyword == "color")
+					valid = ReadFloats(tokens, material.objectColor, 4);
+				else if (keyword == "uv_scale")
+					valid = ReadFloats(tokens, material.uvScale, 2);
+				else if (keyword == "uv_scale2")
+					valid = ReadFloats(tokens, material.uvScale2, 2);
+				else if (keyword == "blend")
+					valid = ReadFloats(tokens, &material.blendFactor, 1);
+				else if (keyword == "light1" || keyword == "light2")
+				{
+					bool first = keyword == "light1";
+					std::string at;
+					valid = ReadFloats(tokens, first ? material.light1Color : material.light2Color, 3)
+						&& (tokens >> at) && at == "at"
+						&& ReadFloats(tokens, first ? material.light1Position : material.light2Position, 3);
+				}
+				else if (keyword == "specular1")
+					valid = ReadFloats(tokens, material.specular, 2);
+				else if (keyword == "specular2")
+					valid = ReadFloats(tokens, material.specular + 2, 2);
+				else
+					return Fail(path, line, "unknown material property " + keyword);
+			}
+			else if ((block == NODE || block == GROUP || block == LIGHT) && keyword == "parent")
+			{
+				std::string name;
+				tokens >> name;
+				if (!nodeNames.count(name))
+					return Fail(path, line, "unknown parent " + name);
+				node.parent = static_cast<int32_t>(nodeNames[name]);
+			}
+			else if (block == GROUP)
+			{
+				if (!ReadTransform(keyword, tokens, local, valid))
+					return Fail(path, line, "unknown group property " + keyword);
+			}
+			else if (block == LIGHT)
+			{
+				if (keyword == "color")
+					valid = ReadFloats(tokens, light.color, 3);
+				else if (keyword == "radius")
+					valid = ReadFloats(tokens, &light.radius, 1) && light.radius > 0.0f;
+				else if (!ReadTransform(keyword, tokens, local, valid))
+					return Fail(path, line, "unknown light property " + keyword);
+			}
+			else if (block == NODE)
+			{
+				if (keyword == "mesh")
+				{
+					std::string name;
+					tokens >> name;
+					nodeMesh = SceneFile::MESH_COUNT;
+					for (uint32_t mesh = 0; mesh < SceneFile::MESH_COUNT; ++mesh)
+					{
+						if (name == SceneFile::MESH_NAMES[mesh])
+							nodeMesh = mesh;
+					}
+					if (nodeMesh == SceneFile::MESH_COUNT)
+						return Fail(path, line, "unknown mesh " + name);
+				}
+				else if (keyword == "material")
+				{
+					std::string name;
+					tokens >> name;
+					if (!materialIndex.count(name))
+						return Fail(path, line, "unknown material " + name);
+					nodeMaterial = materialIndex[name];
+					nodeHasMaterial = true;
+				}
+				else if (keyword == "occluder")
+					node.flags |= SceneFile::NODE_OCCLUDER;
+				else if (keyword == "lightmapped")
+					node.flags |= SceneFile::NODE_LIGHTMAPPED;
+				else if (keyword == "arrays" || keyword == "elements")
+				{
+					SceneFile::DrawRecord draw = {};
+					std::string mode, first, count;
+					draw.indexed = keyword == "elements";
+					valid = (tokens >> mode) && ReadMode(mode, draw.mode);
+					if (valid && !draw.indexed)
+						valid = (tokens >> first) && ReadCount(first, draw.first) && draw.first >= 0;
+					valid = valid && (tokens >> count) && ReadCount(count, draw.count);
+					nodeDraws.push_back(draw);
+				}
+				else if (!ReadTransform(keyword, tokens, local, valid))
+					return Fail(path, line, "unknown node property " + keyword);
+			}
+			else if (!ReadTransform(keyword, tokens, local, valid))
+				return Fail(path, line, "unknown instance property " + keyword);
+
+			if (!valid)
+				return Fail(path, line, "malformed " + keyword);
+		}
+
+		if (block != NONE)
+			return Fail(path, line, "missing end");
+
+		return true;
+	}
+
+	template<typename Record>
+	void WriteArray(std::FILE* file, const std::vector<Record>& records)
+	{
+		if (!records.empty())
+			std::fwrite(records.data(), sizeof(Record), records.size(), file);
+	}
+}
+
+///////////////////////////////////////////////////
+//	Compile(const char*, const char*)
+//
+//	textPath: scene in text form
+//	binaryPath: file to write the binary form to
+//
+//	Parse the text scene and its instances and write
+//	the records
+///////////////////////////////////////////////////
+bool SceneFile::Compile(const char* textPath, const char* binaryPath)
+{
+	Compiler compiler;
+	if (!compiler.Parse(textPath, -1, 0))
+		return false;
+
+	Header header = {};
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.textureCount = static_cast<uint32_t>(compiler.textures.size());
+	header.materialCount = static_cast<uint32_t>(compiler.materials.size());
+	header.sectionCount = static_cast<uint32_t>(compiler.sections.size());
+	header.nodeCount = static_cast<uint32_t>(compiler.nodes.size());
+	header.drawCount = static_cast<uint32_t>(compiler.draws.size());
+	header.lightCount = static_cast<uint32_t>(compiler.lights.size());
+	header.stringBytes = static_cast<uint32_t>(compiler.strings.size());
+
+	// Every record is a multiple of 4 bytes, so the arrays stay aligned
+	header.textureOffset = sizeof(Header);
+	header.materialOffset = header.textureOffset + header.textureCount * sizeof(TextureRecord);
+	header.sectionOffset = header.materialOffset + header.materialCount * sizeof(MaterialRecord);
+	header.nodeOffset = header.sectionOffset + header.sectionCount * sizeof(SectionRecord);
+	header.drawOffset = header.nodeOffset + header.nodeCount * sizeof(NodeRecord);
+	header.lightOffset = header.drawOffset + header.drawCount * sizeof(DrawRecord);
+	header.stringOffset = header.lightOffset + header.lightCount * sizeof(LightRecord);
+
+	std::FILE* file = std::fopen(binaryPath, "wb");
+	if (!file)
+	{
+		std::cout << "ERROR::SCENE::cannot write " << binaryPath << std::endl;
+		return false;
+	}
+
+	std::fwrite(&header, sizeof(header), 1, file);
+	WriteArray(file, compiler.textures);
+	WriteArray(file, compiler.materials);
+	WriteArray(file, compiler.sections);
+	WriteArray(file, compiler.nodes);
+	WriteArray(file, compiler.draws);
+	WriteArray(file, compiler.lights);
+	std::fwrite(compiler.strings.data(), 1, compiler.strings.size(), file);
+
+	bool written = !std::ferror(file);
+	written = std::fclose(file) == 0 && written;
+	if (!written)
+	{
+		std::cout << "ERROR::SCENE::cannot write " << binaryPath << std::endl;
+		std::remove(binaryPath);
+		return false;
+	}
+
+	std::cout << "INFO: Compiled " << textPath << " to " << binaryPath << ": " << header.nodeCount << " nodes, "
+		<< header.drawCount << " draws, " << header.materialCount << " materials, " << header.lightCount << " lights" << std::endl;
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	NeedsCompile(const char*, const char*)
+//
+//	True when the binary form is missing or older than
+//	the text form. Only the top level file is checked,
+//	edits to instanced files need a --compile-scene
+///////////////////////////////////////////////////
+bool SceneFile::NeedsCompile(const char* textPath, const char* binaryPath)
+{
+	struct stat text, binary;
+	if (stat(binaryPath, &binary) != 0)
+		return true;
+	if (stat(textPath, &text) != 0)
+		return false;
+	return text.st_mtime >= binary.st_mtime;
+}
+
+SceneFile::~SceneFile()
+{
+	Close();
+}
+
+///////////////////////////////////////////////////
+//	Open(const char*)
+//
+//	binaryPath: compiled scene
+//
+//	Map the file and point the record arrays into it.
+//	Fails unless the header, every record index and
+//	every string offset are in range, so a corrupt or
+//	stale file is rejected instead of read out of bounds
+///////////////////////////////////////////////////
+bool SceneFile::Open(const char* binaryPath)
+{
+	Close();
+
+#ifdef _WIN32
+	std::ifstream file(binaryPath, std::ios::binary | std::ios::ate);
+	if (file)
+	{
+		fileData.resize(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(fileData.data(), fileData.size());
+		mapping = fileData.data();
+		mappingSize = fileData.size();
+	}
+#else
+	int file = open(binaryPath, O_RDONLY);
+	if (file >= 0)
+	{
+		struct stat info;
+		if (fstat(file, &info) == 0 && info.st_size > 0)
+		{
+			void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+			if (data != MAP_FAILED)
+			{
+				mapping = data;
+				mappingSize = static_cast<size_t>(info.st_size);
+			}
+		}
+		close(file);
+	}
+#endif
+
+	if (!mapping)
+	{
+		std::cout << "ERROR::SCENE::cannot open " << binaryPath << std::endl;
+		return false;
+	}
+
+	const char* base = static_cast<const char*>(mapping);
+	header = reinterpret_cast<const Header*>(base);
+
+	// The arrays must follow each other exactly and end with the file
+	bool valid = mappingSize >= sizeof(Header)
+		&& std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0
+		&& header->version == VERSION
+		&& header->textureOffset == sizeof(Header)
+		&& header->materialOffset == header->textureOffset + header->textureCount * sizeof(TextureRecord)
+		&& header->sectionOffset == header->materialOffset + header->materialCount * sizeof(MaterialRecord)
+		&& header->nodeOffset == header->sectionOffset + header->sectionCount * sizeof(SectionRecord)
+		&& header->drawOffset == header->nodeOffset + header->nodeCount * sizeof(NodeRecord)
+		&& header->lightOffset == header->drawOffset + header->drawCount * sizeof(DrawRecord)
+		&& header->stringOffset == header->lightOffset + header->lightCount * sizeof(LightRecord)
+		&& header->stringOffset + static_cast<size_t>(header->stringBytes) == mappingSize;
+	if (!valid)
+	{
+		std::cout << "ERROR::SCENE::" << binaryPath << " is not a version " << VERSION << " scene" << std::endl;
+		Close();
+		return false;
+	}
+
+	textures = reinterpret_cast<const TextureRecord*>(base + header->textureOffset);
+	materials = reinterpret_cast<const MaterialRecord*>(base + header->materialOffset);
+	sections = reinterpret_cast<const SectionRecord*>(base + header->sectionOffset);
+	nodes = reinterpret_cast<const NodeRecord*>(base + header->nodeOffset);
+	draws = reinterpret_cast<const DrawRecord*>(base + header->drawOffset);
+	lights = reinterpret_cast<const LightRecord*>(base + header->lightOffset);
+	strings = base + header->stringOffset;
+
+	// Records are used as is, so every index and string offset must stay inside its array
+	auto invalid = [&](const char* record, uint32_t i)
+	{
+		std::cout << "ERROR::SCENE::" << binaryPath << " " << record << " " << i << " is out of range" << std::endl;
+		Close();
+		return false;
+	};
+	auto isString = [&](uint32_t offset) { return offset < header->stringBytes; };
+
+	// A terminated last string keeps every string inside the table
+	if (header->stringBytes > 0 && strings[header->stringBytes - 1] != '\0')
+	{
+		std::cout << "ERROR::SCENE::" << binaryPath << " string table is not terminated" << std::endl;
+		Close();
+		return false;
+	}
+
+	for (uint32_t i = 0; i < header->textureCount; ++i)
+	{
+		if (!isString(textures[i].name) || !isString(textures[i].path))
+			return invalid("texture", i);
+	}
+	for (uint32_t i = 0; i < header->materialCount; ++i)
+	{
+		for (int32_t texture : materials[i].textures)
+		{
+			if (texture < -1 || texture >= static_cast<int64_t>(header->textureCount))
+				return invalid("material", i);
+		}
+	}
+	for (uint32_t i = 0; i < header->sectionCount; ++i)
+	{
+		if (!isString(sections[i].name))
+			return invalid("section", i);
+	}
+
+	// Parents come before their children, so the hierarchy has no cycles
+	for (uint32_t i = 0; i < header->nodeCount; ++i)
+	{
+		const NodeRecord& node = nodes[i];
+		if (!isString(node.name) || node.section >= header->sectionCount || node.parent < -1 || node.parent >= static_cast<int64_t>(i))
+			return invalid("node", i);
+	}
+	for (uint32_t i = 0; i < header->drawCount; ++i)
+	{
+		const DrawRecord& draw = draws[i];
+		bool validMode = draw.mode == GL_TRIANGLES || draw.mode == GL_TRIANGLE_STRIP || draw.mode == GL_TRIANGLE_FAN;
+		if (draw.node >= header->nodeCount || draw.material >= header->materialCount || draw.mesh >= MESH_COUNT || !validMode)
+			return invalid("draw", i);
+	}
+	for (uint32_t i = 0; i < header->lightCount; ++i)
+	{
+		if (lights[i].node >= header->nodeCount)
+			return invalid("light", i);
+	}
+
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	Close()
+//
+//	Unmap the file, the record arrays become invalid
+///////////////////////////////////////////////////
+void SceneFile::Close()
+{
+#ifndef _WIN32
+	if (mapping)
+		munmap(const_cast<void*>(mapping), mappingSize);
+#endif
+	fileData.clear();
+	mapping = nullptr;
+	mappingSize = 0;
+
+	header = nullptr;
+	textures = nullptr;
+	materials = nullptr;
+	sections = nullptr;
+	nodes = nullptr;
+	draws = nullptr;
+	lights = nullptr;
+	strings = nullptr;
+}
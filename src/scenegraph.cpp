@@ -0,0 +1,172 @@
+///////////////////////////////////////////////////////////////////////////////
+// scenegraph.cpp
+// ========
+// hierarchy of scene nodes with local and world transforms
+///////////////////////////////////////////////////////////////////////////////
+
+#include "scenegraph.h"
+
+///////////////////////////////////////////////////
+//	Build(const std::vector<NodeDesc>&, std::vector<GLuint>*)
+//
+//	nodes: node descriptions, every parent listed
+//	before its children
+//	positions: receives the node of each description,
+//	for data that refers to descriptions, may be null
+//
+//	Lay the nodes out depth first, keeping siblings
+//	in the order they are listed, and flag every node
+//	so the first Update computes all world transforms
+///////////////////////////////////////////////////
+void SceneGraph::Build(const std::vector<NodeDesc>& nodes, std::vector<GLuint>* positions)
+{
+	Clear();
+
+	// Children of every description, roots under the virtual index nodes.size()
+	std::vector<std::vector<GLuint>> children(nodes.size() + 1);
+	for (size_t i = 0; i < nodes.size(); ++i)
+	{
+		GLint parent = nodes[i].parent;
+		children[parent >= 0 && parent < static_cast<GLint>(i) ? parent : nodes.size()].push_back(static_cast<GLuint>(i));
+	}
+
+	names.reserve(nodes.size());
+	parents.reserve(nodes.size());
+	subtreeEnds.resize(nodes.size());
+	locals.reserve(nodes.size());
+	worlds.resize(nodes.size());
+	firstDraws.reserve(nodes.size());
+	drawCounts.reserve(nodes.size());
+
+	// Explicit stack of (description, position of its parent); a marker entry closes the subtree
+	struct Entry
+	{
+		GLuint desc;
+		GLint parent;
+		bool close;
+	};
+	std::vector<Entry> stack;
+	const std::vector<GLuint>& roots = children[nodes.size()];
+	for (auto root = roots.rbegin(); root != roots.rend(); ++root)
+		stack.push_back({ *root, -1, false });
+
+	std::vector<GLuint> position(nodes.size());
+	while (!stack.empty())
+	{
+		Entry entry = stack.back();
+		stack.pop_back();
+		if (entry.close)
+		{
+			subtreeEnds[position[entry.desc]] = static_cast<GLuint>(parents.size());
+			continue;
+		}
+
+		const NodeDesc& desc = nodes[entry.desc];
+		GLuint index = static_cast<GLuint>(parents.size());
+		position[entry.desc] = index;
+		names.push_back(desc.name);
+		parents.push_back(entry.parent);
+		locals.push_back(desc.local);
+		firstDraws.push_back(desc.firstDraw);
+		drawCounts.push_back(desc.drawCount);
+
+		stack.push_back({ entry.desc, 0, true });
+		const std::vector<GLuint>& kids = children[entry.desc];
+		for (auto child = kids.rbegin(); child != kids.rend(); ++child)
+			stack.push_back({ *child, static_cast<GLint>(index), false });
+	}
+
+	if (positions)
+		positions->swap(position);
+
+	dirty.assign(parents.size(), 0);
+	for (GLuint node = 0; node < parents.size(); node = subtreeEnds[node])
+		dirty[node] = 1;
+	anyDirty = !parents.empty();
+}
+
+///////////////////////////////////////////////////
+//	Clear()
+//
+//	Drop every node
+///////////////////////////////////////////////////
+void SceneGraph::Clear()
+{
+	names.clear();
+	parents.clear();
+	subtreeEnds.clear();
+	locals.clear();
+	worlds.clear();
+	firstDraws.clear();
+	drawCounts.clear();
+	dirty.clear();
+	anyDirty = false;
+}
+
+///////////////////////////////////////////////////
+//	Find(const std::string&)
+//
+//	First node with the given name, in depth-first
+//	order, -1 if none
+///////////////////////////////////////////////////
+GLint SceneGraph::Find(const std::string& name) const
+{
+	for (size_t node = 0; node < names.size(); ++node)
+	{
+		if (names[node] == name)
+			return static_cast<GLint>(node);
+	}
+	return -1;
+}
+
+///////////////////////////////////////////////////
+//	SetLocal(GLuint, const glm::mat4&)
+//
+//	Replace the local transform of a node and flag
+//	its subtree for the next Update
+///////////////////////////////////////////////////
+void SceneGraph::SetLocal(GLuint node, const glm::mat4& local)
+{
+	locals[node] = local;
+	dirty[node] = 1;
+	anyDirty = true;
+}
+
+///////////////////////////////////////////////////
+//	Update(std::vector<GLuint>&)
+//
+//	updatedNodes: receives the nodes whose world
+//	transform was recomputed
+//
+//	Walk the nodes in depth-first order and recompute
+//	each flagged subtree once; flags inside a subtree
+//	being recomputed are cleared along the way
+///////////////////////////////////////////////////
+void SceneGraph::Update(std::vector<GLuint>& updatedNodes)
+{
+	if (!anyDirty)
+		return;
+
+	GLuint count = static_cast<GLuint>(parents.size());
+	GLuint node = 0;
+	while (node < count)
+	{
+		if (!dirty[node])
+		{
+			++node;
+			continue;
+		}
+
+		GLuint end = subtreeEnds[node];
+		for (GLuint child = node; child < end; ++child)
+		{
+			GLint parent = parents[child];
+			worlds[child] = parent >= 0 ? worlds[parent] * locals[child] : locals[child];
+			dirty[child] = 0;
+			updatedNodes.push_back(child);
+		}
+		node = end;
+	}
+
+	anyDirty = false;
+}
@@ -0,0 +1,159 @@
+///////////////////////////////////////////////////////////////////////////////
+// shaderpermutations.cpp
+// ========
+// specialized variants of one shader program, selected by a feature mask
+///////////////////////////////////////////////////////////////////////////////
+
+#include "shaderpermutations.h"
+
+#include <iostream>
+
+///////////////////////////////////////////////////
+//	Create(const std::string&, const std::string&,
+//		CompileFunction, SetupFunction)
+//
+//	vertexSource, fragmentSource: sources starting
+//	with a #version line
+//	compile: compiles and links a variant
+//	setup: sets the uniforms of every new variant
+///////////////////////////////////////////////////
+void ShaderPermutations::Create(const std::string& vertexSource, const std::string& fragmentSource, CompileFunction compile, SetupFunction setup)
+{
+	Destroy();
+	this->vertexSource = vertexSource;
+	this->fragmentSource = fragmentSource;
+	this->compile = compile;
+	this->setup = setup;
+}
+
+///////////////////////////////////////////////////
+//	Destroy()
+//
+//	Delete every compiled variant
+///////////////////////////////////////////////////
+void ShaderPermutations::Destroy()
+{
+	for (GLuint& program : programs)
+	{
+		if (program)
+			glDeleteProgram(program);
+		program = 0;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Prepare(GLuint)
+//
+//	features: mask of Feature flags
+//
+//	Compile, link and set up the variant of the mask
+//	and, so that specialize can be turned off, the
+//	variant with every feature
+///////////////////////////////////////////////////
+bool ShaderPermutations::Prepare(GLuint features)
+{
+	const GLuint masks[2] = { features & ALL_FEATURES, ALL_FEATURES };
+	for (GLuint mask : masks)
+	{
+		if (programs[mask])
+			continue;
+
+		GLuint programId = 0;
+		if (!compile(Permute(vertexSource, mask).c_str(), Permute(fragmentSource, mask).c_str(), programId))
+		{
+			std::cout << "ERROR::SHADER::PERMUTATION::" << mask << "::FAILED\n" << Defines(mask) << std::endl;
+			return false;
+		}
+
+		glUseProgram(programId);
+		if (setup)
+			setup(programId);
+		programs[mask] = programId;
+	}
+	return true;
+}
+
+GLuint ShaderPermutations::Count() const
+{
+	GLuint count = 0;
+	for (GLuint program : programs)
+		count += program ? 1 : 0;
+	return count;
+}
+
+std::vector<GLuint> ShaderPermutations::Masks() const
+{
+	std::vector<GLuint> masks;
+	for (GLuint mask = 0; mask < VARIANT_COUNT; ++mask)
+	{
+		if (programs[mask])
+			masks.push_back(mask);
+	}
+	return masks;
+}
+
+///////////////////////////////////////////////////
+//	Swap(const std::string&, const std::string&,
+//		const std::vector<GLuint>&,
+//		const std::vector<GLuint>&)
+//
+//	masks: variants the replacements were built for,
+//	usually Masks()
+//	replacements: linked programs, owned from now on
+//
+//	Set up every replacement and delete the program
+//	it replaces; later Prepare calls permute the
+//	new sources
+///////////////////////////////////////////////////
+void ShaderPermutations::Swap(const std::string& vertexSource, const std::string& fragmentSource,
+	const std::vector<GLuint>& masks, const std::vector<GLuint>& replacements)
+{
+	this->vertexSource = vertexSource;
+	this->fragmentSource = fragmentSource;
+	for (size_t i = 0; i < masks.size() && i < replacements.size(); ++i)
+	{
+		GLuint& program = programs[masks[i] & ALL_FEATURES];
+		if (program)
+			glDeleteProgram(program);
+		program = replacements[i];
+
+		glUseProgram(program);
+		if (setup)
+			setup(program);
+	}
+}
+
+///////////////////////////////////////////////////
+//	Defines(GLuint)
+//
+//	One #define per feature, true or false, and the
+//	light count
+///////////////////////////////////////////////////
+std::string ShaderPermutations::Defines(GLuint features)
+{
+	std::string defines;
+	defines += features & TEXTURED ? "#define TEXTURED true\n" : "#define TEXTURED false\n";
+	defines += features & BLEND ? "#define BLEND true\n" : "#define BLEND false\n";
+	defines += features & SPECULAR ? "#define SPECULAR true\n" : "#define SPECULAR false\n";
+	defines += features & SECOND_LIGHT ? "#define LIGHT_COUNT 2\n" : "#define LIGHT_COUNT 1\n";
+	defines += features & LIGHTMAPPED ? "#define LIGHTMAPPED true\n" : "#define LIGHTMAPPED false\n";
+	return defines;
+}
+
+///////////////////////////////////////////////////
+//	Permute(const std::string&, GLuint)
+//
+//	Insert the defines of a mask after the #version
+//	line, which must stay first
+///////////////////////////////////////////////////
+std::string ShaderPermutations::Permute(const std::string& source, GLuint features)
+{
+	size_t lineEnd = source.find('\n');
+	if (lineEnd == std::string::npos)
+		return source + "\n" + Defines(features);
+
+	std::string permuted = source.substr(0, lineEnd + 1);
+	permuted += Defines(features);
+	permuted += source.substr(lineEnd + 1);
+	return permuted;
+}
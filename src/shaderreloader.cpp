@@ -0,0 +1,453 @@
+///////////////////////////////////////////////////////////////////////////////
+// shaderreloader.cpp
+// ========
+// shader sources loaded from a directory, watched for edits and recompiled
+// in the background
+///////////////////////////////////////////////////////////////////////////////
+
+#include "shaderreloader.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "directory.h"
+
+namespace
+{
+	// Interval of the modification time polls without inotify
+	const double POLL_SECONDS = 0.5;
+
+	bool ReadFile(const std::string& path, std::string& text)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+		std::ostringstream contents;
+		contents << file.rdbuf();
+		text = contents.str();
+		return true;
+	}
+
+	time_t ModifiedTime(const std::string& path)
+	{
+		struct stat info;
+		return stat(path.c_str(), &info) == 0 ? info.st_mtime : 0;
+	}
+
+	std::string InfoLog(GLuint object, bool program)
+	{
+		GLint length = 0;
+		if (program)
+			glGetProgramiv(object, GL_INFO_LOG_LENGTH, &length);
+		else
+			glGetShaderiv(object, GL_INFO_LOG_LENGTH, &length);
+		if (length <= 0)
+			return std::string();
+
+		std::vector<char> log(length);
+		if (program)
+			glGetProgramInfoLog(object, length, NULL, log.data());
+		else
+			glGetShaderInfoLog(object, length, NULL, log.data());
+		return std::string(log.data());
+	}
+
+	GLuint CompileShader(GLenum type, const std::string& source)
+	{
+		const char* text = source.c_str();
+		GLuint shaderId = glCreateShader(type);
+		glShaderSource(shaderId, 1, &text, NULL);
+		glCompileShader(shaderId);
+		return shaderId;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Open(const std::string&)
+//
+//	directory: where the shader files are kept
+//
+//	Start watching the directory and let the driver
+//	compile on its own threads when it can
+///////////////////////////////////////////////////
+bool ShaderReloader::Open(const std::string& directory)
+{
+	Close();
+
+	if (!MakeDirectory(directory))
+		return false;
+
+#ifdef __linux__
+	// Editors either rewrite the file or rename a new one over it
+	notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (notifyFd >= 0 && inotify_add_watch(notifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+	{
+		close(notifyFd);
+		notifyFd = -1;
+	}
+#endif
+
+	// 0xFFFFFFFF leaves the thread count to the implementation
+	if (GLEW_KHR_parallel_shader_compile)
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+	else if (GLEW_ARB_parallel_shader_compile)
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+	parallel = GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile;
+
+	this->directory = directory;
+	lastPoll = std::chrono::steady_clock::now();
+	enabled = true;
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	Close()
+//
+//	Stop watching and delete the pending batches,
+//	the programs swapped in belong to their owners
+///////////////////////////////////////////////////
+void ShaderReloader::Close()
+{
+#ifdef __linux__
+	if (notifyFd >= 0)
+		close(notifyFd);
+#endif
+	notifyFd = -1;
+
+	for (Batch& batch : pending)
+		DeleteBatch(batch);
+	pending.clear();
+	files.clear();
+	enabled = false;
+}
+
+///////////////////////////////////////////////////
+//	Source(const std::string&, const char*)
+//
+//	name: file name inside the directory
+//	fallback: embedded source, written to the file
+//	when it does not exist yet
+///////////////////////////////////////////////////
+std::string ShaderReloader::Source(const std::string& name, const char* fallback)
+{
+	if (!enabled)
+		return fallback;
+
+	auto found = files.find(name);
+	if (found != files.end())
+		return found->second.text;
+
+	std::string path = PathOf(name);
+	WatchedFile& file = files[name];
+	if (!ReadFile(path, file.text))
+	{
+		file.text = Format(fallback);
+		std::ofstream output(path, std::ios::binary);
+		output << file.text;
+		if (output)
+			std::cout << "INFO: Shader source written to " << path << std::endl;
+	}
+	file.modified = ModifiedTime(path);
+	return file.text;
+}
+
+///////////////////////////////////////////////////
+//	Changed()
+//
+//	Drain the inotify events, or poll the times
+//	every POLL_SECONDS, and re-read the watched
+//	files they name; only files whose text changed
+//	are returned, saving without an edit is ignored
+///////////////////////////////////////////////////
+std::vector<std::string> ShaderReloader::Changed()
+{
+	std::vector<std::string> changed;
+	if (!enabled)
+		return changed;
+
+	std::vector<std::string> touched;
+#ifdef __linux__
+	if (notifyFd >= 0)
+	{
+		alignas(inotify_event) char buffer[4096];
+		ssize_t length;
+		while ((length = read(notifyFd, buffer, sizeof(buffer))) > 0)
+		{
+			for (char* event = buffer; event < buffer + length; )
+			{
+				const inotify_event* notification = reinterpret_cast<const inotify_event*>(event);
+				if (notification->len > 0 && files.count(notification->name))
+					touched.push_back(notification->name);
+				event += sizeof(inotify_event) + notification->len;
+			}
+		}
+	}
+	else
+#endif
+	{
+		auto now = std::chrono::steady_clock::now();
+		if (std::chrono::duration<double>(now - lastPoll).count() < POLL_SECONDS)
+			return changed;
+		lastPoll = now;
+
+		for (auto& entry : files)
+		{
+			if (ModifiedTime(PathOf(entry.first)) != entry.second.modified)
+				touched.push_back(entry.first);
+		}
+	}
+
+	for (const std::string& name : touched)
+	{
+		WatchedFile& file = files[name];
+		file.modified = ModifiedTime(PathOf(name));
+
+		std::string text;
+		if (ReadFile(PathOf(name), text) && text != file.text
+			&& std::find(changed.begin(), changed.end(), name) == changed.end())
+		{
+			file.text = text;
+			changed.push_back(name);
+		}
+	}
+	return changed;
+}
+
+///////////////////////////////////////////////////
+//	Submit(const std::string&, const std::vector<Request>&,
+//		SwapFunction)
+//
+//	label: names the batch in messages, a newer
+//	batch of a label replaces the pending one
+//	requests: sources of every program of the batch
+//	swap: receives the programs once all linked
+//
+//	Issue every compile and link without asking for
+//	a status, so none of them waits on the driver
+///////////////////////////////////////////////////
+void ShaderReloader::Submit(const std::string& label, const std::vector<Request>& requests, SwapFunction swap)
+{
+	for (auto batch = pending.begin(); batch != pending.end(); ++batch)
+	{
+		if (batch->label == label)
+		{
+			DeleteBatch(*batch);
+			pending.erase(batch);
+			break;
+		}
+	}
+
+	Batch batch;
+	batch.label = label;
+	batch.swap = swap;
+	batch.start = std::chrono::steady_clock::now();
+	for (const Request& request : requests)
+	{
+		GLuint programId = glCreateProgram();
+		GLuint vertexShaderId = CompileShader(GL_VERTEX_SHADER, request.vertexSource);
+		GLuint fragmentShaderId = CompileShader(GL_FRAGMENT_SHADER, request.fragmentSource);
+		glAttachShader(programId, vertexShaderId);
+		glAttachShader(programId, fragmentShaderId);
+		glLinkProgram(programId);
+		batch.programs.push_back(programId);
+	}
+	pending.push_back(batch);
+}
+
+///////////////////////////////////////////////////
+//	Update()
+//
+//	Hand every batch whose programs all completed to
+//	its swap function, or drop it when one failed
+///////////////////////////////////////////////////
+void ShaderReloader::Update()
+{
+	for (auto batch = pending.begin(); batch != pending.end(); )
+	{
+		bool completed = std::all_of(batch->programs.begin(), batch->programs.end(),
+			[this](GLuint programId) { return Completed(programId); });
+		if (!completed)
+		{
+			++batch;
+			continue;
+		}
+
+		// Variants of one source fail alike, only the first log is printed
+		bool linked = true;
+		for (GLuint programId : batch->programs)
+			linked = Linked(programId, batch->label, linked) && linked;
+
+		if (linked)
+		{
+			batch->swap(batch->programs);
+			lastReloadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - batch->start).count();
+			++reloads;
+			std::cout << "INFO: Shaders reloaded: " << batch->label << ", " << batch->programs.size()
+				<< " programs in " << lastReloadMs << " ms" << std::endl;
+		}
+		else
+		{
+			DeleteBatch(*batch);
+			++failures;
+			std::cout << "INFO: Shader reload of " << batch->label << " failed, keeping the previous programs" << std::endl;
+		}
+		batch = pending.erase(batch);
+	}
+}
+
+std::string ShaderReloader::PathOf(const std::string& name) const
+{
+	return directory + "/" + name;
+}
+
+///////////////////////////////////////////////////
+//	Completed(GLuint)
+//
+//	With parallel compile, whether the driver
+//	finished; without it the next status query
+//	compiles in place, so always true
+///////////////////////////////////////////////////
+bool ShaderReloader::Completed(GLuint programId) const
+{
+	if (!parallel)
+		return true;
+
+	GLint completed = GL_FALSE;
+	glGetProgramiv(programId, GL_COMPLETION_STATUS_KHR, &completed);
+	return completed == GL_TRUE;
+}
+
+///////////////////////////////////////////////////
+//	Linked(GLuint, const std::string&, bool)
+//
+//	report: print the compile or link log on failure
+//
+//	Check a completed program and release its
+//	shaders, which it no longer needs either way
+///////////////////////////////////////////////////
+bool ShaderReloader::Linked(GLuint programId, const std::string& label, bool report)
+{
+	GLuint shaders[2];
+	GLsizei shaderCount = 0;
+	glGetAttachedShaders(programId, 2, &shaderCount, shaders);
+
+	for (GLsizei i = 0; i < shaderCount; ++i)
+	{
+		GLint compiled = GL_FALSE;
+		glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &compiled);
+		if (!compiled && report)
+		{
+			GLint type = 0;
+			glGetShaderiv(shaders[i], GL_SHADER_TYPE, &type);
+			std::cout << "ERROR::SHADER::RELOAD::" << label << (type == GL_VERTEX_SHADER ? "::VERTEX" : "::FRAGMENT")
+				<< "::COMPILATION_FAILED\n" << InfoLog(shaders[i], false) << std::endl;
+			report = false;
+		}
+	}
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv(programId, GL_LINK_STATUS, &linked);
+	if (!linked && report)
+		std::cout << "ERROR::SHADER::RELOAD::" << label << "::LINKING_FAILED\n" << InfoLog(programId, true) << std::endl;
+
+	for (GLsizei i = 0; i < shaderCount; ++i)
+	{
+		glDetachShader(programId, shaders[i]);
+		glDeleteShader(shaders[i]);
+	}
+	return linked == GL_TRUE;
+}
+
+void ShaderReloader::DeleteBatch(Batch& batch)
+{
+	for (GLuint programId : batch.programs)
+	{
+		GLuint shaders[2];
+		GLsizei shaderCount = 0;
+		glGetAttachedShaders(programId, 2, &shaderCount, shaders);
+		for (GLsizei i = 0; i < shaderCount; ++i)
+			glDeleteShader(shaders[i]);
+		glDeleteProgram(programId);
+	}
+	batch.programs.clear();
+}
+
+///////////////////////////////////////////////////
+//	Format(const char*)
+//
+//	Keep the #version line and put every statement
+//	on its own line, indented by its braces; block
+//	declarations keep their instance name and ;
+///////////////////////////////////////////////////
+std::string ShaderReloader::Format(const char* source)
+{
+	const char* body = std::strchr(source, '\n');
+	if (!body)
+		return source;
+
+	std::string formatted(source, body + 1);
+	size_t lineStart = formatted.size();
+	int parentheses = 0;
+	std::vector<bool> declarations;         // per open brace: closed by "} name;" rather than a new line
+	bool newLine = true;
+
+	for (const char* c = body + 1; *c; ++c)
+	{
+		if (newLine && std::isspace(static_cast<unsigned char>(*c)))
+			continue;
+
+		if (*c == '}')
+		{
+			if (!newLine)
+				formatted += '\n';
+			newLine = true;
+		}
+		if (newLine)
+		{
+			lineStart = formatted.size();
+			formatted.append(declarations.size() - (*c == '}' && !declarations.empty() ? 1 : 0), '\t');
+			newLine = false;
+		}
+		formatted += *c;
+
+		if (*c == '(')
+			++parentheses;
+		else if (*c == ')')
+			--parentheses;
+		else if (*c == '{')
+		{
+			std::string line = formatted.substr(lineStart);
+			declarations.push_back(line.find("uniform") != std::string::npos || line.find("buffer") != std::string::npos
+				|| line.find("struct") != std::string::npos);
+			formatted += '\n';
+			newLine = true;
+		}
+		else if (*c == '}')
+		{
+			bool declaration = !declarations.empty() && declarations.back();
+			if (!declarations.empty())
+				declarations.pop_back();
+			if (!declaration)
+			{
+				formatted += '\n';
+				newLine = true;
+			}
+		}
+		else if (*c == ';' && parentheses == 0)
+		{
+			formatted += '\n';
+			newLine = true;
+		}
+	}
+	return formatted;
+}
@@ -0,0 +1,257 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadowmaps.cpp
+// ========
+// shadow maps of the key light: a cached map of the static draws and a small
+// overlay map of the dynamic draws
+///////////////////////////////////////////////////////////////////////////////
+
+#include "shadowmaps.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+	// Maps clip space [-1, 1] to texture coordinates and depth [0, 1]
+	const glm::mat4 TEXTURE_BIAS(
+		0.5f, 0.0f, 0.0f, 0.0f,
+		0.0f, 0.5f, 0.0f, 0.0f,
+		0.0f, 0.0f, 0.5f, 0.0f,
+		0.5f, 0.5f, 0.5f, 1.0f);
+
+	// Slope scaled depth bias of the shadow passes, against self shadowing
+	const float POLYGON_OFFSET_FACTOR = 2.0f;
+	const float POLYGON_OFFSET_UNITS = 4.0f;
+
+	// Depth texture compared in hardware; outside the map everything is lit
+	bool CreateShadowTarget(GLsizei size, GLuint& texture, GLuint& framebuffer)
+	{
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, size, size);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		const GLfloat border[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		return complete;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Create(size_t, const std::vector<GLuint>&)
+//
+//	drawCount: draws in the scene
+//	dynamicDraws: draws expected to move
+//
+//	Allocate both maps and split the draws between
+//	them. The shadow passes submit through
+//	multi-draw-indirect, the caller checks for it
+///////////////////////////////////////////////////
+bool ShadowMaps::Create(size_t drawCount, const std::vector<GLuint>& dynamicDraws)
+{
+	supported = false;
+	if (!CreateShadowTarget(STATIC_SIZE, staticTexture, staticFramebuffer)
+		|| !CreateShadowTarget(DYNAMIC_SIZE, dynamicTexture, dynamicFramebuffer))
+	{
+		std::cout << "ERROR::SHADOW::FRAMEBUFFER_INCOMPLETE" << std::endl;
+		Destroy();
+		return false;
+	}
+
+	dynamic.assign(drawCount, 0);
+	dynamicIds.clear();
+	for (GLuint id : dynamicDraws)
+	{
+		if (!dynamic[id])
+		{
+			dynamic[id] = 1;
+			dynamicIds.push_back(id);
+		}
+	}
+
+	staticIds.clear();
+	for (GLuint id = 0; id < drawCount; ++id)
+	{
+		if (!dynamic[id])
+			staticIds.push_back(id);
+	}
+
+	staticValid = false;
+	fittedDirection = glm::vec3(0.0f);
+	supported = true;
+	return true;
+}
+
+void ShadowMaps::Destroy()
+{
+	glDeleteFramebuffers(1, &staticFramebuffer);
+	glDeleteFramebuffers(1, &dynamicFramebuffer);
+	glDeleteTextures(1, &staticTexture);
+	glDeleteTextures(1, &dynamicTexture);
+	staticFramebuffer = dynamicFramebuffer = staticTexture = dynamicTexture = 0;
+	staticIds.clear();
+	dynamicIds.clear();
+	dynamic.clear();
+	supported = false;
+	staticValid = false;
+}
+
+///////////////////////////////////////////////////
+//	Invalidate(const std::vector<GLuint>&)
+//
+//	movedIds: draws whose model matrix changed
+//
+//	Static draws that moved are taken out of the
+//	static map for good, which then has to be
+//	rendered again once
+///////////////////////////////////////////////////
+void ShadowMaps::Invalidate(const std::vector<GLuint>& movedIds)
+{
+	bool changed = false;
+	for (GLuint id : movedIds)
+	{
+		if (dynamic[id])
+			continue;
+
+		dynamic[id] = 1;
+		dynamicIds.push_back(id);
+		changed = true;
+	}
+
+	if (!changed)
+		return;
+
+	staticIds.erase(std::remove_if(staticIds.begin(), staticIds.end(), [this](GLuint id) { return dynamic[id] != 0; }), staticIds.end());
+	staticValid = false;
+}
+
+///////////////////////////////////////////////////
+//	Fit(const glm::vec3&, const std::vector<Aabb>&)
+//
+//	lightDirection: unit vector towards the light
+//	drawBounds: world bounds of every draw
+//
+//	The static map covers every draw, so dynamic
+//	casters anywhere in the scene fall inside the
+//	depth range both maps share. The overlay covers
+//	the dynamic draws only and is refitted every frame
+///////////////////////////////////////////////////
+void ShadowMaps::Fit(const glm::vec3& lightDirection, const std::vector<Aabb>& drawBounds)
+{
+	if (lightDirection != fittedDirection)
+		staticValid = false;
+
+	if (!staticValid)
+	{
+		Aabb scene = Aabb::Empty();
+		for (const Aabb& box : drawBounds)
+			scene.Grow(box);
+
+		glm::vec3 center = scene.Center();
+		float radius = glm::length(scene.max - scene.min) * 0.5f;
+		glm::vec3 up = std::fabs(lightDirection.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		lightView = glm::lookAt(center + lightDirection * radius, center, up);
+
+		// The light looks down -z, so the near plane is the largest z
+		Aabb lightBounds = scene.Transformed(lightView);
+		depthRange = glm::vec2(-lightBounds.max.z, -lightBounds.min.z);
+		staticProjection = glm::ortho(lightBounds.min.x, lightBounds.max.x, lightBounds.min.y, lightBounds.max.y, depthRange.x, depthRange.y);
+		staticShadowMatrix = TEXTURE_BIAS * staticProjection * lightView;
+		staticTexelSize = std::max(lightBounds.max.x - lightBounds.min.x, lightBounds.max.y - lightBounds.min.y) / STATIC_SIZE;
+		fittedDirection = lightDirection;
+	}
+
+	Aabb moving = Aabb::Empty();
+	for (GLuint id : dynamicIds)
+		moving.Grow(drawBounds[id]);
+
+	if (dynamicIds.empty())
+	{
+		// Nothing to draw, the cleared overlay lights everything
+		dynamicProjection = staticProjection;
+		dynamicTexelSize = staticTexelSize;
+	}
+	else
+	{
+		Aabb lightBounds = moving.Transformed(lightView);
+		float nearPlane = std::min(depthRange.x, -lightBounds.max.z);
+		float farPlane = std::max(depthRange.y, -lightBounds.min.z);
+		dynamicProjection = glm::ortho(lightBounds.min.x, lightBounds.max.x, lightBounds.min.y, lightBounds.max.y, nearPlane, farPlane);
+		dynamicTexelSize = std::max(lightBounds.max.x - lightBounds.min.x, lightBounds.max.y - lightBounds.min.y) / DYNAMIC_SIZE;
+	}
+	dynamicShadowMatrix = TEXTURE_BIAS * dynamicProjection * lightView;
+}
+
+void ShadowMaps::BeginStatic()
+{
+	Begin(staticFramebuffer, STATIC_SIZE);
+}
+
+///////////////////////////////////////////////////
+//	EndStatic()
+//
+//	The static map now matches the static draws
+///////////////////////////////////////////////////
+void ShadowMaps::EndStatic()
+{
+	End();
+	staticValid = true;
+}
+
+void ShadowMaps::BeginDynamic()
+{
+	Begin(dynamicFramebuffer, DYNAMIC_SIZE);
+}
+
+void ShadowMaps::EndDynamic()
+{
+	End();
+}
+
+void ShadowMaps::Bind() const
+{
+	glActiveTexture(GL_TEXTURE0 + STATIC_UNIT);
+	glBindTexture(GL_TEXTURE_2D, staticTexture);
+	glActiveTexture(GL_TEXTURE0 + DYNAMIC_UNIT);
+	glBindTexture(GL_TEXTURE_2D, dynamicTexture);
+}
+
+///////////////////////////////////////////////////
+//	Begin(GLuint, GLsizei)
+//
+//	Render depth only into a map with a slope scaled
+//	bias, saving the viewport and framebuffer for End
+///////////////////////////////////////////////////
+void ShadowMaps::Begin(GLuint framebuffer, GLsizei size)
+{
+	glGetIntegerv(GL_VIEWPORT, savedViewport);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &savedFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, size, size);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(POLYGON_OFFSET_FACTOR, POLYGON_OFFSET_UNITS);
+}
+
+void ShadowMaps::End()
+{
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	glBindFramebuffer(GL_FRAMEBUFFER, savedFramebuffer);
+	glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+}
@@ -0,0 +1,313 @@
+///////////////////////////////////////////////////////////////////////////////
+// textoverlay.cpp
+// ========
+// lines of text drawn over the finished frame with a built-in 5x7 font
+///////////////////////////////////////////////////////////////////////////////
+
+#include "textoverlay.h"
+
+#include <cctype>
+#include <cstring>
+#include <iostream>
+
+#ifndef GLSL
+#define GLSL(Version, Source) "#version " #Version " core \n" #Source
+#endif
+
+namespace
+{
+	/* Text Vertex Shader Source Code*/
+	const GLchar* textVertexShaderSource = GLSL(440,
+
+		layout(location = 0) in vec2 position;  // window pixels from the top left corner
+		layout(location = 1) in vec2 texel;     // font texture texels
+		layout(location = 2) in vec4 color;
+
+		out vec2 vertexTexel;
+		out vec4 vertexColor;
+
+		uniform vec2 uViewportSize;
+
+		void main()
+		{
+			vec2 ndc = position / uViewportSize * 2.0 - 1.0;
+			gl_Position = vec4(ndc.x, -ndc.y, 0.0, 1.0);
+			vertexTexel = texel;
+			vertexColor = color;
+		}
+	);
+
+	/* Text Fragment Shader Source Code*/
+	const GLchar* textFragmentShaderSource = GLSL(440,
+
+		in vec2 vertexTexel;
+		in vec4 vertexColor;
+
+		out vec4 fragmentColor;
+
+		uniform sampler2D uFont;
+
+		void main()
+		{
+			if (texelFetch(uFont, ivec2(vertexTexel), 0).r < 0.5)
+				discard;
+			fragmentColor = vertexColor;
+		}
+	);
+
+	// Characters of the font, each with 7 rows of 5 bits, the highest bit leftmost
+	const char GLYPH_CHARACTERS[] = " 0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ.:_%-()/,";
+	const int GLYPH_COUNT = sizeof(GLYPH_CHARACTERS) - 1;
+	const int SOLID_GLYPH = GLYPH_COUNT;        // fully covered cell after the characters
+	const unsigned char GLYPH_ROWS[GLYPH_COUNT][7] =
+	{
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },   // space
+		{ 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E },   // 0
+		{ 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E },
+		{ 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F },
+		{ 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E },
+		{ 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 },
+		{ 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E },
+		{ 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E },
+		{ 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },
+		{ 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E },
+		{ 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C },   // 9
+		{ 0x0E, 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11 },   // A
+		{ 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E },
+		{ 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E },
+		{ 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C },
+		{ 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F },
+		{ 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 },
+		{ 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F },
+		{ 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 },
+		{ 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E },
+		{ 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C },
+		{ 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 },
+		{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F },
+		{ 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 },
+		{ 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 },
+		{ 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },
+		{ 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 },
+		{ 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D },
+		{ 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 },
+		{ 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E },
+		{ 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },
+		{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },
+		{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 },
+		{ 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A },
+		{ 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 },
+		{ 0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04 },
+		{ 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F },   // Z
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C },   // .
+		{ 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 },   // :
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F },   // _
+		{ 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 },   // %
+		{ 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 },   // -
+		{ 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 },   // (
+		{ 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 },   // )
+		{ 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 },   // /
+		{ 0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08 }    // ,
+	};
+
+	const GLfloat TEXT_COLOR[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	const GLfloat BOX_COLOR[4] = { 0.0f, 0.0f, 0.0f, 0.6f };
+
+	int GlyphIndex(char c)
+	{
+		const char* found = std::strchr(GLYPH_CHARACTERS, std::toupper(static_cast<unsigned char>(c)));
+		return found && c != '\0' ? static_cast<int>(found - GLYPH_CHARACTERS) : 0;
+	}
+
+	// Two triangles covering x0, y0 to x1, y1 in window pixels, textured with glyph
+	void AppendQuad(std::vector<GLfloat>& vertices, float x0, float y0, float x1, float y1, int glyph, const GLfloat color[4])
+	{
+		const float u0 = static_cast<float>(glyph * TextOverlay::CELL_WIDTH);
+		const float u1 = u0 + TextOverlay::CELL_WIDTH;
+		const float v1 = static_cast<float>(TextOverlay::CELL_HEIGHT);
+		const float corners[6][4] =
+		{
+			{ x0, y0, u0, 0.0f }, { x1, y0, u1, 0.0f }, { x1, y1, u1, v1 },
+			{ x0, y0, u0, 0.0f }, { x1, y1, u1, v1 }, { x0, y1, u0, v1 }
+		};
+		for (const float* corner : corners)
+		{
+			vertices.insert(vertices.end(), corner, corner + 4);
+			vertices.insert(vertices.end(), color, color + 4);
+		}
+	}
+
+	bool CompileShader(GLenum type, const char* source, GLuint& shaderId)
+	{
+		int success = 0;
+		char infoLog[512];
+
+		shaderId = glCreateShader(type);
+		glShaderSource(shaderId, 1, &source, NULL);
+		glCompileShader(shaderId);
+		glGetShaderiv(shaderId, GL_COMPILE_STATUS, &success);
+		if (!success)
+		{
+			glGetShaderInfoLog(shaderId, sizeof(infoLog), NULL, infoLog);
+			std::cout << "ERROR::SHADER::" << (type == GL_VERTEX_SHADER ? "VERTEX" : "FRAGMENT") << "::COMPILATION_FAILED\n" << infoLog << std::endl;
+			glDeleteShader(shaderId);
+			return false;
+		}
+		return true;
+	}
+
+	bool CreateProgram(const char* vertexSource, const char* fragmentSource, GLuint& programId)
+	{
+		int success = 0;
+		char infoLog[512];
+
+		GLuint vertexShaderId = 0;
+		GLuint fragmentShaderId = 0;
+		if (!CompileShader(GL_VERTEX_SHADER, vertexSource, vertexShaderId))
+			return false;
+		if (!CompileShader(GL_FRAGMENT_SHADER, fragmentSource, fragmentShaderId))
+		{
+			glDeleteShader(vertexShaderId);
+			return false;
+		}
+
+		programId = glCreateProgram();
+		glAttachShader(programId, vertexShaderId);
+		glAttachShader(programId, fragmentShaderId);
+		glLinkProgram(programId);
+		glDeleteShader(vertexShaderId);
+		glDeleteShader(fragmentShaderId);
+		glGetProgramiv(programId, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
+			std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+			return false;
+		}
+		return true;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Create()
+//
+//	Compile the text program, bake the font texture
+//	and create the streamed vertex buffer
+///////////////////////////////////////////////////
+bool TextOverlay::Create()
+{
+	if (!CreateProgram(textVertexShaderSource, textFragmentShaderSource, program))
+	{
+		Destroy();
+		return false;
+	}
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "uFont"), FONT_UNIT);
+	viewportSizeLocation = glGetUniformLocation(program, "uViewportSize");
+
+	// Row 0 of the texture is the top row of every glyph
+	const int atlasWidth = (GLYPH_COUNT + 1) * CELL_WIDTH;
+	std::vector<unsigned char> atlas(atlasWidth * CELL_HEIGHT, 0);
+	for (int glyph = 0; glyph < GLYPH_COUNT; ++glyph)
+	{
+		for (int row = 0; row < 7; ++row)
+		{
+			for (int column = 0; column < 5; ++column)
+			{
+				if (GLYPH_ROWS[glyph][row] & (0x10 >> column))
+					atlas[row * atlasWidth + glyph * CELL_WIDTH + column] = 255;
+			}
+		}
+	}
+	for (int row = 0; row < CELL_HEIGHT; ++row)
+		std::memset(&atlas[row * atlasWidth + SOLID_GLYPH * CELL_WIDTH], 255, CELL_WIDTH);
+
+	glGenTextures(1, &fontTexture);
+	glBindTexture(GL_TEXTURE_2D, fontTexture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8, atlasWidth, CELL_HEIGHT);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, atlasWidth, CELL_HEIGHT, GL_RED, GL_UNSIGNED_BYTE, atlas.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// Position, texel and color of every vertex
+	const GLsizei stride = 8 * sizeof(GLfloat);
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &vbo);
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride, (void*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)(2 * sizeof(GLfloat)));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, stride, (void*)(4 * sizeof(GLfloat)));
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return true;
+}
+
+void TextOverlay::Destroy()
+{
+	glDeleteProgram(program);
+	glDeleteTextures(1, &fontTexture);
+	glDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(1, &vbo);
+	program = fontTexture = vao = vbo = 0;
+}
+
+///////////////////////////////////////////////////
+//	Draw(const std::vector<std::string>&, GLsizei, GLsizei)
+//
+//	lines: text, one entry per line
+//	width, height: size of the bound framebuffer
+//
+//	Blend a translucent box and the text over the
+//	frame, depth test off
+///////////////////////////////////////////////////
+void TextOverlay::Draw(const std::vector<std::string>& lines, GLsizei width, GLsizei height)
+{
+	if (!program || lines.empty())
+		return;
+
+	const float cellWidth = static_cast<float>(CELL_WIDTH * PIXEL_SCALE);
+	const float cellHeight = static_cast<float>(CELL_HEIGHT * PIXEL_SCALE);
+	size_t columns = 0;
+	for (const std::string& line : lines)
+		columns = line.size() > columns ? line.size() : columns;
+
+	vertices.clear();
+	AppendQuad(vertices, 0.0f, 0.0f, 2.0f * MARGIN + columns * cellWidth, 2.0f * MARGIN + lines.size() * cellHeight, SOLID_GLYPH, BOX_COLOR);
+	for (size_t row = 0; row < lines.size(); ++row)
+	{
+		for (size_t column = 0; column < lines[row].size(); ++column)
+		{
+			int glyph = GlyphIndex(lines[row][column]);
+			if (glyph == 0)
+				continue;
+			float x = MARGIN + column * cellWidth;
+			float y = MARGIN + row * cellHeight;
+			AppendQuad(vertices, x, y, x + cellWidth, y + cellHeight, glyph, TEXT_COLOR);
+		}
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glViewport(0, 0, width, height);
+	glActiveTexture(GL_TEXTURE0 + FONT_UNIT);
+	glBindTexture(GL_TEXTURE_2D, fontTexture);
+	glUseProgram(program);
+	glUniform2f(viewportSizeLocation, static_cast<GLfloat>(width), static_cast<GLfloat>(height));
+
+	glDisable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glBindVertexArray(vao);
+	glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(vertices.size() / 8));
+	glBindVertexArray(0);
+	glDisable(GL_BLEND);
+	glEnable(GL_DEPTH_TEST);
+}
@@ -0,0 +1,416 @@
+///////////////////////////////////////////////////////////////////////////////
+// tonemapping.cpp
+// ========
+// floating-point scene target, exposure adapted from a luminance histogram
+// and tonemapped to the framebuffer bound before it
+///////////////////////////////////////////////////////////////////////////////
+
+#include "tonemapping.h"
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef GLSL
+#define GLSL(Version, Source) "#version " #Version " core \n" #Source
+#endif
+
+namespace
+{
+	// Each histogram invocation clears and flushes the bin of its index
+	static_assert(ToneMapping::GROUP_SIZE * ToneMapping::GROUP_SIZE == ToneMapping::BIN_COUNT, "one bin per histogram invocation");
+
+	/* Luminance Histogram Compute Shader Source Code*/
+	const GLchar* histogramShaderSource = GLSL(440,
+
+		layout(local_size_x = GROUP_SIZE, local_size_y = GROUP_SIZE) in;
+
+		layout(std430, binding = 7) buffer Histogram
+		{
+			float adaptedLuminance;
+			float exposure;
+			float unused0;
+			float unused1;
+			uint bins[];
+		};
+
+		uniform sampler2D uScene;
+		uniform ivec2 uRenderSize;
+		uniform vec2 uLogRange; // minimum log2 luminance, 1 / width of the range
+
+		shared uint localBins[BIN_COUNT];
+
+		void main()
+		{
+			localBins[gl_LocalInvocationIndex] = 0u;
+			barrier();
+
+			ivec2 pixel = ivec2(gl_GlobalInvocationID.xy) * HISTOGRAM_STRIDE;
+			if (all(lessThan(pixel, uRenderSize)))
+			{
+				float luminance = dot(texelFetch(uScene, pixel, 0).rgb, vec3(0.2126, 0.7152, 0.0722));
+
+				// Black pixels (the cleared background) go to bin 0 and stay out of the average
+				uint bin = 0u;
+				if (luminance > 0.0001)
+					bin = uint(clamp((log2(luminance) - uLogRange.x) * uLogRange.y, 0.0, 1.0) * float(BIN_COUNT - 2) + 1.0);
+				atomicAdd(localBins[bin], 1u);
+			}
+			barrier();
+
+			if (localBins[gl_LocalInvocationIndex] > 0u)
+				atomicAdd(bins[gl_LocalInvocationIndex], localBins[gl_LocalInvocationIndex]);
+		}
+	);
+
+	/* Exposure Compute Shader Source Code*/
+	const GLchar* exposureShaderSource = GLSL(440,
+
+		layout(local_size_x = BIN_COUNT) in;
+
+		layout(std430, binding = 7) buffer Histogram
+		{
+			float adaptedLuminance;
+			float exposure;
+			float unused0;
+			float unused1;
+			uint bins[];
+		};
+
+		uniform vec2 uLogRange;
+		uniform float uAdaptation;  // fraction of the way to this frame's luminance
+		uniform float uKeyValue;
+		uniform vec2 uExposureRange;
+
+		shared float weightedBins[BIN_COUNT];
+		shared uint counts[BIN_COUNT];
+
+		void main()
+		{
+			uint index = gl_LocalInvocationIndex;
+			uint count = index == 0u ? 0u : bins[index];
+			weightedBins[index] = float(count) * float(index);
+			counts[index] = count;
+			bins[index] = 0u;
+			barrier();
+
+			for (uint stride = uint(BIN_COUNT / 2); stride > 0u; stride >>= 1u)
+			{
+				if (index < stride)
+				{
+					weightedBins[index] += weightedBins[index + stride];
+					counts[index] += counts[index + stride];
+				}
+				barrier();
+			}
+
+			// An all black frame keeps the last exposure
+			if (index == 0u && counts[0] > 0u)
+			{
+				float meanBin = weightedBins[0] / float(counts[0]);
+				float luminance = exp2((meanBin - 1.0) / float(BIN_COUNT - 2) / uLogRange.y + uLogRange.x);
+				adaptedLuminance = adaptedLuminance > 0.0 ? adaptedLuminance + (luminance - adaptedLuminance) * uAdaptation : luminance;
+				exposure = clamp(uKeyValue / adaptedLuminance, uExposureRange.x, uExposureRange.y);
+			}
+		}
+	);
+
+	/* Fullscreen Triangle Vertex Shader Source Code*/
+	const GLchar* fullscreenVertexShaderSource = GLSL(440,
+
+		void main()
+		{
+			// (-1, -1), (3, -1), (-1, 3)
+			vec2 corner = vec2(float((gl_VertexID & 1) << 2) - 1.0, float((gl_VertexID & 2) << 1) - 1.0);
+			gl_Position = vec4(corner, 0.0, 1.0);
+		}
+	);
+
+	/* Tonemap Fragment Shader Source Code*/
+	const GLchar* tonemapFragmentShaderSource = GLSL(440,
+
+		out vec4 fragmentColor;
+
+		layout(std430, binding = 7) readonly buffer Histogram
+		{
+			float adaptedLuminance;
+			float exposure;
+			float unused0;
+			float unused1;
+			uint bins[];
+		};
+
+		uniform sampler2D uScene;
+
+		void main()
+		{
+			vec3 color = texelFetch(uScene, ivec2(gl_FragCoord.xy), 0).rgb * exposure;
+
+			// ACES filmic fit (Narkowicz)
+			color = clamp((color * (2.51 * color + 0.03)) / (color * (2.43 * color + 0.59) + 0.14), 0.0, 1.0);
+			fragmentColor = vec4(color, 1.0);
+		}
+	);
+
+	bool CompileShader(GLenum type, const char* source, GLuint& shaderId)
+	{
+		int success = 0;
+		char infoLog[512];
+
+		shaderId = glCreateShader(type);
+		glShaderSource(shaderId, 1, &source, NULL);
+		glCompileShader(shaderId);
+		glGetShaderiv(shaderId, GL_COMPILE_STATUS, &success);
+		if (!success)
+		{
+			glGetShaderInfoLog(shaderId, sizeof(infoLog), NULL, infoLog);
+			std::cout << "ERROR::SHADER::" << (type == GL_VERTEX_SHADER ? "VERTEX" : type == GL_FRAGMENT_SHADER ? "FRAGMENT" : "COMPUTE") << "::COMPILATION_FAILED\n" << infoLog << std::endl;
+			glDeleteShader(shaderId);
+			return false;
+		}
+		return true;
+	}
+
+	bool LinkProgram(const GLuint* shaderIds, int count, GLuint& programId)
+	{
+		int success = 0;
+		char infoLog[512];
+
+		programId = glCreateProgram();
+		for (int i = 0; i < count; ++i)
+		{
+			glAttachShader(programId, shaderIds[i]);
+			glDeleteShader(shaderIds[i]);
+		}
+		glLinkProgram(programId);
+		glGetProgramiv(programId, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
+			std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	// Source with the sizes ToneMapping shares with the compute shaders defined after its #version line
+	std::string WithConstants(const char* source)
+	{
+		std::string text = source;
+		text.insert(text.find('\n') + 1,
+			"#define BIN_COUNT " + std::to_string(ToneMapping::BIN_COUNT) + "\n"
+			+ "#define GROUP_SIZE " + std::to_string(ToneMapping::GROUP_SIZE) + "\n"
+			+ "#define HISTOGRAM_STRIDE " + std::to_string(ToneMapping::HISTOGRAM_STRIDE) + "\n");
+		return text;
+	}
+
+	bool CreateComputeProgram(const char* source, GLuint& programId)
+	{
+		std::string text = WithConstants(source);
+		GLuint shaderId = 0;
+		if (!CompileShader(GL_COMPUTE_SHADER, text.c_str(), shaderId))
+			return false;
+		return LinkProgram(&shaderId, 1, programId);
+	}
+
+	bool CreateProgram(const char* vertexSource, const char* fragmentSource, GLuint& programId)
+	{
+		GLuint shaderIds[2] = {};
+		if (!CompileShader(GL_VERTEX_SHADER, vertexSource, shaderIds[0]))
+			return false;
+		if (!CompileShader(GL_FRAGMENT_SHADER, fragmentSource, shaderIds[1]))
+		{
+			glDeleteShader(shaderIds[0]);
+			return false;
+		}
+		return LinkProgram(shaderIds, 2, programId);
+	}
+
+	GLuint CreateTarget(GLenum internalFormat, GLsizei width, GLsizei height)
+	{
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		return texture;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Create()
+//
+//	Compile the histogram, exposure and tonemap
+//	programs and create the histogram buffer; the
+//	target is allocated by Begin. Fails without
+//	compute shaders.
+///////////////////////////////////////////////////
+bool ToneMapping::Create()
+{
+	supported = false;
+	if (!GLEW_VERSION_4_3)
+		return false;
+
+	if (!CreateComputeProgram(histogramShaderSource, histogramProgram)
+		|| !CreateComputeProgram(exposureShaderSource, exposureProgram)
+		|| !CreateProgram(fullscreenVertexShaderSource, tonemapFragmentShaderSource, tonemapProgram))
+	{
+		Destroy();
+		return false;
+	}
+
+	const GLfloat logMinimum = MIN_LOG_LUMINANCE;
+	const GLfloat logScale = 1.0f / (MAX_LOG_LUMINANCE - MIN_LOG_LUMINANCE);
+	glUseProgram(histogramProgram);
+	glUniform1i(glGetUniformLocation(histogramProgram, "uScene"), COLOR_UNIT);
+	glUniform2f(glGetUniformLocation(histogramProgram, "uLogRange"), logMinimum, logScale);
+	renderSizeLocation = glGetUniformLocation(histogramProgram, "uRenderSize");
+	glUseProgram(exposureProgram);
+	glUniform2f(glGetUniformLocation(exposureProgram, "uLogRange"), logMinimum, logScale);
+	glUniform1f(glGetUniformLocation(exposureProgram, "uKeyValue"), KEY_VALUE);
+	glUniform2f(glGetUniformLocation(exposureProgram, "uExposureRange"), MIN_EXPOSURE, MAX_EXPOSURE);
+	adaptationLocation = glGetUniformLocation(exposureProgram, "uAdaptation");
+	glUseProgram(tonemapProgram);
+	glUniform1i(glGetUniformLocation(tonemapProgram, "uScene"), COLOR_UNIT);
+	glGenVertexArrays(1, &emptyVao);
+
+	// Nothing adapted yet, so the first frame takes its own luminance; exposure 1 until then
+	std::vector<GLuint> histogram(4 + BIN_COUNT, 0);
+	const GLfloat initialExposure = 1.0f;
+	std::memcpy(&histogram[1], &initialExposure, sizeof(initialExposure));
+	glGenBuffers(1, &histogramBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, histogramBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, histogram.size() * sizeof(GLuint), histogram.data(), GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	supported = true;
+	return true;
+}
+
+void ToneMapping::Destroy()
+{
+	Release();
+	glDeleteProgram(histogramProgram);
+	glDeleteProgram(exposureProgram);
+	glDeleteProgram(tonemapProgram);
+	glDeleteVertexArrays(1, &emptyVao);
+	glDeleteBuffers(1, &histogramBuffer);
+	histogramProgram = exposureProgram = tonemapProgram = emptyVao = histogramBuffer = 0;
+	supported = false;
+}
+
+bool ToneMapping::Allocate()
+{
+	colorTexture = CreateTarget(GL_RGBA16F, width, height);
+	depthTexture = CreateTarget(GL_DEPTH_COMPONENT32F, width, height);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "ERROR::TONE_MAPPING::Scene target incomplete, status 0x" << std::hex << status << std::dec << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void ToneMapping::Release()
+{
+	glDeleteFramebuffers(1, &framebuffer);
+	GLuint textures[2] = { colorTexture, depthTexture };
+	glDeleteTextures(2, textures);
+	framebuffer = colorTexture = depthTexture = 0;
+}
+
+///////////////////////////////////////////////////
+//	Begin(GLsizei, GLsizei, GLsizei, GLsizei)
+//
+//	renderWidth, renderHeight: viewport of the scene
+//	width, height: window size, the size of the
+//	target; a new size reallocates it
+//
+//	Remember the bound framebuffer as the
+//	destination and render the scene into the float
+//	target. A target that cannot be allocated turns
+//	tonemapping off
+///////////////////////////////////////////////////
+void ToneMapping::Begin(GLsizei renderWidth, GLsizei renderHeight, GLsizei width, GLsizei height)
+{
+	active = false;
+	this->renderWidth = renderWidth;
+	this->renderHeight = renderHeight;
+	if (!supported || !enabled || width <= 0 || height <= 0)
+		return;
+
+	// Allocation leaves framebuffer 0 bound
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &destination);
+	if (width != this->width || height != this->height)
+	{
+		Release();
+		this->width = width;
+		this->height = height;
+	}
+	if (!framebuffer && !Allocate())
+	{
+		std::cout << "INFO: HDR target unavailable, tonemapping off" << std::endl;
+		Release();
+		supported = false;
+		glBindFramebuffer(GL_FRAMEBUFFER, destination);
+		return;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	active = true;
+}
+
+///////////////////////////////////////////////////
+//	End(float)
+//
+//	deltaSeconds: time since the last frame, paces
+//	the adaptation
+//
+//	Bin the scene's luminance, adapt the exposure
+//	and tonemap into the destination
+///////////////////////////////////////////////////
+void ToneMapping::End(float deltaSeconds)
+{
+	if (!active)
+		return;
+	active = false;
+
+	glActiveTexture(GL_TEXTURE0 + COLOR_UNIT);
+	glBindTexture(GL_TEXTURE_2D, colorTexture);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, HISTOGRAM_BINDING, histogramBuffer);
+
+	const GLuint sampledWidth = (renderWidth + HISTOGRAM_STRIDE - 1) / HISTOGRAM_STRIDE;
+	const GLuint sampledHeight = (renderHeight + HISTOGRAM_STRIDE - 1) / HISTOGRAM_STRIDE;
+	glUseProgram(histogramProgram);
+	glUniform2i(renderSizeLocation, renderWidth, renderHeight);
+	glDispatchCompute((sampledWidth + GROUP_SIZE - 1) / GROUP_SIZE, (sampledHeight + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	glUseProgram(exposureProgram);
+	glUniform1f(adaptationLocation, 1.0f - std::exp(-deltaSeconds * ADAPTATION_RATE));
+	glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, destination);
+	glUseProgram(tonemapProgram);
+	glDisable(GL_DEPTH_TEST);
+	glBindVertexArray(emptyVao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	glEnable(GL_DEPTH_TEST);
+}
@@ -0,0 +1,247 @@
+///////////////////////////////////////////////////////////////////////////////
+// transformbuffer.cpp
+// ========
+// model and normal matrices of every scene draw, baked once at load
+///////////////////////////////////////////////////////////////////////////////
+
+#include "transformbuffer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// Draws whose normal matrices are computed side by side
+	const size_t LANES = 4;
+
+	// Relative tolerance of the uniform scale test
+	const float UNIFORM_SCALE_EPSILON = 1e-4f;
+
+	// Cross products of LANES pairs of vectors, one vector per lane. Computed into a local so the compiler
+	// needs no aliasing check before vectorizing the lane loop
+	void Cross(const float (&a)[3][LANES], const float (&b)[3][LANES], float (&cross)[3][LANES])
+	{
+		float result[3][LANES];
+		for (size_t lane = 0; lane < LANES; ++lane)
+		{
+			result[0][lane] = a[1][lane] * b[2][lane] - a[2][lane] * b[1][lane];
+			result[1][lane] = a[2][lane] * b[0][lane] - a[0][lane] * b[2][lane];
+			result[2][lane] = a[0][lane] * b[1][lane] - a[1][lane] * b[0][lane];
+		}
+		std::copy(&result[0][0], &result[0][0] + 3 * LANES, &cross[0][0]);
+	}
+
+	///////////////////////////////////////////////////
+	//	WriteTexels(const glm::mat4* const*, size_t, glm::vec4*)
+	//
+	//	models: model matrices of up to LANES draws
+	//	texels: receives TEXELS_PER_DRAW texels per draw
+	//
+	//	Copy the model matrices and compute the normal
+	//	matrices, transpose(inverse(mat3(model))), as the
+	//	cofactors of mat3(model) over its determinant.
+	//	The draws are stored one per lane and every step
+	//	is an innermost loop over the LANES floats of
+	//	one value, which GCC vectorizes at -O3 (see
+	//	-fopt-info-vec); at -O2 the uniform scale test
+	//	stays scalar. Draws with a uniform scale get
+	//	UNIFORM_SCALE in the w of their first normal
+	//	texel; their normal matrix is mat3(model) up to
+	//	a scale, so the shader does not fetch it.
+	///////////////////////////////////////////////////
+	void WriteTexels(const glm::mat4* const* models, size_t count, glm::vec4* texels)
+	{
+		// Columns of mat3(model), lane per draw; unused lanes get the identity
+		float m[3][3][LANES];
+		for (size_t lane = 0; lane < LANES; ++lane)
+		{
+			for (int column = 0; column < 3; ++column)
+			{
+				for (int row = 0; row < 3; ++row)
+					m[column][row][lane] = lane < count ? (*models[lane])[column][row] : float(column == row);
+			}
+		}
+
+		// Normals ignore translation and undo non-uniform scaling
+		float n[3][3][LANES];
+		Cross(m[1], m[2], n[0]);
+		Cross(m[2], m[0], n[1]);
+		Cross(m[0], m[1], n[2]);
+
+		// Divided unconditionally and zeroed after, a select the vectorizer accepts; singular matrices get zero normals
+		float determinant[LANES];
+		float inverse[LANES];
+		for (size_t lane = 0; lane < LANES; ++lane)
+			determinant[lane] = m[0][0][lane] * n[0][0][lane] + m[0][1][lane] * n[0][1][lane] + m[0][2][lane] * n[0][2][lane];
+		for (size_t lane = 0; lane < LANES; ++lane)
+			inverse[lane] = 1.0f / determinant[lane];
+		for (size_t lane = 0; lane < LANES; ++lane)
+			inverse[lane] = determinant[lane] != 0.0f ? inverse[lane] : 0.0f;
+		for (int column = 0; column < 3; ++column)
+		{
+			for (int row = 0; row < 3; ++row)
+			{
+				for (size_t lane = 0; lane < LANES; ++lane)
+					n[column][row][lane] *= inverse[lane];
+			}
+		}
+
+		// Uniform scale: orthogonal columns of equal length
+		float uniform[LANES];
+		for (size_t lane = 0; lane < LANES; ++lane)
+		{
+			float length0 = m[0][0][lane] * m[0][0][lane] + m[0][1][lane] * m[0][1][lane] + m[0][2][lane] * m[0][2][lane];
+			float length1 = m[1][0][lane] * m[1][0][lane] + m[1][1][lane] * m[1][1][lane] + m[1][2][lane] * m[1][2][lane];
+			float length2 = m[2][0][lane] * m[2][0][lane] + m[2][1][lane] * m[2][1][lane] + m[2][2][lane] * m[2][2][lane];
+			float dot01 = m[0][0][lane] * m[1][0][lane] + m[0][1][lane] * m[1][1][lane] + m[0][2][lane] * m[1][2][lane];
+			float dot12 = m[1][0][lane] * m[2][0][lane] + m[1][1][lane] * m[2][1][lane] + m[1][2][lane] * m[2][2][lane];
+			float dot20 = m[2][0][lane] * m[0][0][lane] + m[2][1][lane] * m[0][1][lane] + m[2][2][lane] * m[0][2][lane];
+			float deviation = std::max(std::max(std::fabs(length1 - length0), std::fabs(length2 - length0)),
+				std::max(std::max(std::fabs(dot01), std::fabs(dot12)), std::fabs(dot20)));
+			uniform[lane] = deviation <= UNIFORM_SCALE_EPSILON * length0 ? TransformBuffer::UNIFORM_SCALE : 0.0f;
+		}
+
+		for (size_t lane = 0; lane < count; ++lane)
+		{
+			glm::vec4* out = texels + lane * TransformBuffer::TEXELS_PER_DRAW;
+			for (int column = 0; column < 4; ++column)
+				out[column] = (*models[lane])[column];
+			for (int column = 0; column < 3; ++column)
+				out[4 + column] = glm::vec4(n[column][0][lane], n[column][1][lane], n[column][2][lane], 0.0f);
+			out[4].w = uniform[lane];
+		}
+	}
+
+	// Texels of the given draws, LANES at a time
+	template <typename DrawIdAt>
+	void WriteTexels(const Scene& scene, size_t count, DrawIdAt drawIdAt, glm::vec4* texels)
+	{
+		const glm::mat4* models[LANES];
+		for (size_t first = 0; first < count; first += LANES)
+		{
+			size_t batch = std::min(LANES, count - first);
+			for (size_t lane = 0; lane < batch; ++lane)
+				models[lane] = &scene.draws[drawIdAt(first + lane)].model;
+			WriteTexels(models, batch, texels + first * TransformBuffer::TEXELS_PER_DRAW);
+		}
+	}
+}
+
+///////////////////////////////////////////////////
+//	Build(const Scene&)
+//
+//	scene: recorded draw list
+//
+//	Compute the normal matrix of every draw and upload
+//	model and normal matrices in draw ID order
+///////////////////////////////////////////////////
+bool TransformBuffer::Build(const Scene& scene)
+{
+	std::vector<glm::vec4> texels(scene.draws.size() * TEXELS_PER_DRAW);
+	WriteTexels(scene, scene.draws.size(), [](size_t i) { return i; }, texels.data());
+
+	uniformScaleCount = 0;
+	for (size_t id = 0; id < scene.draws.size(); ++id)
+	{
+		if (texels[id * TEXELS_PER_DRAW + 4].w == UNIFORM_SCALE)
+			++uniformScaleCount;
+	}
+
+	GLint maxTexels = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+	if (static_cast<GLint>(texels.size()) > maxTexels)
+		return false;
+
+	count = static_cast<GLsizei>(scene.draws.size());
+	ringBytes = std::min(count, GLsizei(STREAMED_DRAWS)) * TEXELS_PER_DRAW * sizeof(glm::vec4) + sizeof(glm::vec4);
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	glBufferData(GL_TEXTURE_BUFFER, texels.size() * sizeof(glm::vec4), texels.data(), GL_DYNAMIC_DRAW);
+
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_BUFFER, texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	Update(FrameRing&, const Scene&, const std::vector<GLuint>&)
+//
+//	ring: frame ring of the current frame
+//	scene: draw list with the new model matrices
+//	movedIds: draws whose model matrix changed
+//
+//	Write the matrices of the moved draws to the ring
+//	and copy them into the buffer on the GPU, merging
+//	runs of consecutive draw IDs into one copy
+///////////////////////////////////////////////////
+void TransformBuffer::Update(FrameRing& ring, const Scene& scene, const std::vector<GLuint>& movedIds)
+{
+	if (movedIds.empty())
+		return;
+
+	const GLsizeiptr drawBytes = TEXELS_PER_DRAW * sizeof(glm::vec4);
+	FrameRing::Allocation allocation = {};
+	if (movedIds.size() <= static_cast<size_t>(STREAMED_DRAWS))
+		allocation = ring.Allocate(movedIds.size() * drawBytes, sizeof(glm::vec4));
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	if (!allocation.data)
+	{
+		// More draws moved than the ring holds, let the driver stage them
+		std::vector<glm::vec4> texels(movedIds.size() * TEXELS_PER_DRAW);
+		WriteTexels(scene, movedIds.size(), [&](size_t i) { return movedIds[i]; }, texels.data());
+		for (size_t i = 0; i < movedIds.size(); ++i)
+			glBufferSubData(GL_COPY_WRITE_BUFFER, movedIds[i] * drawBytes, drawBytes, &texels[i * TEXELS_PER_DRAW]);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		return;
+	}
+
+	glm::vec4* texels = static_cast<glm::vec4*>(allocation.data);
+	WriteTexels(scene, movedIds.size(), [&](size_t i) { return movedIds[i]; }, texels);
+
+	glBindBuffer(GL_COPY_READ_BUFFER, ring.buffer);
+	size_t runStart = 0;
+	for (size_t i = 1; i <= movedIds.size(); ++i)
+	{
+		if (i < movedIds.size() && movedIds[i] == movedIds[i - 1] + 1)
+			continue;
+
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation.offset + runStart * drawBytes,
+			movedIds[runStart] * drawBytes, (i - runStart) * drawBytes);
+		runStart = i;
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+///////////////////////////////////////////////////
+//	Bind(GLuint)
+//
+//	unit: texture unit read by the uTransforms sampler
+///////////////////////////////////////////////////
+void TransformBuffer::Bind(GLuint unit) const
+{
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_BUFFER, texture);
+}
+
+///////////////////////////////////////////////////
+//	Destroy()
+//
+//	Release the buffer and its texture view
+///////////////////////////////////////////////////
+void TransformBuffer::Destroy()
+{
+	glDeleteTextures(1, &texture);
+	glDeleteBuffers(1, &buffer);
+	texture = buffer = 0;
+	count = 0;
+	uniformScaleCount = 0;
+	ringBytes = 0;
+}
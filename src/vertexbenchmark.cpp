@@ -0,0 +1,316 @@
+///////////////////////////////////////////////////////////////////////////////
+// vertexbenchmark.cpp
+// ========
+// measures vertex throughput of the surface transform paths on a dense mesh
+///////////////////////////////////////////////////////////////////////////////
+
+#include "vertexbenchmark.h"
+
+#include <glm/gtx/transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "scene.h"
+
+#ifndef GLSL
+#define GLSL(Version, Source) "#version " #Version " core \n" #Source
+#endif
+
+namespace
+{
+	const GLsizei VIEWPORT_SIZE = 64;
+	const GLuint TRANSFORM_TEXTURE_UNIT = 0;
+
+	/* Per-vertex Inverse Vertex Shader Source Code*/
+	const GLchar* inverseVertexShaderSource = GLSL(440,
+		layout(location = 0) in vec3 vertexPosition;
+		layout(location = 1) in vec3 vertexNormal;
+
+		out vec3 vertexFragmentNormal;
+
+		uniform samplerBuffer uTransforms;
+		uniform mat4 uViewProjection;
+
+		void main()
+		{
+			int base = gl_InstanceID * 7;
+			mat4 model = mat4(texelFetch(uTransforms, base), texelFetch(uTransforms, base + 1), texelFetch(uTransforms, base + 2), texelFetch(uTransforms, base + 3));
+			mat3 normalMatrix = mat3(transpose(inverse(model)));
+
+			gl_Position = uViewProjection * model * vec4(vertexPosition, 1.0f);
+			vertexFragmentNormal = normalMatrix * vertexNormal;
+		}
+	);
+
+	/* Precomputed Normal Matrix Vertex Shader Source Code, as in the surface shaders*/
+	const GLchar* precomputedVertexShaderSource = GLSL(440,
+		layout(location = 0) in vec3 vertexPosition;
+		layout(location = 1) in vec3 vertexNormal;
+
+		out vec3 vertexFragmentNormal;
+
+		uniform samplerBuffer uTransforms;
+		uniform mat4 uViewProjection;
+
+		void main()
+		{
+			int base = gl_InstanceID * 7;
+			mat4 model = mat4(texelFetch(uTransforms, base), texelFetch(uTransforms, base + 1), texelFetch(uTransforms, base + 2), texelFetch(uTransforms, base + 3));
+			vec4 normalColumn0 = texelFetch(uTransforms, base + 4);
+			mat3 normalMatrix = normalColumn0.w != 0.0 ? mat3(model) : mat3(normalColumn0.xyz, texelFetch(uTransforms, base + 5).xyz, texelFetch(uTransforms, base + 6).xyz);
+
+			gl_Position = uViewProjection * model * vec4(vertexPosition, 1.0f);
+			vertexFragmentNormal = normalMatrix * vertexNormal;
+		}
+	);
+
+	/* Normal Fragment Shader Source Code*/
+	const GLchar* fragmentShaderSource = GLSL(440,
+		in vec3 vertexFragmentNormal;
+
+		out vec4 fragmentColor;
+
+		void main()
+		{
+			fragmentColor = vec4(normalize(vertexFragmentNormal) * 0.5 + 0.5, 1.0);
+		}
+	);
+
+	bool CompileShader(GLenum type, const char* source, GLuint& shaderId)
+	{
+		int success = 0;
+		char infoLog[512];
+
+		shaderId = glCreateShader(type);
+		glShaderSource(shaderId, 1, &source, NULL);
+		glCompileShader(shaderId);
+		glGetShaderiv(shaderId, GL_COMPILE_STATUS, &success);
+		if (!success)
+		{
+			glGetShaderInfoLog(shaderId, sizeof(infoLog), NULL, infoLog);
+			std::cout << "ERROR::SHADER::" << (type == GL_VERTEX_SHADER ? "VERTEX" : "FRAGMENT") << "::COMPILATION_FAILED\n" << infoLog << std::endl;
+			glDeleteShader(shaderId);
+			return false;
+		}
+		return true;
+	}
+
+	bool CreateProgram(const char* vertexSource, GLuint& programId)
+	{
+		int success = 0;
+		char infoLog[512];
+
+		GLuint vertexShaderId = 0;
+		GLuint fragmentShaderId = 0;
+		if (!CompileShader(GL_VERTEX_SHADER, vertexSource, vertexShaderId))
+			return false;
+		if (!CompileShader(GL_FRAGMENT_SHADER, fragmentShaderSource, fragmentShaderId))
+		{
+			glDeleteShader(vertexShaderId);
+			return false;
+		}
+
+		programId = glCreateProgram();
+		glAttachShader(programId, vertexShaderId);
+		glAttachShader(programId, fragmentShaderId);
+		glLinkProgram(programId);
+		glDeleteShader(vertexShaderId);
+		glDeleteShader(fragmentShaderId);
+		glGetProgramiv(programId, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
+			std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+			return false;
+		}
+
+		glUseProgram(programId);
+		glUniform1i(glGetUniformLocation(programId, "uTransforms"), TRANSFORM_TEXTURE_UNIT);
+		glUniformMatrix4fv(glGetUniformLocation(programId, "uViewProjection"), 1, GL_FALSE,
+			glm::value_ptr(glm::ortho(-1.0f, 1.0f, -1.0f, 1.0f, -2.0f, 2.0f)));
+		glUseProgram(0);
+		return true;
+	}
+
+	// Instances on a square layout inside the view, scaled uniformly or not
+	Scene InstanceScene(bool uniformScale)
+	{
+		const int side = 8;
+		Scene scene;
+		scene.draws.resize(VertexBenchmark::INSTANCE_COUNT);
+		for (GLsizei i = 0; i < VertexBenchmark::INSTANCE_COUNT; ++i)
+		{
+			glm::vec3 position((i % side + 0.5f) * 2.0f / side - 1.0f, (i / side % side + 0.5f) * 2.0f / side - 1.0f, 0.0f);
+			glm::vec3 scale = uniformScale ? glm::vec3(0.1f) : glm::vec3(0.1f, 0.05f + 0.02f * (i % 3), 0.08f);
+			scene.draws[i].model = glm::translate(position) * glm::rotate(0.3f * i, glm::vec3(0.3f, 1.0f, 0.2f)) * glm::scale(scale);
+		}
+		return scene;
+	}
+}
+
+///////////////////////////////////////////////////
+//	Run()
+//
+//	Build the mesh, the programs and the transform
+//	buffers, time every path and release everything
+///////////////////////////////////////////////////
+bool VertexBenchmark::Run()
+{
+	CreateGrid();
+	if (!CreateProgram(inverseVertexShaderSource, inverseProgram) || !CreateProgram(precomputedVertexShaderSource, precomputedProgram)
+		|| !scaled.Build(InstanceScene(false)) || !uniform.Build(InstanceScene(true)))
+	{
+		Destroy();
+		return false;
+	}
+	glGenQueries(1, &query);
+
+	GLint savedViewport[4];
+	glGetIntegerv(GL_VIEWPORT, savedViewport);
+	glViewport(0, 0, VIEWPORT_SIZE, VIEWPORT_SIZE);
+	glEnable(GL_DEPTH_TEST);
+
+	struct Path
+	{
+		const char* name;
+		GLuint program;
+		const TransformBuffer* transforms;
+	};
+	const Path paths[] = {
+		{ "inverse per vertex", inverseProgram, &scaled },
+		{ "precomputed normal matrix", precomputedProgram, &scaled },
+		{ "uniform scale, mat3(model)", precomputedProgram, &uniform },
+	};
+
+	const double vertices = double(vertexCount) * INSTANCE_COUNT * DRAWS_PER_SAMPLE;
+	std::cout << "INFO: Vertex benchmark: " << vertexCount << " vertices, " << indexCount / 3 << " triangles x "
+		<< INSTANCE_COUNT << " instances x " << DRAWS_PER_SAMPLE << " draws per sample" << std::endl;
+	for (const Path& path : paths)
+	{
+		double ms = Measure(path.program, *path.transforms);
+		std::cout << "INFO: Vertex benchmark: " << path.name << ": " << ms << " ms/sample, "
+			<< vertices / (ms * 1000.0) << " M vertices/s" << std::endl;
+	}
+
+	glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+	Destroy();
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	CreateGrid()
+//
+//	Tessellate a rippled unit square into GRID_SIZE
+//	by GRID_SIZE quads with analytic normals, laid
+//	out like the scene meshes: position, normal, uv
+///////////////////////////////////////////////////
+void VertexBenchmark::CreateGrid()
+{
+	const GLuint side = GRID_SIZE + 1;
+	std::vector<float> vertices;
+	vertices.reserve(side * side * 8);
+	for (GLuint y = 0; y < side; ++y)
+	{
+		for (GLuint x = 0; x < side; ++x)
+		{
+			float u = float(x) / GRID_SIZE;
+			float v = float(y) / GRID_SIZE;
+			float height = 0.05f * std::sin(u * 25.0f) * std::cos(v * 25.0f);
+			glm::vec3 normal = glm::normalize(glm::vec3(-1.25f * std::cos(u * 25.0f) * std::cos(v * 25.0f),
+				1.25f * std::sin(u * 25.0f) * std::sin(v * 25.0f), 1.0f));
+			float vertex[8] = { u - 0.5f, v - 0.5f, height, normal.x, normal.y, normal.z, u, v };
+			vertices.insert(vertices.end(), vertex, vertex + 8);
+		}
+	}
+
+	std::vector<GLuint> indices;
+	indices.reserve(GRID_SIZE * GRID_SIZE * 6);
+	for (GLuint y = 0; y < GRID_SIZE; ++y)
+	{
+		for (GLuint x = 0; x < GRID_SIZE; ++x)
+		{
+			GLuint corner = y * side + x;
+			GLuint quad[6] = { corner, corner + 1, corner + side, corner + 1, corner + side + 1, corner + side };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+	vertexCount = static_cast<GLsizei>(side * side);
+	indexCount = static_cast<GLsizei>(indices.size());
+
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+
+	glGenBuffers(1, &vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+
+	glGenBuffers(1, &indexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+	const GLint stride = sizeof(float) * 8;
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * 3));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * 6));
+	glEnableVertexAttribArray(2);
+
+	glBindVertexArray(0);
+}
+
+///////////////////////////////////////////////////
+//	Measure(GLuint, const TransformBuffer&)
+//
+//	Median GPU time in milliseconds of SAMPLE_COUNT
+//	samples of DRAWS_PER_SAMPLE instanced draws
+///////////////////////////////////////////////////
+double VertexBenchmark::Measure(GLuint program, const TransformBuffer& transforms)
+{
+	glUseProgram(program);
+	transforms.Bind(TRANSFORM_TEXTURE_UNIT);
+	glBindVertexArray(vao);
+
+	std::vector<double> samples;
+	for (int sample = 0; sample <= SAMPLE_COUNT; ++sample)
+	{
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		glBeginQuery(GL_TIME_ELAPSED, query);
+		for (int draw = 0; draw < DRAWS_PER_SAMPLE; ++draw)
+			glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0, INSTANCE_COUNT);
+		glEndQuery(GL_TIME_ELAPSED);
+
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+		if (sample > 0)
+			samples.push_back(elapsed / 1000000.0);
+	}
+
+	glBindVertexArray(0);
+	glUseProgram(0);
+
+	std::sort(samples.begin(), samples.end());
+	return samples[samples.size() / 2];
+}
+
+///////////////////////////////////////////////////
+//	Destroy()
+//
+//	Release the mesh, the programs and the buffers
+///////////////////////////////////////////////////
+void VertexBenchmark::Destroy()
+{
+	glDeleteQueries(1, &query);
+	glDeleteProgram(inverseProgram);
+	glDeleteProgram(precomputedProgram);
+	glDeleteBuffers(1, &indexBuffer);
+	glDeleteBuffers(1, &vertexBuffer);
+	glDeleteVertexArrays(1, &vao);
+	scaled.Destroy();
+	uniform.Destroy();
+	query = inverseProgram = precomputedProgram = indexBuffer = vertexBuffer = vao = 0;
+}